@@ -0,0 +1,221 @@
+#include "AccountBook.h"
+
+#ifdef AVANT_HAS_COROUTINES
+using std::unique_ptr;
+
+
+/**
+ * Queue the operation on its account's shard. Called by co_await once the caller has suspended.
+ * \param caller The suspended coroutine, resumed by the executor once the operation is done.
+ */
+void CAccountBook::Operation::await_suspend(std::coroutine_handle<> caller)
+{
+	this->mCaller = caller;
+	this->mBook->Dispatch(this);
+}
+
+
+/**
+ * Open the account, unless it exists already.
+ * \param shard The shard that owns the account.
+ */
+void CAccountBook::OpenOperation::Execute(SShard & shard)
+{
+	unique_ptr<CCreditCardAccount> & account = shard.mAccounts[this->mAccount];
+	if (account == nullptr)
+	{
+		account.reset(new CCreditCardAccount(this->mAPR, this->mLimit, this->mStartDate));
+		this->mOpened = true;
+	}
+}
+
+
+/**
+ * Add the transaction to the account, if it exists.
+ * \param shard The shard that owns the account.
+ */
+void CAccountBook::TransactionOperation::Execute(SShard & shard)
+{
+	auto found = shard.mAccounts.find(this->mAccount);
+	if (found == shard.mAccounts.end())
+	{
+		return;
+	}
+	CCreditCardAccount & account = *found->second;
+	this->mAdded = (this->mType == CTransaction::CHARGE) ? account.AddCharge(this->mValue, this->mDay) : account.AddPayment(this->mValue, this->mDay);
+}
+
+
+/**
+ * Calculate the account's balance, if it exists.
+ * \param shard The shard that owns the account.
+ */
+void CAccountBook::BalanceOperation::Execute(SShard & shard)
+{
+	auto found = shard.mAccounts.find(this->mAccount);
+	if (found != shard.mAccounts.end())
+	{
+		this->mResult.mFound = true;
+		this->mResult.mBalance = found->second->GetBalanceOnDay(this->mDay);
+	}
+}
+
+
+/**
+ * Constructor. Starts one executor thread per shard.
+ * \param shardCount How many shards the accounts are split into. At least one.
+ */
+CAccountBook::CAccountBook(size_t shardCount)
+{
+	if (shardCount == 0)
+	{
+		shardCount = 1;
+	}
+	for (size_t i = 0; i < shardCount; ++i)
+	{
+		this->mShards.emplace_back(new SShard());
+	}
+	for (unique_ptr<SShard> & shard : this->mShards)
+	{
+		shard->mExecutor = std::thread(&CAccountBook::RunExecutor, this, shard.get());
+	}
+}
+
+
+/**
+ * Destructor. Carries out whatever is queued, then stops the executors. Nothing may be awaited on the
+ * book once this has started.
+ */
+CAccountBook::~CAccountBook()
+{
+	for (unique_ptr<SShard> & shard : this->mShards)
+	{
+		std::lock_guard<std::mutex> lock(shard->mLock);
+		shard->mStopping = true;
+		shard->mWork.notify_one();
+	}
+	for (unique_ptr<SShard> & shard : this->mShards)
+	{
+		shard->mExecutor.join();
+	}
+}
+
+
+/**
+ * Queue an operation on the shard that owns its account.
+ * \param operation The operation. Lives in the suspended caller's frame until the caller is resumed.
+ */
+void CAccountBook::Dispatch(Operation * operation)
+{
+	SShard & shard = *this->mShards[operation->mAccount % this->mShards.size()];
+	std::lock_guard<std::mutex> lock(shard.mLock);
+	operation->mNext = nullptr;
+	if (shard.mTail == nullptr)
+	{
+		shard.mHead = operation;
+	}
+	else
+	{
+		shard.mTail->mNext = operation;
+	}
+	shard.mTail = operation;
+	shard.mWork.notify_one();
+}
+
+
+/**
+ * Body of a shard's executor thread. Takes everything queued at once, carries it out in order, and
+ * resumes each caller.
+ * \param shard The shard.
+ */
+void CAccountBook::RunExecutor(SShard * shard)
+{
+	while (true)
+	{
+		Operation * operation = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(shard->mLock);
+			shard->mWork.wait(lock, [shard]() { return shard->mHead != nullptr || shard->mStopping; });
+			if (shard->mHead == nullptr)
+			{
+				return;
+			}
+			operation = shard->mHead;
+			shard->mHead = shard->mTail = nullptr;
+		}
+
+		while (operation != nullptr)
+		{
+			// The caller may finish, and destroy the operation, before resume returns.
+			Operation * next = operation->mNext;
+			operation->Execute(*shard);
+			operation->mCaller.resume();
+			operation = next;
+		}
+	}
+}
+
+
+/**
+ * Open an account.
+ * \param id The account.
+ * \param apr The APR of the credit card.
+ * \param limit The limit on the account balance.
+ * \param startDate The day and time the account was started at.
+ * \returns An operation that resumes with false if the account already exists.
+ */
+CAccountBook::OpenOperation CAccountBook::Open(AccountId id, double apr, double limit, time_t startDate)
+{
+	return OpenOperation(this, id, apr, limit, startDate);
+}
+
+
+/**
+ * Add a charge transaction. Increases balance.
+ * \param id The account.
+ * \param value The value of the charge.
+ * \param day The day relative to the account opening day that the charge occurred. 0 is opening day.
+ * \returns An operation that resumes with false if the charge would put the account over the credit
+ *		limit, or the account doesn't exist.
+ */
+CAccountBook::TransactionOperation CAccountBook::Charge(AccountId id, double value, int day)
+{
+	return TransactionOperation(this, id, value, day, CTransaction::CHARGE);
+}
+
+
+/**
+ * Add a payment transaction. Decreases balance.
+ * \param id The account.
+ * \param value The value of the payment.
+ * \param day The day relative to the account opening day that the payment occurred. 0 is opening day.
+ * \returns An operation that resumes with false if the payment would put the account in negative, or the
+ *		account doesn't exist.
+ */
+CAccountBook::TransactionOperation CAccountBook::Payment(AccountId id, double value, int day)
+{
+	return TransactionOperation(this, id, value, day, CTransaction::PAYMENT);
+}
+
+
+/**
+ * Get what the balance would be on a specific day.
+ * \param id The account.
+ * \param day The day we want to get the balance on.
+ * \returns An operation that resumes with the balance, or with mFound false if the account doesn't exist.
+ */
+CAccountBook::BalanceOperation CAccountBook::BalanceOnDay(AccountId id, int day)
+{
+	return BalanceOperation(this, id, day);
+}
+
+
+/**
+ * \returns How many shards the accounts are split into.
+ */
+size_t CAccountBook::GetShardCount()
+{
+	return this->mShards.size();
+}
+
+#endif
@@ -0,0 +1,181 @@
+#pragma once
+
+// Only compiled where the compiler supports C++20 coroutines. Elsewhere this header declares nothing.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define AVANT_HAS_COROUTINES 1
+
+#include <condition_variable>
+#include <coroutine>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "AccountStore.h"
+#include "CreditCardAccount.h"
+
+
+/**
+ * Accounts that coroutines can use without blocking: co_await book.Charge(id, value, day).
+ *
+ * Accounts are split into shards by id, and every shard has one executor thread that owns its accounts,
+ * so an account is only ever touched by one thread and needs no lock. Awaiting an operation queues it on
+ * the shard of its account and suspends the caller. The executor carries it out and resumes the caller
+ * on the executor's thread with the result. The caller can hop back to its own executor afterwards if it
+ * needs to.
+ *
+ * Operations aren't coroutines, just awaiters that live in the awaiting coroutine's frame. They queue
+ * themselves through an intrusive list, so awaiting one allocates nothing.
+ */
+class CAccountBook
+{
+public:
+	/**
+	 * The result of BalanceOnDay.
+	 */
+	struct SBalance
+	{
+		/// False if the account doesn't exist.
+		bool mFound;
+		double mBalance;
+	};
+
+private:
+	struct SShard;
+
+public:
+	/**
+	 * An operation that is waiting for, or being carried out by, a shard's executor.
+	 */
+	class Operation
+	{
+		friend class CAccountBook;
+
+	protected:
+		CAccountBook * mBook;
+		AccountId mAccount;
+
+		/// The coroutine to resume once the operation has been carried out.
+		std::coroutine_handle<> mCaller;
+
+		/// The next operation in the shard's queue.
+		Operation * mNext = nullptr;
+
+		Operation(CAccountBook * book, AccountId account) : mBook(book), mAccount(account) {}
+
+		/**
+		 * Carry the operation out. Runs on the shard's executor.
+		 * \param shard The shard that owns the account.
+		 */
+		virtual void Execute(SShard & shard) = 0;
+
+	public:
+		Operation(const Operation &) = delete;
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> caller);
+	};
+
+	/**
+	 * Opens an account. Resumes with false if the account already exists.
+	 */
+	class OpenOperation : public Operation
+	{
+		friend class CAccountBook;
+
+	private:
+		double mAPR;
+		double mLimit;
+		time_t mStartDate;
+		bool mOpened = false;
+
+		OpenOperation(CAccountBook * book, AccountId account, double apr, double limit, time_t startDate) :
+			Operation(book, account), mAPR(apr), mLimit(limit), mStartDate(startDate) {}
+		virtual void Execute(SShard & shard) override;
+
+	public:
+		bool await_resume() const noexcept { return this->mOpened; }
+	};
+
+	/**
+	 * Adds a charge or a payment. Resumes with the same result AddCharge or AddPayment would return.
+	 */
+	class TransactionOperation : public Operation
+	{
+		friend class CAccountBook;
+
+	private:
+		double mValue;
+		int mDay;
+		CTransaction::TransactionType mType;
+		bool mAdded = false;
+
+		TransactionOperation(CAccountBook * book, AccountId account, double value, int day, CTransaction::TransactionType type) :
+			Operation(book, account), mValue(value), mDay(day), mType(type) {}
+		virtual void Execute(SShard & shard) override;
+
+	public:
+		bool await_resume() const noexcept { return this->mAdded; }
+	};
+
+	/**
+	 * Calculates the balance on a day.
+	 */
+	class BalanceOperation : public Operation
+	{
+		friend class CAccountBook;
+
+	private:
+		int mDay;
+		SBalance mResult = { false, 0.0 };
+
+		BalanceOperation(CAccountBook * book, AccountId account, int day) : Operation(book, account), mDay(day) {}
+		virtual void Execute(SShard & shard) override;
+
+	public:
+		SBalance await_resume() const noexcept { return this->mResult; }
+	};
+
+private:
+	/**
+	 * Some of the accounts, and the thread that owns them.
+	 */
+	struct SShard
+	{
+		/// Only the executor touches these.
+		std::unordered_map<AccountId, std::unique_ptr<CCreditCardAccount>> mAccounts;
+
+		/// Guards the queue and mStopping.
+		std::mutex mLock;
+		std::condition_variable mWork;
+
+		/// Operations waiting to be carried out, oldest first.
+		Operation * mHead = nullptr;
+		Operation * mTail = nullptr;
+
+		/// Set by the destructor. The executor finishes what is queued and exits.
+		bool mStopping = false;
+
+		std::thread mExecutor;
+	};
+
+	std::vector<std::unique_ptr<SShard>> mShards;
+
+	void Dispatch(Operation * operation);
+	void RunExecutor(SShard * shard);
+
+public:
+	CAccountBook(size_t shardCount);
+	CAccountBook(const CAccountBook &) = delete;
+	virtual ~CAccountBook();
+
+	OpenOperation Open(AccountId id, double apr, double limit, time_t startDate);
+	TransactionOperation Charge(AccountId id, double value, int day);
+	TransactionOperation Payment(AccountId id, double value, int day);
+	BalanceOperation BalanceOnDay(AccountId id, int day);
+
+	size_t GetShardCount();
+};
+
+#endif
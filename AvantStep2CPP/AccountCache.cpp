@@ -0,0 +1,604 @@
+#include "AccountCache.h"
+#include <algorithm>
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+
+
+/**
+ * Constructor.
+ * \param store Where the accounts that aren't in memory are kept.
+ * \param memoryBudget How many bytes the accounts in memory may use before some are evicted.
+ */
+CAccountCache::CAccountCache(shared_ptr<CAccountStore> store, size_t memoryBudget) :
+	mStore(store), mMemoryBudget(memoryBudget), mHits(0), mMisses(0), mCoalescedMisses(0), mEvictions(0)
+{
+}
+
+
+/**
+ * Destructor. Writes every changed account back to the store.
+ */
+CAccountCache::~CAccountCache()
+{
+	this->Flush();
+}
+
+
+/**
+ * Find an account, loading it from the store if it isn't in memory, and keep it from being evicted
+ * until Unpin is called.
+ * \param id The account.
+ * \returns The account's entry, or nullptr if the account doesn't exist.
+ */
+shared_ptr<CAccountCache::SEntry> CAccountCache::Pin(AccountId id)
+{
+	bool counted = false;
+	bool coalesced = false;
+	unique_lock<mutex> lock(this->mLock);
+	while (true)
+	{
+		auto found = this->mEntries.find(id);
+		if (found != this->mEntries.end())
+		{
+			if (!counted)
+			{
+				this->mHits++;
+			}
+			found->second->mReferenced = true;
+			found->second->mPins++;
+			return found->second;
+		}
+
+		if (!counted)
+		{
+			this->mMisses++;
+			counted = true;
+		}
+
+		auto pending = this->mPending.find(id);
+		if (pending != this->mPending.end())
+		{
+			// Someone else is already loading it (or writing it back). Wait for them, then look again:
+			// by then it is either in memory or has to be loaded from the store.
+			if (!coalesced)
+			{
+				this->mCoalescedMisses++;
+				coalesced = true;
+			}
+			std::shared_future<void> done = pending->second;
+			lock.unlock();
+			done.wait();
+			lock.lock();
+			continue;
+		}
+
+		std::promise<void> loaded;
+		this->mPending[id] = loaded.get_future().share();
+		lock.unlock();
+
+		vector<unsigned char> buffer;
+		shared_ptr<CCreditCardAccount> account;
+		if (this->mStore->Load(id, buffer))
+		{
+			account = CCreditCardAccount::Deserialize(buffer.data(), buffer.size());
+		}
+		if (account != nullptr)
+		{
+			// Nobody else can touch the account until it is in the cache.
+			this->UpdatePortfolio(id, *account);
+		}
+
+		lock.lock();
+		this->mPending.erase(id);
+		shared_ptr<SEntry> entry;
+		if (account != nullptr)
+		{
+			entry = std::make_shared<SEntry>();
+			entry->mAccount = account;
+			entry->mPins = 1;
+			entry->mBytes = account->GetMemoryUsage();
+			this->AddEntry(id, entry);
+		}
+		loaded.set_value();
+		return entry;
+	}
+}
+
+
+/**
+ * Let an account be evicted again, and evict accounts if the cache is now over its budget.
+ * \param entry The account's entry, as returned by Pin.
+ * \param bytes How much memory the account is using now.
+ */
+void CAccountCache::Unpin(const shared_ptr<SEntry> & entry, size_t bytes)
+{
+	vector<unique_ptr<SWriteBack>> writeBacks;
+	{
+		lock_guard<mutex> guard(this->mLock);
+		this->mMemoryUsage += bytes;
+		this->mMemoryUsage -= entry->mBytes;
+		entry->mBytes = bytes;
+		entry->mPins--;
+		this->Evict(writeBacks);
+	}
+	this->WriteBack(writeBacks);
+}
+
+
+/**
+ * Put an account in the cache. The cache lock must be held.
+ * \param id The account.
+ * \param entry The account's entry.
+ */
+void CAccountCache::AddEntry(AccountId id, const shared_ptr<SEntry> & entry)
+{
+	entry->mClockSlot = this->mClock.size();
+	this->mClock.push_back(id);
+	this->mEntries[id] = entry;
+	this->mMemoryUsage += entry->mBytes;
+}
+
+
+/**
+ * Take an account out of the cache. The cache lock must be held.
+ * \param id The account.
+ */
+void CAccountCache::RemoveEntry(AccountId id)
+{
+	auto found = this->mEntries.find(id);
+	size_t slot = found->second->mClockSlot;
+
+	// Fill the hole with the last slot so the clock stays dense.
+	AccountId moved = this->mClock.back();
+	this->mClock[slot] = moved;
+	this->mEntries[moved]->mClockSlot = slot;
+	this->mClock.pop_back();
+
+	this->mMemoryUsage -= found->second->mBytes;
+	this->mEntries.erase(found);
+}
+
+
+/**
+ * Run the clock hand until the cache is within its budget. Accounts that changed are taken out of the
+ * cache and handed back to be written to the store once the cache lock is released. Until then, anyone
+ * who wants them waits. The cache lock must be held.
+ * \param writeBacks Receives the evicted accounts that have to be written back.
+ */
+void CAccountCache::Evict(vector<unique_ptr<SWriteBack>> & writeBacks)
+{
+	// Two full turns is enough to clear every reference bit and come back around.
+	size_t steps = 2 * this->mClock.size();
+	while (this->mMemoryUsage > this->mMemoryBudget && !this->mClock.empty() && steps-- > 0)
+	{
+		if (this->mClockHand >= this->mClock.size())
+		{
+			this->mClockHand = 0;
+		}
+		AccountId id = this->mClock[this->mClockHand];
+		shared_ptr<SEntry> entry = this->mEntries[id];
+		if (entry->mPins > 0)
+		{
+			this->mClockHand++;
+			continue;
+		}
+		if (entry->mReferenced)
+		{
+			// Second chance.
+			entry->mReferenced = false;
+			this->mClockHand++;
+			continue;
+		}
+
+		// Nobody has the account pinned, so nobody is touching it: every caller, Flush included, unlocks the entry
+		// before it unpins under the cache lock. The hand stays where it is since RemoveEntry moves another account
+		// into this slot. The entry is clean from here on, so nothing that still holds it writes it again.
+		this->RemoveEntry(id);
+		this->mEvictions++;
+		bool dirty = entry->mDirty;
+		entry->mDirty = false;
+		if (dirty)
+		{
+			unique_ptr<SWriteBack> writeBack(new SWriteBack());
+			writeBack->mId = id;
+			writeBack->mEntry = entry;
+			this->mPending[id] = writeBack->mDone.get_future().share();
+			writeBacks.push_back(std::move(writeBack));
+		}
+	}
+}
+
+
+/**
+ * Serialize evicted accounts and write them to the store. The cache lock must NOT be held.
+ * \param writeBacks The accounts Evict handed back.
+ */
+void CAccountCache::WriteBack(vector<unique_ptr<SWriteBack>> & writeBacks)
+{
+	vector<unsigned char> buffer;
+	for (unique_ptr<SWriteBack> & writeBack : writeBacks)
+	{
+		writeBack->mEntry->mAccount->Serialize(buffer);
+		this->mStore->Save(writeBack->mId, buffer);
+
+		lock_guard<mutex> guard(this->mLock);
+		this->mPending.erase(writeBack->mId);
+		writeBack->mDone.set_value();
+	}
+}
+
+
+/**
+ * Give the portfolio totals the balance an account has now, and check the change against the balance alerts.
+ * Whoever calls this must be the only one using the account, either by holding its lock or because it isn't in
+ * the cache yet.
+ * \param id The account.
+ * \param account The account.
+ */
+void CAccountCache::UpdatePortfolio(AccountId id, CCreditCardAccount & account)
+{
+	double balance = account.GetCurrentBalance(nullptr);
+	double creditLimit = account.GetCreditLimit();
+	double previousBalance;
+	if (this->mPortfolio.Update(id, balance, creditLimit, &previousBalance))
+	{
+		this->mAlerts.Check(id, previousBalance, balance, creditLimit);
+	}
+}
+
+
+/**
+ * Add a new account to the cache. It is written to the store when it is evicted or flushed.
+ * \param id The id of the new account.
+ * \param apr The APR of the credit card.
+ * \param limit The limit on the account balance.
+ * \param startDate The day and time the account was started at.
+ * \returns True if the account was created. False if an account with that id already exists.
+ */
+bool CAccountCache::CreateAccount(AccountId id, double apr, double limit, time_t startDate)
+{
+	shared_ptr<SEntry> existing = this->Pin(id);
+	if (existing != nullptr)
+	{
+		lock_guard<mutex> guard(this->mLock);
+		existing->mPins--;
+		return false;
+	}
+
+	shared_ptr<SEntry> entry = std::make_shared<SEntry>();
+	entry->mAccount = std::make_shared<CCreditCardAccount>(apr, limit, startDate);
+	entry->mDirty = true;
+	entry->mPins = 1;
+	{
+		lock_guard<mutex> guard(this->mLock);
+		if (this->mEntries.find(id) != this->mEntries.end() || this->mPending.find(id) != this->mPending.end())
+		{
+			// Another thread created it first.
+			return false;
+		}
+		this->UpdatePortfolio(id, *entry->mAccount);
+		this->AddEntry(id, entry);
+	}
+	this->Unpin(entry, entry->mAccount->GetMemoryUsage());
+	return true;
+}
+
+
+/**
+ * Add a payment transaction to an account. See CCreditCardAccount::AddPayment.
+ * \param id The account.
+ * \param value The value of the payment.
+ * \param day The day relative to the account opening day that the payment occurred.
+ * \returns True if successful. False if the payment was declined or the account doesn't exist.
+ */
+bool CAccountCache::AddPayment(AccountId id, double value, int day)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	bool result;
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		result = entry->mAccount->AddPayment(value, day);
+		entry->mDirty |= result;
+		if (result)
+		{
+			this->UpdatePortfolio(id, *entry->mAccount);
+		}
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return result;
+}
+
+
+/**
+ * Add a charge transaction to an account. See CCreditCardAccount::AddCharge.
+ * \param id The account.
+ * \param value The value of the charge.
+ * \param day The day relative to the account opening day that the charge occurred.
+ * \returns True if successful. False if the charge was declined or the account doesn't exist.
+ */
+bool CAccountCache::AddCharge(AccountId id, double value, int day)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	bool result;
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		result = entry->mAccount->AddCharge(value, day);
+		entry->mDirty |= result;
+		if (result)
+		{
+			this->UpdatePortfolio(id, *entry->mAccount);
+		}
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return result;
+}
+
+
+/**
+ * Add several charges and payments to an account while holding it once. See CCreditCardAccount::AddTransactions.
+ * \param id The account.
+ * \param transactions The transactions, applied in the order given.
+ * \param count How many transactions there are.
+ * \param added Receives for each transaction whether it was added. Room for count of them.
+ * \returns True if the account exists. False if it doesn't, and nothing was added.
+ */
+bool CAccountCache::AddTransactions(AccountId id, const CCreditCardAccount::SPendingTransaction * transactions, size_t count, bool * added)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		std::fill(added, added + count, false);
+		return false;
+	}
+
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		if (entry->mAccount->AddTransactions(transactions, count, added) > 0)
+		{
+			entry->mDirty = true;
+			this->UpdatePortfolio(id, *entry->mAccount);
+		}
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return true;
+}
+
+
+/**
+ * Change the APR of an account from a day on. See CCreditCardAccount::ScheduleAPR.
+ * \param id The account.
+ * \param apr The new APR as a decimal.
+ * \param day The day relative to the account opening day the new APR starts on.
+ * \returns True if successful. False if the change was invalid or the account doesn't exist.
+ */
+bool CAccountCache::ScheduleAPR(AccountId id, double apr, int day)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	bool result;
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		result = entry->mAccount->ScheduleAPR(apr, day);
+		entry->mDirty |= result;
+		if (result)
+		{
+			this->UpdatePortfolio(id, *entry->mAccount);
+		}
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return result;
+}
+
+
+/**
+ * Get what the balance of an account would be on a specific day. See CCreditCardAccount::GetBalanceOnDay.
+ * \param id The account.
+ * \param day The day we want to get the balance on.
+ * \param balance Receives the balance.
+ * \returns True if the account exists.
+ */
+bool CAccountCache::GetBalanceOnDay(AccountId id, int day, double * balance)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		*balance = entry->mAccount->GetBalanceOnDay(day);
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return true;
+}
+
+
+/**
+ * Get the statement of every cycle of an account up to the one of its last transaction. See
+ * CCreditCardAccount::GetStatements.
+ * \param id The account.
+ * \param statements Receives the statements.
+ * \returns True if the account exists.
+ */
+bool CAccountCache::GetStatements(AccountId id, vector<CCreditCardAccount::SStatement> * statements)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		statements->clear();
+		return false;
+	}
+
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		entry->mAccount->GetStatements(*statements);
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return true;
+}
+
+
+/**
+ * Get the scalars portfolio queries filter an account on. See CCreditCardAccount::GetSummary.
+ * \param id The account.
+ * \param asOf The time the summary is for.
+ * \param summary Receives the summary.
+ * \returns True if the account exists.
+ */
+bool CAccountCache::GetSummary(AccountId id, time_t asOf, CCreditCardAccount::SSummary * summary)
+{
+	shared_ptr<SEntry> entry = this->Pin(id);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	size_t bytes;
+	{
+		lock_guard<mutex> guard(entry->mLock);
+		entry->mAccount->GetSummary(asOf, summary);
+		bytes = entry->mAccount->GetMemoryUsage();
+	}
+	this->Unpin(entry, bytes);
+	return true;
+}
+
+
+/**
+ * Write every account that changed since it was loaded back to the store. The accounts stay in memory. Each of them
+ * is pinned until it is written, so it can't be evicted and written back at the same time.
+ */
+void CAccountCache::Flush()
+{
+	vector<std::pair<AccountId, shared_ptr<SEntry>>> entries;
+	{
+		lock_guard<mutex> guard(this->mLock);
+		entries.assign(this->mEntries.begin(), this->mEntries.end());
+		for (auto & entry : entries)
+		{
+			entry.second->mPins++;
+		}
+	}
+
+	vector<unsigned char> buffer;
+	for (auto & entry : entries)
+	{
+		size_t bytes;
+		{
+			lock_guard<mutex> guard(entry.second->mLock);
+			if (entry.second->mDirty)
+			{
+				entry.second->mAccount->Serialize(buffer);
+				entry.second->mDirty = !this->mStore->Save(entry.first, buffer);
+			}
+			bytes = entry.second->mAccount->GetMemoryUsage();
+		}
+		this->Unpin(entry.second, bytes);
+	}
+}
+
+
+/**
+ * \returns How many times an account was already in memory when it was asked for.
+ */
+unsigned long long CAccountCache::GetHitCount()
+{
+	return this->mHits;
+}
+
+
+/**
+ * \returns How many times an account had to be loaded from the store (or waited for) when it was asked for.
+ */
+unsigned long long CAccountCache::GetMissCount()
+{
+	return this->mMisses;
+}
+
+
+/**
+ * \returns How many misses waited for another thread to load the account instead of loading it themselves.
+ */
+unsigned long long CAccountCache::GetCoalescedMissCount()
+{
+	return this->mCoalescedMisses;
+}
+
+
+/**
+ * \returns How many accounts were evicted from memory.
+ */
+unsigned long long CAccountCache::GetEvictionCount()
+{
+	return this->mEvictions;
+}
+
+
+/**
+ * \returns How many bytes the accounts in memory are using.
+ */
+size_t CAccountCache::GetMemoryUsage()
+{
+	lock_guard<mutex> guard(this->mLock);
+	return this->mMemoryUsage;
+}
+
+
+/**
+ * \returns How many accounts are in memory.
+ */
+size_t CAccountCache::GetResidentCount()
+{
+	lock_guard<mutex> guard(this->mLock);
+	return this->mEntries.size();
+}
+
+
+/**
+ * \returns The totals over every account the cache has created or loaded. Safe to query from any thread.
+ */
+CPortfolioAggregates & CAccountCache::GetPortfolio()
+{
+	return this->mPortfolio;
+}
+
+
+/**
+ * \returns The balance alerts of the accounts in the cache. Every change the cache makes to an account is checked
+ * against them, whether the account is in memory or was loaded back from the store.
+ */
+CBalanceAlerts & CAccountCache::GetAlerts()
+{
+	return this->mAlerts;
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <ctime>
+#include "AccountStore.h"
+#include "BalanceAlerts.h"
+#include "CreditCardAccount.h"
+#include "PortfolioAggregates.h"
+
+
+/**
+ * Keeps the working set of accounts in memory, on top of an account store that holds every account.
+ *
+ * Accounts are loaded from the store the first time they are used and stay in memory until the cache is over
+ * its memory budget. Then the CLOCK algorithm picks accounts that haven't been used recently, and they're
+ * written back to the store (only if they changed) and dropped. If several threads miss on the same account
+ * at once, only one of them loads it and the rest wait for it.
+ *
+ * The cache also keeps portfolio totals over every account it has created or loaded (see CPortfolioAggregates).
+ * Every call that changes an account updates them with its new balance while it still holds the account, so
+ * they never go back to an older balance. Accounts that are only in the store count once they are first loaded.
+ * The same change of balance is checked against the balance alerts (see CBalanceAlerts), so consumers hear about
+ * thresholds crossed instead of polling; the first load of an account only sets the balance later changes are
+ * compared with.
+ *
+ * All methods are safe to call from several threads at once. Calls on the same account run one at a time.
+ */
+class CAccountCache
+{
+private:
+	/**
+	 * An account that is in memory.
+	 */
+	struct SEntry
+	{
+		/// The account itself.
+		std::shared_ptr<CCreditCardAccount> mAccount;
+
+		/// Held while an operation runs on the account.
+		std::mutex mLock;
+
+		/// True if the account changed since it was loaded from the store. Guarded by mLock.
+		bool mDirty = false;
+
+		/// How many callers are using the account. Pinned accounts are never evicted. Guarded by the cache lock.
+		int mPins = 0;
+
+		/// Set every time the account is used, cleared as the clock hand passes over it. Guarded by the cache lock.
+		bool mReferenced = true;
+
+		/// How much memory the account was using the last time it was measured. Guarded by the cache lock.
+		size_t mBytes = 0;
+
+		/// Where this account is in mClock. Guarded by the cache lock.
+		size_t mClockSlot = 0;
+	};
+
+	/**
+	 * An account that was evicted but hasn't been written to the store yet.
+	 */
+	struct SWriteBack
+	{
+		AccountId mId;
+		std::shared_ptr<SEntry> mEntry;
+
+		/// Anyone who wants the account waits on this until it is in the store.
+		std::promise<void> mDone;
+	};
+
+	/// Where the accounts that aren't in memory are.
+	std::shared_ptr<CAccountStore> mStore;
+
+	/// How much memory the accounts in the cache may use before some of them are evicted.
+	size_t mMemoryBudget;
+
+	/// How much memory the accounts in the cache are using.
+	size_t mMemoryUsage = 0;
+
+	/// The accounts that are in memory.
+	std::unordered_map<AccountId, std::shared_ptr<SEntry>> mEntries;
+
+	/// The accounts that are in memory, in the order the clock hand visits them.
+	std::vector<AccountId> mClock;
+
+	/// The next slot of mClock the clock hand will look at.
+	size_t mClockHand = 0;
+
+	/// Accounts being loaded from or written to the store. Anyone who wants one of them waits for it.
+	std::unordered_map<AccountId, std::shared_future<void>> mPending;
+
+	/// Guards everything above.
+	std::mutex mLock;
+
+	/// How many times an account was already in memory when asked for.
+	std::atomic<unsigned long long> mHits;
+
+	/// How many times an account wasn't in memory when asked for.
+	std::atomic<unsigned long long> mMisses;
+
+	/// How many misses waited on another thread's load instead of loading the account themselves.
+	std::atomic<unsigned long long> mCoalescedMisses;
+
+	/// How many accounts were dropped from memory.
+	std::atomic<unsigned long long> mEvictions;
+
+	/// Totals over every account the cache has created or loaded. Kept whether the accounts are in memory or not.
+	CPortfolioAggregates mPortfolio;
+
+	/// The thresholds consumers subscribed to, checked with each change of balance mPortfolio sees.
+	CBalanceAlerts mAlerts;
+
+	std::shared_ptr<SEntry> Pin(AccountId id);
+	void Unpin(const std::shared_ptr<SEntry> & entry, size_t bytes);
+	void AddEntry(AccountId id, const std::shared_ptr<SEntry> & entry);
+	void RemoveEntry(AccountId id);
+	void Evict(std::vector<std::unique_ptr<SWriteBack>> & writeBacks);
+	void WriteBack(std::vector<std::unique_ptr<SWriteBack>> & writeBacks);
+	void UpdatePortfolio(AccountId id, CCreditCardAccount & account);
+
+public:
+	CAccountCache(std::shared_ptr<CAccountStore> store, size_t memoryBudget);
+	CAccountCache(const CAccountCache &) = delete;
+	virtual ~CAccountCache();
+
+	bool CreateAccount(AccountId id, double apr, double limit, time_t startDate);
+
+	bool AddPayment(AccountId id, double value, int day);
+	bool AddCharge(AccountId id, double value, int day);
+	bool AddTransactions(AccountId id, const CCreditCardAccount::SPendingTransaction * transactions, size_t count, bool * added);
+	bool ScheduleAPR(AccountId id, double apr, int day);
+	bool GetBalanceOnDay(AccountId id, int day, double * balance);
+	bool GetStatements(AccountId id, std::vector<CCreditCardAccount::SStatement> * statements);
+	bool GetSummary(AccountId id, time_t asOf, CCreditCardAccount::SSummary * summary);
+
+	void Flush();
+
+	unsigned long long GetHitCount();
+	unsigned long long GetMissCount();
+	unsigned long long GetCoalescedMissCount();
+	unsigned long long GetEvictionCount();
+	size_t GetMemoryUsage();
+	size_t GetResidentCount();
+	CPortfolioAggregates & GetPortfolio();
+	CBalanceAlerts & GetAlerts();
+};
@@ -0,0 +1,387 @@
+#include "AccountSnapshot.h"
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <thread>
+#include "Tracing.h"
+using std::vector;
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AVANT_SSE2_LANES
+#endif
+
+/// What the padding after the last row holds. Every comparison with NaN is false.
+static const double NO_VALUE = std::numeric_limits<double>::quiet_NaN();
+
+#if defined(__AVX__)
+typedef __m256d LaneVector;
+static const int LANE_WIDTH = 4;
+static inline LaneVector LaneSet(double value) { return _mm256_set1_pd(value); }
+static inline LaneVector LaneLoad(const double * values) { return _mm256_loadu_pd(values); }
+template <int COMPARISON>
+static inline int LaneCompare(LaneVector a, LaneVector b)
+{
+	switch (COMPARISON)
+	{
+	case CAccountSnapshot::LESS: return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ));
+	case CAccountSnapshot::LESS_OR_EQUAL: return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ));
+	case CAccountSnapshot::GREATER: return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ));
+	default: return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ));
+	}
+}
+#elif defined(AVANT_SSE2_LANES)
+typedef __m128d LaneVector;
+static const int LANE_WIDTH = 2;
+static inline LaneVector LaneSet(double value) { return _mm_set1_pd(value); }
+static inline LaneVector LaneLoad(const double * values) { return _mm_loadu_pd(values); }
+template <int COMPARISON>
+static inline int LaneCompare(LaneVector a, LaneVector b)
+{
+	switch (COMPARISON)
+	{
+	case CAccountSnapshot::LESS: return _mm_movemask_pd(_mm_cmplt_pd(a, b));
+	case CAccountSnapshot::LESS_OR_EQUAL: return _mm_movemask_pd(_mm_cmple_pd(a, b));
+	case CAccountSnapshot::GREATER: return _mm_movemask_pd(_mm_cmpgt_pd(a, b));
+	default: return _mm_movemask_pd(_mm_cmpge_pd(a, b));
+	}
+}
+#else
+typedef double LaneVector;
+static const int LANE_WIDTH = 1;
+static inline LaneVector LaneSet(double value) { return value; }
+static inline LaneVector LaneLoad(const double * values) { return *values; }
+template <int COMPARISON>
+static inline int LaneCompare(LaneVector a, LaneVector b)
+{
+	switch (COMPARISON)
+	{
+	case CAccountSnapshot::LESS: return a < b;
+	case CAccountSnapshot::LESS_OR_EQUAL: return a <= b;
+	case CAccountSnapshot::GREATER: return a > b;
+	default: return a >= b;
+	}
+}
+#endif
+
+
+/**
+ * Compare a word of rows of a column with a value.
+ * \param values The first row of the word.
+ * \param operand The value, in every lane.
+ * \returns Bit b is set if row b meets the comparison.
+ */
+template <int COMPARISON>
+static inline unsigned long long CompareWord(const double * values, LaneVector operand)
+{
+	unsigned long long bits = 0;
+	for (int lane = 0; lane < (int)CAccountSnapshot::ROWS_PER_WORD; lane += LANE_WIDTH)
+	{
+		bits |= (unsigned long long)LaneCompare<COMPARISON>(LaneLoad(values + lane), operand) << lane;
+	}
+	return bits;
+}
+
+
+/**
+ * Round a row count up to a whole word.
+ * \param rows The row count.
+ * \returns How many rows the columns hold, padding included.
+ */
+static size_t PaddedRows(size_t rows)
+{
+	return (rows + CAccountSnapshot::ROWS_PER_WORD - 1) / CAccountSnapshot::ROWS_PER_WORD * CAccountSnapshot::ROWS_PER_WORD;
+}
+
+
+/**
+ * \returns How many rows are selected.
+ */
+size_t CAccountSnapshot::SSelection::Count() const
+{
+	size_t count = 0;
+	for (unsigned long long word : this->mWords)
+	{
+		count += std::bitset<64>(word).count();
+	}
+	return count;
+}
+
+
+/**
+ * \param row A row of the snapshot.
+ * \returns True if the row is selected.
+ */
+bool CAccountSnapshot::SSelection::IsSelected(size_t row) const
+{
+	return row < this->mRows && ((this->mWords[row / ROWS_PER_WORD] >> (row % ROWS_PER_WORD)) & 1) != 0;
+}
+
+
+/**
+ * Constructor. The snapshot is empty until it is refreshed.
+ */
+CAccountSnapshot::CAccountSnapshot()
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CAccountSnapshot::~CAccountSnapshot()
+{
+}
+
+
+/**
+ * Replace the snapshot with the scalars of some accounts as of a time. The accounts are read through the cache in
+ * contiguous ranges, one per thread.
+ * \param accounts Where the accounts are.
+ * \param ids The accounts. Rows are in the same order, leaving out the accounts that don't exist.
+ * \param asOf The time the snapshot is as of.
+ * \param threadCount How many threads read the accounts. 0 means one for each hardware thread.
+ * \returns How many of the accounts exist and are in the snapshot.
+ */
+size_t CAccountSnapshot::Refresh(CAccountCache & accounts, const vector<AccountId> & ids, time_t asOf, size_t threadCount)
+{
+	TRACE_SCOPE("AccountSnapshot: refresh");
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threadCount = std::max((size_t)1, std::min(threadCount, ids.size() / ROWS_PER_WORD));
+
+	// Every account gets the row of its position in ids, and the ones that don't exist are squeezed out after.
+	this->mAsOf = asOf;
+	this->mIds.assign(ids.size(), 0);
+	for (vector<double> & column : this->mColumns)
+	{
+		column.assign(PaddedRows(ids.size()), NO_VALUE);
+	}
+	vector<char> found(ids.size(), 0);
+	vector<std::thread> workers;
+	size_t perThread = (ids.size() + threadCount - 1) / threadCount;
+	for (size_t first = 0; first < ids.size(); first += perThread)
+	{
+		workers.emplace_back(&CAccountSnapshot::RefreshRange, this, &accounts, &ids, first, std::min(first + perThread, ids.size()), &found);
+	}
+	for (std::thread & worker : workers)
+	{
+		worker.join();
+	}
+
+	size_t rows = 0;
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		if (!found[i])
+		{
+			continue;
+		}
+		if (rows != i)
+		{
+			this->mIds[rows] = this->mIds[i];
+			for (vector<double> & column : this->mColumns)
+			{
+				column[rows] = column[i];
+			}
+		}
+		rows++;
+	}
+	this->mIds.resize(rows);
+	for (vector<double> & column : this->mColumns)
+	{
+		column.resize(PaddedRows(rows));
+		std::fill(column.begin() + rows, column.end(), NO_VALUE);
+	}
+	return rows;
+}
+
+
+/**
+ * Read some of the accounts of a refresh. Runs on a worker thread, and only touches the rows of its range.
+ * \param accounts Where the accounts are.
+ * \param ids Every account of the refresh.
+ * \param first The first row of the range.
+ * \param last The row after the range.
+ * \param found Entry i is set if the account of row i exists.
+ */
+void CAccountSnapshot::RefreshRange(CAccountCache * accounts, const vector<AccountId> * ids, size_t first, size_t last, vector<char> * found)
+{
+	CCreditCardAccount::SSummary summary;
+	for (size_t row = first; row < last; ++row)
+	{
+		AccountId id = (*ids)[row];
+		if (accounts->GetSummary(id, this->mAsOf, &summary))
+		{
+			this->SetRow(row, id, summary);
+			(*found)[row] = 1;
+		}
+	}
+}
+
+
+/**
+ * Fill in a row. The columns must already have room for it.
+ * \param row The row.
+ * \param id The account.
+ * \param summary The account's scalars.
+ */
+void CAccountSnapshot::SetRow(size_t row, AccountId id, const CCreditCardAccount::SSummary & summary)
+{
+	this->mIds[row] = id;
+	this->mColumns[BALANCE][row] = summary.mBalance;
+	this->mColumns[APR][row] = summary.mAPR;
+	this->mColumns[CREDIT_LIMIT][row] = summary.mCreditLimit;
+	this->mColumns[DAYS_TO_CYCLE_CLOSE][row] = summary.mDaysToCycleClose;
+	if (summary.mCreditLimit > 0.0)
+	{
+		this->mColumns[UTILIZATION][row] = summary.mBalance / summary.mCreditLimit;
+	}
+	else
+	{
+		this->mColumns[UTILIZATION][row] = (summary.mBalance > 0.0) ? std::numeric_limits<double>::infinity() : 0.0;
+	}
+}
+
+
+/**
+ * Empty the snapshot, to be filled with Add.
+ * \param asOf The time the snapshot is as of.
+ */
+void CAccountSnapshot::Clear(time_t asOf)
+{
+	this->mAsOf = asOf;
+	this->mIds.clear();
+	for (vector<double> & column : this->mColumns)
+	{
+		column.clear();
+	}
+}
+
+
+/**
+ * Add a row for an account whose scalars are already known, say from another source than a cache.
+ * \param id The account.
+ * \param summary The account's scalars, as of the time of the snapshot.
+ */
+void CAccountSnapshot::Add(AccountId id, const CCreditCardAccount::SSummary & summary)
+{
+	size_t row = this->mIds.size();
+	this->mIds.push_back(0);
+	if (row % ROWS_PER_WORD == 0)
+	{
+		for (vector<double> & column : this->mColumns)
+		{
+			column.resize(row + ROWS_PER_WORD, NO_VALUE);
+		}
+	}
+	this->SetRow(row, id, summary);
+}
+
+
+/**
+ * \returns How many accounts are in the snapshot.
+ */
+size_t CAccountSnapshot::Size() const
+{
+	return this->mIds.size();
+}
+
+
+/**
+ * \returns The time the snapshot is as of.
+ */
+time_t CAccountSnapshot::GetAsOf() const
+{
+	return this->mAsOf;
+}
+
+
+/**
+ * \param row A row of the snapshot.
+ * \returns The account of the row.
+ */
+AccountId CAccountSnapshot::GetId(size_t row) const
+{
+	return this->mIds[row];
+}
+
+
+/**
+ * \param column A column.
+ * \param row A row of the snapshot.
+ * \returns The value of the column in the row.
+ */
+double CAccountSnapshot::GetValue(EColumn column, size_t row) const
+{
+	return this->mColumns[column][row];
+}
+
+
+/**
+ * Find the rows that meet every one of some predicates.
+ * \param predicates The predicates. With none, every row is selected.
+ * \param selection Receives the rows.
+ */
+void CAccountSnapshot::Select(const vector<SPredicate> & predicates, SSelection * selection) const
+{
+	TRACE_SCOPE("AccountSnapshot: select");
+	size_t rows = this->mIds.size();
+	size_t wordCount = PaddedRows(rows) / ROWS_PER_WORD;
+	selection->mRows = rows;
+	selection->mWords.resize(wordCount);
+	for (size_t word = 0; word < wordCount; ++word)
+	{
+		size_t first = word * ROWS_PER_WORD;
+		unsigned long long bits = ~0ULL;
+		for (const SPredicate & predicate : predicates)
+		{
+			const double * values = this->mColumns[predicate.mColumn].data() + first;
+			LaneVector operand = LaneSet(predicate.mValue);
+			switch (predicate.mComparison)
+			{
+			case LESS: bits &= CompareWord<LESS>(values, operand); break;
+			case LESS_OR_EQUAL: bits &= CompareWord<LESS_OR_EQUAL>(values, operand); break;
+			case GREATER: bits &= CompareWord<GREATER>(values, operand); break;
+			default: bits &= CompareWord<GREATER_OR_EQUAL>(values, operand); break;
+			}
+			if (bits == 0)
+			{
+				break;
+			}
+		}
+		selection->mWords[word] = bits;
+	}
+
+	// The padding is NaN, but with no predicates nothing compared it.
+	if (rows % ROWS_PER_WORD != 0)
+	{
+		selection->mWords.back() &= (1ULL << (rows % ROWS_PER_WORD)) - 1;
+	}
+}
+
+
+/**
+ * Get the accounts of the rows a query selected.
+ * \param selection The rows, from Select on this snapshot.
+ * \param ids Receives the accounts, in the order of their rows.
+ */
+void CAccountSnapshot::GetSelectedIds(const SSelection & selection, vector<AccountId> & ids) const
+{
+	ids.clear();
+	ids.reserve(selection.Count());
+	for (size_t word = 0; word < selection.mWords.size(); ++word)
+	{
+		unsigned long long bits = selection.mWords[word];
+		while (bits != 0)
+		{
+			// The lowest set bit, less one, has as many bits set as the row is far into the word.
+			unsigned long long lowest = bits & (~bits + 1);
+			ids.push_back(this->mIds[word * ROWS_PER_WORD + std::bitset<64>(lowest - 1).count()]);
+			bits &= bits - 1;
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <ctime>
+#include <vector>
+#include "AccountCache.h"
+#include "AccountStore.h"
+#include "CreditCardAccount.h"
+
+
+/**
+ * The scalars of many accounts as of one time, one column each, for ad hoc portfolio queries like "balance over
+ * X, APR over Y and the cycle closes within 3 days" that have to look at every account.
+ *
+ * Row r is the account GetId(r), and holds its CCreditCardAccount::SSummary plus its utilization. Every column is
+ * a plain array of doubles, even the days until the cycle closes, so one comparison kernel serves them all. Whole
+ * days are exact in a double.
+ *
+ * Select compares the columns a word of 64 rows at a time, in SIMD lanes: AVX when the compiler targets it, SSE2
+ * otherwise, and plain doubles on anything else. Each lane's result lands in one bit of the word, and the words of
+ * all the predicates are ANDed together while they are still in a register. Once a word has no rows left, the
+ * rest of the predicates skip it. The columns are padded to a whole word with NaN, which no comparison selects.
+ *
+ * A snapshot is refreshed as a whole from an account cache and doesn't change until the next refresh. Queries only
+ * read it, so any number of them can run at once, but not during a refresh.
+ */
+class CAccountSnapshot
+{
+public:
+	/// How many rows a word of a selection covers.
+	static const size_t ROWS_PER_WORD = 64;
+
+	/**
+	 * The columns of a snapshot.
+	 */
+	enum EColumn
+	{
+		BALANCE,
+		APR,
+		CREDIT_LIMIT,
+
+		/// How many days until the cycle closes. See CCreditCardAccount::SSummary.
+		DAYS_TO_CYCLE_CLOSE,
+
+		/// The balance divided by the credit limit. Infinity for a balance over zero with no credit limit.
+		UTILIZATION,
+
+		COLUMN_COUNT
+	};
+
+	/**
+	 * How a predicate compares a column with its value.
+	 */
+	enum EComparison
+	{
+		LESS,
+		LESS_OR_EQUAL,
+		GREATER,
+		GREATER_OR_EQUAL
+	};
+
+	/**
+	 * One condition a row has to meet, like BALANCE GREATER 500.
+	 */
+	struct SPredicate
+	{
+		EColumn mColumn;
+		EComparison mComparison;
+		double mValue;
+	};
+
+	/**
+	 * The rows of a snapshot a query selected, one bit per row.
+	 */
+	struct SSelection
+	{
+		/// Bit b of word w is row w * ROWS_PER_WORD + b. The bits past the last row are clear.
+		std::vector<unsigned long long> mWords;
+
+		/// How many rows the snapshot had.
+		size_t mRows = 0;
+
+		size_t Count() const;
+		bool IsSelected(size_t row) const;
+	};
+
+private:
+	/// The account of each row.
+	std::vector<AccountId> mIds;
+
+	/// The values of each column, in the order of mIds, then NaN up to a whole word.
+	std::vector<double> mColumns[COLUMN_COUNT];
+
+	/// The time the snapshot is as of.
+	time_t mAsOf = 0;
+
+	void RefreshRange(CAccountCache * accounts, const std::vector<AccountId> * ids, size_t first, size_t last, std::vector<char> * found);
+	void SetRow(size_t row, AccountId id, const CCreditCardAccount::SSummary & summary);
+
+public:
+	CAccountSnapshot();
+	virtual ~CAccountSnapshot();
+
+	size_t Refresh(CAccountCache & accounts, const std::vector<AccountId> & ids, time_t asOf, size_t threadCount = 0);
+	void Clear(time_t asOf);
+	void Add(AccountId id, const CCreditCardAccount::SSummary & summary);
+
+	size_t Size() const;
+	time_t GetAsOf() const;
+	AccountId GetId(size_t row) const;
+	double GetValue(EColumn column, size_t row) const;
+
+	void Select(const std::vector<SPredicate> & predicates, SSelection * selection) const;
+	void GetSelectedIds(const SSelection & selection, std::vector<AccountId> & ids) const;
+};
@@ -0,0 +1,17 @@
+#include "AccountStore.h"
+
+
+/**
+ * Constructor.
+ */
+CAccountStore::CAccountStore()
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CAccountStore::~CAccountStore()
+{
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+
+/// Identifies one credit card account among many.
+typedef unsigned long long AccountId;
+
+
+/**
+ * Abstract cold storage for accounts that aren't in memory. Accounts are kept as the
+ * compact buffers written by CCreditCardAccount::Serialize.
+ *
+ * Implementations have to be safe to call from several threads at once.
+ */
+class CAccountStore
+{
+public:
+	CAccountStore();
+	CAccountStore(const CAccountStore &) = delete;
+	virtual ~CAccountStore();
+
+	/**
+	 * Read a serialized account.
+	 * \param id The account to read.
+	 * \param buffer Receives the serialized account.
+	 * \returns True if the account was found.
+	 */
+	virtual bool Load(AccountId id, std::vector<unsigned char> & buffer) = 0;
+
+	/**
+	 * Write a serialized account, replacing whatever was stored for it before.
+	 * \param id The account to write.
+	 * \param buffer The serialized account.
+	 * \returns True if the account was written.
+	 */
+	virtual bool Save(AccountId id, const std::vector<unsigned char> & buffer) = 0;
+};
@@ -0,0 +1,208 @@
+#include "AprScenarios.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+using std::vector;
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AVANT_SSE2_LANES
+#endif
+
+/// The amount of days in one cycle.
+static const int DAYS_PER_CYCLE = 30;
+
+#if defined(__AVX__)
+typedef __m256d LaneVector;
+static const int LANE_WIDTH = 4;
+static inline LaneVector LaneSet(double value) { return _mm256_set1_pd(value); }
+static inline LaneVector LaneLoad(const double * values) { return _mm256_loadu_pd(values); }
+static inline void LaneStore(double * values, LaneVector lanes) { _mm256_storeu_pd(values, lanes); }
+static inline LaneVector LaneAdd(LaneVector a, LaneVector b) { return _mm256_add_pd(a, b); }
+static inline LaneVector LaneMultiply(LaneVector a, LaneVector b) { return _mm256_mul_pd(a, b); }
+static inline LaneVector LaneRound(LaneVector a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+#elif defined(AVANT_SSE2_LANES)
+typedef __m128d LaneVector;
+static const int LANE_WIDTH = 2;
+static inline LaneVector LaneSet(double value) { return _mm_set1_pd(value); }
+static inline LaneVector LaneLoad(const double * values) { return _mm_loadu_pd(values); }
+static inline void LaneStore(double * values, LaneVector lanes) { _mm_storeu_pd(values, lanes); }
+static inline LaneVector LaneAdd(LaneVector a, LaneVector b) { return _mm_add_pd(a, b); }
+static inline LaneVector LaneMultiply(LaneVector a, LaneVector b) { return _mm_mul_pd(a, b); }
+static inline LaneVector LaneRound(LaneVector a)
+{
+	// SSE2 has no rounding instruction. Adding 2^52 with the sign of the value pushes the fraction out of the
+	// mantissa, rounding to nearest even, and taking it away again leaves the whole number.
+	LaneVector magic = _mm_or_pd(_mm_and_pd(a, _mm_set1_pd(-0.0)), _mm_set1_pd(4503599627370496.0));
+	return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+}
+#else
+typedef double LaneVector;
+static const int LANE_WIDTH = 1;
+static inline LaneVector LaneSet(double value) { return value; }
+static inline LaneVector LaneLoad(const double * values) { return *values; }
+static inline void LaneStore(double * values, LaneVector lanes) { *values = lanes; }
+static inline LaneVector LaneAdd(LaneVector a, LaneVector b) { return a + b; }
+static inline LaneVector LaneMultiply(LaneVector a, LaneVector b) { return a * b; }
+static inline LaneVector LaneRound(LaneVector a) { return std::nearbyint(a); }
+#endif
+
+/// How many vectors of lanes are worked on together. Three of each (rate, balance and interest) have to
+/// fit in the 16 vector registers.
+static const int BLOCK_VECTORS = 4;
+
+/// How many APRs are worked on together.
+static const int BLOCK_LANES = LANE_WIDTH * BLOCK_VECTORS;
+
+
+/**
+ * The state of one block of APRs while the history is walked. Follows CalculateCycle: interest accrues at
+ * the close of each day on that day's balance and is added to the balance at the close of each cycle.
+ * Amounts are in millionths of a dollar.
+ */
+struct SLaneBlock
+{
+	/// The daily interest rate of each lane.
+	LaneVector mRate[BLOCK_VECTORS];
+
+	/// The balance of each lane, without the interest of the current cycle.
+	LaneVector mBalance[BLOCK_VECTORS];
+
+	/// The interest each lane has accrued so far in the current cycle.
+	LaneVector mInterest[BLOCK_VECTORS];
+
+	/// The cycle the block has been walked into.
+	int mCycle = 0;
+
+	/// The day within mCycle up to which interest has accrued.
+	int mDayInCycle = 0;
+
+	/**
+	 * Constructor.
+	 * \param rates The daily interest rate of each lane. BLOCK_LANES of them.
+	 */
+	SLaneBlock(const double * rates)
+	{
+		for (int v = 0; v < BLOCK_VECTORS; ++v)
+		{
+			this->mRate[v] = LaneLoad(rates + v * LANE_WIDTH);
+			this->mBalance[v] = LaneSet(0.0);
+			this->mInterest[v] = LaneSet(0.0);
+		}
+	}
+
+	/**
+	 * Accrue interest on the current balance for some days, each day's rounded to the nearest millionth.
+	 * \param days How many days.
+	 */
+	void Accrue(int days)
+	{
+		if (days <= 0)
+		{
+			return;
+		}
+		LaneVector span = LaneSet((double)days);
+		for (int v = 0; v < BLOCK_VECTORS; ++v)
+		{
+			this->mInterest[v] = LaneAdd(this->mInterest[v], LaneMultiply(LaneRound(LaneMultiply(this->mBalance[v], this->mRate[v])), span));
+		}
+	}
+
+	/**
+	 * Move forward to the start of a day, closing every cycle on the way.
+	 * \param day The day.
+	 */
+	void AdvanceTo(int day)
+	{
+		int cycle = day / DAYS_PER_CYCLE;
+		while (this->mCycle < cycle)
+		{
+			this->Accrue(DAYS_PER_CYCLE - this->mDayInCycle);
+			for (int v = 0; v < BLOCK_VECTORS; ++v)
+			{
+				this->mBalance[v] = LaneAdd(this->mBalance[v], this->mInterest[v]);
+				this->mInterest[v] = LaneSet(0.0);
+			}
+			this->mDayInCycle = 0;
+			this->mCycle++;
+		}
+		int dayInCycle = day % DAYS_PER_CYCLE;
+		this->Accrue(dayInCycle - this->mDayInCycle);
+		this->mDayInCycle = dayInCycle;
+	}
+
+	/**
+	 * Apply a transaction to every lane.
+	 * \param amount What it does to the balance.
+	 */
+	void Add(CMoney amount)
+	{
+		LaneVector lanes = LaneSet((double)amount.GetUnits());
+		for (int v = 0; v < BLOCK_VECTORS; ++v)
+		{
+			this->mBalance[v] = LaneAdd(this->mBalance[v], lanes);
+		}
+	}
+
+	/**
+	 * \param balances Receives the balance of every lane in dollars. BLOCK_LANES of them.
+	 */
+	void StoreBalances(double * balances)
+	{
+		for (int v = 0; v < BLOCK_VECTORS; ++v)
+		{
+			LaneStore(balances + v * LANE_WIDTH, this->mBalance[v]);
+		}
+		for (int lane = 0; lane < BLOCK_LANES; ++lane)
+		{
+			balances[lane] = CMoney::FromUnits((long long)balances[lane]).ToDollars();
+		}
+	}
+};
+
+
+/**
+ * Calculate the balance on each of some days under each of some APRs.
+ * \param events The transaction history, oldest first.
+ * \param aprs The APRs to evaluate.
+ * \param days The days to get the balance at the end of, in any order.
+ * \param balances Receives the balances: the one for days[d] under aprs[a] is at d * aprs.size() + a.
+ */
+void CAprScenarios::BalancesOnDays(const vector<SEvent> & events, const vector<double> & aprs, const vector<int> & days, vector<double> & balances)
+{
+	balances.assign(days.size() * aprs.size(), 0.0);
+
+	// Answer the days in order, so each block walks the history only once.
+	vector<size_t> order(days.size());
+	std::iota(order.begin(), order.end(), (size_t)0);
+	std::stable_sort(order.begin(), order.end(), [&days](size_t a, size_t b) { return days[a] < days[b]; });
+
+	double rates[BLOCK_LANES];
+	double laneBalances[BLOCK_LANES];
+	for (size_t first = 0; first < aprs.size(); first += BLOCK_LANES)
+	{
+		size_t lanes = std::min((size_t)BLOCK_LANES, aprs.size() - first);
+		for (size_t lane = 0; lane < (size_t)BLOCK_LANES; ++lane)
+		{
+			rates[lane] = (lane < lanes) ? CMoney::DailyRate(aprs[first + lane]) : 0.0;
+		}
+
+		SLaneBlock block(rates);
+		size_t next = 0;
+		for (size_t query : order)
+		{
+			int day = days[query];
+			for (; next < events.size() && events[next].mDay <= day; ++next)
+			{
+				block.AdvanceTo(events[next].mDay);
+				block.Add(events[next].mAmount);
+			}
+			block.AdvanceTo(day);
+
+			block.StoreBalances(laneBalances);
+			std::copy(laneBalances, laneBalances + lanes, balances.begin() + query * aprs.size() + first);
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include "Money.h"
+
+
+/**
+ * Calculates the balances one transaction history would have under many APRs at once, for pricing
+ * what-if evaluation. The result for each APR is what GetBalanceOnDay returns for an account with that
+ * APR and the same transactions.
+ *
+ * The APRs are evaluated side by side in SIMD lanes: AVX when the compiler targets it, SSE2 otherwise,
+ * and plain doubles on anything else. Each block of lanes stays in registers while the history is
+ * walked, so every transaction costs one vector add per block instead of one replay per APR.
+ *
+ * Lanes hold whole millionths of a dollar. A double holds those exactly, and each day's interest is rounded
+ * the way CMoney::InterestAt rounds it, so every lane comes out the same as the account to the last millionth.
+ */
+class CAprScenarios
+{
+public:
+	/**
+	 * One transaction of the history.
+	 */
+	struct SEvent
+	{
+		/// How many days after the opening of the account the transaction occurred.
+		int mDay;
+
+		/// What it does to the balance: positive for a charge, negative for a payment.
+		CMoney mAmount;
+	};
+
+	static void BalancesOnDays(const std::vector<SEvent> & events, const std::vector<double> & aprs, const std::vector<int> & days, std::vector<double> & balances);
+
+	CAprScenarios() = delete;
+};
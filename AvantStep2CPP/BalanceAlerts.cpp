@@ -0,0 +1,194 @@
+#include "BalanceAlerts.h"
+#include <algorithm>
+#include "EpochManager.h"
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+
+/**
+ * Constructor. There are no subscriptions to begin with.
+ * \param queueCapacity The most events that can wait for the consumer before more are dropped.
+ */
+CBalanceAlerts::CBalanceAlerts(size_t queueCapacity) :
+	mGlobal(new vector<SSubscription>()), mSubscriptionCount(0), mEvents(queueCapacity), mDropped(0)
+{
+	for (std::atomic<AccountSubscriptions *> & shard : this->mShards)
+	{
+		shard = nullptr;
+	}
+}
+
+
+/**
+ * Destructor. No thread may still be checking.
+ */
+CBalanceAlerts::~CBalanceAlerts()
+{
+	CEpochManager::Retire(this->mGlobal.load());
+	for (std::atomic<AccountSubscriptions *> & shard : this->mShards)
+	{
+		if (shard.load() != nullptr)
+		{
+			CEpochManager::Retire(shard.load());
+		}
+	}
+}
+
+
+/**
+ * Subscribe to a threshold of every account.
+ * \param threshold The threshold.
+ * \returns The subscription, which its events carry. Never 0.
+ */
+unsigned long long CBalanceAlerts::Subscribe(const SThreshold & threshold)
+{
+	lock_guard<mutex> guard(this->mLock);
+	vector<SSubscription> * global = new vector<SSubscription>(*this->mGlobal.load());
+	SSubscription subscription = { this->mNextId++, threshold };
+	global->push_back(subscription);
+	CEpochManager::Retire(this->mGlobal.exchange(global));
+	this->mSubscriptionCount++;
+	return subscription.mId;
+}
+
+
+/**
+ * Subscribe to a threshold of one account. The account doesn't have to exist yet.
+ * \param id The account.
+ * \param threshold The threshold.
+ * \returns The subscription, which its events carry. Never 0.
+ */
+unsigned long long CBalanceAlerts::Subscribe(AccountId id, const SThreshold & threshold)
+{
+	lock_guard<mutex> guard(this->mLock);
+	std::atomic<AccountSubscriptions *> & shard = this->mShards[id % SHARD_COUNT];
+	AccountSubscriptions * subscriptions = (shard.load() != nullptr) ? new AccountSubscriptions(*shard.load()) : new AccountSubscriptions();
+	SSubscription subscription = { this->mNextId++, threshold };
+	(*subscriptions)[id].push_back(subscription);
+	this->mAccountOf[subscription.mId] = id;
+	AccountSubscriptions * old = shard.exchange(subscriptions);
+	if (old != nullptr)
+	{
+		CEpochManager::Retire(old);
+	}
+	this->mSubscriptionCount++;
+	return subscription.mId;
+}
+
+
+/**
+ * Stop a subscription. Events it already queued stay in the queue.
+ * \param subscription The subscription, as Subscribe returned it.
+ * \returns False if there is no such subscription.
+ */
+bool CBalanceAlerts::Unsubscribe(unsigned long long subscription)
+{
+	lock_guard<mutex> guard(this->mLock);
+	auto matches = [subscription](const SSubscription & candidate) { return candidate.mId == subscription; };
+	auto account = this->mAccountOf.find(subscription);
+	if (account != this->mAccountOf.end())
+	{
+		AccountId id = account->second;
+		std::atomic<AccountSubscriptions *> & shard = this->mShards[id % SHARD_COUNT];
+		AccountSubscriptions * subscriptions = new AccountSubscriptions(*shard.load());
+		vector<SSubscription> & ofAccount = (*subscriptions)[id];
+		ofAccount.erase(std::remove_if(ofAccount.begin(), ofAccount.end(), matches), ofAccount.end());
+		if (ofAccount.empty())
+		{
+			subscriptions->erase(id);
+		}
+		CEpochManager::Retire(shard.exchange(subscriptions));
+		this->mAccountOf.erase(account);
+	}
+	else
+	{
+		const vector<SSubscription> & current = *this->mGlobal.load();
+		if (std::find_if(current.begin(), current.end(), matches) == current.end())
+		{
+			return false;
+		}
+		vector<SSubscription> * global = new vector<SSubscription>(current);
+		global->erase(std::remove_if(global->begin(), global->end(), matches), global->end());
+		CEpochManager::Retire(this->mGlobal.exchange(global));
+	}
+	this->mSubscriptionCount--;
+	return true;
+}
+
+
+/**
+ * Queue an event for every threshold a change of balance crossed. Safe to call from several threads at once, but
+ * the changes of one account have to be checked one at a time, in the order they were made.
+ * \param id The account.
+ * \param previousBalance The balance before the change.
+ * \param balance The balance after the change.
+ * \param creditLimit The credit limit of the account.
+ */
+void CBalanceAlerts::Check(AccountId id, double previousBalance, double balance, double creditLimit)
+{
+	if (this->mSubscriptionCount.load(std::memory_order_relaxed) == 0 || previousBalance == balance)
+	{
+		return;
+	}
+	CEpochManager::Guard guard;
+	this->CheckAll(*this->mGlobal.load(), id, previousBalance, balance, creditLimit);
+	const AccountSubscriptions * subscriptions = this->mShards[id % SHARD_COUNT].load();
+	if (subscriptions != nullptr)
+	{
+		auto found = subscriptions->find(id);
+		if (found != subscriptions->end())
+		{
+			this->CheckAll(found->second, id, previousBalance, balance, creditLimit);
+		}
+	}
+}
+
+
+/**
+ * Queue an event for every one of some subscriptions whose threshold a change of balance crossed.
+ * \param subscriptions The subscriptions.
+ * \param id The account.
+ * \param previousBalance The balance before the change.
+ * \param balance The balance after the change.
+ * \param creditLimit The credit limit of the account.
+ */
+void CBalanceAlerts::CheckAll(const vector<SSubscription> & subscriptions, AccountId id, double previousBalance, double balance, double creditLimit)
+{
+	for (const SSubscription & subscription : subscriptions)
+	{
+		const SThreshold & threshold = subscription.mThreshold;
+		double level = (threshold.mLevel == UTILIZATION) ? threshold.mValue * creditLimit : threshold.mValue;
+		bool crossed = (threshold.mDirection == RISING) ? (previousBalance < level && balance >= level)
+			: (previousBalance > level && balance <= level);
+		if (!crossed)
+		{
+			continue;
+		}
+		SEvent event = { subscription.mId, id, threshold, previousBalance, balance, creditLimit };
+		if (!this->mEvents.TryPush(event))
+		{
+			this->mDropped++;
+		}
+	}
+}
+
+
+/**
+ * Take the oldest event off the queue. Only one thread may consume events.
+ * \param event Receives the event.
+ * \returns False if there are no events.
+ */
+bool CBalanceAlerts::TryPop(SEvent & event)
+{
+	return this->mEvents.TryPop(event);
+}
+
+
+/**
+ * \returns How many events were dropped because the consumer had fallen a whole queue behind.
+ */
+unsigned long long CBalanceAlerts::GetDroppedCount()
+{
+	return this->mDropped;
+}
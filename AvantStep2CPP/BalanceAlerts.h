@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "AccountStore.h"
+#include "RingBuffer.h"
+
+
+/**
+ * Tells consumers when the balance of an account crosses a threshold, so they don't have to poll every account to
+ * find out.
+ *
+ * A subscription is a threshold, for one account or for all of them: a balance in dollars or a share of the credit
+ * limit, crossed going up or going down. Going up, a balance crosses a level when it goes from below the level to
+ * the level or above it; going down, from above it to the level or below it. So "utilization reaches 100%" fires
+ * for a charge that takes the balance exactly to the credit limit, and "balance falls to 0" for a payment that
+ * pays it off.
+ *
+ * Whoever changes an account calls Check with the balance before and after. Check compares them with the
+ * subscriptions of the account and the global ones and pushes an event for each threshold crossed onto a bounded
+ * queue, which one consumer drains with TryPop. Checking never waits: the subscriptions are read through
+ * CEpochManager without a lock, and an event that finds the queue full is dropped and counted. Events of one
+ * account are queued in the order its changes were made, as long as they were made one at a time.
+ *
+ * The subscriptions are copied on write. The per-account ones are split into SHARD_COUNT shards by account, so
+ * subscribing or unsubscribing copies the global subscriptions or one shard. Both are meant to be rare next to
+ * Check, and per-account subscriptions are meant for a minority of the accounts; a threshold for all of them is
+ * one global subscription.
+ */
+class CBalanceAlerts
+{
+public:
+	/// The most events that can wait for the consumer unless another number is given.
+	static const size_t DEFAULT_QUEUE_CAPACITY = 4096;
+
+	/// How many parts the per-account subscriptions are split into.
+	static const size_t SHARD_COUNT = 256;
+
+	/**
+	 * What a threshold is measured against.
+	 */
+	enum ELevel
+	{
+		/// The level is a balance in dollars.
+		BALANCE,
+
+		/// The level is a share of the credit limit: 0.8 for 80%.
+		UTILIZATION
+	};
+
+	/**
+	 * Which way the balance has to cross the level.
+	 */
+	enum EDirection
+	{
+		RISING,
+		FALLING
+	};
+
+	/**
+	 * A level and the way to cross it.
+	 */
+	struct SThreshold
+	{
+		ELevel mLevel;
+		double mValue;
+		EDirection mDirection;
+	};
+
+	/**
+	 * A threshold an account crossed.
+	 */
+	struct SEvent
+	{
+		/// The subscription, as Subscribe returned it.
+		unsigned long long mSubscription;
+
+		AccountId mAccount;
+		SThreshold mThreshold;
+
+		/// The balance before and after the change that crossed the threshold.
+		double mPreviousBalance;
+		double mBalance;
+
+		double mCreditLimit;
+	};
+
+private:
+	/**
+	 * A threshold and who asked for it.
+	 */
+	struct SSubscription
+	{
+		unsigned long long mId;
+		SThreshold mThreshold;
+	};
+
+	/// The subscriptions of some accounts, by account.
+	typedef std::unordered_map<AccountId, std::vector<SSubscription>> AccountSubscriptions;
+
+	/// The subscriptions for every account. Never changed once Check can see it: a change publishes a new
+	/// vector under mLock, and the old one is retired through CEpochManager.
+	std::atomic<std::vector<SSubscription> *> mGlobal;
+
+	/// The per-account subscriptions of the accounts whose id is s modulo SHARD_COUNT are in shard s, or nullptr
+	/// before the first of them. Replaced the same way as mGlobal.
+	std::atomic<AccountSubscriptions *> mShards[SHARD_COUNT];
+
+	/// Which account each per-account subscription is for, so it can be found to unsubscribe. Guarded by mLock.
+	std::unordered_map<unsigned long long, AccountId> mAccountOf;
+
+	/// The id the next subscription gets. Guarded by mLock.
+	unsigned long long mNextId = 1;
+
+	/// How many subscriptions there are, so Check can return at once when there are none.
+	std::atomic<size_t> mSubscriptionCount;
+
+	/// Serializes subscribing and unsubscribing.
+	std::mutex mLock;
+
+	CRingBuffer<SEvent> mEvents;
+
+	/// How many events found the queue full.
+	std::atomic<unsigned long long> mDropped;
+
+	void CheckAll(const std::vector<SSubscription> & subscriptions, AccountId id, double previousBalance, double balance, double creditLimit);
+
+public:
+	CBalanceAlerts(size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+	CBalanceAlerts(const CBalanceAlerts &) = delete;
+	virtual ~CBalanceAlerts();
+
+	unsigned long long Subscribe(const SThreshold & threshold);
+	unsigned long long Subscribe(AccountId id, const SThreshold & threshold);
+	bool Unsubscribe(unsigned long long subscription);
+
+	void Check(AccountId id, double previousBalance, double balance, double creditLimit);
+	bool TryPop(SEvent & event);
+
+	unsigned long long GetDroppedCount();
+};
@@ -0,0 +1,282 @@
+#include "BalanceIndex.h"
+#include <algorithm>
+#include <limits>
+using std::vector;
+
+/// The fewest cycles the tree makes room for.
+static const size_t MIN_CAPACITY = 16;
+
+/// The highest balance of a cycle nothing is known about.
+static const double NO_HIGH = -std::numeric_limits<double>::infinity();
+
+/// The lowest balance of a cycle nothing is known about.
+static const double NO_LOW = std::numeric_limits<double>::infinity();
+
+
+/**
+ * \returns How many cycles are in the index.
+ */
+size_t CBalanceIndex::Size() const
+{
+	return this->mSize;
+}
+
+
+/**
+ * Forget every cycle.
+ */
+void CBalanceIndex::Clear()
+{
+	this->mSize = 0;
+	this->mCapacity = 0;
+	this->mHigh.clear();
+	this->mLow.clear();
+	this->mAdded.clear();
+	this->mStart.clear();
+}
+
+
+/**
+ * Forget the cycles from one on, and the highest and lowest balance of the cycle before it, which are out
+ * of date once something changes in that cycle.
+ * \param count How many cycles keep their start balance.
+ */
+void CBalanceIndex::Truncate(size_t count)
+{
+	for (size_t cycle = (count > 0) ? count - 1 : 0; cycle < this->mSize; ++cycle)
+	{
+		size_t node = this->mCapacity + cycle;
+		this->mHigh[node] = NO_HIGH;
+		this->mLow[node] = NO_LOW;
+		this->UpdateAbove(node);
+	}
+	this->mSize = std::min(this->mSize, count);
+}
+
+
+/**
+ * Add the next cycle. Its highest and lowest balance aren't known yet.
+ * \param start The balance at the start of the cycle.
+ */
+void CBalanceIndex::Push(double start)
+{
+	if (this->mSize == this->mCapacity)
+	{
+		this->Grow();
+	}
+	size_t cycle = this->mSize++;
+	this->mStart[cycle] = start - this->GetAddedAbove(this->mCapacity + cycle);
+}
+
+
+/**
+ * Set the highest and lowest balance right after a transaction of a cycle.
+ * \param cycle The cycle. Must be in the index.
+ * \param high The highest balance.
+ * \param low The lowest balance.
+ */
+void CBalanceIndex::SetExtremes(size_t cycle, double high, double low)
+{
+	size_t node = this->mCapacity + cycle;
+	double added = this->GetAddedAbove(node);
+	this->mHigh[node] = high - added;
+	this->mLow[node] = low - added;
+	this->UpdateAbove(node);
+}
+
+
+/**
+ * Add an amount to the start balance and the highest and lowest balance of every cycle from one on.
+ * \param cycle The first cycle the amount is added to.
+ * \param amount The amount.
+ */
+void CBalanceIndex::AddFrom(size_t cycle, double amount)
+{
+	if (cycle < this->mSize)
+	{
+		this->AddFrom(1, 0, this->mCapacity, cycle, amount);
+	}
+}
+
+
+/**
+ * \param cycle The cycle. Must be in the index.
+ * \returns The balance at the start of the cycle.
+ */
+double CBalanceIndex::GetStart(size_t cycle) const
+{
+	return this->mStart[cycle] + this->GetAddedAbove(this->mCapacity + cycle);
+}
+
+
+/**
+ * \param cycle The first cycle to look at.
+ * \returns The highest balance of any cycle from that one on, or -infinity if none is known.
+ */
+double CBalanceIndex::HighestFrom(size_t cycle) const
+{
+	return (cycle < this->mSize) ? this->HighestFrom(1, 0, this->mCapacity, cycle) : NO_HIGH;
+}
+
+
+/**
+ * \param cycle The first cycle to look at.
+ * \returns The lowest balance of any cycle from that one on, or infinity if none is known.
+ */
+double CBalanceIndex::LowestFrom(size_t cycle) const
+{
+	return (cycle < this->mSize) ? this->LowestFrom(1, 0, this->mCapacity, cycle) : NO_LOW;
+}
+
+
+/**
+ * \returns The memory the index uses in bytes, not counting the object itself.
+ */
+size_t CBalanceIndex::GetMemoryUsage() const
+{
+	return (this->mHigh.capacity() + this->mLow.capacity() + this->mAdded.capacity() + this->mStart.capacity()) * sizeof(double);
+}
+
+
+/**
+ * \param node A node.
+ * \returns What was added to every ancestor of the node and not to the node itself.
+ */
+double CBalanceIndex::GetAddedAbove(size_t node) const
+{
+	double added = 0.0;
+	for (node /= 2; node > 0; node /= 2)
+	{
+		added += this->mAdded[node];
+	}
+	return added;
+}
+
+
+/**
+ * Work out the highest and lowest balance of every ancestor of a node again after the node changed.
+ * \param node The node.
+ */
+void CBalanceIndex::UpdateAbove(size_t node)
+{
+	for (node /= 2; node > 0; node /= 2)
+	{
+		this->mHigh[node] = std::max(this->mHigh[2 * node], this->mHigh[2 * node + 1]) + this->mAdded[node];
+		this->mLow[node] = std::min(this->mLow[2 * node], this->mLow[2 * node + 1]) + this->mAdded[node];
+	}
+}
+
+
+/**
+ * Make room for twice as many cycles. The tree is built again with nothing added to its inner nodes.
+ */
+void CBalanceIndex::Grow()
+{
+	size_t capacity = std::max(MIN_CAPACITY, 2 * this->mCapacity);
+	vector<double> high(2 * capacity, NO_HIGH);
+	vector<double> low(2 * capacity, NO_LOW);
+	vector<double> start(capacity, 0.0);
+	for (size_t cycle = 0; cycle < this->mSize; ++cycle)
+	{
+		size_t node = this->mCapacity + cycle;
+		double added = this->GetAddedAbove(node);
+		high[capacity + cycle] = this->mHigh[node] + added;
+		low[capacity + cycle] = this->mLow[node] + added;
+		start[cycle] = this->mStart[cycle] + added;
+	}
+	for (size_t node = capacity - 1; node > 0; --node)
+	{
+		high[node] = std::max(high[2 * node], high[2 * node + 1]);
+		low[node] = std::min(low[2 * node], low[2 * node + 1]);
+	}
+
+	this->mCapacity = capacity;
+	this->mHigh.swap(high);
+	this->mLow.swap(low);
+	this->mStart.swap(start);
+	this->mAdded.assign(capacity, 0.0);
+}
+
+
+/**
+ * Add an amount to every cycle from one on below a node.
+ * \param node The node.
+ * \param nodeFirst The first cycle below the node.
+ * \param nodeEnd The cycle after the last one below the node.
+ * \param cycle The first cycle the amount is added to.
+ * \param amount The amount.
+ */
+void CBalanceIndex::AddFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle, double amount)
+{
+	if (nodeEnd <= cycle)
+	{
+		return;
+	}
+	if (nodeFirst >= cycle)
+	{
+		// Everything below the node gets the amount. Only the node itself is told.
+		this->mHigh[node] += amount;
+		this->mLow[node] += amount;
+		if (node < this->mCapacity)
+		{
+			this->mAdded[node] += amount;
+		}
+		else
+		{
+			this->mStart[node - this->mCapacity] += amount;
+		}
+		return;
+	}
+
+	size_t middle = (nodeFirst + nodeEnd) / 2;
+	this->AddFrom(2 * node, nodeFirst, middle, cycle, amount);
+	this->AddFrom(2 * node + 1, middle, nodeEnd, cycle, amount);
+	this->mHigh[node] = std::max(this->mHigh[2 * node], this->mHigh[2 * node + 1]) + this->mAdded[node];
+	this->mLow[node] = std::min(this->mLow[2 * node], this->mLow[2 * node + 1]) + this->mAdded[node];
+}
+
+
+/**
+ * \param node The node.
+ * \param nodeFirst The first cycle below the node.
+ * \param nodeEnd The cycle after the last one below the node.
+ * \param cycle The first cycle to look at.
+ * \returns The highest balance below the node from the cycle on, not counting what was added to its ancestors.
+ */
+double CBalanceIndex::HighestFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle) const
+{
+	if (nodeEnd <= cycle)
+	{
+		return NO_HIGH;
+	}
+	if (nodeFirst >= cycle)
+	{
+		return this->mHigh[node];
+	}
+	size_t middle = (nodeFirst + nodeEnd) / 2;
+	return std::max(this->HighestFrom(2 * node, nodeFirst, middle, cycle), this->HighestFrom(2 * node + 1, middle, nodeEnd, cycle))
+		+ this->mAdded[node];
+}
+
+
+/**
+ * \param node The node.
+ * \param nodeFirst The first cycle below the node.
+ * \param nodeEnd The cycle after the last one below the node.
+ * \param cycle The first cycle to look at.
+ * \returns The lowest balance below the node from the cycle on, not counting what was added to its ancestors.
+ */
+double CBalanceIndex::LowestFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle) const
+{
+	if (nodeEnd <= cycle)
+	{
+		return NO_LOW;
+	}
+	if (nodeFirst >= cycle)
+	{
+		return this->mLow[node];
+	}
+	size_t middle = (nodeFirst + nodeEnd) / 2;
+	return std::min(this->LowestFrom(2 * node, nodeFirst, middle, cycle), this->LowestFrom(2 * node + 1, middle, nodeEnd, cycle))
+		+ this->mAdded[node];
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * What an account knows about each of its cycles, kept in a segment tree: the balance at the start of the
+ * cycle, and the highest and lowest balance right after any transaction of the cycle. Adding an amount to
+ * every cycle from one on, and finding the highest or lowest balance from one cycle on, take O(log n) for
+ * n cycles. That is what checking a transaction inserted into the past against the credit limit needs.
+ *
+ * The index stores whatever values it is given. CCreditCardAccount divides them by how much interest has
+ * grown a balance by the start of each cycle, so a transaction in the past moves every later value by the
+ * same amount.
+ *
+ * A cycle's start balance is known from when it is pushed. Its highest and lowest balance are set once
+ * the cycle has been walked; until then they are -infinity and infinity, so they never decide a query.
+ */
+class CBalanceIndex
+{
+public:
+	size_t Size() const;
+	void Clear();
+	void Truncate(size_t count);
+	void Push(double start);
+	void SetExtremes(size_t cycle, double high, double low);
+	void AddFrom(size_t cycle, double amount);
+
+	double GetStart(size_t cycle) const;
+	double HighestFrom(size_t cycle) const;
+	double LowestFrom(size_t cycle) const;
+
+	size_t GetMemoryUsage() const;
+
+private:
+	/// How many cycles are in the index.
+	size_t mSize = 0;
+
+	/// How many cycles fit before the tree has to grow. Always a power of two, or 0.
+	size_t mCapacity = 0;
+
+	/// Node n has children 2n and 2n + 1, and cycle c is node mCapacity + c. Each node holds the highest
+	/// balance below it, including what was added to it and its descendants but not to its ancestors.
+	std::vector<double> mHigh;
+
+	/// The same for the lowest balance.
+	std::vector<double> mLow;
+
+	/// The amount added to everything below an inner node, which its descendants don't include yet.
+	std::vector<double> mAdded;
+
+	/// The start balance of each cycle, not including what was added to the ancestors of its node.
+	std::vector<double> mStart;
+
+	double GetAddedAbove(size_t node) const;
+	void UpdateAbove(size_t node);
+	void Grow();
+	void AddFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle, double amount);
+	double HighestFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle) const;
+	double LowestFrom(size_t node, size_t nodeFirst, size_t nodeEnd, size_t cycle) const;
+};
@@ -0,0 +1,190 @@
+#include "ConcurrentAccount.h"
+#include "EpochManager.h"
+#include "SnapshotTransactionStore.h"
+#include "EngineMetrics.h"
+#include <algorithm>
+using std::unique_ptr;
+using std::vector;
+
+
+/**
+ * Constructor. An account with no transactions.
+ * \param apr The APR of the credit card.
+ * \param limit The limit on the account balance.
+ * \param startDate The day and time the account was started at.
+ */
+CConcurrentAccount::SVersion::SVersion(double apr, double limit, time_t startDate) :
+	mAccount(apr, limit, startDate, unique_ptr<CTransactionStore>(new CSnapshotTransactionStore()))
+{
+}
+
+
+/**
+ * Copy constructor. The copy shares all but the latest transactions with the original.
+ * \param other The version to copy.
+ */
+CConcurrentAccount::SVersion::SVersion(const SVersion & other) : mAccount(other.mAccount)
+{
+}
+
+
+/**
+ * Constructor.
+ * \param apr The APR of the credit card.
+ * \param limit The limit on the account balance.
+ * \param startDate The day and time the account was started at.
+ */
+CConcurrentAccount::CConcurrentAccount(double apr, double limit, time_t startDate) :
+	mCurrent(new SVersion(apr, limit, startDate))
+{
+	this->mCurrent.load()->mAccount.PrepareReads();
+}
+
+
+/**
+ * Destructor. No thread may still be using the account.
+ */
+CConcurrentAccount::~CConcurrentAccount()
+{
+	CEpochManager::Retire(this->mCurrent.load());
+}
+
+
+/**
+ * Queue a transaction and wait for the batch it ends up in to be published. If no batch is in progress,
+ * the calling thread applies one itself, along with whatever other writers have queued.
+ * \param value The value of the transaction
+ * \param day How many days after the opening of the account the transaction occurred.
+ * \param type The type of transaction. Charges increase balance, payments decrease it.
+ * \returns True if the addition was successful. False otherwise.
+ */
+bool CConcurrentAccount::AddTransaction(double value, int day, CTransaction::TransactionType type)
+{
+	SWrite write = { value, day, type, false, false };
+	std::unique_lock<std::mutex> lock(this->mQueueLock);
+	this->mPending.push_back(&write);
+	while (!write.mDone)
+	{
+		if (this->mCombining)
+		{
+			this->mBatchDone.wait(lock);
+			continue;
+		}
+
+		// Our write is still queued, so the batch we take includes it.
+		this->mCombining = true;
+		vector<SWrite *> batch;
+		batch.swap(this->mPending);
+		lock.unlock();
+		this->ApplyBatch(batch);
+		lock.lock();
+
+		for (SWrite * applied : batch)
+		{
+			applied->mDone = true;
+		}
+		this->mCombining = false;
+		this->mBatchDone.notify_all();
+	}
+	return write.mAdded;
+}
+
+
+/**
+ * Add a batch of transactions to one copy of the current version, in the order they happened, and
+ * publish the copy if any of them was accepted. Declined transactions publish nothing, so readers never
+ * see them. Only the combiner calls this.
+ * \param batch The writes to apply. Each one's result is filled in.
+ */
+void CConcurrentAccount::ApplyBatch(vector<SWrite *> & batch)
+{
+	CEngineMetrics::Observe(CEngineMetrics::COMBINED_BATCH_SIZE, batch.size());
+
+	// Writers that queued at the same moment can arrive in any order. Sorting them by day keeps the
+	// batch on the append path instead of backdating the earlier ones. Writes on the same day keep the
+	// order they were queued in.
+	vector<SWrite *> ordered(batch);
+	std::stable_sort(ordered.begin(), ordered.end(), [](const SWrite * a, const SWrite * b) { return a->mDay < b->mDay; });
+
+	SVersion * current = this->mCurrent.load();
+	unique_ptr<SVersion> next(new SVersion(*current));
+	bool anyAdded = false;
+	for (SWrite * write : ordered)
+	{
+		CCreditCardAccount & account = next->mAccount;
+		write->mAdded = (write->mType == CTransaction::CHARGE) ? account.AddCharge(write->mValue, write->mDay) : account.AddPayment(write->mValue, write->mDay);
+		anyAdded = anyAdded || write->mAdded;
+	}
+
+	if (anyAdded)
+	{
+		// Readers share the version without a lock, so it has to be done changing before they can see it.
+		next->mAccount.PrepareReads();
+		this->mCurrent.store(next.release());
+		CEpochManager::Retire(current);
+	}
+}
+
+
+/**
+ * Add a payment transaction. Decreases balance.
+ * \param value The value of the payment.
+ * \param day The day relative to the account opening day that the payment occurred. 0 is opening day.
+ * \returns True if successful. False otherwise. Most likely reason for a failure is if the payment would put the account in negative.
+ */
+bool CConcurrentAccount::AddPayment(double value, int day)
+{
+	return this->AddTransaction(value, day, CTransaction::PAYMENT);
+}
+
+
+/**
+ * Add a charge transaction. Increases balance.
+ * \param value The value of the charge.
+ * \param day The day relative to the account opening day that the charge occurred. 0 is opening day.
+ * \returns True if successful. False otherwise. Most likely reason for a failure is if the charge would put the account over the credit limit.
+ */
+bool CConcurrentAccount::AddCharge(double value, int day)
+{
+	return this->AddTransaction(value, day, CTransaction::CHARGE);
+}
+
+
+/**
+ * Get what the balance would be on a specific day, without blocking or being blocked by writers.
+ * \param day The day we want to get the balance on.
+ * \param transactionCount If not null, the number of transactions in the version the balance was calculated from.
+ * \returns The balance on that day.
+ */
+double CConcurrentAccount::GetBalanceOnDay(int day, size_t * transactionCount)
+{
+	CEpochManager::Guard guard;
+	SVersion * version = this->mCurrent.load();
+	if (transactionCount != nullptr)
+	{
+		*transactionCount = version->mAccount.GetTransactionCount();
+	}
+	return version->mAccount.GetBalanceOnDay(day);
+}
+
+
+/**
+ * Gets the balance of the card up to the time of the most recent transaction.
+ * \param transactionTime The time of the most recent transaction will be stored in this.
+ * \returns The balance of the account as of the last transaction addition.
+ */
+double CConcurrentAccount::GetCurrentBalance(time_t * transactionTime)
+{
+	CEpochManager::Guard guard;
+	return this->mCurrent.load()->mAccount.GetCurrentBalance(transactionTime);
+}
+
+
+/**
+ * \returns The number of transactions in the current version.
+ */
+size_t CConcurrentAccount::GetTransactionCount()
+{
+	CEpochManager::Guard guard;
+	return this->mCurrent.load()->mAccount.GetTransactionCount();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ctime>
+#include <vector>
+#include "CreditCardAccount.h"
+
+
+/**
+ * A credit card account that any number of threads can read and add transactions to at once.
+ *
+ * Every change produces a new immutable version of the account, published with one atomic store. Readers
+ * take no lock: they compute against whichever version was current when they started, which is always a
+ * consistent history and balance. Writers copy the current version, change the copy, and publish it.
+ * A CCreditCardAccount remembers balances it works out, so a version is given everything the reads below
+ * remember (see CCreditCardAccount::PrepareReads) before it is published, and reading it changes nothing.
+ * Versions keep their transactions in a CSnapshotTransactionStore, so a copy shares everything
+ * but the latest few transactions. Old versions are deleted through CEpochManager once no reader can be
+ * using them.
+ *
+ * Writes are combined. A writer queues its transaction, and whichever writer finds no batch in progress
+ * becomes the combiner: it takes everything queued, applies it in time order to a single copy, and
+ * publishes that copy once. Every writer still gets the result its own transaction would have had if
+ * the batch had been added one transaction at a time, so the credit limit works exactly as it does for
+ * CCreditCardAccount.
+ */
+class CConcurrentAccount
+{
+private:
+	/**
+	 * One immutable version of the account. Only the reads CConcurrentAccount offers may be made on it once
+	 * it is published; the others, such as statements, remember what they work out.
+	 */
+	struct SVersion
+	{
+		CCreditCardAccount mAccount;
+
+		SVersion(double apr, double limit, time_t startDate);
+		SVersion(const SVersion & other);
+	};
+
+	/**
+	 * A transaction waiting for the combiner, and its result.
+	 */
+	struct SWrite
+	{
+		double mValue;
+		int mDay;
+		CTransaction::TransactionType mType;
+
+		/// Whether the transaction was accepted. Only valid once mDone is set.
+		bool mAdded;
+
+		/// Set by the combiner once the batch holding this write has been published.
+		bool mDone;
+	};
+
+	/// The version readers see. Replaced, never changed.
+	std::atomic<SVersion *> mCurrent;
+
+	/// Guards mPending and mCombining, and the results in every queued write.
+	std::mutex mQueueLock;
+
+	/// Signalled whenever a batch has been published.
+	std::condition_variable mBatchDone;
+
+	/// Writes waiting for the next batch. They live on their writers' stacks.
+	std::vector<SWrite *> mPending;
+
+	/// True while a writer is applying a batch. Only that writer builds versions.
+	bool mCombining = false;
+
+	bool AddTransaction(double value, int day, CTransaction::TransactionType type);
+	void ApplyBatch(std::vector<SWrite *> & batch);
+
+public:
+	CConcurrentAccount(double apr, double limit, time_t startDate);
+	CConcurrentAccount(const CConcurrentAccount &) = delete;
+	virtual ~CConcurrentAccount();
+
+	bool AddPayment(double value, int day);
+	bool AddCharge(double value, int day);
+
+	double GetBalanceOnDay(int day, size_t * transactionCount = nullptr);
+	double GetCurrentBalance(time_t * transactionTime = nullptr);
+	size_t GetTransactionCount();
+};
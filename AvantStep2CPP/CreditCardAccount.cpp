@@ -1,10 +1,17 @@
 #include "CreditCardAccount.h"
 #include <ctime>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include "TimeHelper.h"
+#include "AprScenarios.h"
+#include "EngineMetrics.h"
+#include "ShadowVerifier.h"
+#include "Tracing.h"
 #include "TransactionFactory.h"
-using std::vector;
-using std::shared_ptr;
+#include "InlineTransactionStore.h"
+using std::unique_ptr;
 using std::find_if;
 
 /// The default time an account is opened. It is midnight on February 27, 2012 GMT;
@@ -13,6 +20,121 @@ const time_t DEFAULT_TIME = (time_t)1330300800;
 /// The amount of days in one cycle. 
 const int DAYS_PER_CYCLE = 30;
 
+/// How far off a value mCycleIndex was just given can be, in dollars at the start of the account.
+const double CYCLE_INDEX_ROUNDING = 0.000001;
+
+/// Version byte at the start of a serialized account. Bump it whenever the layout changes.
+const unsigned char SERIALIZED_VERSION = 3;
+
+/// The version before amounts were stored as whole millionths of a dollar. Deserialize still reads it.
+const unsigned char SERIALIZED_VERSION_DOUBLE_AMOUNTS = 2;
+
+/// The version before accounts had an APR schedule. Deserialize still reads it.
+const unsigned char SERIALIZED_VERSION_FIXED_APR = 1;
+
+// Scans over many accounts read each one's balance, limit and APR. Whatever only some accounts need goes in
+// SCycleCaches or the transaction store, so an account stays within two 64-byte cache lines.
+static_assert(sizeof(CCreditCardAccount) <= 2 * 64, "CCreditCardAccount must fit in two cache lines");
+
+
+/**
+ * Append a value to a buffer exactly as it is laid out in memory.
+ * \param buffer The buffer to append to.
+ * \param value The value to append.
+ */
+template <typename T>
+static void AppendRaw(std::vector<unsigned char> & buffer, const T & value)
+{
+	const unsigned char * bytes = (const unsigned char *)&value;
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/**
+ * Read a value written by AppendRaw.
+ * \param cursor Where to read from. Moved past the value.
+ * \param end The end of the buffer.
+ * \param value Where the value is stored.
+ * \returns False if the buffer is too short.
+ */
+template <typename T>
+static bool ReadRaw(const unsigned char *& cursor, const unsigned char * end, T * value)
+{
+	if ((size_t)(end - cursor) < sizeof(T))
+	{
+		return false;
+	}
+	memcpy(value, cursor, sizeof(T));
+	cursor += sizeof(T);
+	return true;
+}
+
+/**
+ * Read an amount of money written by Serialize: millionths of a dollar, or dollars in a double before
+ * SERIALIZED_VERSION 3.
+ * \param cursor Where to read from. Moved past the amount.
+ * \param end The end of the buffer.
+ * \param version The version of the serialized account.
+ * \param amount Where the amount is stored.
+ * \returns False if the buffer is too short.
+ */
+static bool ReadAmount(const unsigned char *& cursor, const unsigned char * end, unsigned char version, CMoney * amount)
+{
+	if (version <= SERIALIZED_VERSION_DOUBLE_AMOUNTS)
+	{
+		double dollars;
+		if (!ReadRaw(cursor, end, &dollars))
+		{
+			return false;
+		}
+		*amount = CMoney::FromDollars(dollars);
+		return true;
+	}
+	long long units;
+	if (!ReadRaw(cursor, end, &units))
+	{
+		return false;
+	}
+	*amount = CMoney::FromUnits(units);
+	return true;
+}
+
+/**
+ * Append an unsigned integer using 7 bits per byte. Small numbers take one byte.
+ * \param buffer The buffer to append to.
+ * \param value The value to append.
+ */
+static void AppendVarint(std::vector<unsigned char> & buffer, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+/**
+ * Read an integer written by AppendVarint.
+ * \param cursor Where to read from. Moved past the value.
+ * \param end The end of the buffer.
+ * \param value Where the value is stored.
+ * \returns False if the buffer ends in the middle of the value.
+ */
+static bool ReadVarint(const unsigned char *& cursor, const unsigned char * end, unsigned long long * value)
+{
+	*value = 0;
+	for (int shift = 0; cursor != end && shift < 64; shift += 7)
+	{
+		unsigned char byte = *cursor++;
+		*value |= (unsigned long long)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 
 /**
 * Constructor.
@@ -28,9 +150,9 @@ CCreditCardAccount::IsInCycle::IsInCycle(const time_t startTime, const int cycle
  * \param transaction The transaction we are evaluating
  * \returns True if the transaction occured during the cycle stored in this functor.
  */
-bool CCreditCardAccount::IsInCycle::operator()(const std::shared_ptr<CTransaction>& transaction) const
+bool CCreditCardAccount::IsInCycle::operator()(const CTransaction & transaction) const
 {
-	int cycle = CCreditCardAccount::GetCycle(transaction->GetTime(), this->_startTime);
+	int cycle = CCreditCardAccount::GetCycle(transaction.GetTime(), this->_startTime);
 	return (this->_cycle == cycle);
 }
 
@@ -48,9 +170,9 @@ CCreditCardAccount::IsPastDay::IsPastDay(const time_t startTime, const int day)
  * \param transaction The transaction we are evaluating.
  * \returns True if the transaction occurred past the day stored in this functor.
  */
-bool CCreditCardAccount::IsPastDay::operator()(const std::shared_ptr<CTransaction>& transaction) const
+bool CCreditCardAccount::IsPastDay::operator()(const CTransaction & transaction) const
 {
-	int day = CTimeHelper::DiffDays(transaction->GetTime(), this->_startTime);
+	int day = CTimeHelper::DiffDays(transaction.GetTime(), this->_startTime);
 	return (day > this->_day);
 }
 
@@ -69,9 +191,9 @@ CCreditCardAccount::IsInOrPastCycle::IsInOrPastCycle(const time_t startTime, con
 * \param transaction The transaction we are evaluating
 * \returns True if the transaction occured during or after the cycle stored in this functor.
 */
-bool CCreditCardAccount::IsInOrPastCycle::operator()(const std::shared_ptr<CTransaction>& transaction) const
+bool CCreditCardAccount::IsInOrPastCycle::operator()(const CTransaction & transaction) const
 {
-	int cycle = CCreditCardAccount::GetCycle(transaction->GetTime(), this->_startTime);
+	int cycle = CCreditCardAccount::GetCycle(transaction.GetTime(), this->_startTime);
 	return (this->_cycle <= cycle);
 }
 
@@ -83,18 +205,60 @@ bool CCreditCardAccount::IsInOrPastCycle::operator()(const std::shared_ptr<CTran
  * \param limit The limit on the account balance.
  * \param startDate The day and time the account was started at.
  */
-CCreditCardAccount::CCreditCardAccount(double apr, double limit, time_t startDate = DEFAULT_TIME): mAPR(apr), mCreditLimit(limit), mStartDate(startDate)
+CCreditCardAccount::CCreditCardAccount(double apr, double limit, time_t startDate = DEFAULT_TIME): mStartDate(startDate), mAPR(apr), mCreditLimit(CMoney::FromDollars(limit))
+{
+	this->mTransactions = unique_ptr<CTransactionStore>(new CInlineTransactionStore());
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNTS, 1);
+	this->ReportMemoryUsage();
+}
+
+
+/**
+ * Constructor for an account whose transactions are kept in a store other than the default in-memory one,
+ * such as a CMappedTransactionStore. If the store already holds transactions they become the history of the
+ * account, and the current balance is calculated from them.
+ * \param apr The APR of the credit card.
+ * \param limit The limit on the account balance.
+ * \param startDate The day and time the account was started at.
+ * \param store The store that will hold the transactions of this account.
+ */
+CCreditCardAccount::CCreditCardAccount(double apr, double limit, time_t startDate, unique_ptr<CTransactionStore> store) :
+	mTransactions(std::move(store)), mStartDate(startDate), mAPR(apr), mCreditLimit(CMoney::FromDollars(limit))
+{
+	if (!this->mTransactions->Empty())
+	{
+		TransactionIter lastTransaction = this->mTransactions->End() - 1;
+		this->mBalance = this->CalculateInRange(CMoney(), this->mTransactions->Begin(), this->mTransactions->End(),
+			GetCycle(lastTransaction, this->mStartDate));
+		this->mBalanceDate = lastTransaction->GetTime();
+	}
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNTS, 1);
+	this->ReportMemoryUsage();
+}
+
+
+/**
+ * Copy constructor. The copy gets its own transaction store from the original's Clone, so changing one
+ * account never changes the other.
+ * \param other The account to copy.
+ */
+CCreditCardAccount::CCreditCardAccount(const CCreditCardAccount & other) :
+	mTransactions(other.mTransactions->Clone()), mStartDate(other.mStartDate), mBalanceDate(other.mBalanceDate),
+	mBalance(other.mBalance), mBalanceStale(other.mBalanceStale), mAPR(other.mAPR), mCreditLimit(other.mCreditLimit),
+	mRateChanges(other.mRateChanges), mCaches(other.mCaches ? new SCycleCaches(*other.mCaches) : nullptr)
 {
-	this->mTransactions = TransactionVector();
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNTS, 1);
+	this->ReportMemoryUsage();
 }
 
 
 /**
- * Destructor.
+ * Destructor. The store is released, not cleared, so a persistent store keeps the account's history.
  */
 CCreditCardAccount::~CCreditCardAccount()
 {
-	this->mTransactions.clear();
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNTS, -1);
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNT_BYTES, -(long long)this->mReportedBytes);
 }
 
 /**
@@ -118,7 +282,7 @@ int CCreditCardAccount::GetCycle(time_t currentTime, time_t startTime)
  */
 int CCreditCardAccount::GetCycle(TransactionIter transaction, time_t startTime)
 {
-	time_t time = transaction->get()->GetTime();
+	time_t time = transaction->GetTime();
 	return GetCycle(time, startTime);
 }
 
@@ -145,7 +309,7 @@ int CCreditCardAccount::DayInCycle(time_t currentTime, time_t startTime)
  */
 int CCreditCardAccount::GetDayOfTransaction(TransactionIter transaction, time_t startTime)
 {
-	time_t time = transaction->get()->GetTime();
+	time_t time = transaction->GetTime();
 	return CTimeHelper::DiffDays(time, startTime);
 }
 
@@ -156,12 +320,7 @@ int CCreditCardAccount::GetDayOfTransaction(TransactionIter transaction, time_t
  */
 TransactionIter CCreditCardAccount::FirstTransactionAfterCycleStart(int cycle)
 {
-	if (cycle < this->GetCycleCount())
-	{
-		TransactionIter iter = find_if(this->mTransactions.begin(), this->mTransactions.end(), CCreditCardAccount::IsInOrPastCycle(this->mStartDate, cycle));
-		return iter;
-	}
-	return this->mTransactions.end();
+	return this->FirstTransactionFromDay(cycle * DAYS_PER_CYCLE);
 }
 
 /**
@@ -172,13 +331,12 @@ TransactionIter CCreditCardAccount::FirstTransactionAfterCycleStart(int cycle)
 */
 TransactionIter CCreditCardAccount::CycleBegin(int cycle)
 {
-	if (cycle < this->GetCycleCount())
+	TransactionIter iter = this->FirstTransactionAfterCycleStart(cycle);
+	if (iter != this->mTransactions->End() && GetCycle(iter, this->mStartDate) == cycle)
 	{
-
-		TransactionIter iter = find_if(this->mTransactions.begin(), this->mTransactions.end(), CCreditCardAccount::IsInCycle(this->mStartDate, cycle));
 		return iter;
 	}
-	return this->mTransactions.end();
+	return this->mTransactions->End();
 }
 
 /**
@@ -190,19 +348,11 @@ TransactionIter CCreditCardAccount::CycleBegin(int cycle)
 TransactionIter CCreditCardAccount::CycleEnd(int cycle)
 {
 	TransactionIter cycleStart = this->CycleBegin(cycle);
-	TransactionIter searchEnd = this->FirstTransactionAfterCycleStart(cycle + 1);
-	for (; searchEnd != cycleStart; --searchEnd)
+	if (cycleStart == this->mTransactions->End())
 	{
-		if (GetCycle((searchEnd - 1), this->mStartDate) == cycle)
-		{
-			return searchEnd;
-		}
+		return cycleStart;
 	}
-
-	return cycleStart;
-
-	/**TransactionIter nextCycleStart = find_if(cycleStart, this->mTransactions.end(), CCreditCardAccount::IsInCycle(this->mStartDate, cycle + 1));
-	return --nextCycleStart;*/
+	return this->FirstTransactionAfterCycleStart(cycle + 1);
 }
 
 /**
@@ -212,57 +362,80 @@ TransactionIter CCreditCardAccount::CycleEnd(int cycle)
  */
 TransactionIter CCreditCardAccount::LastTransactionOfDay(int day)
 {
-	if (GetDayOfTransaction(this->mTransactions.begin(), this->mStartDate) > day)
+	TransactionIter pastDay = this->FirstTransactionFromDay(day + 1);
+	if (pastDay == this->mTransactions->Begin())
 	{
-		return this->mTransactions.end();
+		return this->mTransactions->End();
 	}
-	return --(find_if(this->mTransactions.begin(), mTransactions.end(), CCreditCardAccount::IsPastDay(this->mStartDate, day)));
+	return --pastDay;
+}
+
+
+/**
+ * Get the first transaction that occurred on or after a day. The transactions are in order by time, so this
+ * is a binary search.
+ * \param day The day.
+ * \returns Iterator to the first transaction on or after that day, or the end if there is none.
+ */
+TransactionIter CCreditCardAccount::FirstTransactionFromDay(int day)
+{
+	time_t dayStart = CTimeHelper::GetStartOfDay(CTimeHelper::AddDays(&this->mStartDate, day));
+	return std::partition_point(this->mTransactions->Begin(), this->mTransactions->End(),
+		[dayStart](const CTransaction & transaction) { return transaction.GetTime() < dayStart; });
 }
 
 
 
 /**
- * Create a new transaction. Add it to the vector of transactions.
+ * Create a new transaction. Add it to the store of transactions. The caller reports the memory usage afterwards.
  * \param value The value of the transaction
  * \param day How many days after the opening of the account the transaction occurred.
  * \param type The type of transaction. Charges increase balance, payments decrease it.
- * \returns True if the addition was successful. False otherwise. 
+ * \returns True if the addition was successful. False if the day is before the opening day, or the transaction
+ *		would put the balance over the limit or below zero.
  */
 bool CCreditCardAccount::AddTransaction(double value, int day, CTransaction::TransactionType type)
 {
+	CEngineMetrics::ScopedTimer timer(CEngineMetrics::ADD_TRANSACTION_NANOSECONDS);
+	TRACE_SCOPE("AddTransaction");
+	if (day < 0)
+	{
+		// Like an APR change, nothing can happen before the account opened. The cycles, the interest and the
+		// balances on a day all count from the opening day.
+		return false;
+	}
+	TRACE_BEGIN(createSpan, "AddTransaction: create");
 	CTransactionFactory factory = CTransactionFactory();
-	shared_ptr<CTransaction> transaction = factory.CreateTransaction(value, &(this->mStartDate), day, type);
+	CTransaction transaction = factory.CreateTransaction(value, &(this->mStartDate), day, type);
+	TRACE_END(createSpan);
 
-	time_t transactionTime = transaction->GetTime();
+	time_t transactionTime = transaction.GetTime();
 
-	TransactionIter insertIter = mTransactions.end();
+	TRACE_BEGIN(searchSpan, "AddTransaction: search");
+	TransactionIter insertIter = this->mTransactions->End();
 	// Quick shortcut that makes this function O(1) in most cases.
-	if (!(this->mTransactions.empty()) && this->mTransactions.back()->GetTime() <= transactionTime)
+	if (!(this->mTransactions->Empty()) && (this->mTransactions->End() - 1)->GetTime() <= transactionTime)
 	{
-		// This would truly be the most recent transaction. No need to go through the loop.
+		// This would truly be the most recent transaction. No need to search.
 	} 
 	else
 	{
 		// We have to find where in the collection this transaction belongs. The list should stay in order by the 
-		// time of the transaction.
-		for (TransactionIter iter = this->mTransactions.begin(); iter != this->mTransactions.end(); ++iter)
-		{
-			time_t iterTime = iter->get()->GetTime();
-			if (transactionTime < iterTime) {
-				insertIter = iter;
-				iter = --(this->mTransactions.end());
-			}
-		}
+		// time of the transaction, and a transaction goes after any others at the same time.
+		insertIter = std::partition_point(this->mTransactions->Begin(), this->mTransactions->End(),
+			[transactionTime](const CTransaction & other) { return other.GetTime() <= transactionTime; });
 	}
+	TRACE_END(searchSpan);
 
 
 	// Next we're going to figure out what the balance would after the time we add this transaction if we 
 	// were to add it. This makes sure we don't do any invalid transactions.
-	int cycle = GetCycle(transaction->GetTime(), this->mStartDate);
-	double balance = 0.0;
-	if (insertIter == this->mTransactions.end())
+	int cycle = GetCycle(transaction.GetTime(), this->mStartDate);
+	CMoney balance;
+	if (insertIter == this->mTransactions->End())
 	{
-		balance = mBalance;
+		balance = this->GetLatestBalance();
+		CEngineMetrics::Counter path = CEngineMetrics::APPEND_TRANSACTIONS;
 
 		// If this transaction is the newest chronologically then we can take a shortcut in calculating
 		// the balance after it is added, by just accumulating any interest that occurred before it was made,
@@ -270,95 +443,547 @@ bool CCreditCardAccount::AddTransaction(double value, int day, CTransaction::Tra
 		if (this->GetTransactionCount() > 0)
 		{
 			// We're going to see if any cycles were completed by adding this transaction.
-			TransactionIter lastTransaction = insertIter - 1;
 			int currentCycleCount = this->GetCycleCount() - 1;
 			if (cycle - currentCycleCount > 0)
 			{
+					path = CEngineMetrics::CYCLE_CROSSING_TRANSACTIONS;
+
 					// Counterintuitively, we have to remove the transactions in the last cycle from the balance for this to work. 
 					// We need to get the first one in the cycle first. 
+					TRACE_BEGIN(undoSpan, "AddTransaction: undo cycle");
 					TransactionIter cycleStart = this->CycleBegin(currentCycleCount);
 
-				for (TransactionIter iter = cycleStart; iter != this->mTransactions.end(); ++iter)
+				for (TransactionIter iter = cycleStart; iter != this->mTransactions->End(); ++iter)
 				{
-					switch (iter->get()->GetType())
+					switch (iter->GetType())
 					{
 					case CTransaction::CHARGE:
-						balance -= transaction->GetValue();
+						balance -= iter->GetAmount();
 						break;
 					case CTransaction::PAYMENT:
-						balance += transaction->GetValue();
+						balance += iter->GetAmount();
 						break;
 					default:
 						break;
 					}
 				}
+				TRACE_END(undoSpan);
 
 
 
 
-				balance = this->CalculateInRange(balance, cycleStart, this->mTransactions.end(), cycle);
+				balance = this->CalculateInRange(balance, cycleStart, this->mTransactions->End(), cycle);
 			}
 
 		}
-		TransactionIter addedIter = this->mTransactions.insert(insertIter, transaction);
-
-		balance = this->CalculateInRange(balance, addedIter, this->mTransactions.end(), cycle);
-		if (balance - this->mCreditLimit > 0.000001 || balance < 0.0)
+		CEngineMetrics::Increment(path);
+		size_t addedIndex = insertIter.Index();
+		TRACE_BEGIN(insertSpan, "AddTransaction: insert");
+		if (!this->mTransactions->Insert(addedIndex, transaction))
+		{
+			return false;
+		}
+		TRACE_END(insertSpan);
+		TransactionIter addedIter = this->mTransactions->Begin() + addedIndex;
+
+		TRACE_BEGIN(limitSpan, "AddTransaction: limit check");
+		balance = this->CalculateInRange(balance, addedIter, this->mTransactions->End(), cycle);
+		bool overLimit = balance > this->mCreditLimit || balance < CMoney();
+		TRACE_END(limitSpan);
+		if (overLimit)
 		{
 			// Ading this transaction either puts the balance above the limit or puts it to negative. 
 			// Either way, delete it and return that the adding was unsuccessful.
-			this->mTransactions.erase(addedIter);
+			TRACE_SCOPE("AddTransaction: erase");
+			this->mTransactions->Erase(addedIndex);
+			CEngineMetrics::Increment(CEngineMetrics::DECLINED_TRANSACTIONS);
 			return false;
 		}
 		else
 		{
 			// Adding this transaction can be done successfully.
 			this->mBalance = balance;
-			this->mBalanceDate = transaction->GetTime();
+			this->mBalanceDate = transaction.GetTime();
+			this->InvalidateFromDay(day);
 			return true;
 		}
 	}
 	else
 	{
-		// Since we also have the power to add a transaction in the middle of the history, we
-		// need to calculate the balance from scatch.
-		TransactionIter addedIter = this->mTransactions.insert(insertIter, transaction);
-		balance = this->CalculateInRange(this->mBalance, this->mTransactions.begin(), this->mTransactions.end(), cycle);
+		CEngineMetrics::Increment(CEngineMetrics::BACKDATED_TRANSACTIONS);
+		SCycleCaches & caches = this->GetCaches();
+
+		// Every balance after this transaction moves, and in mCycleIndex, where each is divided by the growth of its
+		// cycle, they all move by about the same amount. So once every cycle up to the latest transaction is in the
+		// index, only the cycle of this one has to be walked, and the index says whether any later balance ends up
+		// over the limit or below zero. When the answer is too close to call, the history is walked from the cycle
+		// of the transaction on with exact amounts. Days before the opening day were turned away above, so the
+		// cycle of the transaction always starts at or before it.
+		int lastCycle = this->GetCycleCount() - 1;
+		if ((int)caches.mCycleIndex.Size() <= lastCycle + 1)
+		{
+			this->FillCycleIndex(lastCycle + 1);
+		}
+		bool indexed = (int)caches.mCycleIndex.Size() > lastCycle + 1;
+		CMoney cycleStartBalance = indexed ? CMoney::FromDollars(caches.mCycleIndex.GetStart(cycle) * caches.mCycleGrowth[cycle]) : CMoney();
 
-		if (balance - this->mCreditLimit > 0.000001 || balance < 0.0)
+		TRACE_BEGIN(insertSpan, "AddTransaction: insert");
+		size_t addedIndex = insertIter.Index();
+		if (!this->mTransactions->Insert(addedIndex, transaction))
 		{
-			// For right now I made it impossible for adding a transaction in the middle to fail.
-			// It seems to me the equivalent of canceling the compounding of interest if it made the 
-			// the balance over the credit limit. This isn't rejecting a charge or payment. The only
-			// reason to ever add a transaction in the middle would be an error on fault of the 
-			// credit card company.
-			this->mBalance = balance;
-			this->mBalanceDate = transaction->GetTime();
-			return true;
+			return false;
 		}
-		else
+		TRACE_END(insertSpan);
+		TransactionIter addedIter = this->mTransactions->Begin() + addedIndex;
+
+		TRACE_BEGIN(limitSpan, "AddTransaction: limit check");
+		CMoney amount = (type == CTransaction::CHARGE) ? transaction.GetAmount() : -transaction.GetAmount();
+		CMoney highBefore, lowBefore, high, low;
+		double shift = 0.0;
+		bool decided = false;
+		bool overLimit = false;
+		if (indexed)
 		{
-			// Adding this transaction can be done successfully.
-			this->mBalance = balance;
-			this->mBalanceDate = transaction->GetTime();
-			return true;
+			// Only the balances of this cycle from the new transaction on have to be walked. The ones before it stay.
+			TransactionIter cycleStart = this->FirstTransactionFromDay(cycle * DAYS_PER_CYCLE);
+			TransactionIter cycleEnd = this->FirstTransactionFromDay((cycle + 1) * DAYS_PER_CYCLE);
+			CMoney balanceBefore = this->GetBalanceExtremes(cycleStartBalance, cycleStart, addedIter, &highBefore, &lowBefore);
+			this->GetBalanceExtremes(balanceBefore, addedIter, cycleEnd, &high, &low);
+
+			// The transaction and its interest up to the end of its cycle move the start of the next cycle, and every
+			// later one by about the same amount in mCycleIndex. A charge can only push balances up, and a payment down.
+			int daysLeft = (cycle + 1) * DAYS_PER_CYCLE - day;
+			double growth = caches.mCycleGrowth[cycle];
+			shift = (amount + this->GetInterestOverDays(amount, day, daysLeft)).ToDollars() / caches.mCycleGrowth[cycle + 1];
+			double furthest;
+			if (type == CTransaction::CHARGE)
+			{
+				furthest = std::max((high - this->mCreditLimit).ToDollars() / growth, caches.mCycleIndex.HighestFrom(cycle + 1) + shift);
+			}
+			else
+			{
+				furthest = -std::min(low.ToDollars() / growth, caches.mCycleIndex.LowestFrom(cycle + 1) + shift);
+			}
+			double error = caches.mCycleIndexError + CYCLE_INDEX_ROUNDING;
+			decided = furthest > error || furthest < -error;
+			overLimit = furthest > error;
+		}
+		bool rebuildIndex = false;
+		if (!decided)
+		{
+			overLimit = this->ReplayExceedsLimit(cycle, addedIter, type);
+
+			// The history was walked anyway. Rather than walk it again for the next transaction this close to the
+			// limit, the index is worked out again from exact balances.
+			rebuildIndex = indexed && caches.mCycleIndexError > 0.0;
+			if (rebuildIndex)
+			{
+				caches.mCycleIndex.Clear();
+				caches.mCycleGrowth.clear();
+				caches.mCycleIndexError = 0.0;
+			}
+		}
+		TRACE_END(limitSpan);
+		if (overLimit)
+		{
+			TRACE_SCOPE("AddTransaction: erase");
+			this->mTransactions->Erase(addedIndex);
+			CEngineMetrics::Increment(CEngineMetrics::DECLINED_TRANSACTIONS);
+			return false;
 		}
 
+		// The latest transaction is still the latest, so only the balance after it changes. It is worked out again
+		// when it is next needed.
+		if (indexed && !rebuildIndex)
+		{
+			// Interest rounded each day doesn't move every later balance by exactly the shift. Each day from here on
+			// can be off by up to a millionth, and adding doubles of this size can be off by a few of their last bits.
+			this->SetCycleExtremes(cycle, std::max(highBefore, high), std::min(lowBefore, low));
+			caches.mCycleIndex.AddFrom(cycle + 1, shift);
+			double scale = std::max(this->mCreditLimit.ToDollars(), std::max(std::fabs(high.ToDollars()), std::fabs(low.ToDollars())));
+			caches.mCycleIndexError += (double)((lastCycle + 1 - cycle) * DAYS_PER_CYCLE) / CMoney::UNITS_PER_DOLLAR
+				+ 8 * std::numeric_limits<double>::epsilon() * (scale + std::fabs(shift));
+			if (caches.mCycleBalances.size() > (size_t)cycle + 1)
+			{
+				caches.mCycleBalances.resize(cycle + 1);
+			}
+			if (caches.mStatements.size() > (size_t)cycle)
+			{
+				caches.mStatements.resize(cycle);
+			}
+		}
+		else
+		{
+			this->InvalidateFromDay(day);
+		}
+		this->mBalanceStale = true;
+		return true;
 	}
 	
 }
 
 
 
+/**
+ * \returns What the account has worked out about its cycles, allocated empty the first time it is asked for.
+ */
+CCreditCardAccount::SCycleCaches & CCreditCardAccount::GetCaches()
+{
+	if (!this->mCaches)
+	{
+		this->mCaches.reset(new SCycleCaches());
+	}
+	return *this->mCaches;
+}
+
+
 /**
  * Get the interest that would occur and the end of the day.
  * \param balance The balance at the end of the day.
+ * \param day The day, which decides the APR.
  * \returns The interest if the given balance was at the end of the day.
  */
-double CCreditCardAccount::GetEndDayInterest(double balance)
+CMoney CCreditCardAccount::GetEndDayInterest(CMoney balance, int day)
+{
+	// Daily Interest calculation from the instruction email, rounded to the nearest millionth.
+	return balance.InterestAt(CMoney::DailyRate(this->GetAPROnDay(day)));
+}
+
+
+/**
+ * Get the interest a balance accrues over a run of days, at the APR of each of those days. The interest of each
+ * day is rounded on its own.
+ * \param balance The balance at the end of every one of the days.
+ * \param firstDay The first of the days.
+ * \param days How many days.
+ * \returns The interest of all those days together.
+ */
+CMoney CCreditCardAccount::GetInterestOverDays(CMoney balance, int firstDay, int days)
+{
+	CMoney interest;
+	int day = firstDay;
+	int endDay = firstDay + days;
+	while (day < endDay)
+	{
+		// The rate holds until the next change or the end of the run, whichever comes first.
+		std::vector<SRateChange>::iterator next = std::upper_bound(this->mRateChanges.begin(), this->mRateChanges.end(), day,
+			[](int value, const SRateChange & change) { return value < change.mDay; });
+		int untilDay = (next == this->mRateChanges.end() || next->mDay > endDay) ? endDay : next->mDay;
+		interest += this->GetEndDayInterest(balance, day) * (untilDay - day);
+		day = untilDay;
+	}
+	return interest;
+}
+
+
+/**
+ * Get the balance at the start of a cycle, with the interest of every earlier cycle applied. The balances
+ * of cycles up to the one after the last transaction are remembered in mCycleBalances, so each is only worked
+ * out once until a transaction or a change of APR in an earlier cycle forgets it.
+ * \param cycle The cycle.
+ * \returns The balance when the cycle starts.
+ */
+CMoney CCreditCardAccount::GetCycleStartBalance(int cycle)
+{
+	if (cycle <= 0)
+	{
+		return CMoney();
+	}
+	SCycleCaches & caches = this->GetCaches();
+	if (caches.mCycleBalances.empty())
+	{
+		caches.mCycleBalances.push_back(CMoney());
+	}
+
+	int transactionCycles = this->GetCycleCount();
+	int lastCached = std::min(cycle, transactionCycles);
+	while ((int)caches.mCycleBalances.size() <= lastCached)
+	{
+		int previous = (int)caches.mCycleBalances.size() - 1;
+		CMoney balance = caches.mCycleBalances.back();
+		TransactionIter start = this->FirstTransactionFromDay(previous * DAYS_PER_CYCLE);
+		TransactionIter end = this->FirstTransactionFromDay((previous + 1) * DAYS_PER_CYCLE);
+		if (start == end)
+		{
+			balance += this->GetInterestOverDays(balance, previous * DAYS_PER_CYCLE, DAYS_PER_CYCLE);
+		}
+		else
+		{
+			CEngineMetrics::Observe(CEngineMetrics::SCANNED_TRANSACTIONS, end.Index() - start.Index());
+			balance = this->CalculateCycle(balance, start, end, previous, false);
+		}
+		caches.mCycleBalances.push_back(balance);
+	}
+
+	// Past the last transaction nothing changes but the interest, which isn't worth remembering.
+	int known = std::min(cycle, (int)caches.mCycleBalances.size() - 1);
+	CMoney balance = caches.mCycleBalances[known];
+	for (int later = known; later < cycle; ++later)
+	{
+		if (later < transactionCycles)
+		{
+			TransactionIter start = this->FirstTransactionFromDay(later * DAYS_PER_CYCLE);
+			TransactionIter end = this->FirstTransactionFromDay((later + 1) * DAYS_PER_CYCLE);
+			balance = this->CalculateCycle(balance, start, end, later, false);
+		}
+		else
+		{
+			balance += this->GetInterestOverDays(balance, later * DAYS_PER_CYCLE, DAYS_PER_CYCLE);
+		}
+	}
+	return balance;
+}
+
+
+/**
+ * Put every cycle up to one into mCycleIndex, and the highest and lowest balance of the ones before it, starting
+ * from the exact balances of mCycleBalances.
+ * \param cycle The last cycle. Must be no later than the one after the last transaction.
+ */
+void CCreditCardAccount::FillCycleIndex(int cycle)
+{
+	if (cycle <= 0)
+	{
+		return;
+	}
+	this->GetCycleStartBalance(cycle);
+	SCycleCaches & caches = this->GetCaches();
+	if (caches.mCycleIndex.Size() == 0)
+	{
+		caches.mCycleIndex.Push(0.0);
+		caches.mCycleGrowth.assign(1, 1.0);
+		caches.mCycleIndexError = 0.0;
+	}
+
+	while ((int)caches.mCycleIndex.Size() <= cycle)
+	{
+		// Growth is what a balance is multiplied by over the cycle, leaving out the rounding of each day.
+		int previous = (int)caches.mCycleIndex.Size() - 1;
+		double nextGrowth = caches.mCycleGrowth[previous] * (1.0 + this->GetRateOverDays(previous * DAYS_PER_CYCLE, DAYS_PER_CYCLE));
+		if (!std::isfinite(nextGrowth))
+		{
+			// Centuries of interest at a high APR. The index stops here.
+			break;
+		}
+
+		TransactionIter start = this->FirstTransactionFromDay(previous * DAYS_PER_CYCLE);
+		TransactionIter end = this->FirstTransactionFromDay((previous + 1) * DAYS_PER_CYCLE);
+		CMoney high, low;
+		this->GetBalanceExtremes(caches.mCycleBalances[previous], start, end, &high, &low);
+		this->SetCycleExtremes(previous, high, low);
+		caches.mCycleIndex.Push(caches.mCycleBalances[previous + 1].ToDollars() / nextGrowth);
+		caches.mCycleGrowth.push_back(nextGrowth);
+	}
+}
+
+
+/**
+ * Get the daily rates of a run of days added up, at the APR of each of those days.
+ * \param firstDay The first of the days.
+ * \param days How many days.
+ * \returns The rates of all those days together.
+ */
+double CCreditCardAccount::GetRateOverDays(int firstDay, int days)
+{
+	double rate = 0.0;
+	int day = firstDay;
+	int endDay = firstDay + days;
+	while (day < endDay)
+	{
+		std::vector<SRateChange>::iterator next = std::upper_bound(this->mRateChanges.begin(), this->mRateChanges.end(), day,
+			[](int value, const SRateChange & change) { return value < change.mDay; });
+		int untilDay = (next == this->mRateChanges.end() || next->mDay > endDay) ? endDay : next->mDay;
+		rate += CMoney::DailyRate(this->GetAPROnDay(day)) * (double)(untilDay - day);
+		day = untilDay;
+	}
+	return rate;
+}
+
+
+/**
+ * Get the balance after the latest transaction, working it out again if a transaction inserted into the past
+ * changed it.
+ * \returns The balance as of the latest transaction.
+ */
+CMoney CCreditCardAccount::GetLatestBalance()
+{
+	if (this->mBalanceStale)
+	{
+		int lastCycle = this->GetCycleCount() - 1;
+		if (lastCycle <= 0)
+		{
+			this->mBalance = this->CalculateInRange(CMoney(), this->mTransactions->Begin(), this->mTransactions->End(), lastCycle);
+		}
+		else
+		{
+			this->mBalance = this->CalculateInRange(this->GetCycleStartBalance(lastCycle),
+				this->FirstTransactionFromDay(lastCycle * DAYS_PER_CYCLE), this->mTransactions->End(), lastCycle);
+		}
+		this->mBalanceStale = false;
+	}
+	return this->mBalance;
+}
+
+
+/**
+ * Put the highest and lowest balance after a transaction of a cycle into mCycleIndex.
+ * \param cycle The cycle. Must be in mCycleIndex.
+ * \param high The highest balance.
+ * \param low The lowest balance.
+ */
+void CCreditCardAccount::SetCycleExtremes(int cycle, CMoney high, CMoney low)
+{
+	SCycleCaches & caches = this->GetCaches();
+	if (high < low)
+	{
+		// The cycle has no transactions.
+		caches.mCycleIndex.SetExtremes(cycle, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+		return;
+	}
+	double growth = caches.mCycleGrowth[cycle];
+	caches.mCycleIndex.SetExtremes(cycle, (high - this->mCreditLimit).ToDollars() / growth, low.ToDollars() / growth);
+}
+
+
+/**
+ * Forget what mCycleBalances, mStatements and mCycleIndex know that a change on the given day affects: the
+ * balances of every cycle after it, and the statement and highest and lowest balance of its own.
+ * \param day The day of the change.
+ */
+void CCreditCardAccount::InvalidateFromDay(int day)
+{
+	if (!this->mCaches)
+	{
+		return;
+	}
+	SCycleCaches & caches = *this->mCaches;
+	size_t keep = (size_t)std::max(0, day / DAYS_PER_CYCLE) + 1;
+	if (caches.mCycleBalances.size() > keep)
+	{
+		caches.mCycleBalances.resize(keep);
+	}
+	if (caches.mStatements.size() > keep - 1)
+	{
+		caches.mStatements.resize(keep - 1);
+	}
+	caches.mCycleIndex.Truncate(keep);
+	if (caches.mCycleGrowth.size() > keep)
+	{
+		caches.mCycleGrowth.resize(keep);
+	}
+	if (keep == 1)
+	{
+		// Nothing that was moved in place is left.
+		caches.mCycleIndexError = 0.0;
+	}
+}
+
+
+/**
+ * Find the highest and lowest balance right after each of some transactions.
+ * \param balance The balance before the first of them.
+ * \param start Iterator to the first transaction.
+ * \param end Iterator DIRECTLY AFTER the last transaction. All of them have to be in the same cycle.
+ * \param high Receives the highest balance, or the lowest amount there is if there are no transactions.
+ * \param low Receives the lowest balance, or the highest amount there is if there are no transactions.
+ * \returns The balance after the last transaction.
+ */
+CMoney CCreditCardAccount::GetBalanceExtremes(CMoney balance, TransactionIter start, TransactionIter end, CMoney * high, CMoney * low)
+{
+	*high = CMoney::FromUnits(std::numeric_limits<long long>::min());
+	*low = CMoney::FromUnits(std::numeric_limits<long long>::max());
+	for (; start != end; ++start)
+	{
+		switch (start->GetType())
+		{
+		case CTransaction::CHARGE:
+			balance += start->GetAmount();
+			break;
+		case CTransaction::PAYMENT:
+			balance -= start->GetAmount();
+			break;
+		default:
+			break;
+		}
+		*high = std::max(*high, balance);
+		*low = std::min(*low, balance);
+	}
+	return balance;
+}
+
+
+/**
+ * Check a transaction that was inserted into the past the slow way, by walking the history from its cycle on,
+ * for when mCycleIndex can't: growth too large for a double, or balances too close to the limit or to zero for
+ * the index to tell.
+ * \param firstCycle The cycle to start walking at. Nothing before it may have changed since its start balance
+ *		was last worked out.
+ * \param from Iterator to the inserted transaction.
+ * \param type Its type. A charge is checked against the credit limit, a payment against a negative balance.
+ * \returns True if the balance after the transaction or after a later one is over the limit or below zero.
+ */
+bool CCreditCardAccount::ReplayExceedsLimit(int firstCycle, TransactionIter from, CTransaction::TransactionType type)
+{
+	int lastCycle = this->GetCycleCount() - 1;
+	CMoney balance = this->GetCycleStartBalance(firstCycle);
+	for (int cycle = firstCycle; cycle <= lastCycle; ++cycle)
+	{
+		TransactionIter start = this->FirstTransactionFromDay(cycle * DAYS_PER_CYCLE);
+		TransactionIter end = this->FirstTransactionFromDay((cycle + 1) * DAYS_PER_CYCLE);
+		if (from.Index() < end.Index())
+		{
+			// Balances before the inserted transaction don't count.
+			TransactionIter checkFrom = (from.Index() > start.Index()) ? from : start;
+			CMoney high, low;
+			CMoney balanceBefore = this->GetBalanceExtremes(balance, start, checkFrom, &high, &low);
+			this->GetBalanceExtremes(balanceBefore, checkFrom, end, &high, &low);
+			if ((type == CTransaction::CHARGE) ? high > this->mCreditLimit : low < CMoney())
+			{
+				return true;
+			}
+		}
+		balance = this->CalculateCycle(balance, start, end, cycle, false);
+	}
+	return false;
+}
+
+
+/**
+ * Tell CEngineMetrics how much the memory usage of the account changed since it was last told.
+ */
+void CCreditCardAccount::ReportMemoryUsage()
 {
-	// Daily Interest calculation from the instruction email. 
-	return balance * this->mAPR / 365;
+	size_t bytes = this->GetMemoryUsage();
+	CEngineMetrics::Adjust(CEngineMetrics::ACCOUNT_BYTES, (long long)bytes - (long long)this->mReportedBytes);
+	this->mReportedBytes = bytes;
+}
+
+
+/**
+ * Hand a balance this account calculated to CShadowVerifier, with a copy of the account's history, so it
+ * can be checked against the reference calculation in the background.
+ * \param day The day the balance was calculated for.
+ * \param balance The balance.
+ */
+void CCreditCardAccount::SubmitShadowSample(int day, double balance)
+{
+	CShadowVerifier::SSample sample;
+	sample.mAPR = this->mAPR;
+	sample.mCreditLimit = this->mCreditLimit.ToDollars();
+	sample.mDay = day;
+	sample.mBalance = balance;
+	for (const SRateChange & change : this->mRateChanges)
+	{
+		CShadowVerifier::SRateChange copy = { change.mDay, change.mAPR };
+		sample.mRateChanges.push_back(copy);
+	}
+	sample.mTransactions.reserve(this->mTransactions->Size());
+	for (TransactionIter transaction = this->mTransactions->Begin(); transaction != this->mTransactions->End(); ++transaction)
+	{
+		CShadowVerifier::STransaction copy = { transaction->GetValue(), GetDayOfTransaction(transaction, this->mStartDate), transaction->GetType() };
+		sample.mTransactions.push_back(copy);
+	}
+	CShadowVerifier::Submit(std::move(sample));
 }
 
 
@@ -369,31 +994,33 @@ double CCreditCardAccount::GetEndDayInterest(double balance)
  * \param balance Balance before the cycle begins.
  * \param start Iterator irst transaction in the cycle.
  * \param end Iterator DIRECTLY AFTER the last transaction in the cycle.
+ * \param cycle The cycle, which decides the APR of each of its days.
  * \param justInterest. If true only return the interest of the cycle.
  * \returns The balance after the cycle, with interest applied, unless justInterest is true. In that case, you'll only get the interest.
  */
-double CCreditCardAccount::CalculateCycle(double balance, TransactionIter start, TransactionIter end, bool justInterest = false)
+CMoney CCreditCardAccount::CalculateCycle(CMoney balance, TransactionIter start, TransactionIter end, int cycle, bool justInterest = false)
 {
+	int firstDay = cycle * DAYS_PER_CYCLE;
 
-	double interest = 0.0;
+	CMoney interest;
 	int prevDayInCycle = 0;
 	for (; start != end; ++start)
 	{
-		CTransaction *transaction = start->get();
+		const CTransaction *transaction = &*start;
 	
 		// Get the interest acculumated between this transaction and the previous transaction. 
 		int dayInCycle = DayInCycle(transaction->GetTime(), this->mStartDate);
-		interest += this->GetEndDayInterest(balance) * (double)(dayInCycle - prevDayInCycle);
+		interest += this->GetInterestOverDays(balance, firstDay + prevDayInCycle, dayInCycle - prevDayInCycle);
 		prevDayInCycle = dayInCycle;
 
 		// Apply this transaction to the balance.
 		switch (transaction->GetType())
 		{
 		case CTransaction::CHARGE:
-			balance += transaction->GetValue();
+			balance += transaction->GetAmount();
 			break;
 		case CTransaction::PAYMENT:
-			balance -= transaction->GetValue();
+			balance -= transaction->GetAmount();
 			break;
 		default:
 			break;
@@ -402,7 +1029,7 @@ double CCreditCardAccount::CalculateCycle(double balance, TransactionIter start,
 
 	// Get the interest accululated between the last transaction in the cycle and the end of the cycle.
 	int daysLeftInCycle = DAYS_PER_CYCLE - (prevDayInCycle);
-	interest += this->GetEndDayInterest(balance) * (double)(daysLeftInCycle);
+	interest += this->GetInterestOverDays(balance, firstDay + prevDayInCycle, daysLeftInCycle);
 
 	if (justInterest)
 	{
@@ -413,6 +1040,51 @@ double CCreditCardAccount::CalculateCycle(double balance, TransactionIter start,
 }
 
 
+/**
+ * Does the calculation of CalculateCycle, and adds up the charges and the payments of the cycle on the way.
+ * \param balance Balance before the cycle begins.
+ * \param start Iterator to the first transaction in the cycle.
+ * \param end Iterator DIRECTLY AFTER the last transaction in the cycle.
+ * \param cycle The cycle, which decides the APR of each of its days.
+ * \param statement Receives the statement of the cycle.
+ * \returns The balance after the cycle, with interest applied.
+ */
+CMoney CCreditCardAccount::CalculateStatement(CMoney balance, TransactionIter start, TransactionIter end, int cycle, SStatement * statement)
+{
+	int firstDay = cycle * DAYS_PER_CYCLE;
+
+	CMoney opening = balance;
+	CMoney charges, payments, interest;
+	int prevDayInCycle = 0;
+	for (; start != end; ++start)
+	{
+		int dayInCycle = DayInCycle(start->GetTime(), this->mStartDate);
+		interest += this->GetInterestOverDays(balance, firstDay + prevDayInCycle, dayInCycle - prevDayInCycle);
+		prevDayInCycle = dayInCycle;
+
+		switch (start->GetType())
+		{
+		case CTransaction::CHARGE:
+			charges += start->GetAmount();
+			balance += start->GetAmount();
+			break;
+		case CTransaction::PAYMENT:
+			payments += start->GetAmount();
+			balance -= start->GetAmount();
+			break;
+		default:
+			break;
+		}
+	}
+	interest += this->GetInterestOverDays(balance, firstDay + prevDayInCycle, DAYS_PER_CYCLE - prevDayInCycle);
+
+	balance += interest;
+	SStatement calculated = { cycle, opening.ToDollars(), charges.ToDollars(), payments.ToDollars(), interest.ToDollars(), balance.ToDollars() };
+	*statement = calculated;
+	return balance;
+}
+
+
 /**
  * The heart of the balance calculation. Generates a balance based on: an initial balance before the calculation,
  * the first transaction we are applying in the calculation, the last transaction we are applying in the calculation,
@@ -425,11 +1097,16 @@ double CCreditCardAccount::CalculateCycle(double balance, TransactionIter start,
  *		cycle would have occured in that time, so we would have a cycleCount of 1. 
  * \returns 
  */
-double CCreditCardAccount::CalculateInRange(double balance, TransactionIter start, TransactionIter end, int cycleCount)
+CMoney CCreditCardAccount::CalculateInRange(CMoney balance, TransactionIter start, TransactionIter end, int cycleCount)
 {
-	int prevCycle = GetCycle(start, this->mStartDate);
+	TRACE_SCOPE("CalculateInRange");
 
-	while (start != this->mTransactions.end() && start != end)
+	// With nothing to apply, only the interest of the cycles up to cycleCount is left.
+	int prevCycle = (start != this->mTransactions->End()) ? GetCycle(start, this->mStartDate) : 0;
+	this->mTransactions->AdviseSequential(start, end);
+	CEngineMetrics::Observe(CEngineMetrics::SCANNED_TRANSACTIONS, end.Index() - start.Index());
+
+	while (start != this->mTransactions->End() && start != end)
 	{
 		int cycle = GetCycle(start, this->mStartDate);
 		
@@ -437,15 +1114,16 @@ double CCreditCardAccount::CalculateInRange(double balance, TransactionIter star
 		// We need to collect the interest in these skipped cycles.
 		while (cycle - prevCycle > 1)
 		{
-			balance += this->GetEndDayInterest(balance) * DAYS_PER_CYCLE;
+			balance += this->GetInterestOverDays(balance, (prevCycle + 1) * DAYS_PER_CYCLE, DAYS_PER_CYCLE);
 			prevCycle++;
 		}
 
 		
+		// A cycle that continues past end is the last one in the range, just like the last cycle of the account.
 		TransactionIter cycleEnd = this->CycleEnd(cycle);
-		if (cycleEnd != mTransactions.end())
+		if (cycleEnd.Index() < end.Index())
 		{
-			balance = this->CalculateCycle(balance, start, cycleEnd);
+			balance = this->CalculateCycle(balance, start, cycleEnd, cycle, false);
 			start = cycleEnd;
 		} 
 		else
@@ -460,8 +1138,8 @@ double CCreditCardAccount::CalculateInRange(double balance, TransactionIter star
 			// a complete cycle. 
 			if (cycle < cycleCount)
 			{
-				balance = this->CalculateCycle(balance, start, this->mTransactions.end());
-				start = this->mTransactions.end();
+				balance = this->CalculateCycle(balance, start, end, cycle, false);
+				start = end;
 				cycle++;
 			}
 			else
@@ -469,18 +1147,18 @@ double CCreditCardAccount::CalculateInRange(double balance, TransactionIter star
 				// When we asked for the balance of this range, we asked for the balance
 				// on a day within the cycle these last transactions are a part of.
 				// We don't have to care about interest at all.
-				for (; start != this->mTransactions.end(); ++start)
+				for (; start != end; ++start)
 				{
-					CTransaction *transaction = start->get();
+					const CTransaction *transaction = &*start;
 
 					// Apply this transaction to the balance.
 					switch (transaction->GetType())
 					{
 					case CTransaction::CHARGE:
-						balance += transaction->GetValue();
+						balance += transaction->GetAmount();
 						break;
 					case CTransaction::PAYMENT:
-						balance -= transaction->GetValue();
+						balance -= transaction->GetAmount();
 						break;
 					default:
 						break;
@@ -500,7 +1178,7 @@ double CCreditCardAccount::CalculateInRange(double balance, TransactionIter star
 	// no transactions were made during them.
 	while (prevCycle < cycleCount)
 	{
-		balance += this->GetEndDayInterest(balance) * DAYS_PER_CYCLE;
+		balance += this->GetInterestOverDays(balance, prevCycle * DAYS_PER_CYCLE, DAYS_PER_CYCLE);
 		prevCycle++;
 	}
 
@@ -513,11 +1191,11 @@ double CCreditCardAccount::CalculateInRange(double balance, TransactionIter star
  */
 int CCreditCardAccount::GetCycleCount()
 {
-	if (this->mTransactions.empty())
+	if (this->mTransactions->Empty())
 	{
 		return 0;
 	}
-	TransactionIter lastTrans = --(this->mTransactions.end());
+	TransactionIter lastTrans = --(this->mTransactions->End());
 	return GetCycle(lastTrans, this->mStartDate) + 1;
 }
 
@@ -528,7 +1206,7 @@ int CCreditCardAccount::GetCycleCount()
  */
 size_t CCreditCardAccount::GetTransactionCount()
 {
-	return this->mTransactions.size();
+	return this->mTransactions->Size();
 }
 
 
@@ -541,13 +1219,80 @@ double CCreditCardAccount::GetAPR()
 	return this->mAPR;
 }
 
+
+/**
+ * Get the interest rate of the account on a day, following its APR schedule.
+ * \param day The day relative to the account opening day.
+ * \returns The APR as a decimal (.10 = 10%).
+ */
+double CCreditCardAccount::GetAPROnDay(int day)
+{
+	if (this->mRateChanges.empty() || day < this->mRateChanges.front().mDay)
+	{
+		return this->mAPR;
+	}
+	std::vector<SRateChange>::iterator next = std::upper_bound(this->mRateChanges.begin(), this->mRateChanges.end(), day,
+		[](int value, const SRateChange & change) { return value < change.mDay; });
+	return (next - 1)->mAPR;
+}
+
+
+/**
+ * Change the APR from a day on, for a promotional rate or a penalty rate say. Changes already scheduled for
+ * later days still happen; one already scheduled for the same day is replaced. Only the cycles from the day
+ * on are calculated again, and only when a balance in them is asked for.
+ * \param apr The new APR as a decimal (.10 = 10%).
+ * \param day The day relative to the account opening day the new APR starts on. Day 0 replaces the opening APR.
+ * \returns True if the APR was changed. False if the day is before the opening day or the APR is negative.
+ */
+bool CCreditCardAccount::ScheduleAPR(double apr, int day)
+{
+	if (day < 0 || apr < 0.0)
+	{
+		return false;
+	}
+
+	if (day == 0)
+	{
+		this->mAPR = apr;
+	}
+	else
+	{
+		std::vector<SRateChange>::iterator position = std::lower_bound(this->mRateChanges.begin(), this->mRateChanges.end(), day,
+			[](const SRateChange & change, int value) { return change.mDay < value; });
+		if (position != this->mRateChanges.end() && position->mDay == day)
+		{
+			position->mAPR = apr;
+		}
+		else
+		{
+			SRateChange change = { day, apr };
+			this->mRateChanges.insert(position, change);
+		}
+	}
+	this->InvalidateFromDay(day);
+
+	// The balance after the latest transaction includes the interest of every cycle closed before it.
+	if (!this->mTransactions->Empty())
+	{
+		TransactionIter lastTransaction = this->mTransactions->End() - 1;
+		int lastDay = GetDayOfTransaction(lastTransaction, this->mStartDate);
+		if (day < lastDay)
+		{
+			this->mBalanceStale = true;
+		}
+	}
+	this->ReportMemoryUsage();
+	return true;
+}
+
 /**
  * Get the maximum balance the account can have before no more money can be charged.
  * \returns The limit of the credit card.
  */
 double CCreditCardAccount::GetCreditLimit()
 {
-	return this->mCreditLimit;
+	return this->mCreditLimit.ToDollars();
 }
 
 /**
@@ -570,7 +1315,141 @@ double CCreditCardAccount::GetCurrentBalance(time_t * transactionTime = nullptr)
 	{
 		*transactionTime = this->mBalanceDate;
 	}
-	return this->mBalance;
+	return this->GetLatestBalance().ToDollars();
+}
+
+
+/**
+ * Get how much memory the account is using, counting its transactions.
+ * \returns The size of the account in bytes.
+ */
+size_t CCreditCardAccount::GetMemoryUsage()
+{
+	size_t bytes = sizeof(*this) + this->mTransactions->GetMemoryUsage() + this->mRateChanges.capacity() * sizeof(SRateChange);
+	if (this->mCaches)
+	{
+		const SCycleCaches & caches = *this->mCaches;
+		bytes += sizeof(SCycleCaches) + caches.mCycleBalances.capacity() * sizeof(CMoney)
+			+ caches.mStatements.capacity() * sizeof(SStatement) + caches.mCycleIndex.GetMemoryUsage()
+			+ caches.mCycleGrowth.capacity() * sizeof(double);
+	}
+	return bytes;
+}
+
+
+/**
+ * Write the account into a compact byte buffer that Deserialize can turn back into an account.
+ * Transactions are stored as the time since the previous transaction, which is usually one or two
+ * bytes, with the transaction type in its lowest bit, followed by the value in millionths of a dollar.
+ * The changes of the APR come last, each as its day followed by the new APR.
+ * \param buffer The buffer to write to. Anything already in it is replaced.
+ */
+void CCreditCardAccount::Serialize(std::vector<unsigned char> & buffer)
+{
+	buffer.clear();
+	buffer.reserve(1 + 5 * sizeof(double) + 10 + this->mTransactions->Size() * (sizeof(long long) + 3));
+
+	buffer.push_back(SERIALIZED_VERSION);
+	AppendRaw(buffer, this->mAPR);
+	AppendRaw(buffer, this->mCreditLimit.GetUnits());
+	AppendRaw(buffer, (long long)this->mStartDate);
+	AppendRaw(buffer, (long long)this->mBalanceDate);
+	AppendRaw(buffer, this->GetLatestBalance().GetUnits());
+	AppendVarint(buffer, this->mTransactions->Size());
+
+	time_t previousTime = this->mStartDate;
+	for (TransactionIter iter = this->mTransactions->Begin(); iter != this->mTransactions->End(); ++iter)
+	{
+		// Zigzag the difference so a transaction before the start date still encodes small.
+		long long difference = (long long)(iter->GetTime() - previousTime);
+		unsigned long long zigzag = ((unsigned long long)difference << 1) ^ (unsigned long long)(difference >> 63);
+		AppendVarint(buffer, (zigzag << 1) | (iter->GetType() == CTransaction::PAYMENT ? 1 : 0));
+		AppendRaw(buffer, iter->GetAmount().GetUnits());
+		previousTime = iter->GetTime();
+	}
+
+	AppendVarint(buffer, this->mRateChanges.size());
+	for (const SRateChange & change : this->mRateChanges)
+	{
+		AppendVarint(buffer, (unsigned long long)change.mDay);
+		AppendRaw(buffer, change.mAPR);
+	}
+}
+
+
+/**
+ * Rebuild an account written by Serialize. The account keeps its transactions in memory.
+ * \param data The serialized account.
+ * \param size How many bytes are in data.
+ * \returns The account, or nullptr if the data isn't a serialized account.
+ */
+std::shared_ptr<CCreditCardAccount> CCreditCardAccount::Deserialize(const unsigned char * data, size_t size)
+{
+	const unsigned char * cursor = data;
+	const unsigned char * end = data + size;
+
+	double apr;
+	CMoney limit, balance;
+	long long startDate, balanceDate;
+	unsigned long long count;
+	if (size == 0)
+	{
+		return nullptr;
+	}
+	unsigned char version = *cursor++;
+	if ((version != SERIALIZED_VERSION && version != SERIALIZED_VERSION_DOUBLE_AMOUNTS && version != SERIALIZED_VERSION_FIXED_APR) ||
+		!ReadRaw(cursor, end, &apr) || !ReadAmount(cursor, end, version, &limit) ||
+		!ReadRaw(cursor, end, &startDate) || !ReadRaw(cursor, end, &balanceDate) ||
+		!ReadAmount(cursor, end, version, &balance) || !ReadVarint(cursor, end, &count))
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<CCreditCardAccount> account = std::make_shared<CCreditCardAccount>(apr, 0.0, (time_t)startDate);
+	account->mCreditLimit = limit;
+	time_t previousTime = (time_t)startDate;
+	for (unsigned long long i = 0; i < count; ++i)
+	{
+		unsigned long long encoded;
+		CMoney value;
+		if (!ReadVarint(cursor, end, &encoded) || !ReadAmount(cursor, end, version, &value))
+		{
+			return nullptr;
+		}
+		CTransaction::TransactionType type = (encoded & 1) ? CTransaction::PAYMENT : CTransaction::CHARGE;
+		unsigned long long zigzag = encoded >> 1;
+		long long difference = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+		previousTime += (time_t)difference;
+		if (!account->mTransactions->Insert(account->mTransactions->Size(), CTransaction(value, previousTime, type)))
+		{
+			return nullptr;
+		}
+	}
+
+	if (version != SERIALIZED_VERSION_FIXED_APR)
+	{
+		unsigned long long changes;
+		if (!ReadVarint(cursor, end, &changes))
+		{
+			return nullptr;
+		}
+		for (unsigned long long i = 0; i < changes; ++i)
+		{
+			unsigned long long day;
+			SRateChange change;
+			if (!ReadVarint(cursor, end, &day) || day > 0x7fffffff || !ReadRaw(cursor, end, &change.mAPR))
+			{
+				return nullptr;
+			}
+			change.mDay = (int)day;
+			account->mRateChanges.push_back(change);
+		}
+	}
+
+	account->mBalance = balance;
+	account->mBalanceDate = (time_t)balanceDate;
+	account->ReportMemoryUsage();
+	return account;
 }
 
 
@@ -579,10 +1458,16 @@ double CCreditCardAccount::GetCurrentBalance(time_t * transactionTime = nullptr)
  * \param value The value of the payment.
  * \param day The day relative to the account opening day that the payment occurred. 0 is opening day.
  * \returns True if successful. False otherwise. Most likely reason for a failure is if the payment would put the account in negative.
+ *		A payment before the opening day is never added.
  */
 bool CCreditCardAccount::AddPayment(double value, int day)
 {
-	return this->AddTransaction(value, day, CTransaction::PAYMENT);
+	bool added = this->AddTransaction(value, day, CTransaction::PAYMENT);
+	if (added)
+	{
+		this->ReportMemoryUsage();
+	}
+	return added;
 }
 
 /**
@@ -590,10 +1475,46 @@ bool CCreditCardAccount::AddPayment(double value, int day)
 * \param value The value of the charge.
 * \param day The day relative to the account opening day that the charge occurred. 0 is opening day.
 * \returns True if successful. False otherwise. Most likely reason for a failure is if the charge would put the account over the credit limit.
+*		A charge before the opening day is never added.
 */
 bool CCreditCardAccount::AddCharge(double value, int day)
 {
-	return this->AddTransaction(value, day, CTransaction::CHARGE);
+	bool added = this->AddTransaction(value, day, CTransaction::CHARGE);
+	if (added)
+	{
+		this->ReportMemoryUsage();
+	}
+	return added;
+}
+
+
+/**
+ * Add several charges and payments at once, in the order given. Each is accepted or declined exactly as AddCharge
+ * or AddPayment would, but the account's memory usage is reported once for the whole batch. Giving them in order
+ * by day keeps every one of them on the path of a transaction appended after the latest one.
+ * \param transactions The transactions.
+ * \param count How many transactions there are.
+ * \param added If not nullptr, receives for each transaction whether it was added. Room for count of them.
+ * \returns How many of the transactions were added.
+ */
+size_t CCreditCardAccount::AddTransactions(const SPendingTransaction * transactions, size_t count, bool * added)
+{
+	TRACE_SCOPE("AddTransactions");
+	size_t addedCount = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		bool result = this->AddTransaction(transactions[i].mValue, transactions[i].mDay, transactions[i].mType);
+		if (added != nullptr)
+		{
+			added[i] = result;
+		}
+		addedCount += result ? 1 : 0;
+	}
+	if (addedCount > 0)
+	{
+		this->ReportMemoryUsage();
+	}
+	return addedCount;
 }
 
 
@@ -604,23 +1525,208 @@ bool CCreditCardAccount::AddCharge(double value, int day)
  */
 double CCreditCardAccount::GetBalanceOnDay(int day)
 {
+	CEngineMetrics::ScopedTimer timer(CEngineMetrics::BALANCE_ON_DAY_NANOSECONDS);
+	CEngineMetrics::Increment(CEngineMetrics::BALANCE_QUERIES);
+	TRACE_SCOPE("GetBalanceOnDay");
+
 	time_t timeOfDay = CTimeHelper::AddDays(&this->mStartDate, day);
 	int cycleOfDay = GetCycle(timeOfDay, this->mStartDate);
 
-	// This isn't the same as the last calculated balance member variable!!
-	double startingBalance = 0.0;
+	// Every cycle before the one of the day is closed, so its balance is remembered. That leaves the transactions
+	// of this cycle up to the day, whose interest isn't added until the cycle closes.
+	CMoney balance = this->GetCycleStartBalance(cycleOfDay);
+
+	TRACE_BEGIN(lastOfDaySpan, "GetBalanceOnDay: last transaction of day");
+	TransactionIter cycleStart = this->FirstTransactionFromDay(cycleOfDay * DAYS_PER_CYCLE);
+	TransactionIter pastDay = this->FirstTransactionFromDay(day + 1);
+	TRACE_END(lastOfDaySpan);
+	if (cycleStart < pastDay)
+	{
+		balance = this->CalculateInRange(balance, cycleStart, pastDay, cycleOfDay);
+	}
+
+	if (CShadowVerifier::ShouldSample())
+	{
+		this->SubmitShadowSample(day, balance.ToDollars());
+	}
+	return balance.ToDollars();
+}
+
+
+/**
+ * Work out and remember everything GetBalanceOnDay and GetCurrentBalance would otherwise work out and remember
+ * the first time they are called: the latest balance, and the balance at the start of every cycle up to the one
+ * after the last transaction. Until the account changes again, neither of them changes the account after this,
+ * so any number of threads can call them at once. The statements aren't worked out; GetStatement still remembers
+ * them as it goes.
+ */
+void CCreditCardAccount::PrepareReads()
+{
+	this->GetLatestBalance();
+
+	// Asking for cycle 1 of an account with no transactions still allocates the caches and their first entry.
+	this->GetCycleStartBalance(std::max(this->GetCycleCount(), 1));
+}
+
 
-	TransactionIter lastOfDay = this->LastTransactionOfDay(day);
-	if (lastOfDay == this->mTransactions.end())
+/**
+ * Get the statement of a cycle: its opening balance, what was charged and paid, its interest and its closing
+ * balance. Statements are remembered, so asking for every cycle in turn walks the history once, and only a
+ * transaction or a change of APR in a cycle or before it makes its statement be worked out again.
+ * \param cycle The cycle. A cycle after the last transaction has nothing but interest.
+ * \param statement Receives the statement.
+ * \returns False if the cycle is before the opening of the account.
+ */
+bool CCreditCardAccount::GetStatement(int cycle, SStatement * statement)
+{
+	TRACE_SCOPE("GetStatement");
+	if (cycle < 0)
+	{
+		return false;
+	}
+	SCycleCaches & caches = this->GetCaches();
+
+	// The cycles after the last transaction change with every one appended, so they aren't remembered.
+	int lastCached = std::min(cycle, this->GetCycleCount() - 1);
+	if ((int)caches.mStatements.size() <= lastCached)
+	{
+		// One walk from the first statement that isn't known, each closing balance opening the next cycle.
+		int first = (int)caches.mStatements.size();
+		CMoney balance = this->GetCycleStartBalance(first);
+		TransactionIter start = this->FirstTransactionFromDay(first * DAYS_PER_CYCLE);
+		this->mTransactions->AdviseSequential(start, this->mTransactions->End());
+		for (int next = first; next <= lastCached; ++next)
+		{
+			TransactionIter end = this->FirstTransactionFromDay((next + 1) * DAYS_PER_CYCLE);
+			CEngineMetrics::Observe(CEngineMetrics::SCANNED_TRANSACTIONS, end.Index() - start.Index());
+			SStatement calculated;
+			balance = this->CalculateStatement(balance, start, end, next, &calculated);
+			caches.mStatements.push_back(calculated);
+
+			// The closing balance is the start of the next cycle, which mCycleBalances may as well keep.
+			if ((int)caches.mCycleBalances.size() == next + 1)
+			{
+				caches.mCycleBalances.push_back(balance);
+			}
+			start = end;
+		}
+		this->ReportMemoryUsage();
+	}
 
+	if (cycle < (int)caches.mStatements.size())
 	{
-		// There are no transactions to apply between the creation of the account and the day we are asking the balance 
-		// at the end of. So the balance should be zero. However, if for some reason you want to make them start with a 
-		// balance greater than zero, this line will apply the interest over the cycles that complete before the given day.
-		return this->CalculateInRange(startingBalance, this->mTransactions.end(), this->mTransactions.end(), cycleOfDay);
+		*statement = caches.mStatements[cycle];
 	}
 	else
 	{
-		return this->CalculateInRange(startingBalance, this->mTransactions.begin(), ++lastOfDay, cycleOfDay);
+		TransactionIter end = this->mTransactions->End();
+		this->CalculateStatement(this->GetCycleStartBalance(cycle), end, end, cycle, statement);
+	}
+	return true;
+}
+
+
+/**
+ * Get the statement of every cycle up to the one of the last transaction, in one walk over the history. Unlike
+ * GetStatement this doesn't remember the statements it works out, so going over many accounts once doesn't leave
+ * each of them holding on to its statements. The ones GetStatement already remembers are used as they are.
+ * \param statements Receives the statements, in order by cycle. Empty if there are no transactions.
+ */
+void CCreditCardAccount::GetStatements(std::vector<SStatement> & statements)
+{
+	TRACE_SCOPE("GetStatements");
+	statements.clear();
+	int cycleCount = this->GetCycleCount();
+	if (this->mCaches)
+	{
+		const std::vector<SStatement> & known = this->mCaches->mStatements;
+		statements.assign(known.begin(), known.begin() + std::min((size_t)cycleCount, known.size()));
+	}
+
+	int first = (int)statements.size();
+	if (first >= cycleCount)
+	{
+		return;
+	}
+	CMoney balance = this->GetCycleStartBalance(first);
+	TransactionIter start = this->FirstTransactionFromDay(first * DAYS_PER_CYCLE);
+	this->mTransactions->AdviseSequential(start, this->mTransactions->End());
+	for (int next = first; next < cycleCount; ++next)
+	{
+		TransactionIter end = this->FirstTransactionFromDay((next + 1) * DAYS_PER_CYCLE);
+		CEngineMetrics::Observe(CEngineMetrics::SCANNED_TRANSACTIONS, end.Index() - start.Index());
+		SStatement calculated;
+		balance = this->CalculateStatement(balance, start, end, next, &calculated);
+		statements.push_back(calculated);
+		start = end;
+	}
+}
+
+
+/**
+ * Get a view of the transactions made from one day to another. Nothing is copied, and the view is only good
+ * until a transaction is added to the account or taken back out.
+ * \param firstDay The first day, relative to the account opening day.
+ * \param lastDay The last day, included.
+ * \returns The transactions of those days in time order. Empty if lastDay is before firstDay.
+ */
+CTransactionRange CCreditCardAccount::GetTransactionsBetweenDays(int firstDay, int lastDay)
+{
+	if (lastDay < firstDay)
+	{
+		return CTransactionRange(this->mTransactions->End(), this->mTransactions->End());
 	}
-}
\ No newline at end of file
+	return CTransactionRange(this->FirstTransactionFromDay(firstDay), this->FirstTransactionFromDay(lastDay + 1));
+}
+
+
+/**
+ * Get a view of the transactions of a cycle. See GetTransactionsBetweenDays.
+ * \param cycle The cycle.
+ * \returns The transactions of the cycle in time order.
+ */
+CTransactionRange CCreditCardAccount::GetTransactionsInCycle(int cycle)
+{
+	return this->GetTransactionsBetweenDays(cycle * DAYS_PER_CYCLE, (cycle + 1) * DAYS_PER_CYCLE - 1);
+}
+
+
+/**
+ * Get what the balance would be on some days if the account had each of some other APRs, for pricing
+ * what-if evaluation. Each APR holds from opening on, in place of the account's APR schedule. The
+ * transactions are the ones this account accepted: they aren't checked against the credit limit again
+ * under the other APRs. The history is read once however many APRs there are.
+ * \param aprs The APRs to evaluate.
+ * \param days The days to get the balance at the end of, in any order.
+ * \param balances Receives the balances: the one for days[d] under aprs[a] is at d * aprs.size() + a.
+ */
+void CCreditCardAccount::GetBalancesOnDays(const std::vector<double> & aprs, const std::vector<int> & days, std::vector<double> & balances)
+{
+	TRACE_SCOPE("GetBalancesOnDays");
+
+	std::vector<CAprScenarios::SEvent> events;
+	events.reserve(this->mTransactions->Size());
+	this->mTransactions->AdviseSequential(this->mTransactions->Begin(), this->mTransactions->End());
+	for (TransactionIter transaction = this->mTransactions->Begin(); transaction != this->mTransactions->End(); ++transaction)
+	{
+		CMoney value = transaction->GetAmount();
+		CAprScenarios::SEvent event = { GetDayOfTransaction(transaction, this->mStartDate), (transaction->GetType() == CTransaction::CHARGE) ? value : -value };
+		events.push_back(event);
+	}
+	CAprScenarios::BalancesOnDays(events, aprs, days, balances);
+}
+
+
+/**
+ * Get the scalars portfolio queries filter accounts on, all at once.
+ * \param asOf The time the APR and the days until the cycle closes are for.
+ * \param summary Receives the scalars.
+ */
+void CCreditCardAccount::GetSummary(time_t asOf, SSummary * summary)
+{
+	int day = CTimeHelper::DiffDays(asOf, this->mStartDate);
+	summary->mBalance = this->GetCurrentBalance(nullptr);
+	summary->mAPR = this->GetAPROnDay(day);
+	summary->mCreditLimit = this->GetCreditLimit();
+	summary->mDaysToCycleClose = (day < 0) ? DAYS_PER_CYCLE - day : DAYS_PER_CYCLE - day % DAYS_PER_CYCLE;
+}
@@ -1,12 +1,15 @@
 #pragma once
 #include <memory>
 #include <ctime>
+#include "BalanceIndex.h"
+#include "Money.h"
 #include "Transaction.h"
-#include <vector>
+#include "TransactionRange.h"
+#include "TransactionStore.h"
 #include <iterator>
+#include <vector>
 
-typedef std::vector<std::shared_ptr<CTransaction>> TransactionVector;
-typedef TransactionVector::iterator TransactionIter;
+typedef CTransactionStore::Iterator TransactionIter;
 
 
 /**
@@ -23,9 +26,65 @@ public:
 	static int DayInCycle(time_t currentTime, time_t startTime);
 	static int GetDayOfTransaction(TransactionIter transaction, time_t startTime);
 
+	/**
+	 * What happened to the balance over one cycle. The closing balance is the opening balance of the next cycle.
+	 */
+	struct SStatement
+	{
+		/// The cycle.
+		int mCycle;
+
+		/// The balance when the cycle starts.
+		double mOpeningBalance;
+
+		/// All the charges made during the cycle added up.
+		double mCharges;
+
+		/// All the payments made during the cycle added up.
+		double mPayments;
+
+		/// The interest applied at the close of the cycle.
+		double mInterest;
+
+		/// The balance when the cycle closes, with its interest applied.
+		double mClosingBalance;
+	};
+
+	/**
+	 * A charge or payment for AddTransactions.
+	 */
+	struct SPendingTransaction
+	{
+		/// The value of the transaction.
+		double mValue;
+
+		/// How many days after the opening of the account it happened.
+		int mDay;
+
+		CTransaction::TransactionType mType;
+	};
+
+	/**
+	 * The scalars portfolio queries filter accounts on, as of some time. See GetSummary.
+	 */
+	struct SSummary
+	{
+		/// The balance as of the latest transaction. See GetCurrentBalance.
+		double mBalance;
+
+		/// The APR on the day of the summary, following the APR schedule.
+		double mAPR;
+
+		double mCreditLimit;
+
+		/// How many days from the day of the summary until the cycle it is in closes: 1 on the last day of a
+		/// cycle, up to 30 on the first. Before the account opens, the days until its first cycle closes.
+		int mDaysToCycleClose;
+	};
+
 private:
-	/// Container containing all charges and payments.
-	TransactionVector mTransactions;
+	/// Container containing all charges and payments. In memory unless the account was given another store.
+	std::unique_ptr<CTransactionStore> mTransactions;
 	
 	/// The start date of the account
 	time_t mStartDate;
@@ -34,28 +93,95 @@ private:
 	time_t mBalanceDate = -1;
 
 	/// The outstanding balance of the account, according to the time in mBalanceDate and calculated 
-	/// from the current members of mTransactions.
-	double mBalance = 0.0;
+	/// from the current members of mTransactions. Out of date while mBalanceStale is set; see GetLatestBalance.
+	CMoney mBalance;
+
+	/// True once a transaction inserted into the past has changed mBalance and it wasn't worked out again yet.
+	bool mBalanceStale = false;
 
 	/// The APR (interest rate).
 	double mAPR = 0.0;
 
 	/// The upper limit of the outstanding balance.
-	double mCreditLimit = 0.0;
+	CMoney mCreditLimit;
+
+	/**
+	 * A change of the APR. The new rate holds from mDay until the next change.
+	 */
+	struct SRateChange
+	{
+		int mDay;
+		double mAPR;
+	};
+
+	/// Changes of the APR since the account was opened, in order by day. mAPR holds until the first one.
+	std::vector<SRateChange> mRateChanges;
+
+	/**
+	 * What the account has worked out about its cycles, to answer the next question faster. Only an account that
+	 * has been asked about more than its current balance needs any of it, so it lives apart from the account
+	 * and is allocated the first time it is needed. That keeps an idle account within two cache lines.
+	 */
+	struct SCycleCaches
+	{
+		/// Entry c is the balance at the start of cycle c, with the interest of every earlier cycle applied.
+		/// Entries are worked out as balances are asked for, and dropped from the cycle of any change on.
+		std::vector<CMoney> mCycleBalances;
+
+		/// Entry c is the statement of cycle c. Statements are worked out as they are asked for, for cycles up to the
+		/// one of the last transaction, and dropped from the cycle of any change on.
+		std::vector<SStatement> mStatements;
+
+		/// For each cycle: the balance at its start; how far the highest balance after one of its transactions is over
+		/// the credit limit; and the lowest such balance. Every value is in dollars, divided by the cycle's entry in
+		/// mCycleGrowth. Cycles are filled in when a transaction is inserted into the past and dropped from the cycle of
+		/// a change on, except that a transaction inserted into the past moves the later cycles in place. That treats
+		/// interest as exact rather than rounded each day, so the values are only known to within mCycleIndexError.
+		CBalanceIndex mCycleIndex;
+
+		/// How far the values in mCycleIndex can be from the exact ones, in the same units.
+		double mCycleIndexError = 0.0;
+
+		/// Entry c is what a balance at the start of cycle 0 has grown to by the start of cycle c, with nothing but
+		/// interest. One entry for each cycle in mCycleIndex.
+		std::vector<double> mCycleGrowth;
+	};
+
+	/// What the account has worked out about its cycles, or nullptr if it hasn't been needed yet. See GetCaches.
+	std::unique_ptr<SCycleCaches> mCaches;
+
+	/// The memory usage of the account last reported to CEngineMetrics.
+	size_t mReportedBytes = 0;
 
 	TransactionIter FirstTransactionAfterCycleStart(int cycle);
 	TransactionIter CycleBegin(int cycle);
 	TransactionIter CycleEnd(int cycle);
 	TransactionIter LastTransactionOfDay(int day);
+	TransactionIter FirstTransactionFromDay(int day);
 	
 
 	bool AddTransaction(double value, int day, CTransaction::TransactionType type);
 
-	double GetEndDayInterest(double balance);
+	SCycleCaches & GetCaches();
+	CMoney GetEndDayInterest(CMoney balance, int day);
+	CMoney GetInterestOverDays(CMoney balance, int firstDay, int days);
+	CMoney GetCycleStartBalance(int cycle);
+	void FillCycleIndex(int cycle);
+	double GetRateOverDays(int firstDay, int days);
+	CMoney GetLatestBalance();
+	void SetCycleExtremes(int cycle, CMoney high, CMoney low);
+	void InvalidateFromDay(int day);
+	CMoney GetBalanceExtremes(CMoney balance, TransactionIter start, TransactionIter end, CMoney * high, CMoney * low);
+	bool ReplayExceedsLimit(int cycle, TransactionIter from, CTransaction::TransactionType type);
 
-	double CalculateCycle(double balance, TransactionIter start, TransactionIter end, bool justInterest);
+	void ReportMemoryUsage();
+
+	void SubmitShadowSample(int day, double balance);
+
+	CMoney CalculateCycle(CMoney balance, TransactionIter start, TransactionIter end, int cycle, bool justInterest);
+	CMoney CalculateStatement(CMoney balance, TransactionIter start, TransactionIter end, int cycle, SStatement * statement);
 	
-	double CalculateInRange(double balance, TransactionIter start, TransactionIter end, int cycleCount);
+	CMoney CalculateInRange(CMoney balance, TransactionIter start, TransactionIter end, int cycleCount);
 	
 	/**
 	 * This is a functor class. It is used to determine if a given transaction is
@@ -64,10 +190,10 @@ private:
 	 * Essentially it is used by the <algorithm> functions as a binary predicate. 
 	 * For an example, see std::find_if
 	 */
-	struct IsInCycle : std::unary_function<std::shared_ptr<CTransaction>, bool>
+	struct IsInCycle : std::unary_function<CTransaction, bool>
 	{
 		IsInCycle(const time_t startTime, const int cycle);
-		virtual bool operator() (const std::shared_ptr<CTransaction> & transaction) const;
+		virtual bool operator() (const CTransaction & transaction) const;
 
 		const time_t _startTime;
 		const int _cycle;
@@ -80,10 +206,10 @@ private:
 	* Essentially it is used by the <algorithm> functions as a binary predicate.
 	* For an example, see std::find_if
 	*/
-	struct IsPastDay : std::unary_function<std::shared_ptr<CTransaction>, bool>
+	struct IsPastDay : std::unary_function<CTransaction, bool>
 	{
 		IsPastDay(const time_t startTime, const int day);
-		bool operator() (const std::shared_ptr<CTransaction> & transaction) const;
+		bool operator() (const CTransaction & transaction) const;
 
 		const time_t _startTime;
 		const int _day;
@@ -99,7 +225,7 @@ private:
 	struct IsInOrPastCycle : IsInCycle
 	{
 		IsInOrPastCycle(const time_t startTime, const int cycle);
-		bool operator() (const std::shared_ptr<CTransaction> & transaction) const;
+		bool operator() (const CTransaction & transaction) const;
 
 	};
 
@@ -107,24 +233,38 @@ private:
 public:
 	// Never use the default constructor.
 	CCreditCardAccount() = delete;
-	// TODO: Implement the copy constructor. For now it is deleted.
-	CCreditCardAccount(const CCreditCardAccount &) = delete;
+	CCreditCardAccount(const CCreditCardAccount & other);
 	CCreditCardAccount(double apr, double limit, time_t startDate);
+	CCreditCardAccount(double apr, double limit, time_t startDate, std::unique_ptr<CTransactionStore> store);
 	virtual ~CCreditCardAccount();
 
 	int GetCycleCount();
 	size_t GetTransactionCount();
 	double GetAPR();
+	double GetAPROnDay(int day);
+	bool ScheduleAPR(double apr, int day);
 	double GetCreditLimit();
 	time_t GetStartDate();
 
 	double GetCurrentBalance(time_t *transactionTime);
+	size_t GetMemoryUsage();
+
+	void Serialize(std::vector<unsigned char> & buffer);
+	static std::shared_ptr<CCreditCardAccount> Deserialize(const unsigned char * data, size_t size);
 
 	bool AddPayment(double value, int day);
 	bool AddCharge(double value, int day);
+	size_t AddTransactions(const SPendingTransaction * transactions, size_t count, bool * added);
 
 	
 	double GetBalanceOnDay(int day);
+	void PrepareReads();
+	bool GetStatement(int cycle, SStatement * statement);
+	void GetStatements(std::vector<SStatement> & statements);
+	CTransactionRange GetTransactionsBetweenDays(int firstDay, int lastDay);
+	CTransactionRange GetTransactionsInCycle(int cycle);
+	void GetBalancesOnDays(const std::vector<double> & aprs, const std::vector<int> & days, std::vector<double> & balances);
+	void GetSummary(time_t asOf, SSummary * summary);
 
 	
 };
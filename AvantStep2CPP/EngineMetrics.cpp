@@ -0,0 +1,384 @@
+#include "EngineMetrics.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+using std::atomic;
+using std::string;
+using std::memory_order_relaxed;
+
+/// Prefix of every metric name in the text exposition.
+static const char * const METRIC_PREFIX = "avant_";
+
+
+/**
+ * The metrics recorded by one thread. Only that thread writes them, so it can add with a plain load and
+ * store. They're atomic only so other threads can read them while they're written.
+ */
+struct SThreadMetrics
+{
+	atomic<unsigned long long> mCounters[CEngineMetrics::COUNTER_COUNT];
+	atomic<long long> mGauges[CEngineMetrics::GAUGE_COUNT];
+
+	struct
+	{
+		atomic<unsigned long long> mBuckets[CEngineMetrics::BUCKET_COUNT];
+		atomic<unsigned long long> mCount;
+		atomic<unsigned long long> mSum;
+	} mHistograms[CEngineMetrics::HISTOGRAM_COUNT];
+
+	SThreadMetrics()
+	{
+		for (auto & counter : this->mCounters)
+		{
+			counter.store(0, memory_order_relaxed);
+		}
+		for (auto & gauge : this->mGauges)
+		{
+			gauge.store(0, memory_order_relaxed);
+		}
+		for (auto & histogram : this->mHistograms)
+		{
+			for (auto & bucket : histogram.mBuckets)
+			{
+				bucket.store(0, memory_order_relaxed);
+			}
+			histogram.mCount.store(0, memory_order_relaxed);
+			histogram.mSum.store(0, memory_order_relaxed);
+		}
+	}
+};
+
+
+/**
+ * Add to a value only the calling thread writes. Cheaper than fetch_add since it needs no locked instruction.
+ * \param value The value.
+ * \param amount How much to add.
+ */
+template <typename T>
+static void AddOwned(atomic<T> & value, T amount)
+{
+	value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+
+/**
+ * Every thread's metrics, and what threads that exited left behind.
+ */
+struct SMetricsRegistry
+{
+	std::mutex mLock;
+	std::vector<SThreadMetrics *> mThreads;
+
+	/// The metrics of threads that exited. Guarded by mLock.
+	SThreadMetrics mRetired;
+};
+
+/**
+ * \returns The registry. Created on first use so threads started during static initialization can record, and
+ *		never destroyed, since threads owned by other statics, like the checking thread of CShadowVerifier, still
+ *		retire their metrics into it while statics are being destroyed.
+ */
+static SMetricsRegistry & GetRegistry()
+{
+	static SMetricsRegistry * registry = new SMetricsRegistry;
+	return *registry;
+}
+
+
+/**
+ * Registers the calling thread's metrics while the thread lives, and folds them into the retired
+ * metrics when it exits.
+ */
+struct SThreadSlot
+{
+	SThreadMetrics mMetrics;
+
+	SThreadSlot()
+	{
+		SMetricsRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		registry.mThreads.push_back(&this->mMetrics);
+	}
+
+	~SThreadSlot()
+	{
+		SMetricsRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		SThreadMetrics & retired = registry.mRetired;
+		for (int i = 0; i < CEngineMetrics::COUNTER_COUNT; ++i)
+		{
+			retired.mCounters[i].fetch_add(this->mMetrics.mCounters[i].load(memory_order_relaxed), memory_order_relaxed);
+		}
+		for (int i = 0; i < CEngineMetrics::GAUGE_COUNT; ++i)
+		{
+			retired.mGauges[i].fetch_add(this->mMetrics.mGauges[i].load(memory_order_relaxed), memory_order_relaxed);
+		}
+		for (int i = 0; i < CEngineMetrics::HISTOGRAM_COUNT; ++i)
+		{
+			for (int b = 0; b < CEngineMetrics::BUCKET_COUNT; ++b)
+			{
+				retired.mHistograms[i].mBuckets[b].fetch_add(this->mMetrics.mHistograms[i].mBuckets[b].load(memory_order_relaxed), memory_order_relaxed);
+			}
+			retired.mHistograms[i].mCount.fetch_add(this->mMetrics.mHistograms[i].mCount.load(memory_order_relaxed), memory_order_relaxed);
+			retired.mHistograms[i].mSum.fetch_add(this->mMetrics.mHistograms[i].mSum.load(memory_order_relaxed), memory_order_relaxed);
+		}
+
+		for (size_t i = 0; i < registry.mThreads.size(); ++i)
+		{
+			if (registry.mThreads[i] == &this->mMetrics)
+			{
+				registry.mThreads[i] = registry.mThreads.back();
+				registry.mThreads.pop_back();
+				break;
+			}
+		}
+	}
+};
+
+
+/**
+ * \returns The calling thread's metrics.
+ */
+static SThreadMetrics & GetThreadMetrics()
+{
+	thread_local SThreadSlot slot;
+	return slot.mMetrics;
+}
+
+
+/**
+ * Count an event.
+ * \param counter What happened.
+ * \param amount How many times it happened.
+ */
+void CEngineMetrics::Increment(Counter counter, unsigned long long amount)
+{
+	AddOwned(GetThreadMetrics().mCounters[counter], amount);
+}
+
+
+/**
+ * Change a gauge. One thread may raise a gauge and another lower it; only the total across threads means anything.
+ * \param gauge The gauge.
+ * \param delta How much it changed by.
+ */
+void CEngineMetrics::Adjust(Gauge gauge, long long delta)
+{
+	AddOwned(GetThreadMetrics().mGauges[gauge], delta);
+}
+
+
+/**
+ * Record a value in a histogram.
+ * \param histogram The histogram.
+ * \param value The value.
+ */
+void CEngineMetrics::Observe(Histogram histogram, unsigned long long value)
+{
+	int bucket = 0;
+	for (unsigned long long rest = value; rest != 0; rest >>= 1)
+	{
+		++bucket;
+	}
+
+	SThreadMetrics & metrics = GetThreadMetrics();
+	AddOwned(metrics.mHistograms[histogram].mBuckets[bucket], 1ULL);
+	AddOwned(metrics.mHistograms[histogram].mCount, 1ULL);
+	AddOwned(metrics.mHistograms[histogram].mSum, value);
+}
+
+
+/**
+ * \param counter The counter.
+ * \returns How many times the event happened, across all threads, since the process started.
+ */
+unsigned long long CEngineMetrics::GetCounter(Counter counter)
+{
+	SMetricsRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+	unsigned long long total = registry.mRetired.mCounters[counter].load(memory_order_relaxed);
+	for (SThreadMetrics * metrics : registry.mThreads)
+	{
+		total += metrics->mCounters[counter].load(memory_order_relaxed);
+	}
+	return total;
+}
+
+
+/**
+ * \param gauge The gauge.
+ * \returns The current value of the gauge.
+ */
+long long CEngineMetrics::GetGauge(Gauge gauge)
+{
+	SMetricsRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+	long long total = registry.mRetired.mGauges[gauge].load(memory_order_relaxed);
+	for (SThreadMetrics * metrics : registry.mThreads)
+	{
+		total += metrics->mGauges[gauge].load(memory_order_relaxed);
+	}
+	return total;
+}
+
+
+/**
+ * \param histogram The histogram.
+ * \returns Everything recorded in the histogram, across all threads, since the process started.
+ */
+CEngineMetrics::SHistogramSnapshot CEngineMetrics::GetHistogram(Histogram histogram)
+{
+	SHistogramSnapshot snapshot = {};
+	SMetricsRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+
+	auto addThread = [&](SThreadMetrics & metrics)
+	{
+		for (int b = 0; b < BUCKET_COUNT; ++b)
+		{
+			snapshot.mBuckets[b] += metrics.mHistograms[histogram].mBuckets[b].load(memory_order_relaxed);
+		}
+		snapshot.mCount += metrics.mHistograms[histogram].mCount.load(memory_order_relaxed);
+		snapshot.mSum += metrics.mHistograms[histogram].mSum.load(memory_order_relaxed);
+	};
+
+	addThread(registry.mRetired);
+	for (SThreadMetrics * metrics : registry.mThreads)
+	{
+		addThread(*metrics);
+	}
+	return snapshot;
+}
+
+
+/**
+ * Write every metric in the Prometheus text exposition format.
+ * \param stream Where to write.
+ */
+void CEngineMetrics::WriteText(std::ostream & stream)
+{
+	static const char * const pathNames[] = { "append", "cycle_crossing", "backdated" };
+	stream << "# HELP " << METRIC_PREFIX << "transactions_total Transactions added, by the path AddTransaction took.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "transactions_total counter\n";
+	for (int i = APPEND_TRANSACTIONS; i <= BACKDATED_TRANSACTIONS; ++i)
+	{
+		stream << METRIC_PREFIX << "transactions_total{path=\"" << pathNames[i] << "\"} " << GetCounter((Counter)i) << "\n";
+	}
+
+	stream << "# HELP " << METRIC_PREFIX << "declined_transactions_total Transactions rejected by the credit limit or a negative balance.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "declined_transactions_total counter\n";
+	stream << METRIC_PREFIX << "declined_transactions_total " << GetCounter(DECLINED_TRANSACTIONS) << "\n";
+
+	stream << "# HELP " << METRIC_PREFIX << "balance_queries_total Calls to GetBalanceOnDay.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "balance_queries_total counter\n";
+	stream << METRIC_PREFIX << "balance_queries_total " << GetCounter(BALANCE_QUERIES) << "\n";
+
+	stream << "# HELP " << METRIC_PREFIX << "ingestion_backpressure_waits_total Ingestion pushes that found their queue full.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "ingestion_backpressure_waits_total counter\n";
+	stream << METRIC_PREFIX << "ingestion_backpressure_waits_total " << GetCounter(INGESTION_BACKPRESSURE_WAITS) << "\n";
+
+	stream << "# HELP " << METRIC_PREFIX << "shadow_samples_total Balance calculations sampled for shadow verification, by whether they were checked.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "shadow_samples_total counter\n";
+	stream << METRIC_PREFIX << "shadow_samples_total{outcome=\"verified\"} " << GetCounter(SHADOW_VERIFIED_SAMPLES) << "\n";
+	stream << METRIC_PREFIX << "shadow_samples_total{outcome=\"dropped\"} " << GetCounter(SHADOW_DROPPED_SAMPLES) << "\n";
+	stream << "# HELP " << METRIC_PREFIX << "shadow_mismatches_total Balance calculations that disagreed with the reference calculation.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "shadow_mismatches_total counter\n";
+	stream << METRIC_PREFIX << "shadow_mismatches_total " << GetCounter(SHADOW_MISMATCHES) << "\n";
+
+	long long accounts = GetGauge(ACCOUNTS);
+	long long bytes = GetGauge(ACCOUNT_BYTES);
+	stream << "# HELP " << METRIC_PREFIX << "accounts Accounts in memory.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "accounts gauge\n";
+	stream << METRIC_PREFIX << "accounts " << accounts << "\n";
+	stream << "# HELP " << METRIC_PREFIX << "account_bytes Memory used by the accounts in memory.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "account_bytes gauge\n";
+	stream << METRIC_PREFIX << "account_bytes " << bytes << "\n";
+	stream << "# HELP " << METRIC_PREFIX << "account_bytes_per_account Average memory used by one account.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "account_bytes_per_account gauge\n";
+	stream << METRIC_PREFIX << "account_bytes_per_account " << (accounts > 0 ? bytes / accounts : 0) << "\n";
+	stream << "# HELP " << METRIC_PREFIX << "ingestion_queue_depth Records waiting in ingestion queues.\n";
+	stream << "# TYPE " << METRIC_PREFIX << "ingestion_queue_depth gauge\n";
+	stream << METRIC_PREFIX << "ingestion_queue_depth " << GetGauge(INGESTION_QUEUE_DEPTH) << "\n";
+
+	static const char * const histogramNames[] = { "scanned_transactions", "add_transaction_nanoseconds", "balance_on_day_nanoseconds", "combined_batch_size",
+		"ingestion_batch_size", "ingestion_latency_nanoseconds" };
+	static const char * const histogramHelp[] = {
+		"Transactions each balance calculation went through.",
+		"Time taken by AddPayment and AddCharge.",
+		"Time taken by GetBalanceOnDay.",
+		"Writes applied together by each combined batch of a concurrent account.",
+		"Records each ingestion applier took from its queue at once.",
+		"Time records waited between being pushed and being applied."
+	};
+	for (int i = 0; i < HISTOGRAM_COUNT; ++i)
+	{
+		SHistogramSnapshot snapshot = GetHistogram((Histogram)i);
+		string name = string(METRIC_PREFIX) + histogramNames[i];
+		stream << "# HELP " << name << " " << histogramHelp[i] << "\n";
+		stream << "# TYPE " << name << " histogram\n";
+
+		int lastBucket = BUCKET_COUNT - 1;
+		while (lastBucket > 0 && snapshot.mBuckets[lastBucket] == 0)
+		{
+			--lastBucket;
+		}
+		unsigned long long cumulative = 0;
+		for (int b = 0; b <= lastBucket && b < BUCKET_COUNT - 1; ++b)
+		{
+			cumulative += snapshot.mBuckets[b];
+			unsigned long long upperBound = (b == 0) ? 0 : (1ULL << b) - 1;
+			stream << name << "_bucket{le=\"" << upperBound << "\"} " << cumulative << "\n";
+		}
+		stream << name << "_bucket{le=\"+Inf\"} " << snapshot.mCount << "\n";
+		stream << name << "_sum " << snapshot.mSum << "\n";
+		stream << name << "_count " << snapshot.mCount << "\n";
+	}
+}
+
+
+/**
+ * Write every metric to a file for a scraper to pick up. The file is replaced in one step, so a reader
+ * never sees half of it.
+ * \param path The file.
+ * \returns True if the file was written.
+ */
+bool CEngineMetrics::WriteTextFile(const string & path)
+{
+	string temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+		WriteText(file);
+		if (!file)
+		{
+			return false;
+		}
+	}
+	// rename doesn't replace an existing file on Windows.
+	std::remove(path.c_str());
+	return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+
+/**
+ * Constructor. Starts timing.
+ * \param histogram The histogram the time is recorded in, in nanoseconds.
+ */
+CEngineMetrics::ScopedTimer::ScopedTimer(Histogram histogram) : mHistogram(histogram), mStart(std::chrono::steady_clock::now())
+{
+}
+
+
+/**
+ * Destructor. Records the time since the constructor.
+ */
+CEngineMetrics::ScopedTimer::~ScopedTimer()
+{
+	auto elapsed = std::chrono::steady_clock::now() - this->mStart;
+	CEngineMetrics::Observe(this->mHistogram, (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+
+
+/**
+ * Counters, gauges and histograms describing what the account engine is doing: which path each
+ * transaction took, how many transactions each balance calculation went through, how long operations
+ * took, and how much memory the accounts hold.
+ *
+ * Recording is cheap enough to leave on in production. Every thread records into its own block with
+ * plain relaxed stores, so threads never contend, and the blocks are only added up when the metrics
+ * are read. Blocks of threads that exit are folded into a shared total so nothing is lost.
+ */
+class CEngineMetrics
+{
+public:
+	/// Events that are counted.
+	enum Counter
+	{
+		/// A transaction added after every other one, in the same cycle as the last.
+		APPEND_TRANSACTIONS,
+		/// A transaction added after every other one, in a later cycle than the last.
+		CYCLE_CROSSING_TRANSACTIONS,
+		/// A transaction added before the last one, which recalculates the balance from scratch.
+		BACKDATED_TRANSACTIONS,
+		/// A transaction rejected because of the credit limit or a negative balance.
+		DECLINED_TRANSACTIONS,
+		/// A call to GetBalanceOnDay.
+		BALANCE_QUERIES,
+		/// A push to a CIngestionPipeline that found its queue full and had to wait.
+		INGESTION_BACKPRESSURE_WAITS,
+		/// A balance calculation CShadowVerifier checked against the reference calculation.
+		SHADOW_VERIFIED_SAMPLES,
+		/// A sampled balance calculation CShadowVerifier had no room to queue, so it wasn't checked.
+		SHADOW_DROPPED_SAMPLES,
+		/// A balance calculation that disagreed with the reference calculation.
+		SHADOW_MISMATCHES,
+		COUNTER_COUNT
+	};
+
+	/// Values that go up and down.
+	enum Gauge
+	{
+		/// How many accounts exist.
+		ACCOUNTS,
+		/// How much memory those accounts use, transactions included.
+		ACCOUNT_BYTES,
+		/// How many records are waiting in the queues of every CIngestionPipeline.
+		INGESTION_QUEUE_DEPTH,
+		GAUGE_COUNT
+	};
+
+	/// Distributions that are recorded.
+	enum Histogram
+	{
+		/// How many transactions each balance calculation went through.
+		SCANNED_TRANSACTIONS,
+		/// How long each AddPayment or AddCharge took, in nanoseconds.
+		ADD_TRANSACTION_NANOSECONDS,
+		/// How long each GetBalanceOnDay took, in nanoseconds.
+		BALANCE_ON_DAY_NANOSECONDS,
+		/// How many writes each combined batch of a CConcurrentAccount applied.
+		COMBINED_BATCH_SIZE,
+		/// How many records an ingestion applier took from its queue at once.
+		INGESTION_BATCH_SIZE,
+		/// How long records waited between being pushed and being applied, in nanoseconds.
+		INGESTION_LATENCY_NANOSECONDS,
+		HISTOGRAM_COUNT
+	};
+
+	/// Bucket i of a histogram holds the values that are i bits wide: 0, 1, 2-3, 4-7, and so on.
+	static const int BUCKET_COUNT = 65;
+
+	/**
+	 * The contents of a histogram at one point in time.
+	 */
+	struct SHistogramSnapshot
+	{
+		unsigned long long mBuckets[BUCKET_COUNT];
+		unsigned long long mCount;
+		unsigned long long mSum;
+	};
+
+	/**
+	 * Records how long the scope it lives in took into a histogram.
+	 */
+	class ScopedTimer
+	{
+	private:
+		Histogram mHistogram;
+		std::chrono::steady_clock::time_point mStart;
+
+	public:
+		ScopedTimer(Histogram histogram);
+		ScopedTimer(const ScopedTimer &) = delete;
+		~ScopedTimer();
+	};
+
+	static void Increment(Counter counter, unsigned long long amount = 1);
+	static void Adjust(Gauge gauge, long long delta);
+	static void Observe(Histogram histogram, unsigned long long value);
+
+	static unsigned long long GetCounter(Counter counter);
+	static long long GetGauge(Gauge gauge);
+	static SHistogramSnapshot GetHistogram(Histogram histogram);
+
+	static void WriteText(std::ostream & stream);
+	static bool WriteTextFile(const std::string & path);
+
+	CEngineMetrics() = delete;
+};
@@ -0,0 +1,257 @@
+#include "EpochManager.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+using std::atomic;
+using std::vector;
+
+/// The epoch a thread announces while it holds no guard.
+const unsigned long long IDLE_EPOCH = ~0ULL;
+
+
+/**
+ * A thread that holds, or has held, guards.
+ */
+struct SParticipant
+{
+	/// The epoch this thread's outermost guard started in, or IDLE_EPOCH.
+	atomic<unsigned long long> mEpoch;
+
+	/// How many guards this thread holds. Only the thread itself uses it.
+	int mDepth = 0;
+
+	/// False once the thread exits, so another thread can take this participant over.
+	bool mInUse = true;
+
+	SParticipant() : mEpoch(IDLE_EPOCH) {}
+};
+
+
+/**
+ * An object waiting to be deleted.
+ */
+struct SRetired
+{
+	void * mObject;
+	void(*mDeleter)(void *);
+
+	/// The global epoch when the object was retired.
+	unsigned long long mEpoch;
+};
+
+
+/**
+ * Every participant and everything waiting to be deleted.
+ */
+struct SEpochRegistry
+{
+	std::mutex mLock;
+
+	/// Never shrinks, so readers can keep pointers into it. Guarded by mLock.
+	vector<std::unique_ptr<SParticipant>> mParticipants;
+
+	/// Guarded by mLock.
+	vector<SRetired> mRetired;
+
+	atomic<unsigned long long> mGlobalEpoch;
+
+	SEpochRegistry() : mGlobalEpoch(0) {}
+
+	/// Nothing can be reading at exit, so whatever is left is deleted.
+	~SEpochRegistry()
+	{
+		for (SRetired & retired : this->mRetired)
+		{
+			retired.mDeleter(retired.mObject);
+		}
+	}
+};
+
+/**
+ * \returns The registry.
+ */
+static SEpochRegistry & GetRegistry()
+{
+	static SEpochRegistry registry;
+	return registry;
+}
+
+
+/**
+ * Holds the calling thread's participant while the thread lives.
+ */
+struct SParticipantSlot
+{
+	SParticipant * mParticipant = nullptr;
+
+	SParticipantSlot()
+	{
+		SEpochRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		for (std::unique_ptr<SParticipant> & participant : registry.mParticipants)
+		{
+			if (!participant->mInUse)
+			{
+				participant->mInUse = true;
+				this->mParticipant = participant.get();
+				return;
+			}
+		}
+		registry.mParticipants.emplace_back(new SParticipant());
+		this->mParticipant = registry.mParticipants.back().get();
+	}
+
+	~SParticipantSlot()
+	{
+		SEpochRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		this->mParticipant->mEpoch.store(IDLE_EPOCH);
+		this->mParticipant->mDepth = 0;
+		this->mParticipant->mInUse = false;
+	}
+};
+
+/**
+ * \returns The calling thread's participant.
+ */
+static SParticipant & GetParticipant()
+{
+	thread_local SParticipantSlot slot;
+	return *slot.mParticipant;
+}
+
+
+/**
+ * Move the global epoch on if every guard has caught up with it, and take out what can be deleted.
+ * The registry lock must be held.
+ * \param registry The registry.
+ * \param reclaimable Where the objects that can be deleted are moved.
+ */
+static void AdvanceLocked(SEpochRegistry & registry, vector<SRetired> & reclaimable)
+{
+	unsigned long long global = registry.mGlobalEpoch.load();
+	bool caughtUp = true;
+	for (std::unique_ptr<SParticipant> & participant : registry.mParticipants)
+	{
+		unsigned long long epoch = participant->mEpoch.load();
+		if (epoch != IDLE_EPOCH && epoch != global)
+		{
+			caughtUp = false;
+			break;
+		}
+	}
+	if (caughtUp)
+	{
+		registry.mGlobalEpoch.store(++global);
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < registry.mRetired.size(); ++i)
+	{
+		if (registry.mRetired[i].mEpoch + 2 <= global)
+		{
+			reclaimable.push_back(registry.mRetired[i]);
+		}
+		else
+		{
+			registry.mRetired[kept++] = registry.mRetired[i];
+		}
+	}
+	registry.mRetired.resize(kept);
+}
+
+
+/**
+ * Constructor. Announces the current epoch, unless the thread already holds a guard.
+ */
+CEpochManager::Guard::Guard()
+{
+	SParticipant & participant = GetParticipant();
+	if (participant.mDepth++ > 0)
+	{
+		return;
+	}
+
+	// Announce, then check the epoch didn't move in the meantime. A stale announcement is still safe,
+	// but it would hold the epoch back until the guard is released.
+	SEpochRegistry & registry = GetRegistry();
+	unsigned long long epoch = registry.mGlobalEpoch.load();
+	while (true)
+	{
+		participant.mEpoch.store(epoch);
+		unsigned long long current = registry.mGlobalEpoch.load();
+		if (current == epoch)
+		{
+			break;
+		}
+		epoch = current;
+	}
+}
+
+
+/**
+ * Destructor. Once the thread's outermost guard is released it no longer holds anything back.
+ */
+CEpochManager::Guard::~Guard()
+{
+	SParticipant & participant = GetParticipant();
+	if (--participant.mDepth == 0)
+	{
+		participant.mEpoch.store(IDLE_EPOCH, std::memory_order_release);
+	}
+}
+
+
+/**
+ * Delete an object once no guard can still be using it. Use Retire, which supplies the deleter.
+ * \param object The object. Must already be unreachable for new readers.
+ * \param deleter Deletes the object.
+ */
+void CEpochManager::RetireObject(void * object, void(*deleter)(void *))
+{
+	vector<SRetired> reclaimable;
+	{
+		SEpochRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		registry.mRetired.push_back(SRetired{ object, deleter, registry.mGlobalEpoch.load() });
+		AdvanceLocked(registry, reclaimable);
+	}
+
+	// Deleted outside the lock, in case a destructor retires something itself.
+	for (SRetired & retired : reclaimable)
+	{
+		retired.mDeleter(retired.mObject);
+	}
+}
+
+
+/**
+ * Delete whatever can be deleted now. Retire does this too, so only call this when nothing has been
+ * retired in a while and the memory should be given back.
+ */
+void CEpochManager::Reclaim()
+{
+	vector<SRetired> reclaimable;
+	{
+		SEpochRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		AdvanceLocked(registry, reclaimable);
+		AdvanceLocked(registry, reclaimable);
+	}
+	for (SRetired & retired : reclaimable)
+	{
+		retired.mDeleter(retired.mObject);
+	}
+}
+
+
+/**
+ * \returns How many retired objects haven't been deleted yet.
+ */
+size_t CEpochManager::GetPendingCount()
+{
+	SEpochRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+	return registry.mRetired.size();
+}
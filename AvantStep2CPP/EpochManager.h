@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+
+
+/**
+ * Epoch-based reclamation, so readers can use objects that writers replace without taking a lock.
+ *
+ * A reader holds a Guard while it uses a shared object. A writer that replaces the object hands the old
+ * one to Retire instead of deleting it. Every guard announces the epoch it started in, and the global epoch
+ * only moves on once no guard is left in an older one. An object retired in epoch E is deleted once the
+ * global epoch reaches E + 2, when no guard can still be using it.
+ *
+ * Readers never block. Retire takes a lock, so it is meant for writers that already serialize.
+ */
+class CEpochManager
+{
+public:
+	/**
+	 * Keeps every object the calling thread can see from being deleted while it exists. Guards nest.
+	 */
+	class Guard
+	{
+	public:
+		Guard();
+		Guard(const Guard &) = delete;
+		~Guard();
+	};
+
+	/**
+	 * Delete an object once no guard can still be using it.
+	 * \param object The object. Must already be unreachable for new readers.
+	 */
+	template <typename T>
+	static void Retire(T * object)
+	{
+		RetireObject(object, [](void * retired) { delete static_cast<T *>(retired); });
+	}
+
+	static void RetireObject(void * object, void(*deleter)(void *));
+	static void Reclaim();
+	static size_t GetPendingCount();
+
+	CEpochManager() = delete;
+};
@@ -0,0 +1,77 @@
+#include "FileAccountStore.h"
+#include <fstream>
+#include <cstdio>
+using std::string;
+using std::ifstream;
+using std::ofstream;
+
+
+/**
+ * Constructor.
+ * \param directory The directory the account files go in.
+ */
+CFileAccountStore::CFileAccountStore(const string & directory) : mDirectory(directory)
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CFileAccountStore::~CFileAccountStore()
+{
+}
+
+
+/**
+ * \param id The account.
+ * \returns The path of the file the account is kept in.
+ */
+string CFileAccountStore::GetPath(AccountId id)
+{
+	return this->mDirectory + "/" + std::to_string(id) + ".account";
+}
+
+
+/**
+ * Read a serialized account.
+ * \param id The account to read.
+ * \param buffer Receives the serialized account.
+ * \returns True if the account's file was found and read.
+ */
+bool CFileAccountStore::Load(AccountId id, std::vector<unsigned char> & buffer)
+{
+	ifstream file(this->GetPath(id), std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		return false;
+	}
+	std::streamoff size = file.tellg();
+	file.seekg(0);
+	buffer.resize((size_t)size);
+	return (bool)file.read((char *)buffer.data(), size);
+}
+
+
+/**
+ * Write a serialized account, replacing whatever was stored for it before. The account is written
+ * to a temporary file first and then renamed, so a crash never leaves half an account behind.
+ * \param id The account to write.
+ * \param buffer The serialized account.
+ * \returns True if the account was written.
+ */
+bool CFileAccountStore::Save(AccountId id, const std::vector<unsigned char> & buffer)
+{
+	string path = this->GetPath(id);
+	string temporaryPath = path + ".tmp";
+	{
+		ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file || !file.write((const char *)buffer.data(), (std::streamsize)buffer.size()))
+		{
+			return false;
+		}
+	}
+	// rename doesn't replace an existing file on Windows.
+	remove(path.c_str());
+	return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include "AccountStore.h"
+
+
+/**
+ * Account store that keeps each serialized account in its own file in a directory.
+ * The directory has to exist already.
+ */
+class CFileAccountStore : public CAccountStore
+{
+private:
+	/// The directory the account files are in.
+	std::string mDirectory;
+
+	std::string GetPath(AccountId id);
+
+public:
+	CFileAccountStore(const std::string & directory);
+	virtual ~CFileAccountStore();
+
+	virtual bool Load(AccountId id, std::vector<unsigned char> & buffer) override;
+	virtual bool Save(AccountId id, const std::vector<unsigned char> & buffer) override;
+};
@@ -0,0 +1,279 @@
+#include "IngestionPipeline.h"
+#include <chrono>
+#include "EngineMetrics.h"
+#include "Tracing.h"
+using std::shared_ptr;
+using std::vector;
+
+/// How many times a full queue or an idle applier spins before it starts yielding.
+const int SPIN_LIMIT = 64;
+
+/// How many times it yields before it starts sleeping.
+const int YIELD_LIMIT = 128;
+
+/// How long it sleeps at a time once it does.
+const std::chrono::microseconds BACKOFF_SLEEP(50);
+
+
+/**
+ * Wait a little longer each time something that should happen soon hasn't happened yet.
+ * \param attempt How many times the caller has waited so far. Incremented.
+ */
+static void Backoff(int & attempt)
+{
+	if (attempt < SPIN_LIMIT)
+	{
+		// Busy wait, in case the other side is about to finish.
+	}
+	else if (attempt < SPIN_LIMIT + YIELD_LIMIT)
+	{
+		std::this_thread::yield();
+	}
+	else
+	{
+		std::this_thread::sleep_for(BACKOFF_SLEEP);
+	}
+	++attempt;
+}
+
+
+/**
+ * Constructor. Starts one applier thread per shard.
+ * \param accounts Where the transactions are applied.
+ * \param shardCount How many queues and applier threads there are. At least one.
+ * \param queueCapacity The most records each queue holds before pushes have to wait.
+ * \param maxBatch The most records an applier takes from its queue at once.
+ */
+CIngestionPipeline::CIngestionPipeline(shared_ptr<CAccountCache> accounts, size_t shardCount, size_t queueCapacity, size_t maxBatch) :
+	mAccounts(accounts), mMaxBatch(maxBatch > 0 ? maxBatch : 1), mStopping(false), mAccepted(0), mDeclined(0), mFullQueues(0)
+{
+	if (shardCount == 0)
+	{
+		shardCount = 1;
+	}
+	for (size_t i = 0; i < shardCount; ++i)
+	{
+		this->mShards.emplace_back(new SShard(queueCapacity));
+	}
+
+	// Only start the appliers once every shard exists.
+	for (std::unique_ptr<SShard> & shard : this->mShards)
+	{
+		shard->mApplier = std::thread(&CIngestionPipeline::RunApplier, this, shard.get());
+	}
+}
+
+
+/**
+ * Destructor. Applies whatever is still queued first.
+ */
+CIngestionPipeline::~CIngestionPipeline()
+{
+	this->Stop();
+}
+
+
+/**
+ * \param id An account.
+ * \returns The shard that account's transactions go through.
+ */
+CIngestionPipeline::SShard & CIngestionPipeline::GetShard(AccountId id)
+{
+	return *this->mShards[id % this->mShards.size()];
+}
+
+
+/**
+ * Queue a transaction, waiting for room if its shard's queue is full. Safe to call from several
+ * threads at once. Must not be called after Stop.
+ * \param record The transaction.
+ */
+void CIngestionPipeline::Push(const SRecord & record)
+{
+	SShard & shard = this->GetShard(record.mAccount);
+	SRecord stamped = record;
+	stamped.mPushedNanoseconds = CTracing::Now();
+	if (shard.mQueue.TryPush(stamped))
+	{
+		CEngineMetrics::Adjust(CEngineMetrics::INGESTION_QUEUE_DEPTH, 1);
+		return;
+	}
+
+	this->mFullQueues++;
+	CEngineMetrics::Increment(CEngineMetrics::INGESTION_BACKPRESSURE_WAITS);
+	int attempt = 0;
+	do
+	{
+		Backoff(attempt);
+	} while (!shard.mQueue.TryPush(stamped));
+	CEngineMetrics::Adjust(CEngineMetrics::INGESTION_QUEUE_DEPTH, 1);
+}
+
+
+/**
+ * Queue a transaction if there is room for it. Safe to call from several threads at once.
+ * Must not be called after Stop.
+ * \param record The transaction.
+ * \returns False if the shard's queue is full. Nothing was queued.
+ */
+bool CIngestionPipeline::TryPush(const SRecord & record)
+{
+	SRecord stamped = record;
+	stamped.mPushedNanoseconds = CTracing::Now();
+	if (!this->GetShard(record.mAccount).mQueue.TryPush(stamped))
+	{
+		this->mFullQueues++;
+		return false;
+	}
+	CEngineMetrics::Adjust(CEngineMetrics::INGESTION_QUEUE_DEPTH, 1);
+	return true;
+}
+
+
+/**
+ * Apply everything that is queued, then stop the appliers. Nothing may be pushed while or after this runs.
+ */
+void CIngestionPipeline::Stop()
+{
+	this->mStopping = true;
+	for (std::unique_ptr<SShard> & shard : this->mShards)
+	{
+		if (shard->mApplier.joinable())
+		{
+			shard->mApplier.join();
+		}
+	}
+}
+
+
+/**
+ * Body of a shard's applier thread. Drains the queue in batches until Stop is called and the queue is empty.
+ * \param shard The shard to drain.
+ */
+void CIngestionPipeline::RunApplier(SShard * shard)
+{
+	vector<SRecord> batch;
+	SRecord record;
+	int idle = 0;
+	while (true)
+	{
+		// Read the flag before draining, so a record pushed before Stop is always applied.
+		bool stopping = this->mStopping;
+		size_t maxBatch = this->mMaxBatch.load(std::memory_order_relaxed);
+		batch.clear();
+		while (batch.size() < maxBatch && shard->mQueue.TryPop(record))
+		{
+			batch.push_back(record);
+		}
+
+		if (batch.empty())
+		{
+			if (stopping)
+			{
+				return;
+			}
+			Backoff(idle);
+			continue;
+		}
+
+		idle = 0;
+		CEngineMetrics::Adjust(CEngineMetrics::INGESTION_QUEUE_DEPTH, -(long long)batch.size());
+		CEngineMetrics::Observe(CEngineMetrics::INGESTION_BATCH_SIZE, batch.size());
+		this->ApplyBatch(batch);
+	}
+}
+
+
+/**
+ * Apply a batch of records to their accounts, in the order they were queued.
+ * \param batch The records.
+ */
+void CIngestionPipeline::ApplyBatch(const vector<SRecord> & batch)
+{
+	TRACE_SCOPE("IngestionPipeline: apply batch");
+	for (const SRecord & record : batch)
+	{
+		bool added = (record.mType == CTransaction::CHARGE) ?
+			this->mAccounts->AddCharge(record.mAccount, record.mValue, record.mDay) :
+			this->mAccounts->AddPayment(record.mAccount, record.mValue, record.mDay);
+		if (added)
+		{
+			this->mAccepted++;
+		}
+		else
+		{
+			this->mDeclined++;
+		}
+		CEngineMetrics::Observe(CEngineMetrics::INGESTION_LATENCY_NANOSECONDS, CTracing::Now() - record.mPushedNanoseconds);
+	}
+}
+
+
+/**
+ * Change how many records an applier takes from its queue at once. Larger batches cost fewer wakeups
+ * per record, smaller ones keep latency down. Takes effect with each applier's next batch.
+ * \param maxBatch The most records per batch. At least one.
+ */
+void CIngestionPipeline::SetMaxBatch(size_t maxBatch)
+{
+	this->mMaxBatch = maxBatch > 0 ? maxBatch : 1;
+}
+
+
+/**
+ * \returns The most records an applier takes from its queue at once.
+ */
+size_t CIngestionPipeline::GetMaxBatch()
+{
+	return this->mMaxBatch;
+}
+
+
+/**
+ * \returns How many queues and applier threads there are.
+ */
+size_t CIngestionPipeline::GetShardCount()
+{
+	return this->mShards.size();
+}
+
+
+/**
+ * \returns Roughly how many records are waiting in all the queues.
+ */
+size_t CIngestionPipeline::GetQueueDepth()
+{
+	size_t depth = 0;
+	for (std::unique_ptr<SShard> & shard : this->mShards)
+	{
+		depth += shard->mQueue.GetDepth();
+	}
+	return depth;
+}
+
+
+/**
+ * \returns How many records were applied and accepted.
+ */
+unsigned long long CIngestionPipeline::GetAcceptedCount()
+{
+	return this->mAccepted;
+}
+
+
+/**
+ * \returns How many records were applied and declined, including ones for accounts that don't exist.
+ */
+unsigned long long CIngestionPipeline::GetDeclinedCount()
+{
+	return this->mDeclined;
+}
+
+
+/**
+ * \returns How many pushes found their queue full, whether they waited or gave up.
+ */
+unsigned long long CIngestionPipeline::GetFullQueueCount()
+{
+	return this->mFullQueues;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "AccountCache.h"
+#include "AccountStore.h"
+#include "RingBuffer.h"
+#include "Transaction.h"
+
+
+/**
+ * Moves transactions from the threads that parse them to the threads that apply them to accounts.
+ *
+ * Accounts are split into shards by id, and every shard has a bounded lock-free queue and one applier
+ * thread. Parser threads push fixed-size records onto the queue of the record's shard, and the shard's
+ * applier drains them in batches into the account cache. Since an account always lands on the same shard,
+ * its transactions are applied in the order they were pushed, and appliers never wait on each other.
+ *
+ * When a queue is full, Push waits for the applier to catch up (spinning, then yielding, then sleeping),
+ * so parsers slow down to the rate the accounts can be updated at. TryPush gives up instead.
+ */
+class CIngestionPipeline
+{
+public:
+	/**
+	 * One transaction on its way to an account. Plain data, so it can be copied in and out of a queue.
+	 */
+	struct SRecord
+	{
+		AccountId mAccount;
+		double mValue;
+		int mDay;
+		CTransaction::TransactionType mType;
+
+		/// When the record was pushed, from CTracing::Now. Filled in by the pipeline.
+		unsigned long long mPushedNanoseconds;
+	};
+
+	/// The queue capacity of each shard unless another is given.
+	static const size_t DEFAULT_QUEUE_CAPACITY = 4096;
+
+	/// The most records an applier takes at once unless another number is given.
+	static const size_t DEFAULT_MAX_BATCH = 64;
+
+private:
+	/**
+	 * A queue and the thread that drains it.
+	 */
+	struct SShard
+	{
+		CRingBuffer<SRecord> mQueue;
+		std::thread mApplier;
+
+		SShard(size_t capacity) : mQueue(capacity) {}
+	};
+
+	/// Where the transactions are applied.
+	std::shared_ptr<CAccountCache> mAccounts;
+
+	std::vector<std::unique_ptr<SShard>> mShards;
+
+	/// The most records an applier takes from its queue before applying them.
+	std::atomic<size_t> mMaxBatch;
+
+	/// Set by Stop. Appliers finish what is queued and exit.
+	std::atomic<bool> mStopping;
+
+	/// How many records were applied and accepted.
+	std::atomic<unsigned long long> mAccepted;
+
+	/// How many records were applied and declined, or were for an account that doesn't exist.
+	std::atomic<unsigned long long> mDeclined;
+
+	/// How many pushes found their queue full.
+	std::atomic<unsigned long long> mFullQueues;
+
+	SShard & GetShard(AccountId id);
+	void RunApplier(SShard * shard);
+	void ApplyBatch(const std::vector<SRecord> & batch);
+
+public:
+	CIngestionPipeline(std::shared_ptr<CAccountCache> accounts, size_t shardCount,
+		size_t queueCapacity = DEFAULT_QUEUE_CAPACITY, size_t maxBatch = DEFAULT_MAX_BATCH);
+	CIngestionPipeline(const CIngestionPipeline &) = delete;
+	virtual ~CIngestionPipeline();
+
+	void Push(const SRecord & record);
+	bool TryPush(const SRecord & record);
+	void Stop();
+
+	void SetMaxBatch(size_t maxBatch);
+	size_t GetMaxBatch();
+	size_t GetShardCount();
+	size_t GetQueueDepth();
+
+	unsigned long long GetAcceptedCount();
+	unsigned long long GetDeclinedCount();
+	unsigned long long GetFullQueueCount();
+};
@@ -0,0 +1,160 @@
+#include "InlineTransactionStore.h"
+#include <cstring>
+#include <type_traits>
+
+// Transactions are moved around mInline with memmove, which is only allowed for trivially copyable types.
+static_assert(std::is_trivially_copyable<CTransaction>::value, "CTransaction must stay trivially copyable");
+
+
+/**
+ * Constructor. The store starts out empty.
+ */
+CInlineTransactionStore::CInlineTransactionStore()
+{
+	this->UpdateSegments();
+}
+
+
+/**
+ * Copy constructor. A copy of a store that still keeps its transactions inline is inline as well.
+ * \param other The store to copy.
+ */
+CInlineTransactionStore::CInlineTransactionStore(const CInlineTransactionStore & other) :
+	mInlineCount(other.mInlineCount), mOverflow(other.mOverflow)
+{
+	std::memcpy(this->mInline, other.mInline, other.mInlineCount * sizeof(CTransaction));
+	this->UpdateSegments();
+}
+
+
+/**
+ * Destructor.
+ */
+CInlineTransactionStore::~CInlineTransactionStore()
+{
+}
+
+
+/**
+ * \returns The transactions in mInline.
+ */
+CTransaction * CInlineTransactionStore::InlineData()
+{
+	return reinterpret_cast<CTransaction *>(this->mInline);
+}
+
+
+/**
+ * Point the base class iterators at wherever the transactions are. Either way there is only one segment.
+ */
+void CInlineTransactionStore::UpdateSegments()
+{
+	if (this->IsInline())
+	{
+		this->SetSegments(this->InlineData(), this->mInlineCount, nullptr, 0);
+	}
+	else
+	{
+		this->SetSegments(this->mOverflow.data(), this->mOverflow.size(), nullptr, 0);
+	}
+}
+
+
+/**
+ * \returns True while the transactions are kept in the store itself rather than on the heap.
+ */
+bool CInlineTransactionStore::IsInline() const
+{
+	return this->mOverflow.empty();
+}
+
+
+/**
+ * Insert a transaction so it ends up at the given position. If there is no room left inline, every transaction
+ * moves to the heap first.
+ * \param position Index the transaction will have after the insert.
+ * \param transaction The transaction to insert.
+ * \returns Always true.
+ */
+bool CInlineTransactionStore::Insert(size_t position, const CTransaction & transaction)
+{
+	if (!this->IsInline())
+	{
+		this->mOverflow.insert(this->mOverflow.begin() + position, transaction);
+	}
+	else if (this->mInlineCount < INLINE_CAPACITY)
+	{
+		CTransaction * transactions = this->InlineData();
+		std::memmove(transactions + position + 1, transactions + position, (this->mInlineCount - position) * sizeof(CTransaction));
+		std::memcpy(transactions + position, &transaction, sizeof(CTransaction));
+		++this->mInlineCount;
+	}
+	else
+	{
+		// Twice the inline capacity, so the next several transactions don't reallocate.
+		CTransaction * transactions = this->InlineData();
+		this->mOverflow.reserve(2 * INLINE_CAPACITY);
+		this->mOverflow.insert(this->mOverflow.end(), transactions, transactions + position);
+		this->mOverflow.push_back(transaction);
+		this->mOverflow.insert(this->mOverflow.end(), transactions + position, transactions + this->mInlineCount);
+		this->mInlineCount = 0;
+	}
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove the transaction at the given position. Transactions that moved to the heap stay there.
+ * \param position Index of the transaction to remove.
+ * \returns Always true.
+ */
+bool CInlineTransactionStore::Erase(size_t position)
+{
+	if (this->IsInline())
+	{
+		CTransaction * transactions = this->InlineData();
+		std::memmove(transactions + position, transactions + position + 1, (this->mInlineCount - position - 1) * sizeof(CTransaction));
+		--this->mInlineCount;
+	}
+	else
+	{
+		this->mOverflow.erase(this->mOverflow.begin() + position);
+		if (this->mOverflow.empty())
+		{
+			// Nothing is left, so the next transaction can go inline again.
+			std::vector<CTransaction>().swap(this->mOverflow);
+		}
+	}
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove every transaction, and give back the heap buffer if there is one.
+ */
+void CInlineTransactionStore::Clear()
+{
+	this->mInlineCount = 0;
+	std::vector<CTransaction>().swap(this->mOverflow);
+	this->UpdateSegments();
+}
+
+
+/**
+ * \returns A copy of the store, made with the copy constructor so it keeps its transactions inline if this one does.
+ */
+std::unique_ptr<CTransactionStore> CInlineTransactionStore::Clone() const
+{
+	return std::unique_ptr<CTransactionStore>(new CInlineTransactionStore(*this));
+}
+
+
+/**
+ * \returns How many bytes of memory this store is holding on to, including itself.
+ */
+size_t CInlineTransactionStore::GetMemoryUsage() const
+{
+	return sizeof(*this) + this->mOverflow.capacity() * sizeof(CTransaction);
+}
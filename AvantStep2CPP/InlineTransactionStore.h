@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include "TransactionStore.h"
+
+
+/**
+ * The default transaction store. Keeps the first few transactions of an account in the store itself, so an
+ * account with little activity costs one allocation for all of its transactions instead of a store plus a
+ * buffer that is reallocated as it grows. Once more than INLINE_CAPACITY transactions are added they move to one
+ * contiguous heap buffer, like CVectorTransactionStore, and stay there.
+ */
+class CInlineTransactionStore : public CTransactionStore
+{
+public:
+	/// How many transactions fit in the store before it moves them to the heap.
+	static const size_t INLINE_CAPACITY = 8;
+
+private:
+	/// Room for the first INLINE_CAPACITY transactions. CTransaction has no default constructor, so this is raw
+	/// memory, and only the first mInlineCount entries hold transactions.
+	alignas(CTransaction) unsigned char mInline[INLINE_CAPACITY * sizeof(CTransaction)];
+
+	/// How many transactions are in mInline. 0 once they have moved to mOverflow.
+	size_t mInlineCount = 0;
+
+	/// Every transaction of the account, in order by time, once there are too many for mInline.
+	std::vector<CTransaction> mOverflow;
+
+	CTransaction * InlineData();
+	void UpdateSegments();
+
+public:
+	CInlineTransactionStore();
+	CInlineTransactionStore(const CInlineTransactionStore & other);
+	virtual ~CInlineTransactionStore();
+
+	bool IsInline() const;
+
+	virtual bool Insert(size_t position, const CTransaction & transaction) override;
+	virtual bool Erase(size_t position) override;
+	virtual void Clear() override;
+	virtual std::unique_ptr<CTransactionStore> Clone() const override;
+	virtual size_t GetMemoryUsage() const override;
+};
@@ -0,0 +1,454 @@
+#include "MappedTransactionStore.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/// Size of one record in the file.
+const size_t RECORD_SIZE = sizeof(CTransaction);
+
+/// Size of the header in front of the records. Keeps the records 8-byte aligned.
+const size_t HEADER_SIZE = 32;
+
+const char CMappedTransactionStore::FILE_MAGIC[8] = { 'A', 'V', 'T', 'X', 'R', 'E', 'C', 'S' };
+
+/// The fewest records the file grows to, so a small account doesn't remap for each of its first transactions.
+const size_t MIN_CAPACITY = 1024;
+
+
+/**
+ * Constructor. The store isn't usable until Open() succeeds.
+ * \param mergeThreshold How many transactions the in-memory tail holds before it is merged into the file.
+ */
+CMappedTransactionStore::CMappedTransactionStore(size_t mergeThreshold) : mMergeThreshold(mergeThreshold)
+{
+}
+
+
+/**
+ * Destructor. Merges whatever is left in the tail into the file before closing it.
+ */
+CMappedTransactionStore::~CMappedTransactionStore()
+{
+	this->Close();
+}
+
+
+/**
+ * Open (or create) the file backing this store and map it into memory. Any
+ * transactions already in the file become the contents of the store.
+ * \param path Path of the file.
+ * \returns True if the file was opened and mapped. False if the file couldn't be opened, doesn't start with
+ *		the header, was written by another version or with another record size, or isn't made of whole records.
+ */
+bool CMappedTransactionStore::Open(const std::string & path)
+{
+	this->Close();
+
+	size_t fileSize = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	this->mFile = file;
+	fileSize = (size_t)size.QuadPart;
+#else
+	int file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		close(file);
+		return false;
+	}
+	this->mFile = file;
+	fileSize = (size_t)status.st_size;
+#endif
+
+	bool opened;
+	if (fileSize == 0)
+	{
+		opened = this->Map(0);
+		if (opened)
+		{
+			this->WriteHeader();
+		}
+	}
+	else if (fileSize >= HEADER_SIZE && (fileSize - HEADER_SIZE) % RECORD_SIZE == 0 && this->Map((fileSize - HEADER_SIZE) / RECORD_SIZE)
+		&& memcmp(this->mHeader->mMagic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0)
+	{
+		opened = this->mHeader->mVersion == FILE_VERSION && this->mHeader->mRecordSize == RECORD_SIZE
+			&& this->mHeader->mRecordCount <= this->mCapacity;
+		if (opened)
+		{
+			this->mRecordCount = (size_t)this->mHeader->mRecordCount;
+		}
+	}
+	else
+	{
+		// Without the magic, the file wasn't written by this store.
+		opened = false;
+	}
+
+	if (!opened)
+	{
+		// Unmapped first, so closing doesn't cut a file this store can't read down to what it holds.
+		this->Unmap();
+		this->Close();
+		return false;
+	}
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Write the header of the current version, for the records the store holds, at the start of the mapped file.
+ */
+void CMappedTransactionStore::WriteHeader()
+{
+	memcpy(this->mHeader->mMagic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	this->mHeader->mVersion = FILE_VERSION;
+	this->mHeader->mRecordSize = (uint32_t)RECORD_SIZE;
+	this->mHeader->mRecordCount = this->mRecordCount;
+	this->mHeader->mReserved = 0;
+}
+
+
+/**
+ * Merge the tail into the file and close it. The file is cut down to the records it holds. The store is empty
+ * afterwards.
+ */
+void CMappedTransactionStore::Close()
+{
+	if (!this->IsOpen())
+	{
+		return;
+	}
+
+	this->Merge();
+	bool unusedRoom = this->mHeader != nullptr && this->mCapacity > this->mRecordCount;
+	this->Unmap();
+	if (unusedRoom)
+	{
+		this->SetFileSize(HEADER_SIZE + this->mRecordCount * RECORD_SIZE);
+	}
+#ifdef _WIN32
+	CloseHandle((HANDLE)this->mFile);
+	this->mFile = nullptr;
+#else
+	close(this->mFile);
+	this->mFile = -1;
+#endif
+	this->mTail.clear();
+	this->mRecordCount = 0;
+	this->UpdateSegments();
+}
+
+
+/**
+ * \returns True if the store has a file open.
+ */
+bool CMappedTransactionStore::IsOpen() const
+{
+#ifdef _WIN32
+	return this->mFile != nullptr;
+#else
+	return this->mFile >= 0;
+#endif
+}
+
+
+/**
+ * Unmap the file without changing its contents.
+ */
+void CMappedTransactionStore::Unmap()
+{
+#ifdef _WIN32
+	if (this->mHeader != nullptr)
+	{
+		UnmapViewOfFile(this->mHeader);
+	}
+	if (this->mMapping != nullptr)
+	{
+		CloseHandle((HANDLE)this->mMapping);
+		this->mMapping = nullptr;
+	}
+#else
+	if (this->mHeader != nullptr)
+	{
+		munmap(this->mHeader, HEADER_SIZE + this->mCapacity * RECORD_SIZE);
+	}
+#endif
+	this->mHeader = nullptr;
+	this->mRecords = nullptr;
+	this->mCapacity = 0;
+}
+
+
+/**
+ * Change the size of the file without touching the mapping.
+ * \param fileSize The new size in bytes.
+ * \returns True if the file has the new size.
+ */
+bool CMappedTransactionStore::SetFileSize(size_t fileSize)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)fileSize;
+	return SetFilePointerEx((HANDLE)this->mFile, size, nullptr, FILE_BEGIN) && SetEndOfFile((HANDLE)this->mFile);
+#else
+	return ftruncate(this->mFile, (off_t)fileSize) == 0;
+#endif
+}
+
+
+/**
+ * Make room in the file for at least the given number of records. The file at least doubles when it grows.
+ * \param recordCount How many records the file has to have room for.
+ * \returns True if there is room. False if the file couldn't grow, in which case it is still mapped as before.
+ */
+bool CMappedTransactionStore::Reserve(size_t recordCount)
+{
+	if (recordCount <= this->mCapacity)
+	{
+		return true;
+	}
+	return this->Map(std::max(recordCount, std::max(2 * this->mCapacity, MIN_CAPACITY)));
+}
+
+
+/**
+ * Grow the file to the header and the given number of records and map all of it. The new mapping is made before
+ * the old one is let go, so if anything fails the store is left as it was. The caller updates the segments.
+ * \param capacity How many records the file should have room for. Not less than mRecordCount.
+ * \returns True if the file was grown and mapped.
+ */
+bool CMappedTransactionStore::Map(size_t capacity)
+{
+	size_t fileSize = HEADER_SIZE + capacity * RECORD_SIZE;
+
+#ifdef _WIN32
+	// Making a mapping bigger than the file grows the file.
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)fileSize;
+	HANDLE mapping = CreateFileMappingA((HANDLE)this->mFile, nullptr, PAGE_READWRITE, (DWORD)(size.QuadPart >> 32),
+		(DWORD)(size.QuadPart & 0xFFFFFFFF), nullptr);
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+	void * view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, fileSize);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	this->Unmap();
+	this->mMapping = mapping;
+#else
+	// Growing the file doesn't disturb the current mapping. If the new one can't be made, the file keeps the room
+	// it was given until the store is closed.
+	if ((this->mHeader == nullptr || capacity > this->mCapacity) && !this->SetFileSize(fileSize))
+	{
+		return false;
+	}
+	void * view = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->mFile, 0);
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+	this->Unmap();
+#endif
+
+	this->mHeader = (SFileHeader *)view;
+	this->mRecords = (CTransaction *)((char *)view + HEADER_SIZE);
+	this->mCapacity = capacity;
+	return true;
+}
+
+
+/**
+ * Point the base class iterators at the mapped file and the in-memory tail, and write how many records the file
+ * holds into its header.
+ */
+void CMappedTransactionStore::UpdateSegments()
+{
+	if (this->mHeader != nullptr)
+	{
+		this->mHeader->mRecordCount = this->mRecordCount;
+	}
+	this->SetSegments(this->mRecords, this->mRecordCount, this->mTail.data(), this->mTail.size());
+}
+
+
+/**
+ * Append the in-memory tail to the end of the file.
+ * \returns True if the tail is now in the file (or was already empty).
+ */
+bool CMappedTransactionStore::Merge()
+{
+	if (this->mTail.empty())
+	{
+		return true;
+	}
+
+	if (!this->Reserve(this->mRecordCount + this->mTail.size()))
+	{
+		return false;
+	}
+	memcpy(this->mRecords + this->mRecordCount, this->mTail.data(), this->mTail.size() * RECORD_SIZE);
+	this->mRecordCount += this->mTail.size();
+	this->mTail.clear();
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * \returns How many transactions are stored in the file.
+ */
+size_t CMappedTransactionStore::GetFileCount() const
+{
+	return this->mRecordCount;
+}
+
+
+/**
+ * \returns How many transactions are waiting in the in-memory tail.
+ */
+size_t CMappedTransactionStore::GetTailCount() const
+{
+	return this->mTail.size();
+}
+
+
+/**
+ * Insert a transaction so it ends up at the given position. Transactions after the end of the
+ * file go to the tail. Ones before it are written into the file after merging the tail.
+ * \param position Index the transaction will have after the insert.
+ * \param transaction The transaction to insert.
+ * \returns True if the transaction was stored. False if the file couldn't grow.
+ */
+bool CMappedTransactionStore::Insert(size_t position, const CTransaction & transaction)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+
+	// Merging before the insert means a charge that gets declined right away is still in the
+	// tail when it's erased, so it never touches the file.
+	if (this->mTail.size() >= this->mMergeThreshold && !this->Merge())
+	{
+		return false;
+	}
+
+	if (position >= this->mRecordCount)
+	{
+		this->mTail.insert(this->mTail.begin() + (position - this->mRecordCount), transaction);
+		this->UpdateSegments();
+		return true;
+	}
+
+	// Backdated transaction. The records from this position on move up one.
+	if (!this->Merge() || !this->Reserve(this->mRecordCount + 1))
+	{
+		return false;
+	}
+	memmove(this->mRecords + position + 1, this->mRecords + position, (this->mRecordCount - position) * RECORD_SIZE);
+	this->mRecords[position] = transaction;
+	this->mRecordCount++;
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove the transaction at the given position. The file keeps its size, so this can't fail.
+ * \param position Index of the transaction to remove.
+ * \returns True.
+ */
+bool CMappedTransactionStore::Erase(size_t position)
+{
+	if (position >= this->mRecordCount)
+	{
+		this->mTail.erase(this->mTail.begin() + (position - this->mRecordCount));
+		this->UpdateSegments();
+		return true;
+	}
+
+	memmove(this->mRecords + position, this->mRecords + position + 1, (this->mRecordCount - position - 1) * RECORD_SIZE);
+	this->mRecordCount--;
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove every transaction, from the tail and the file. The file keeps its room until the store is closed.
+ */
+void CMappedTransactionStore::Clear()
+{
+	this->mTail.clear();
+	this->mRecordCount = 0;
+	this->UpdateSegments();
+}
+
+
+/**
+ * The mapped file doesn't count. Its pages belong to the operating system, which drops them when memory runs low.
+ * \returns How many bytes of memory this store is holding on to, including itself.
+ */
+size_t CMappedTransactionStore::GetMemoryUsage() const
+{
+	return sizeof(*this) + this->mTail.capacity() * sizeof(CTransaction);
+}
+
+
+/**
+ * Hint to the operating system that the part of the file under the given range is
+ * about to be read from start to end, so it reads ahead and drops pages behind.
+ * \param start Iterator to the first transaction that will be read.
+ * \param end Iterator DIRECTLY AFTER the last transaction that will be read.
+ */
+void CMappedTransactionStore::AdviseSequential(Iterator start, Iterator end) const
+{
+#ifndef _WIN32
+	size_t first = start.Index();
+	size_t last = std::min(end.Index(), this->mRecordCount);
+	if (this->mRecords == nullptr || first >= last)
+	{
+		return;
+	}
+
+	// madvise wants a page aligned address.
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	char * begin = (char *)(this->mRecords + first);
+	char * alignedBegin = (char *)((uintptr_t)begin & ~(uintptr_t)(pageSize - 1));
+	size_t length = (size_t)((char *)(this->mRecords + last) - alignedBegin);
+	madvise(alignedBegin, length, MADV_SEQUENTIAL);
+	madvise(alignedBegin, length, MADV_WILLNEED);
+#endif
+	// On Windows the file is opened with FILE_FLAG_SEQUENTIAL_SCAN, which is the same hint for the whole file.
+}
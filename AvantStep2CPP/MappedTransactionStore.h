@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include "TransactionStore.h"
+
+
+/**
+ * A transaction store for accounts with too many transactions to keep in memory.
+ *
+ * Transactions live in a file of fixed-width records, sorted by time, that is memory-mapped so the
+ * operating system pages it in and out as the account is read. New transactions go to a small
+ * in-memory tail first. Once the tail holds mergeThreshold transactions it is merged into the file.
+ * A transaction inserted before the end of the file (a backdated one) is written into the file right away.
+ *
+ * The file starts with an SFileHeader, which says which layout the records have and how many of them there are.
+ *
+ * The file grows by doubling, so it usually has room for more records than it holds and a merge or a
+ * backdated insert only has to remap it once in a while. Erasing never remaps: the records after the
+ * erased one move down and the room at the end is given back when the store is closed.
+ */
+class CMappedTransactionStore : public CTransactionStore
+{
+public:
+	/// How many transactions the in-memory tail holds before it is merged into the file.
+	static const size_t DEFAULT_MERGE_THRESHOLD = 4096;
+
+	/// The layout of the records the store writes. A file of any other version is rejected.
+	static const uint32_t FILE_VERSION = 1;
+
+private:
+	/**
+	 * The start of the file. The records come right after it.
+	 */
+	struct SFileHeader
+	{
+		/// FILE_MAGIC.
+		char mMagic[8];
+
+		/// FILE_VERSION when the file was written.
+		uint32_t mVersion;
+
+		/// sizeof(CTransaction) when the file was written.
+		uint32_t mRecordSize;
+
+		/// How many of the records after the header are transactions. The rest is room to grow into.
+		uint64_t mRecordCount;
+
+		/// Always 0.
+		uint64_t mReserved;
+	};
+
+	/// What every file the store writes starts with.
+	static const char FILE_MAGIC[8];
+
+	/// Transactions added after the last one in the file, in order by time.
+	std::vector<CTransaction> mTail;
+
+	/// Start of the mapped file, or nullptr if the file isn't mapped.
+	SFileHeader * mHeader = nullptr;
+
+	/// The first record, right after mHeader.
+	CTransaction * mRecords = nullptr;
+
+	/// How many transactions are in the file.
+	size_t mRecordCount = 0;
+
+	/// How many records the file and its mapping have room for. Never less than mRecordCount.
+	size_t mCapacity = 0;
+
+	/// How big mTail can get before it is merged into the file.
+	size_t mMergeThreshold;
+
+#ifdef _WIN32
+	/// Handle to the open file.
+	void * mFile = nullptr;
+
+	/// Handle to the file mapping object of mFile.
+	void * mMapping = nullptr;
+#else
+	/// File descriptor of the open file, -1 if there is none.
+	int mFile = -1;
+#endif
+
+	bool Reserve(size_t recordCount);
+	bool Map(size_t capacity);
+	bool SetFileSize(size_t fileSize);
+	void WriteHeader();
+	void Unmap();
+	void UpdateSegments();
+
+public:
+	CMappedTransactionStore(size_t mergeThreshold = DEFAULT_MERGE_THRESHOLD);
+	virtual ~CMappedTransactionStore();
+
+	bool Open(const std::string & path);
+	void Close();
+	bool IsOpen() const;
+
+	bool Merge();
+
+	size_t GetFileCount() const;
+	size_t GetTailCount() const;
+
+	virtual bool Insert(size_t position, const CTransaction & transaction) override;
+	virtual bool Erase(size_t position) override;
+	virtual void Clear() override;
+	virtual size_t GetMemoryUsage() const override;
+	virtual void AdviseSequential(Iterator start, Iterator end) const override;
+};
@@ -0,0 +1,52 @@
+#include "MemoryAccountStore.h"
+using std::lock_guard;
+using std::mutex;
+
+
+/**
+ * Constructor. The store starts out empty.
+ */
+CMemoryAccountStore::CMemoryAccountStore()
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CMemoryAccountStore::~CMemoryAccountStore()
+{
+}
+
+
+/**
+ * Read a serialized account.
+ * \param id The account to read.
+ * \param buffer Receives the serialized account.
+ * \returns True if the account was found.
+ */
+bool CMemoryAccountStore::Load(AccountId id, std::vector<unsigned char> & buffer)
+{
+	lock_guard<mutex> guard(this->mLock);
+	auto found = this->mAccounts.find(id);
+	if (found == this->mAccounts.end())
+	{
+		return false;
+	}
+	buffer = found->second;
+	return true;
+}
+
+
+/**
+ * Write a serialized account, replacing whatever was stored for it before.
+ * \param id The account to write.
+ * \param buffer The serialized account.
+ * \returns Always true.
+ */
+bool CMemoryAccountStore::Save(AccountId id, const std::vector<unsigned char> & buffer)
+{
+	lock_guard<mutex> guard(this->mLock);
+	this->mAccounts[id] = buffer;
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <unordered_map>
+#include <mutex>
+#include "AccountStore.h"
+
+
+/**
+ * Account store that keeps serialized accounts in memory. A serialized account is a
+ * small fraction of the size of a live one, so this is enough for a cold tier in front
+ * of a database, and for testing.
+ */
+class CMemoryAccountStore : public CAccountStore
+{
+private:
+	/// Serialized accounts by their id.
+	std::unordered_map<AccountId, std::vector<unsigned char>> mAccounts;
+
+	/// Guards mAccounts.
+	std::mutex mLock;
+
+public:
+	CMemoryAccountStore();
+	virtual ~CMemoryAccountStore();
+
+	virtual bool Load(AccountId id, std::vector<unsigned char> & buffer) override;
+	virtual bool Save(AccountId id, const std::vector<unsigned char> & buffer) override;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <cmath>
+
+
+/**
+ * An amount of money, as a whole number of millionths of a dollar. Adding, subtracting and comparing amounts is
+ * exact, so a sum comes out the same whatever order it is added up in, and checking a balance against the credit
+ * limit needs no epsilon. Millionths leave room for balances of up to about nine trillion dollars.
+ *
+ * Interest is where rounding happens, and it happens in one place: InterestAt works out the interest of one day
+ * and rounds it to the nearest millionth, ties to even. Interest over several days at the same balance and rate is
+ * that many days of the rounded daily interest. Everything that calculates balances accrues interest this way, so
+ * CCreditCardAccount, the reference calculation of CShadowVerifier and the SIMD lanes of CAprScenarios agree to the
+ * last millionth. The daily interest is calculated in double precision from the exact amount, which is exact for
+ * balances below 2^53 millionths, about nine billion dollars.
+ *
+ * The public interface of the engine still takes and returns dollars as doubles. FromDollars and ToDollars convert,
+ * rounding to the nearest millionth.
+ */
+class CMoney
+{
+public:
+	/// How many units there are in a dollar.
+	static const long long UNITS_PER_DOLLAR = 1000000;
+
+private:
+	/// The amount in millionths of a dollar.
+	long long mUnits;
+
+	explicit CMoney(long long units) : mUnits(units)
+	{
+	}
+
+public:
+	/**
+	 * Constructor. No money.
+	 */
+	CMoney() : mUnits(0)
+	{
+	}
+
+	/**
+	 * \param units An amount in millionths of a dollar.
+	 * \returns The amount.
+	 */
+	static CMoney FromUnits(long long units)
+	{
+		return CMoney(units);
+	}
+
+	/**
+	 * \param dollars An amount in dollars.
+	 * \returns The amount, rounded to the nearest millionth of a dollar.
+	 */
+	static CMoney FromDollars(double dollars)
+	{
+		return CMoney(std::llround(dollars * UNITS_PER_DOLLAR));
+	}
+
+	/**
+	 * \param apr An APR as a decimal (.10 = 10%).
+	 * \returns The rate of interest of one day, which InterestAt takes.
+	 */
+	static double DailyRate(double apr)
+	{
+		return apr / 365;
+	}
+
+	/**
+	 * \returns The amount in millionths of a dollar.
+	 */
+	long long GetUnits() const
+	{
+		return this->mUnits;
+	}
+
+	/**
+	 * \returns The amount in dollars.
+	 */
+	double ToDollars() const
+	{
+		return (double)this->mUnits / UNITS_PER_DOLLAR;
+	}
+
+	/**
+	 * Get the interest of one day on this amount, rounded to the nearest millionth, ties to even.
+	 * \param dailyRate The rate of interest of the day, from DailyRate.
+	 * \returns The interest.
+	 */
+	CMoney InterestAt(double dailyRate) const
+	{
+		return CMoney((long long)std::nearbyint((double)this->mUnits * dailyRate));
+	}
+
+	CMoney operator+(CMoney other) const { return CMoney(this->mUnits + other.mUnits); }
+	CMoney operator-(CMoney other) const { return CMoney(this->mUnits - other.mUnits); }
+	CMoney operator-() const { return CMoney(-this->mUnits); }
+	CMoney operator*(int times) const { return CMoney(this->mUnits * times); }
+	CMoney & operator+=(CMoney other) { this->mUnits += other.mUnits; return *this; }
+	CMoney & operator-=(CMoney other) { this->mUnits -= other.mUnits; return *this; }
+
+	bool operator==(CMoney other) const { return this->mUnits == other.mUnits; }
+	bool operator!=(CMoney other) const { return this->mUnits != other.mUnits; }
+	bool operator<(CMoney other) const { return this->mUnits < other.mUnits; }
+	bool operator<=(CMoney other) const { return this->mUnits <= other.mUnits; }
+	bool operator>(CMoney other) const { return this->mUnits > other.mUnits; }
+	bool operator>=(CMoney other) const { return this->mUnits >= other.mUnits; }
+};
@@ -0,0 +1,328 @@
+#include "PortfolioAggregates.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+/// Where the credit limit bands start when none are given, in dollars.
+static const double DEFAULT_BAND_LIMITS[] = { 0.0, 1000.0, 5000.0, 10000.0, 25000.0 };
+
+
+/**
+ * Constructor. Bands start at credit limits of $0, $1000, $5000, $10000 and $25000.
+ */
+CPortfolioAggregates::CPortfolioAggregates() :
+	CPortfolioAggregates(vector<double>(std::begin(DEFAULT_BAND_LIMITS), std::end(DEFAULT_BAND_LIMITS)))
+{
+}
+
+
+/**
+ * Constructor.
+ * \param bandLimits The credit limits at which the bands start, in dollars. A band from 0 is added if there
+ * isn't one, and the rest are sorted.
+ */
+CPortfolioAggregates::CPortfolioAggregates(const vector<double> & bandLimits) :
+	mBandLimits(bandLimits)
+{
+	this->mBandLimits.push_back(0.0);
+	std::sort(this->mBandLimits.begin(), this->mBandLimits.end());
+	this->mBandLimits.erase(std::unique(this->mBandLimits.begin(), this->mBandLimits.end()), this->mBandLimits.end());
+	this->mBandLimits.erase(this->mBandLimits.begin(), std::find(this->mBandLimits.begin(), this->mBandLimits.end(), 0.0));
+	this->mBandBalances.resize(this->mBandLimits.size());
+	this->mBandAccounts.resize(this->mBandLimits.size(), 0);
+}
+
+
+/**
+ * Destructor.
+ */
+CPortfolioAggregates::~CPortfolioAggregates()
+{
+}
+
+
+/**
+ * Record the balance and credit limit an account has now. The totals move by the difference from what it had
+ * the last time, or take the account in if this is the first time.
+ * \param id The account.
+ * \param balance The balance of the account as of its latest transaction.
+ * \param creditLimit The credit limit of the account.
+ * \param previousBalance Receives the balance the account had the last time, or 0 if this is the first time. Can
+ * be nullptr.
+ * \returns False if this is the first time for the account.
+ */
+bool CPortfolioAggregates::Update(AccountId id, double balance, double creditLimit, double * previousBalance)
+{
+	CMoney newBalance = CMoney::FromDollars(balance);
+	CMoney newLimit = CMoney::FromDollars(creditLimit);
+	size_t band = this->FindBand(creditLimit);
+
+	lock_guard<mutex> guard(this->mLock);
+	// Looked up before inserting, since inserting allocates a node even when the account is already there.
+	auto found = this->mAccounts.find(id);
+	bool inserted = found == this->mAccounts.end();
+	if (inserted)
+	{
+		found = this->mAccounts.insert(std::make_pair(id, SAccount())).first;
+	}
+	SAccount & account = found->second;
+	if (inserted)
+	{
+		account.mBand = band;
+		account.mHeapSlot = this->mHeap.size();
+		this->mBandAccounts[band]++;
+		SHeapEntry entry = { 0.0, id, &account };
+		this->mHeap.push_back(entry);
+	}
+	else if (account.mBand != band)
+	{
+		this->mBandBalances[account.mBand] -= account.mBalance;
+		this->mBandAccounts[account.mBand]--;
+		this->mBandBalances[band] += account.mBalance;
+		this->mBandAccounts[band]++;
+		account.mBand = band;
+	}
+
+	if (previousBalance != nullptr)
+	{
+		*previousBalance = account.mBalance.ToDollars();
+	}
+	CMoney delta = newBalance - account.mBalance;
+	this->mOutstanding += delta;
+	this->mBandBalances[band] += delta;
+	account.mBalance = newBalance;
+	account.mCreditLimit = newLimit;
+
+	SHeapEntry & entry = this->mHeap[account.mHeapSlot];
+	double before = entry.mUtilization;
+	entry.mUtilization = Utilization(newBalance, newLimit);
+	if (inserted || entry.mUtilization > before)
+	{
+		this->SiftUp(account.mHeapSlot);
+	}
+	else
+	{
+		this->SiftDown(account.mHeapSlot);
+	}
+	return !inserted;
+}
+
+
+/**
+ * \returns How many accounts the totals cover.
+ */
+size_t CPortfolioAggregates::GetAccountCount()
+{
+	lock_guard<mutex> guard(this->mLock);
+	return this->mAccounts.size();
+}
+
+
+/**
+ * \returns The balances of every account added up.
+ */
+double CPortfolioAggregates::GetOutstandingBalance()
+{
+	lock_guard<mutex> guard(this->mLock);
+	return this->mOutstanding.ToDollars();
+}
+
+
+/**
+ * \returns Every credit limit band, in order by limit.
+ */
+vector<CPortfolioAggregates::SBand> CPortfolioAggregates::GetBands()
+{
+	lock_guard<mutex> guard(this->mLock);
+	vector<SBand> bands(this->mBandLimits.size());
+	for (size_t band = 0; band < bands.size(); ++band)
+	{
+		bands[band].mLowestLimit = this->mBandLimits[band];
+		bands[band].mLimitEnd = (band + 1 < bands.size()) ? this->mBandLimits[band + 1] : std::numeric_limits<double>::infinity();
+		bands[band].mBalance = this->mBandBalances[band].ToDollars();
+		bands[band].mAccounts = this->mBandAccounts[band];
+	}
+	return bands;
+}
+
+
+/**
+ * Get how much of its credit limit one account uses.
+ * \param id The account.
+ * \param utilization Receives the utilization.
+ * \returns False if the account was never updated.
+ */
+bool CPortfolioAggregates::GetUtilization(AccountId id, SUtilization * utilization)
+{
+	lock_guard<mutex> guard(this->mLock);
+	auto found = this->mAccounts.find(id);
+	if (found == this->mAccounts.end())
+	{
+		return false;
+	}
+	this->Describe(this->mHeap[found->second.mHeapSlot], utilization);
+	return true;
+}
+
+
+/**
+ * Get the accounts that use the most of their credit limit. Ties go to the lower account id.
+ * \param count How many accounts to get.
+ * \param top Receives the accounts, most utilized first. Fewer than count if there aren't that many accounts.
+ */
+void CPortfolioAggregates::GetTopUtilization(size_t count, vector<SUtilization> & top)
+{
+	top.clear();
+	lock_guard<mutex> guard(this->mLock);
+	count = std::min(count, this->mHeap.size());
+	top.reserve(count);
+
+	// The next account in order is always the best of the slots whose parent was already taken, so those
+	// slots are kept in a small heap of their own.
+	auto after = [this](size_t first, size_t second) { return Before(this->mHeap[second], this->mHeap[first]); };
+	// Every account taken adds at most two slots and removes one.
+	vector<size_t> candidates;
+	candidates.reserve(count + 1);
+	if (count > 0)
+	{
+		candidates.push_back(0);
+	}
+	while (top.size() < count)
+	{
+		std::pop_heap(candidates.begin(), candidates.end(), after);
+		size_t slot = candidates.back();
+		candidates.pop_back();
+		SUtilization utilization;
+		this->Describe(this->mHeap[slot], &utilization);
+		top.push_back(utilization);
+		for (size_t child = 2 * slot + 1; child <= 2 * slot + 2 && child < this->mHeap.size(); ++child)
+		{
+			candidates.push_back(child);
+			std::push_heap(candidates.begin(), candidates.end(), after);
+		}
+	}
+}
+
+
+/**
+ * Find the band of a credit limit.
+ * \param creditLimit The credit limit.
+ * \returns The band. Limits below 0 are in the first band.
+ */
+size_t CPortfolioAggregates::FindBand(double creditLimit) const
+{
+	size_t after = std::upper_bound(this->mBandLimits.begin(), this->mBandLimits.end(), creditLimit) - this->mBandLimits.begin();
+	return (after > 0) ? after - 1 : 0;
+}
+
+
+/**
+ * Put an account in a slot of the heap, and tell the account where it is.
+ * \param slot The slot.
+ * \param entry The account.
+ */
+void CPortfolioAggregates::Place(size_t slot, const SHeapEntry & entry)
+{
+	this->mHeap[slot] = entry;
+	entry.mDetails->mHeapSlot = slot;
+}
+
+
+/**
+ * Move an account towards the top of the heap until it is after its parent.
+ * \param slot Where the account is.
+ */
+void CPortfolioAggregates::SiftUp(size_t slot)
+{
+	SHeapEntry entry = this->mHeap[slot];
+	while (slot > 0)
+	{
+		size_t parent = (slot - 1) / 2;
+		if (!Before(entry, this->mHeap[parent]))
+		{
+			break;
+		}
+		this->Place(slot, this->mHeap[parent]);
+		slot = parent;
+	}
+	this->Place(slot, entry);
+}
+
+
+/**
+ * Move an account towards the bottom of the heap until it is before its children.
+ * \param slot Where the account is.
+ */
+void CPortfolioAggregates::SiftDown(size_t slot)
+{
+	SHeapEntry entry = this->mHeap[slot];
+	size_t size = this->mHeap.size();
+	while (true)
+	{
+		size_t child = 2 * slot + 1;
+		if (child >= size)
+		{
+			break;
+		}
+		if (child + 1 < size && Before(this->mHeap[child + 1], this->mHeap[child]))
+		{
+			child++;
+		}
+		if (!Before(this->mHeap[child], entry))
+		{
+			break;
+		}
+		this->Place(slot, this->mHeap[child]);
+		slot = child;
+	}
+	this->Place(slot, entry);
+}
+
+
+/**
+ * Fill in what a query returns about an account.
+ * \param entry The account's slot in the heap.
+ * \param utilization Receives the account's balance, limit and utilization.
+ */
+void CPortfolioAggregates::Describe(const SHeapEntry & entry, SUtilization * utilization) const
+{
+	utilization->mAccount = entry.mAccount;
+	utilization->mBalance = entry.mDetails->mBalance.ToDollars();
+	utilization->mCreditLimit = entry.mDetails->mCreditLimit.ToDollars();
+	utilization->mUtilization = entry.mUtilization;
+}
+
+
+/**
+ * Work out how much of its credit limit a balance uses.
+ * \param balance The balance.
+ * \param creditLimit The credit limit.
+ * \returns The balance divided by the limit. With no limit, infinity for a balance over zero and 0 otherwise.
+ */
+double CPortfolioAggregates::Utilization(CMoney balance, CMoney creditLimit)
+{
+	if (creditLimit <= CMoney())
+	{
+		return (balance > CMoney()) ? std::numeric_limits<double>::infinity() : 0.0;
+	}
+	return balance.ToDollars() / creditLimit.ToDollars();
+}
+
+
+/**
+ * Decide which of two accounts is nearer the top of the heap.
+ * \param first One account.
+ * \param second The other account.
+ * \returns True if first uses more of its limit than second, or the same and has the lower id.
+ */
+bool CPortfolioAggregates::Before(const SHeapEntry & first, const SHeapEntry & second)
+{
+	if (first.mUtilization != second.mUtilization)
+	{
+		return first.mUtilization > second.mUtilization;
+	}
+	return first.mAccount < second.mAccount;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "AccountStore.h"
+#include "Money.h"
+
+
+/**
+ * Totals over every account of a portfolio, kept up to date one account at a time so that no query has to go over
+ * the accounts: the outstanding balance of all of them, how much of it is in each band of credit limits, and which
+ * accounts use the most of their credit limit.
+ *
+ * Whoever changes an account calls Update with its new balance and limit, and the totals move by the difference
+ * from what the account had before. Balances are kept in CMoney, so however many updates there are, the totals are
+ * exactly the sum of the balances. A balance below zero (an account that was paid past zero) counts against the
+ * totals like any other.
+ *
+ * Utilization is the balance divided by the credit limit. The accounts are in a binary heap by utilization, and
+ * each account knows its slot in it, so an update moves the account to its new place in O(log n) for n accounts.
+ * The most utilized account is at the top of the heap, and the top N come out in O(N log N) by walking down from
+ * it without changing the heap.
+ *
+ * All methods are safe to call from several threads at once.
+ */
+class CPortfolioAggregates
+{
+public:
+	/**
+	 * The accounts whose credit limit is in a range, and what they owe.
+	 */
+	struct SBand
+	{
+		/// The lowest credit limit in the band.
+		double mLowestLimit;
+
+		/// The credit limit the next band starts at. Infinity for the last band.
+		double mLimitEnd;
+
+		/// The balances of the accounts in the band added up.
+		double mBalance;
+
+		/// How many accounts are in the band.
+		size_t mAccounts;
+	};
+
+	/**
+	 * How much of its credit limit an account uses.
+	 */
+	struct SUtilization
+	{
+		AccountId mAccount;
+		double mBalance;
+		double mCreditLimit;
+
+		/// mBalance divided by mCreditLimit. Infinity for a balance over zero with no credit limit.
+		double mUtilization;
+	};
+
+private:
+	/**
+	 * What the totals have counted for an account.
+	 */
+	struct SAccount
+	{
+		CMoney mBalance;
+		CMoney mCreditLimit;
+		size_t mBand;
+
+		/// Where the account is in mHeap.
+		size_t mHeapSlot;
+	};
+
+	/**
+	 * An account in mHeap. The utilization is kept here, rather than only worked out from the SAccount, so
+	 * comparing two slots doesn't leave the heap.
+	 */
+	struct SHeapEntry
+	{
+		double mUtilization;
+		AccountId mAccount;
+
+		/// The account's entry in mAccounts. Nodes of an unordered_map don't move when it grows.
+		SAccount * mDetails;
+	};
+
+	/// Every account that was ever updated.
+	std::unordered_map<AccountId, SAccount> mAccounts;
+
+	/// Slot s has children 2s + 1 and 2s + 2, and comes before both of them by utilization (see Before).
+	std::vector<SHeapEntry> mHeap;
+
+	/// The balances of every account added up.
+	CMoney mOutstanding;
+
+	/// Band b holds the credit limits from entry b up to entry b + 1. The first entry is always 0.
+	std::vector<double> mBandLimits;
+
+	/// The balances in each band added up.
+	std::vector<CMoney> mBandBalances;
+
+	/// How many accounts are in each band.
+	std::vector<size_t> mBandAccounts;
+
+	/// Guards everything above.
+	std::mutex mLock;
+
+	size_t FindBand(double creditLimit) const;
+	void Place(size_t slot, const SHeapEntry & entry);
+	void SiftUp(size_t slot);
+	void SiftDown(size_t slot);
+	void Describe(const SHeapEntry & entry, SUtilization * utilization) const;
+
+	static double Utilization(CMoney balance, CMoney creditLimit);
+	static bool Before(const SHeapEntry & first, const SHeapEntry & second);
+
+public:
+	CPortfolioAggregates();
+	CPortfolioAggregates(const std::vector<double> & bandLimits);
+	CPortfolioAggregates(const CPortfolioAggregates &) = delete;
+	virtual ~CPortfolioAggregates();
+
+	bool Update(AccountId id, double balance, double creditLimit, double * previousBalance = nullptr);
+
+	size_t GetAccountCount();
+	double GetOutstandingBalance();
+	std::vector<SBand> GetBands();
+	bool GetUtilization(AccountId id, SUtilization * utilization);
+	void GetTopUtilization(size_t count, std::vector<SUtilization> & top);
+};
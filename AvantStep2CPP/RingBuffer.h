@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+/**
+ * A bounded queue that any number of threads can push to and one thread pops from, without locks.
+ *
+ * Every slot carries a sequence number that says whose turn it is. A producer claims a position by moving
+ * the tail on with a compare-and-swap, writes the value, and then publishes it by setting the slot's
+ * sequence. The consumer only reads a slot once its sequence says it was published, and hands it back to
+ * the producers the same way. A full queue makes TryPush fail instead of waiting, so the caller decides
+ * how to apply backpressure.
+ *
+ * With a single producer the compare-and-swap never fails, so the same class serves as an SPSC queue.
+ */
+template <typename T>
+class CRingBuffer
+{
+private:
+	/**
+	 * One value and the sequence number that says who may use it next.
+	 */
+	struct SSlot
+	{
+		std::atomic<size_t> mSequence;
+		T mValue;
+	};
+
+	/// Keeps the producers' and the consumer's positions on separate cache lines.
+	static const size_t CACHE_LINE = 64;
+
+	/// The slots. The count is a power of two so positions wrap with a mask.
+	std::unique_ptr<SSlot[]> mSlots;
+
+	/// The slot count minus one.
+	size_t mMask;
+
+	/// The next position a producer will claim.
+	alignas(CACHE_LINE) std::atomic<size_t> mTail;
+
+	/// The next position the consumer will read.
+	alignas(CACHE_LINE) std::atomic<size_t> mHead;
+
+public:
+	/**
+	 * Constructor.
+	 * \param capacity The most values the queue holds. Rounded up to a power of two.
+	 */
+	CRingBuffer(size_t capacity) : mTail(0), mHead(0)
+	{
+		size_t slotCount = 2;
+		while (slotCount < capacity)
+		{
+			slotCount *= 2;
+		}
+		this->mSlots.reset(new SSlot[slotCount]);
+		this->mMask = slotCount - 1;
+		for (size_t i = 0; i < slotCount; ++i)
+		{
+			this->mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	CRingBuffer(const CRingBuffer &) = delete;
+
+	/**
+	 * Add a value to the back of the queue. Safe to call from several threads at once.
+	 * \param value The value to add.
+	 * \returns False if the queue is full.
+	 */
+	bool TryPush(const T & value)
+	{
+		size_t position = this->mTail.load(std::memory_order_relaxed);
+		while (true)
+		{
+			SSlot & slot = this->mSlots[position & this->mMask];
+			size_t sequence = slot.mSequence.load(std::memory_order_acquire);
+			if (sequence == position)
+			{
+				// The slot is free. Claim it, unless another producer got there first.
+				if (this->mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					slot.mValue = value;
+					slot.mSequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (sequence < position)
+			{
+				// The consumer hasn't emptied this slot since the last lap.
+				return false;
+			}
+			else
+			{
+				position = this->mTail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Take the value at the front of the queue. Only one thread may pop.
+	 * \param value Receives the value.
+	 * \returns False if the queue is empty.
+	 */
+	bool TryPop(T & value)
+	{
+		size_t position = this->mHead.load(std::memory_order_relaxed);
+		SSlot & slot = this->mSlots[position & this->mMask];
+		if (slot.mSequence.load(std::memory_order_acquire) != position + 1)
+		{
+			return false;
+		}
+		value = slot.mValue;
+
+		// Hand the slot back to the producers for their next lap.
+		slot.mSequence.store(position + this->mMask + 1, std::memory_order_release);
+		this->mHead.store(position + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * \returns Roughly how many values are queued. Exact only when nobody is pushing or popping.
+	 */
+	size_t GetDepth() const
+	{
+		size_t tail = this->mTail.load(std::memory_order_relaxed);
+		size_t head = this->mHead.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	/**
+	 * \returns The most values the queue holds.
+	 */
+	size_t GetCapacity() const
+	{
+		return this->mMask + 1;
+	}
+};
@@ -0,0 +1,554 @@
+#include "SettlementImporter.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include "Tracing.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// std::from_chars needs C++17, and a standard library recent enough to parse doubles with it. Without it the
+// fields are parsed with the C library instead.
+#if defined(__has_include)
+#if __has_include(<charconv>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <charconv>
+#endif
+#endif
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+// Defined here as well as declared, since std::min takes it by reference.
+const size_t CSettlementImporter::MAX_REJECTED_TEXT;
+
+/// The longest field the C library fallback parses.
+const size_t MAX_FIELD_LENGTH = 63;
+
+/// How many fields a row has.
+const int FIELD_COUNT = 4;
+
+
+/**
+ * A settlement file mapped into memory for reading.
+ */
+struct SMappedFile
+{
+	const char * mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+};
+
+
+/**
+ * Unmap and close a file opened by MapFile.
+ * \param file The file.
+ */
+static void UnmapFile(SMappedFile * file)
+{
+#ifdef _WIN32
+	if (file->mData != nullptr)
+	{
+		UnmapViewOfFile(file->mData);
+	}
+	if (file->mMapping != nullptr)
+	{
+		CloseHandle(file->mMapping);
+	}
+	if (file->mFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file->mFile);
+	}
+#else
+	if (file->mData != nullptr)
+	{
+		munmap((void *)file->mData, file->mSize);
+	}
+	if (file->mFile >= 0)
+	{
+		close(file->mFile);
+	}
+#endif
+	*file = SMappedFile();
+}
+
+
+/**
+ * Map a whole file into memory, read-only, and tell the operating system it will be read from start to end.
+ * \param path The file.
+ * \param file Receives the mapping. An empty file has no data.
+ * \returns False if the file couldn't be opened or mapped.
+ */
+static bool MapFile(const string & path, SMappedFile * file)
+{
+#ifdef _WIN32
+	file->mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER size;
+	if (file->mFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->mFile, &size))
+	{
+		UnmapFile(file);
+		return false;
+	}
+	file->mSize = (size_t)size.QuadPart;
+	if (file->mSize == 0)
+	{
+		return true;
+	}
+	file->mMapping = CreateFileMappingA(file->mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (file->mMapping != nullptr)
+	{
+		file->mData = (const char *)MapViewOfFile(file->mMapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	file->mFile = open(path.c_str(), O_RDONLY);
+	struct stat status;
+	if (file->mFile < 0 || fstat(file->mFile, &status) != 0)
+	{
+		UnmapFile(file);
+		return false;
+	}
+	file->mSize = (size_t)status.st_size;
+	if (file->mSize == 0)
+	{
+		return true;
+	}
+	void * data = mmap(nullptr, file->mSize, PROT_READ, MAP_PRIVATE, file->mFile, 0);
+	if (data != MAP_FAILED)
+	{
+		madvise(data, file->mSize, MADV_SEQUENTIAL);
+		file->mData = (const char *)data;
+	}
+#endif
+	if (file->mData == nullptr)
+	{
+		UnmapFile(file);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Parse a whole field as a number.
+ * \param begin The first character of the field.
+ * \param end DIRECTLY AFTER the last character of the field.
+ * \param value Receives the number.
+ * \returns False if the field isn't a number of the type, or has anything after it.
+ */
+template <typename T>
+static bool ParseNumber(const char * begin, const char * end, T * value)
+{
+#if defined(__cpp_lib_to_chars)
+	std::from_chars_result result = std::from_chars(begin, end, *value);
+	return result.ec == std::errc() && result.ptr == end;
+#else
+	// The C library needs the field to end with a null, and skips leading spaces and signs from_chars rejects.
+	size_t length = (size_t)(end - begin);
+	if (length == 0 || length > MAX_FIELD_LENGTH || !(*begin == '-' || *begin == '.' || (*begin >= '0' && *begin <= '9')))
+	{
+		return false;
+	}
+	char field[MAX_FIELD_LENGTH + 1];
+	std::memcpy(field, begin, length);
+	field[length] = '\0';
+	char * parsed = nullptr;
+	errno = 0;
+	if (std::is_floating_point<T>::value)
+	{
+		*value = (T)std::strtod(field, &parsed);
+	}
+	else if (std::is_signed<T>::value)
+	{
+		long long number = std::strtoll(field, &parsed, 10);
+		*value = (T)number;
+		if ((long long)*value != number)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		if (*begin == '-')
+		{
+			return false;
+		}
+		*value = (T)std::strtoull(field, &parsed, 10);
+	}
+	return errno == 0 && parsed == field + length;
+#endif
+}
+
+
+/**
+ * \param begin The first character of a field.
+ * \param end DIRECTLY AFTER the last character of the field.
+ * \param text A word.
+ * \returns True if the field is the word, ignoring case.
+ */
+static bool FieldIs(const char * begin, const char * end, const char * text)
+{
+	size_t length = std::strlen(text);
+	if ((size_t)(end - begin) != length)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < length; ++i)
+	{
+		char c = begin[i];
+		if (c >= 'A' && c <= 'Z')
+		{
+			c = (char)(c - 'A' + 'a');
+		}
+		if (c != text[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * Parse one row of a settlement file.
+ * \param begin The first character of the row.
+ * \param end DIRECTLY AFTER the last character of the row, not counting the line break.
+ * \param account Receives the account id.
+ * \param transaction Receives the transaction.
+ * \param reason Receives why the row was rejected, if it was.
+ * \returns False if the row was rejected.
+ */
+static bool ParseRow(const char * begin, const char * end, AccountId * account,
+	CCreditCardAccount::SPendingTransaction * transaction, const char ** reason)
+{
+	const char * fields[FIELD_COUNT];
+	const char * fieldEnds[FIELD_COUNT];
+	int count = 0;
+	const char * field = begin;
+	while (true)
+	{
+		const char * comma = (const char *)std::memchr(field, ',', (size_t)(end - field));
+		const char * fieldEnd = (comma != nullptr) ? comma : end;
+		if (count == FIELD_COUNT)
+		{
+			*reason = "too many fields";
+			return false;
+		}
+
+		// Spaces around a field are allowed.
+		const char * first = field;
+		const char * last = fieldEnd;
+		while (first < last && (*first == ' ' || *first == '\t'))
+		{
+			++first;
+		}
+		while (last > first && (last[-1] == ' ' || last[-1] == '\t'))
+		{
+			--last;
+		}
+		fields[count] = first;
+		fieldEnds[count] = last;
+		++count;
+		if (comma == nullptr)
+		{
+			break;
+		}
+		field = comma + 1;
+	}
+	if (count < FIELD_COUNT)
+	{
+		*reason = "too few fields";
+		return false;
+	}
+
+	if (!ParseNumber(fields[0], fieldEnds[0], account))
+	{
+		*reason = "bad account id";
+		return false;
+	}
+	if (!ParseNumber(fields[1], fieldEnds[1], &transaction->mDay))
+	{
+		*reason = "bad day";
+		return false;
+	}
+	if (!ParseNumber(fields[2], fieldEnds[2], &transaction->mValue) || !std::isfinite(transaction->mValue))
+	{
+		*reason = "bad amount";
+		return false;
+	}
+	if (transaction->mValue <= 0.0)
+	{
+		*reason = "amount is not positive";
+		return false;
+	}
+	if (FieldIs(fields[3], fieldEnds[3], "c") || FieldIs(fields[3], fieldEnds[3], "charge"))
+	{
+		transaction->mType = CTransaction::CHARGE;
+	}
+	else if (FieldIs(fields[3], fieldEnds[3], "p") || FieldIs(fields[3], fieldEnds[3], "payment"))
+	{
+		transaction->mType = CTransaction::PAYMENT;
+	}
+	else
+	{
+		*reason = "bad type";
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Constructor.
+ * \param accounts Where the rows are applied. The accounts have to exist already.
+ * \param threadCount How many threads parse and apply. 0 means one for each hardware thread.
+ */
+CSettlementImporter::CSettlementImporter(shared_ptr<CAccountCache> accounts, size_t threadCount) :
+	mAccounts(accounts), mThreadCount(threadCount)
+{
+	if (this->mThreadCount == 0)
+	{
+		this->mThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+
+/**
+ * Destructor.
+ */
+CSettlementImporter::~CSettlementImporter()
+{
+}
+
+
+/**
+ * \returns How many threads parse and apply.
+ */
+size_t CSettlementImporter::GetThreadCount()
+{
+	return this->mThreadCount;
+}
+
+
+/**
+ * Import a settlement file.
+ * \param path The file.
+ * \param report Receives what the import did.
+ * \returns False if the file couldn't be opened or mapped. Nothing was imported.
+ */
+bool CSettlementImporter::Import(const string & path, SReport * report)
+{
+	auto start = std::chrono::steady_clock::now();
+	SMappedFile file;
+	if (!MapFile(path, &file))
+	{
+		return false;
+	}
+	this->ImportBuffer(file.mData, file.mSize, report);
+	UnmapFile(&file);
+	report->mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	report->mRowsPerSecond = (report->mSeconds > 0.0) ? report->mRows / report->mSeconds : 0.0;
+	return true;
+}
+
+
+/**
+ * Import settlement rows that are already in memory, laid out like a settlement file.
+ * \param data The rows.
+ * \param size How many characters there are.
+ * \param report Receives what the import did.
+ */
+void CSettlementImporter::ImportBuffer(const char * data, size_t size, SReport * report)
+{
+	TRACE_SCOPE("SettlementImporter: import");
+	auto start = std::chrono::steady_clock::now();
+	*report = SReport();
+
+	// Each chunk starts right after a line break, or at the start of the data.
+	vector<SChunk> chunks(this->mThreadCount);
+	const char * end = data + size;
+	const char * chunkBegin = data;
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		const char * chunkEnd = end;
+		if (i + 1 < chunks.size() && size > 0)
+		{
+			chunkEnd = std::max(chunkBegin, data + size / chunks.size() * (i + 1));
+			const char * lineBreak = (const char *)std::memchr(chunkEnd, '\n', (size_t)(end - chunkEnd));
+			chunkEnd = (lineBreak != nullptr) ? lineBreak + 1 : end;
+		}
+		chunks[i].mBegin = chunkBegin;
+		chunks[i].mEnd = chunkEnd;
+		chunks[i].mFirst = (i == 0);
+		chunks[i].mBuckets.resize(this->mThreadCount);
+		chunkBegin = chunkEnd;
+	}
+
+	vector<std::thread> threads;
+	for (SChunk & chunk : chunks)
+	{
+		threads.emplace_back(&CSettlementImporter::ParseChunk, this, &chunk);
+	}
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	vector<SBucketResult> results(this->mThreadCount);
+	threads.clear();
+	for (size_t bucket = 0; bucket < results.size(); ++bucket)
+	{
+		threads.emplace_back(&CSettlementImporter::ApplyBucket, this, bucket, std::ref(chunks), &results[bucket]);
+	}
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	unsigned long long firstLine = 0;
+	for (SChunk & chunk : chunks)
+	{
+		report->mRows += chunk.mRows;
+		report->mRejected += chunk.mRejected;
+		for (SRejectedRow & rejection : chunk.mRejections)
+		{
+			if (report->mRejections.size() < MAX_REJECTIONS)
+			{
+				rejection.mLine += firstLine;
+				report->mRejections.push_back(std::move(rejection));
+			}
+		}
+		firstLine += chunk.mLines;
+	}
+	for (const SBucketResult & result : results)
+	{
+		report->mAccepted += result.mAccepted;
+		report->mDeclined += result.mDeclined;
+		report->mUnknownAccount += result.mUnknownAccount;
+	}
+	report->mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	report->mRowsPerSecond = (report->mSeconds > 0.0) ? report->mRows / report->mSeconds : 0.0;
+}
+
+
+/**
+ * Body of a parsing thread. Parses every line of a chunk into the bucket of its account.
+ * \param chunk The chunk.
+ */
+void CSettlementImporter::ParseChunk(SChunk * chunk)
+{
+	TRACE_SCOPE("SettlementImporter: parse");
+	size_t bucketCount = chunk->mBuckets.size();
+	const char * line = chunk->mBegin;
+	while (line < chunk->mEnd)
+	{
+		const char * lineBreak = (const char *)std::memchr(line, '\n', (size_t)(chunk->mEnd - line));
+		const char * next = (lineBreak != nullptr) ? lineBreak + 1 : chunk->mEnd;
+		const char * lineEnd = (lineBreak != nullptr) ? lineBreak : chunk->mEnd;
+		if (lineEnd > line && lineEnd[-1] == '\r')
+		{
+			--lineEnd;
+		}
+		++chunk->mLines;
+		bool header = chunk->mFirst && chunk->mLines == 1 && lineEnd > line && ((*line >= 'A' && *line <= 'Z') || (*line >= 'a' && *line <= 'z'));
+		if (lineEnd == line || header)
+		{
+			line = next;
+			continue;
+		}
+
+		++chunk->mRows;
+		SRow row;
+		const char * reason = nullptr;
+		if (ParseRow(line, lineEnd, &row.mAccount, &row.mTransaction, &reason))
+		{
+			chunk->mBuckets[row.mAccount % bucketCount].push_back(row);
+		}
+		else
+		{
+			++chunk->mRejected;
+			if (chunk->mRejections.size() < MAX_REJECTIONS)
+			{
+				size_t length = std::min((size_t)(lineEnd - line), MAX_REJECTED_TEXT);
+				chunk->mRejections.push_back({ chunk->mLines, reason, string(line, length) });
+			}
+		}
+		line = next;
+	}
+}
+
+
+/**
+ * Body of an applying thread. Applies the rows of one bucket of every chunk, each account's in order by day.
+ * \param bucket The bucket.
+ * \param chunks Every chunk, already parsed.
+ * \param result Receives what applying the bucket did.
+ */
+void CSettlementImporter::ApplyBucket(size_t bucket, vector<SChunk> & chunks, SBucketResult * result)
+{
+	TRACE_SCOPE("SettlementImporter: apply");
+	vector<SRow> rows;
+	size_t count = 0;
+	for (const SChunk & chunk : chunks)
+	{
+		count += chunk.mBuckets[bucket].size();
+	}
+	rows.reserve(count);
+	for (SChunk & chunk : chunks)
+	{
+		rows.insert(rows.end(), chunk.mBuckets[bucket].begin(), chunk.mBuckets[bucket].end());
+		vector<SRow>().swap(chunk.mBuckets[bucket]);
+	}
+
+	// Stable, so rows of the same account and day keep the order of the file.
+	std::stable_sort(rows.begin(), rows.end(), [](const SRow & a, const SRow & b)
+	{
+		return a.mAccount < b.mAccount || (a.mAccount == b.mAccount && a.mTransaction.mDay < b.mTransaction.mDay);
+	});
+
+	vector<CCreditCardAccount::SPendingTransaction> transactions;
+	std::unique_ptr<bool[]> added;
+	size_t addedRoom = 0;
+	for (size_t first = 0; first < rows.size();)
+	{
+		AccountId account = rows[first].mAccount;
+		transactions.clear();
+		size_t last = first;
+		for (; last < rows.size() && rows[last].mAccount == account; ++last)
+		{
+			transactions.push_back(rows[last].mTransaction);
+		}
+		if (transactions.size() > addedRoom)
+		{
+			addedRoom = transactions.size();
+			added.reset(new bool[addedRoom]);
+		}
+
+		if (!this->mAccounts->AddTransactions(account, transactions.data(), transactions.size(), added.get()))
+		{
+			result->mUnknownAccount += transactions.size();
+		}
+		else
+		{
+			size_t accepted = (size_t)std::count(added.get(), added.get() + transactions.size(), true);
+			result->mAccepted += accepted;
+			result->mDeclined += transactions.size() - accepted;
+		}
+		first = last;
+	}
+}
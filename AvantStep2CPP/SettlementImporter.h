@@ -0,0 +1,143 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "AccountCache.h"
+#include "AccountStore.h"
+#include "CreditCardAccount.h"
+
+
+/**
+ * Applies a daily settlement file to the accounts of a cache.
+ *
+ * A settlement file has one transaction per line: the account id, the day relative to the opening of the account,
+ * the amount in dollars and C for a charge or P for a payment, separated by commas. Blank lines are skipped, and so
+ * is a first line that starts with a letter, which is taken as a header.
+ *
+ * The file is memory-mapped and split on line boundaries into one chunk per thread. Each thread parses its chunk
+ * and splits the rows into buckets by account, one bucket per thread. Then each thread takes one bucket from every
+ * chunk and applies it, one account at a time with CAccountCache::AddTransactions, in order by day. An account only
+ * ever lands in one bucket, so no two threads wait on the same account, and rows of the same account and day are
+ * applied in the order they are in the file.
+ *
+ * Rows that can't be parsed are rejected and counted, and the first MAX_REJECTIONS of them are kept with their line
+ * number and the reason. Rows that parse but are declined by their account, or are for an account that doesn't
+ * exist, are counted as well.
+ */
+class CSettlementImporter
+{
+public:
+	/// The most rejected rows a report keeps the details of.
+	static const size_t MAX_REJECTIONS = 100;
+
+	/// The most characters of a rejected row a report keeps.
+	static const size_t MAX_REJECTED_TEXT = 120;
+
+	/**
+	 * A row of the file that couldn't be parsed.
+	 */
+	struct SRejectedRow
+	{
+		/// The line of the row, counting from 1.
+		unsigned long long mLine;
+
+		/// Why the row was rejected.
+		const char * mReason;
+
+		/// The row itself, cut short after MAX_REJECTED_TEXT characters.
+		std::string mText;
+	};
+
+	/**
+	 * What an import did.
+	 */
+	struct SReport
+	{
+		/// How many rows the file has, not counting blank lines and the header.
+		unsigned long long mRows = 0;
+
+		/// How many rows were added to their account.
+		unsigned long long mAccepted = 0;
+
+		/// How many rows their account declined.
+		unsigned long long mDeclined = 0;
+
+		/// How many rows were for an account that doesn't exist.
+		unsigned long long mUnknownAccount = 0;
+
+		/// How many rows couldn't be parsed.
+		unsigned long long mRejected = 0;
+
+		/// The first MAX_REJECTIONS rows that couldn't be parsed, in the order they are in the file.
+		std::vector<SRejectedRow> mRejections;
+
+		/// How long the import took, from mapping the file to the last row applied.
+		double mSeconds = 0.0;
+
+		/// mRows divided by mSeconds.
+		double mRowsPerSecond = 0.0;
+	};
+
+private:
+	/**
+	 * A row that was parsed, on its way to its account.
+	 */
+	struct SRow
+	{
+		AccountId mAccount;
+		CCreditCardAccount::SPendingTransaction mTransaction;
+	};
+
+	/**
+	 * The part of the file one thread parses, and what it found there.
+	 */
+	struct SChunk
+	{
+		const char * mBegin = nullptr;
+		const char * mEnd = nullptr;
+
+		/// True for the chunk at the start of the file, which may have a header.
+		bool mFirst = false;
+
+		/// Entry b holds the rows that bucket b applies, in the order they are in the chunk.
+		std::vector<std::vector<SRow>> mBuckets;
+
+		/// How many lines the chunk has, so the next chunk knows the number of its first line.
+		unsigned long long mLines = 0;
+
+		unsigned long long mRows = 0;
+		unsigned long long mRejected = 0;
+
+		/// The first MAX_REJECTIONS rejected rows of the chunk, numbered from the start of the chunk.
+		std::vector<SRejectedRow> mRejections;
+	};
+
+	/**
+	 * What applying one bucket did.
+	 */
+	struct SBucketResult
+	{
+		unsigned long long mAccepted = 0;
+		unsigned long long mDeclined = 0;
+		unsigned long long mUnknownAccount = 0;
+	};
+
+	/// Where the rows are applied.
+	std::shared_ptr<CAccountCache> mAccounts;
+
+	/// How many threads parse and apply.
+	size_t mThreadCount;
+
+	void ParseChunk(SChunk * chunk);
+	void ApplyBucket(size_t bucket, std::vector<SChunk> & chunks, SBucketResult * result);
+
+public:
+	CSettlementImporter(std::shared_ptr<CAccountCache> accounts, size_t threadCount = 0);
+	CSettlementImporter(const CSettlementImporter &) = delete;
+	virtual ~CSettlementImporter();
+
+	bool Import(const std::string & path, SReport * report);
+	void ImportBuffer(const char * data, size_t size, SReport * report);
+
+	size_t GetThreadCount();
+};
@@ -0,0 +1,340 @@
+#include "ShadowVerifier.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "EngineMetrics.h"
+using std::atomic;
+using std::string;
+using std::vector;
+using std::memory_order_relaxed;
+
+/// The amount of days in one cycle.
+static const int DAYS_PER_CYCLE = 30;
+
+/// How far apart the two balances can be before they count as a mismatch, unless SetTolerance says otherwise.
+static const double DEFAULT_TOLERANCE = 0.005;
+
+
+/**
+ * Everything the verifier shares between the threads that submit samples and the thread that checks them.
+ * The checking thread starts with the first sample and is stopped when the program exits, leaving whatever
+ * is still queued unchecked.
+ */
+struct SVerifierState
+{
+	atomic<double> mSampleRate;
+	atomic<double> mTolerance;
+
+	std::mutex mLock;
+
+	/// Signalled when a sample is queued or the thread should stop.
+	std::condition_variable mQueued;
+
+	/// Signalled when the checking thread runs out of samples.
+	std::condition_variable mIdle;
+
+	std::deque<CShadowVerifier::SSample> mQueue;
+	vector<CShadowVerifier::SMismatch> mMismatches;
+	string mReproductionDirectory;
+
+	/// How many mismatches there have been, kept or not. Numbers the reproduction files.
+	unsigned long long mMismatchCount = 0;
+
+	/// True while the checking thread is working on a sample it took off the queue.
+	bool mChecking = false;
+	bool mStopping = false;
+	std::thread mThread;
+
+	SVerifierState() : mSampleRate(0.0), mTolerance(DEFAULT_TOLERANCE)
+	{
+	}
+
+	~SVerifierState()
+	{
+		{
+			std::lock_guard<std::mutex> guard(this->mLock);
+			this->mStopping = true;
+		}
+		this->mQueued.notify_all();
+		if (this->mThread.joinable())
+		{
+			this->mThread.join();
+		}
+	}
+};
+
+static SVerifierState gState;
+
+
+/**
+ * Write the command file that reproduces a sampled calculation.
+ * \param sample The calculation.
+ * \returns The command file.
+ */
+static string BuildReproduction(const CShadowVerifier::SSample & sample)
+{
+	char line[128];
+	string reproduction;
+	snprintf(line, sizeof(line), "OPEN 0 %.15g %.15g\n", sample.mAPR, sample.mCreditLimit);
+	reproduction.append(line);
+	for (const CShadowVerifier::SRateChange & change : sample.mRateChanges)
+	{
+		snprintf(line, sizeof(line), "RATE 0 %.15g %d\n", change.mAPR, change.mDay);
+		reproduction.append(line);
+	}
+	for (const CShadowVerifier::STransaction & transaction : sample.mTransactions)
+	{
+		const char * command = (transaction.mType == CTransaction::CHARGE) ? "CHARGE" : "PAYMENT";
+		snprintf(line, sizeof(line), "%s 0 %.15g %d\n", command, transaction.mValue, transaction.mDay);
+		reproduction.append(line);
+	}
+	snprintf(line, sizeof(line), "BALANCE 0 %d\n", sample.mDay);
+	reproduction.append(line);
+	return reproduction;
+}
+
+
+/**
+ * Check one sample and keep it if it doesn't match. Called on the checking thread without the lock held.
+ * \param sample The sample.
+ */
+static void CheckSample(const CShadowVerifier::SSample & sample)
+{
+	CEngineMetrics::Increment(CEngineMetrics::SHADOW_VERIFIED_SAMPLES);
+	double expected = CShadowVerifier::ReferenceBalanceOnDay(sample.mAPR, sample.mTransactions, sample.mDay, sample.mRateChanges);
+	if (std::fabs(expected - sample.mBalance) <= gState.mTolerance.load(memory_order_relaxed))
+	{
+		return;
+	}
+	CEngineMetrics::Increment(CEngineMetrics::SHADOW_MISMATCHES);
+
+	CShadowVerifier::SMismatch mismatch;
+	mismatch.mDay = sample.mDay;
+	mismatch.mBalance = sample.mBalance;
+	mismatch.mExpectedBalance = expected;
+	mismatch.mReproduction = BuildReproduction(sample);
+
+	string directory;
+	unsigned long long number = 0;
+	{
+		std::lock_guard<std::mutex> guard(gState.mLock);
+		number = ++gState.mMismatchCount;
+		directory = gState.mReproductionDirectory;
+		if (gState.mMismatches.size() < CShadowVerifier::MAX_MISMATCHES)
+		{
+			gState.mMismatches.push_back(mismatch);
+		}
+	}
+
+	if (!directory.empty())
+	{
+		std::ofstream file(directory + "/shadow-mismatch-" + std::to_string(number) + ".txt", std::ios::trunc);
+		file << mismatch.mReproduction;
+	}
+}
+
+
+/**
+ * What the checking thread does until the program exits.
+ */
+static void CheckSamples()
+{
+	std::unique_lock<std::mutex> lock(gState.mLock);
+	for (;;)
+	{
+		gState.mQueued.wait(lock, [] { return gState.mStopping || !gState.mQueue.empty(); });
+		if (gState.mStopping)
+		{
+			return;
+		}
+		CShadowVerifier::SSample sample = std::move(gState.mQueue.front());
+		gState.mQueue.pop_front();
+		gState.mChecking = true;
+
+		lock.unlock();
+		CheckSample(sample);
+		lock.lock();
+
+		gState.mChecking = false;
+		if (gState.mQueue.empty())
+		{
+			gState.mIdle.notify_all();
+		}
+	}
+}
+
+
+/**
+ * Choose how many balance calculations are checked.
+ * \param fraction The fraction of calls to GetBalanceOnDay to check, from 0 (off, the default) to 1 (all).
+ */
+void CShadowVerifier::SetSampleRate(double fraction)
+{
+	gState.mSampleRate.store(std::min(1.0, std::max(0.0, fraction)), memory_order_relaxed);
+}
+
+
+/**
+ * \returns The fraction of calls to GetBalanceOnDay that are checked.
+ */
+double CShadowVerifier::GetSampleRate()
+{
+	return gState.mSampleRate.load(memory_order_relaxed);
+}
+
+
+/**
+ * Choose how far apart a balance and the reference balance can be before they count as a mismatch.
+ * \param tolerance The largest difference that still matches. Half a cent by default.
+ */
+void CShadowVerifier::SetTolerance(double tolerance)
+{
+	gState.mTolerance.store(tolerance, memory_order_relaxed);
+}
+
+
+/**
+ * Write the reproduction of every mismatch from now on to its own file, shadow-mismatch-<n>.txt.
+ * \param directory Where the files go. Empty to only keep them in memory.
+ */
+void CShadowVerifier::SetReproductionDirectory(const string & directory)
+{
+	std::lock_guard<std::mutex> guard(gState.mLock);
+	gState.mReproductionDirectory = directory;
+}
+
+
+/**
+ * Decide whether to check the balance calculation that is being made. Cheap enough to ask on every call.
+ * \returns True if the caller should Submit a sample of it.
+ */
+bool CShadowVerifier::ShouldSample()
+{
+	double rate = gState.mSampleRate.load(memory_order_relaxed);
+	if (rate <= 0.0)
+	{
+		return false;
+	}
+
+	// xorshift64*, one generator per thread so sampling never contends.
+	thread_local unsigned long long random = 0x9E3779B97F4A7C15ULL
+		^ (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count()
+		^ (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id());
+	random ^= random >> 12;
+	random ^= random << 25;
+	random ^= random >> 27;
+	double uniform = (double)((random * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+	return uniform < rate;
+}
+
+
+/**
+ * Queue a balance calculation to be checked on the checking thread. Never waits: if the queue is full,
+ * the sample is dropped and counted.
+ * \param sample The calculation.
+ */
+void CShadowVerifier::Submit(SSample && sample)
+{
+	{
+		std::lock_guard<std::mutex> guard(gState.mLock);
+		if (gState.mStopping)
+		{
+			return;
+		}
+		if (gState.mQueue.size() >= QUEUE_CAPACITY)
+		{
+			CEngineMetrics::Increment(CEngineMetrics::SHADOW_DROPPED_SAMPLES);
+			return;
+		}
+		gState.mQueue.push_back(std::move(sample));
+		if (!gState.mThread.joinable())
+		{
+			gState.mThread = std::thread(CheckSamples);
+		}
+	}
+	gState.mQueued.notify_one();
+}
+
+
+/**
+ * Wait until every sample submitted so far has been checked.
+ */
+void CShadowVerifier::Flush()
+{
+	std::unique_lock<std::mutex> lock(gState.mLock);
+	gState.mIdle.wait(lock, [] { return gState.mQueue.empty() && !gState.mChecking; });
+}
+
+
+/**
+ * \returns The mismatches found so far, up to MAX_MISMATCHES of them, oldest first.
+ */
+vector<CShadowVerifier::SMismatch> CShadowVerifier::GetMismatches()
+{
+	std::lock_guard<std::mutex> guard(gState.mLock);
+	return gState.mMismatches;
+}
+
+
+/**
+ * Forget the mismatches found so far.
+ */
+void CShadowVerifier::ClearMismatches()
+{
+	std::lock_guard<std::mutex> guard(gState.mLock);
+	gState.mMismatches.clear();
+}
+
+
+/**
+ * Calculate a balance the slow, obvious way: one day at a time, from the opening day. This is what
+ * every balance calculation has to agree with.
+ *
+ * Interest accrues at the close of each day on that day's balance and is added to the balance at the
+ * close of each 30 day cycle, so the balance on day d includes the interest of every cycle that closed
+ * on or before d and every transaction made on or before d. Each day accrues at the APR in effect that day,
+ * rounded to the nearest millionth of a dollar. CCreditCardAccount never accepts a transaction before the
+ * opening day, but one given here counts as made on the opening day, without interest before it.
+ * \param apr The APR of the account when it opened.
+ * \param transactions Every transaction of the account, in any order.
+ * \param day The day to get the balance at the end of.
+ * \param rateChanges The changes of the APR after opening, in order by day.
+ * \returns The balance at the end of that day.
+ */
+double CShadowVerifier::ReferenceBalanceOnDay(double apr, const vector<STransaction> & transactions, int day, const vector<SRateChange> & rateChanges)
+{
+	vector<STransaction> byDay(transactions);
+	std::stable_sort(byDay.begin(), byDay.end(), [](const STransaction & a, const STransaction & b) { return a.mDay < b.mDay; });
+
+	CMoney balance;
+	CMoney interest;
+	size_t next = 0;
+	size_t nextChange = 0;
+	for (int today = 0; today <= day; ++today)
+	{
+		for (; nextChange < rateChanges.size() && rateChanges[nextChange].mDay <= today; ++nextChange)
+		{
+			apr = rateChanges[nextChange].mAPR;
+		}
+		if (today > 0 && today % DAYS_PER_CYCLE == 0)
+		{
+			balance += interest;
+			interest = CMoney();
+		}
+		for (; next < byDay.size() && byDay[next].mDay <= today; ++next)
+		{
+			CMoney value = CMoney::FromDollars(byDay[next].mValue);
+			balance += (byDay[next].mType == CTransaction::CHARGE) ? value : -value;
+		}
+		interest += balance.InterestAt(CMoney::DailyRate(apr));
+	}
+	return balance.ToDollars();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Transaction.h"
+
+
+/**
+ * Checks a sample of balance calculations against a plain day-by-day reference calculation, so faster
+ * balance paths can be trusted in production.
+ *
+ * CCreditCardAccount asks ShouldSample on every GetBalanceOnDay. Most of the time that is one relaxed
+ * load and a random number, and sampling is off until SetSampleRate is called. A sampled call copies the
+ * account's history into a SSample and hands it to Submit, and a background thread recalculates the
+ * balance and compares. Samples that arrive while the queue is full are dropped rather than waited on.
+ *
+ * A mismatch is kept with a reproduction: a command file, in the format AvantStep2CPPServer and
+ * AvantStep2CPPWorkload --replay read, that opens the account, schedules its APR changes, makes its
+ * transactions in order and asks for the balance that came out wrong.
+ */
+class CShadowVerifier
+{
+public:
+	/// The most samples waiting to be checked at once.
+	static const size_t QUEUE_CAPACITY = 256;
+
+	/// The most mismatches kept. Later ones are still counted, just not kept.
+	static const size_t MAX_MISMATCHES = 100;
+
+	/**
+	 * One transaction of a sampled account.
+	 */
+	struct STransaction
+	{
+		double mValue;
+		int mDay;
+		CTransaction::TransactionType mType;
+	};
+
+	/**
+	 * A change of the APR of a sampled account, from mDay on.
+	 */
+	struct SRateChange
+	{
+		int mDay;
+		double mAPR;
+	};
+
+	/**
+	 * A balance calculation to check, with everything needed to redo it.
+	 */
+	struct SSample
+	{
+		double mAPR = 0.0;
+		double mCreditLimit = 0.0;
+
+		/// The changes of the APR after opening, in order by day.
+		std::vector<SRateChange> mRateChanges;
+
+		/// Every transaction of the account, oldest first.
+		std::vector<STransaction> mTransactions;
+
+		/// The day the balance was asked for.
+		int mDay = 0;
+
+		/// The balance the account calculated.
+		double mBalance = 0.0;
+	};
+
+	/**
+	 * A balance calculation that disagreed with the reference calculation.
+	 */
+	struct SMismatch
+	{
+		int mDay;
+		double mBalance;
+		double mExpectedBalance;
+
+		/// A command file that makes the same calculation.
+		std::string mReproduction;
+	};
+
+	static void SetSampleRate(double fraction);
+	static double GetSampleRate();
+	static void SetTolerance(double tolerance);
+	static void SetReproductionDirectory(const std::string & directory);
+
+	static bool ShouldSample();
+	static void Submit(SSample && sample);
+	static void Flush();
+
+	static std::vector<SMismatch> GetMismatches();
+	static void ClearMismatches();
+
+	static double ReferenceBalanceOnDay(double apr, const std::vector<STransaction> & transactions, int day,
+		const std::vector<SRateChange> & rateChanges = std::vector<SRateChange>());
+
+	CShadowVerifier() = delete;
+};
@@ -0,0 +1,143 @@
+#include "SnapshotTransactionStore.h"
+using std::vector;
+
+
+/**
+ * Constructor. The store starts out empty.
+ * \param mergeThreshold How many transactions the tail holds before it is merged into a new base.
+ */
+CSnapshotTransactionStore::CSnapshotTransactionStore(size_t mergeThreshold) :
+	mBase(std::make_shared<const vector<CTransaction>>()), mMergeThreshold(mergeThreshold)
+{
+	this->mTail.reserve(mergeThreshold);
+	this->UpdateSegments();
+}
+
+
+/**
+ * Copy constructor. The copy shares the base and gets its own tail, so it costs at most mergeThreshold
+ * transactions no matter how long the history is.
+ * \param other The store to copy.
+ */
+CSnapshotTransactionStore::CSnapshotTransactionStore(const CSnapshotTransactionStore & other) :
+	mBase(other.mBase), mMergeThreshold(other.mMergeThreshold)
+{
+	this->mTail.reserve(this->mMergeThreshold);
+	this->mTail.insert(this->mTail.end(), other.mTail.begin(), other.mTail.end());
+	this->UpdateSegments();
+}
+
+
+/**
+ * Destructor.
+ */
+CSnapshotTransactionStore::~CSnapshotTransactionStore()
+{
+}
+
+
+/**
+ * Replace the base with the given transactions and empty the tail.
+ * \param transactions Every transaction of the store, in order by time. Moved from.
+ */
+void CSnapshotTransactionStore::Rebase(vector<CTransaction> & transactions)
+{
+	this->mBase = std::make_shared<const vector<CTransaction>>(std::move(transactions));
+	this->mTail.clear();
+	this->UpdateSegments();
+}
+
+
+/**
+ * Point the base class iterators at the base and the tail.
+ */
+void CSnapshotTransactionStore::UpdateSegments()
+{
+	this->SetSegments(this->mBase->data(), this->mBase->size(), this->mTail.data(), this->mTail.size());
+}
+
+
+/**
+ * \returns How many transactions are in the shared base.
+ */
+size_t CSnapshotTransactionStore::GetBaseCount() const
+{
+	return this->mBase->size();
+}
+
+
+/**
+ * Insert a transaction so it ends up at the given position. Only a full tail or a position inside the
+ * base copies the history.
+ * \param position Index the transaction will have after the insert.
+ * \param transaction The transaction to insert.
+ * \returns Always true.
+ */
+bool CSnapshotTransactionStore::Insert(size_t position, const CTransaction & transaction)
+{
+	size_t baseCount = this->mBase->size();
+	if (position >= baseCount && this->mTail.size() < this->mMergeThreshold)
+	{
+		this->mTail.insert(this->mTail.begin() + (position - baseCount), transaction);
+		this->UpdateSegments();
+		return true;
+	}
+
+	vector<CTransaction> transactions;
+	transactions.reserve(this->Size() + 1);
+	transactions.insert(transactions.end(), this->Begin(), this->End());
+	transactions.insert(transactions.begin() + position, transaction);
+	this->Rebase(transactions);
+	return true;
+}
+
+
+/**
+ * Remove the transaction at the given position.
+ * \param position Index of the transaction to remove.
+ * \returns Always true.
+ */
+bool CSnapshotTransactionStore::Erase(size_t position)
+{
+	size_t baseCount = this->mBase->size();
+	if (position >= baseCount)
+	{
+		this->mTail.erase(this->mTail.begin() + (position - baseCount));
+		this->UpdateSegments();
+		return true;
+	}
+
+	vector<CTransaction> transactions(this->Begin(), this->End());
+	transactions.erase(transactions.begin() + position);
+	this->Rebase(transactions);
+	return true;
+}
+
+
+/**
+ * Remove every transaction. Other copies keep theirs.
+ */
+void CSnapshotTransactionStore::Clear()
+{
+	vector<CTransaction> none;
+	this->Rebase(none);
+}
+
+
+/**
+ * \returns How many bytes of memory this store is holding on to, including itself. The base is counted
+ *		in full even though other copies may share it.
+ */
+size_t CSnapshotTransactionStore::GetMemoryUsage() const
+{
+	return sizeof(*this) + (this->mBase->capacity() + this->mTail.capacity()) * sizeof(CTransaction);
+}
+
+
+/**
+ * \returns A copy that shares this store's base.
+ */
+std::unique_ptr<CTransactionStore> CSnapshotTransactionStore::Clone() const
+{
+	return std::unique_ptr<CTransactionStore>(new CSnapshotTransactionStore(*this));
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "TransactionStore.h"
+
+
+/**
+ * A transaction store that is cheap to copy, for keeping many versions of one account's history.
+ *
+ * The bulk of the transactions is in an immutable base that copies share. Transactions added after the
+ * end of the base go to a small tail that each copy owns. Once the tail holds mergeThreshold transactions
+ * it is merged into a new base. Anything that would change the base (a backdated insert, say) builds a
+ * new base instead, so a copy never sees a change made to another copy.
+ */
+class CSnapshotTransactionStore : public CTransactionStore
+{
+public:
+	/// How many transactions the tail holds before it is merged into a new base.
+	static const size_t DEFAULT_MERGE_THRESHOLD = 256;
+
+private:
+	/// The transactions shared with other copies. Never changed once it is built.
+	std::shared_ptr<const std::vector<CTransaction>> mBase;
+
+	/// Transactions after the last one in mBase, in order by time. Owned by this copy.
+	std::vector<CTransaction> mTail;
+
+	/// How big mTail can get before it is merged into a new base.
+	size_t mMergeThreshold;
+
+	void Rebase(std::vector<CTransaction> & transactions);
+	void UpdateSegments();
+
+public:
+	CSnapshotTransactionStore(size_t mergeThreshold = DEFAULT_MERGE_THRESHOLD);
+	CSnapshotTransactionStore(const CSnapshotTransactionStore & other);
+	virtual ~CSnapshotTransactionStore();
+
+	size_t GetBaseCount() const;
+
+	virtual bool Insert(size_t position, const CTransaction & transaction) override;
+	virtual bool Erase(size_t position) override;
+	virtual void Clear() override;
+	virtual size_t GetMemoryUsage() const override;
+	virtual std::unique_ptr<CTransactionStore> Clone() const override;
+};
@@ -0,0 +1,396 @@
+#include "StatementExporter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include "Tracing.h"
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using std::lock_guard;
+using std::mutex;
+
+const char CStatementExporter::MAGIC[8] = { 'A', 'V', 'S', 'T', 'M', 'T', '0', '1' };
+
+const CStatementExporter::SColumn CStatementExporter::COLUMNS[CStatementExporter::COLUMN_COUNT] =
+{
+	{ "account_id", UINT64 },
+	{ "cycle", INT32 },
+	{ "opening_balance", FLOAT64 },
+	{ "charges", FLOAT64 },
+	{ "payments", FLOAT64 },
+	{ "interest", FLOAT64 },
+	{ "closing_balance", FLOAT64 }
+};
+
+
+/**
+ * Append the values of a column to a buffer as they are laid out in memory.
+ * \param buffer The buffer.
+ * \param values The values.
+ */
+template <typename T>
+static void AppendColumn(vector<unsigned char> & buffer, const vector<T> & values)
+{
+	const unsigned char * bytes = (const unsigned char *)values.data();
+	buffer.insert(buffer.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+
+/**
+ * Append a value to a buffer as it is laid out in memory.
+ * \param buffer The buffer.
+ * \param value The value.
+ */
+template <typename T>
+static void AppendValue(vector<unsigned char> & buffer, T value)
+{
+	const unsigned char * bytes = (const unsigned char *)&value;
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+
+/**
+ * Read a value laid out in memory from a buffer.
+ * \param data The buffer.
+ * \param size How big the buffer is.
+ * \param offset Where the value is. Moved past it.
+ * \param value Receives the value.
+ * \returns False if the buffer ends first.
+ */
+template <typename T>
+static bool ReadValue(const vector<unsigned char> & data, size_t * offset, T * value)
+{
+	if (*offset + sizeof(T) > data.size())
+	{
+		return false;
+	}
+	std::memcpy(value, data.data() + *offset, sizeof(T));
+	*offset += sizeof(T);
+	return true;
+}
+
+
+/**
+ * Read the values of a column of a row group.
+ * \param data The whole file.
+ * \param offset Where the column starts. Moved past it.
+ * \param rows How many values the column has in the row group.
+ * \param values The values are appended to this.
+ * \returns False if the file ends first.
+ */
+template <typename T>
+static bool ReadColumn(const vector<unsigned char> & data, size_t * offset, unsigned long long rows, vector<T> & values)
+{
+	if (rows > (data.size() - std::min(*offset, data.size())) / sizeof(T))
+	{
+		return false;
+	}
+	size_t first = values.size();
+	values.resize(first + (size_t)rows);
+	std::memcpy(values.data() + first, data.data() + *offset, (size_t)rows * sizeof(T));
+	*offset += (size_t)rows * sizeof(T);
+	return true;
+}
+
+
+/**
+ * Remove every row.
+ */
+void CStatementExporter::SRows::Clear()
+{
+	this->mAccount.clear();
+	this->mCycle.clear();
+	this->mOpeningBalance.clear();
+	this->mCharges.clear();
+	this->mPayments.clear();
+	this->mInterest.clear();
+	this->mClosingBalance.clear();
+}
+
+
+/**
+ * Add a row.
+ * \param account The account.
+ * \param statement The statement of one of its cycles.
+ */
+void CStatementExporter::SRows::Append(AccountId account, const CCreditCardAccount::SStatement & statement)
+{
+	this->mAccount.push_back(account);
+	this->mCycle.push_back(statement.mCycle);
+	this->mOpeningBalance.push_back(statement.mOpeningBalance);
+	this->mCharges.push_back(statement.mCharges);
+	this->mPayments.push_back(statement.mPayments);
+	this->mInterest.push_back(statement.mInterest);
+	this->mClosingBalance.push_back(statement.mClosingBalance);
+}
+
+
+/**
+ * Constructor.
+ * \param accounts Where the statements come from.
+ * \param threadCount How many worker threads work out statements. 0 means one for each hardware thread.
+ */
+CStatementExporter::CStatementExporter(shared_ptr<CAccountCache> accounts, size_t threadCount) :
+	mAccounts(accounts), mThreadCount(threadCount), mNextAccount(0), mMissingAccounts(0)
+{
+	if (this->mThreadCount == 0)
+	{
+		this->mThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+
+/**
+ * Destructor.
+ */
+CStatementExporter::~CStatementExporter()
+{
+}
+
+
+/**
+ * Export the statements of some accounts. Only one export runs at a time on an exporter.
+ * \param path The file to write. Replaced if it exists.
+ * \param ids The accounts.
+ * \param report Receives what the export did.
+ * \returns False if the file couldn't be written.
+ */
+bool CStatementExporter::Export(const string & path, const vector<AccountId> & ids, SReport * report)
+{
+	TRACE_SCOPE("StatementExporter: export");
+	auto start = std::chrono::steady_clock::now();
+	*report = SReport();
+	string temporaryPath = path + ".tmp";
+	this->mFile = std::fopen(temporaryPath.c_str(), "wb");
+	if (this->mFile == nullptr)
+	{
+		return false;
+	}
+	// Every write is a whole row group, so a buffer in between would only copy it once more.
+	std::setvbuf(this->mFile, nullptr, _IONBF, 0);
+	this->mOffset = 0;
+	this->mRowGroups.clear();
+	this->mWriteFailed = false;
+	this->mNextAccount = 0;
+	this->mMissingAccounts = 0;
+
+	vector<std::thread> workers;
+	for (size_t i = 0; i < this->mThreadCount; ++i)
+	{
+		workers.emplace_back(&CStatementExporter::RunWorker, this, &ids);
+	}
+	for (std::thread & worker : workers)
+	{
+		worker.join();
+	}
+
+	bool written = this->WriteFooter();
+	written &= std::fclose(this->mFile) == 0;
+	this->mFile = nullptr;
+	if (!written)
+	{
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+	// rename doesn't replace an existing file on Windows.
+	std::remove(path.c_str());
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		return false;
+	}
+
+	report->mMissingAccounts = this->mMissingAccounts;
+	report->mAccounts = ids.size() - report->mMissingAccounts;
+	for (const SRowGroup & group : this->mRowGroups)
+	{
+		report->mRows += group.mRows;
+	}
+	report->mBytes = this->mOffset;
+	report->mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	report->mBytesPerSecond = (report->mSeconds > 0.0) ? report->mBytes / report->mSeconds : 0.0;
+	return true;
+}
+
+
+/**
+ * Body of a worker thread. Takes blocks of accounts until there are none left, and writes a row group every time
+ * it has enough rows for one.
+ * \param ids Every account of the export.
+ */
+void CStatementExporter::RunWorker(const vector<AccountId> * ids)
+{
+	SRows rows;
+	vector<CCreditCardAccount::SStatement> statements;
+	vector<unsigned char> buffer;
+	while (true)
+	{
+		size_t first = this->mNextAccount.fetch_add(ACCOUNT_BLOCK);
+		if (first >= ids->size())
+		{
+			break;
+		}
+		size_t last = std::min(first + ACCOUNT_BLOCK, ids->size());
+		for (size_t i = first; i < last; ++i)
+		{
+			AccountId id = (*ids)[i];
+			if (!this->mAccounts->GetStatements(id, &statements))
+			{
+				this->mMissingAccounts++;
+				continue;
+			}
+			for (const CCreditCardAccount::SStatement & statement : statements)
+			{
+				rows.Append(id, statement);
+			}
+		}
+		if (rows.Size() >= ROW_GROUP_ROWS)
+		{
+			this->WriteRowGroup(rows, buffer);
+			rows.Clear();
+		}
+	}
+	if (rows.Size() > 0)
+	{
+		this->WriteRowGroup(rows, buffer);
+	}
+}
+
+
+/**
+ * Write rows to the file as one row group.
+ * \param rows The rows.
+ * \param buffer Where the row group is put together. Kept by the worker so it is only allocated once.
+ */
+void CStatementExporter::WriteRowGroup(const SRows & rows, vector<unsigned char> & buffer)
+{
+	TRACE_SCOPE("StatementExporter: write row group");
+	buffer.clear();
+	AppendColumn(buffer, rows.mAccount);
+	AppendColumn(buffer, rows.mCycle);
+	AppendColumn(buffer, rows.mOpeningBalance);
+	AppendColumn(buffer, rows.mCharges);
+	AppendColumn(buffer, rows.mPayments);
+	AppendColumn(buffer, rows.mInterest);
+	AppendColumn(buffer, rows.mClosingBalance);
+
+	lock_guard<mutex> guard(this->mLock);
+	if (this->mWriteFailed || std::fwrite(buffer.data(), 1, buffer.size(), this->mFile) != buffer.size())
+	{
+		this->mWriteFailed = true;
+		return;
+	}
+	SRowGroup group = { this->mOffset, rows.Size() };
+	this->mRowGroups.push_back(group);
+	this->mOffset += buffer.size();
+}
+
+
+/**
+ * Write the footer after the last row group.
+ * \returns False if a row group or the footer couldn't be written.
+ */
+bool CStatementExporter::WriteFooter()
+{
+	vector<unsigned char> footer;
+	AppendValue(footer, (unsigned int)COLUMN_COUNT);
+	for (const SColumn & column : COLUMNS)
+	{
+		size_t length = std::strlen(column.mName);
+		AppendValue(footer, (unsigned char)column.mType);
+		AppendValue(footer, (unsigned char)length);
+		footer.insert(footer.end(), column.mName, column.mName + length);
+	}
+	AppendValue(footer, (unsigned int)this->mRowGroups.size());
+	unsigned long long rows = 0;
+	for (const SRowGroup & group : this->mRowGroups)
+	{
+		AppendValue(footer, group.mOffset);
+		AppendValue(footer, group.mRows);
+		rows += group.mRows;
+	}
+	AppendValue(footer, rows);
+	AppendValue(footer, (unsigned int)footer.size());
+	footer.insert(footer.end(), MAGIC, MAGIC + sizeof(MAGIC));
+
+	if (this->mWriteFailed || std::fwrite(footer.data(), 1, footer.size(), this->mFile) != footer.size())
+	{
+		return false;
+	}
+	this->mOffset += footer.size();
+	return true;
+}
+
+
+/**
+ * Read a whole export back into memory. Meant for checking an export and for small ones; an analytics tool would
+ * read the columns it wants straight from the file.
+ * \param path The file.
+ * \param rows Receives every row, in the order of the file.
+ * \returns False if the file can't be read or isn't an export with the columns this version writes.
+ */
+bool CStatementExporter::Read(const string & path, SRows * rows)
+{
+	rows->Clear();
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+	vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	size_t trailer = sizeof(unsigned int) + sizeof(MAGIC);
+	if (data.size() < trailer || std::memcmp(data.data() + data.size() - sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0)
+	{
+		return false;
+	}
+	unsigned int footerSize;
+	size_t offset = data.size() - trailer;
+	ReadValue(data, &offset, &footerSize);
+	if (footerSize > data.size() - trailer)
+	{
+		return false;
+	}
+
+	offset = data.size() - trailer - footerSize;
+	unsigned int columnCount;
+	if (!ReadValue(data, &offset, &columnCount) || columnCount != COLUMN_COUNT)
+	{
+		return false;
+	}
+	for (const SColumn & column : COLUMNS)
+	{
+		unsigned char type, length;
+		if (!ReadValue(data, &offset, &type) || !ReadValue(data, &offset, &length) || type != column.mType
+			|| offset + length > data.size() || std::strlen(column.mName) != length
+			|| std::memcmp(data.data() + offset, column.mName, length) != 0)
+		{
+			return false;
+		}
+		offset += length;
+	}
+	unsigned int groupCount;
+	if (!ReadValue(data, &offset, &groupCount))
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < groupCount; ++i)
+	{
+		SRowGroup group;
+		if (!ReadValue(data, &offset, &group.mOffset) || !ReadValue(data, &offset, &group.mRows))
+		{
+			return false;
+		}
+		size_t column = (size_t)group.mOffset;
+		if (!ReadColumn(data, &column, group.mRows, rows->mAccount) || !ReadColumn(data, &column, group.mRows, rows->mCycle)
+			|| !ReadColumn(data, &column, group.mRows, rows->mOpeningBalance) || !ReadColumn(data, &column, group.mRows, rows->mCharges)
+			|| !ReadColumn(data, &column, group.mRows, rows->mPayments) || !ReadColumn(data, &column, group.mRows, rows->mInterest)
+			|| !ReadColumn(data, &column, group.mRows, rows->mClosingBalance))
+		{
+			return false;
+		}
+	}
+	unsigned long long total;
+	return ReadValue(data, &offset, &total) && total == rows->Size();
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AccountCache.h"
+#include "AccountStore.h"
+#include "CreditCardAccount.h"
+
+
+/**
+ * Writes the statement of every cycle of many accounts to a columnar binary file for analytics.
+ *
+ * Each row is one cycle of one account: the account id, the cycle, and the opening balance, charges, payments,
+ * interest and closing balance of its statement (see CCreditCardAccount::SStatement). The rows of an account are
+ * next to each other and in order by cycle, but the accounts are in no particular order.
+ *
+ * Worker threads take accounts a block at a time, and each collects its rows in memory until it has a row group of
+ * ROW_GROUP_ROWS of them. A row group is written with one large write: every column of the group as a contiguous
+ * array, in the order of COLUMNS. After the last row group comes the footer, which tells a reader where everything is:
+ *
+ *		uint32 column count, then for each column: uint8 type (a EColumnType), uint8 name length, the name
+ *		uint32 row group count, then for each row group: uint64 offset in the file, uint64 rows
+ *		uint64 total rows
+ *		uint32 size of everything above in bytes
+ *		the 8 characters of MAGIC
+ *
+ * Numbers are little-endian, as they are laid out in memory on the platforms the engine builds for. A row group of
+ * n rows at offset o has the column c at o plus n times the width of every column before c.
+ *
+ * The file is written under a temporary name and renamed once it is complete, so a reader never sees half of one.
+ */
+class CStatementExporter
+{
+public:
+	/// How many rows a row group has, except the last one of each worker.
+	static const size_t ROW_GROUP_ROWS = 65536;
+
+	/// How many accounts a worker takes at a time.
+	static const size_t ACCOUNT_BLOCK = 256;
+
+	/// The last 8 bytes of every export.
+	static const char MAGIC[8];
+
+	/**
+	 * How the values of a column are stored.
+	 */
+	enum EColumnType
+	{
+		UINT64 = 1,
+		INT32 = 2,
+		FLOAT64 = 3
+	};
+
+	/**
+	 * The name and type of a column.
+	 */
+	struct SColumn
+	{
+		const char * mName;
+		EColumnType mType;
+	};
+
+	/// How many columns an export has.
+	static const size_t COLUMN_COUNT = 7;
+
+	/// The columns of an export, in the order they are in every row group.
+	static const SColumn COLUMNS[COLUMN_COUNT];
+
+	/**
+	 * Rows of an export, one vector per column.
+	 */
+	struct SRows
+	{
+		std::vector<AccountId> mAccount;
+		std::vector<int> mCycle;
+		std::vector<double> mOpeningBalance;
+		std::vector<double> mCharges;
+		std::vector<double> mPayments;
+		std::vector<double> mInterest;
+		std::vector<double> mClosingBalance;
+
+		size_t Size() const { return this->mAccount.size(); }
+		void Clear();
+		void Append(AccountId account, const CCreditCardAccount::SStatement & statement);
+	};
+
+	/**
+	 * What an export did.
+	 */
+	struct SReport
+	{
+		/// How many accounts were exported.
+		unsigned long long mAccounts = 0;
+
+		/// How many of the accounts asked for don't exist.
+		unsigned long long mMissingAccounts = 0;
+
+		/// How many rows were written.
+		unsigned long long mRows = 0;
+
+		/// How big the file is.
+		unsigned long long mBytes = 0;
+
+		/// How long the export took, from opening the file to renaming it.
+		double mSeconds = 0.0;
+
+		/// mBytes divided by mSeconds.
+		double mBytesPerSecond = 0.0;
+	};
+
+private:
+	/**
+	 * Where a row group is in the file.
+	 */
+	struct SRowGroup
+	{
+		unsigned long long mOffset;
+		unsigned long long mRows;
+	};
+
+	/// Where the statements come from.
+	std::shared_ptr<CAccountCache> mAccounts;
+
+	/// How many worker threads there are.
+	size_t mThreadCount;
+
+	/// The file being written. Guarded by mLock.
+	std::FILE * mFile = nullptr;
+
+	/// How many bytes were written to mFile. Guarded by mLock.
+	unsigned long long mOffset = 0;
+
+	/// The row groups written to mFile, in order. Guarded by mLock.
+	std::vector<SRowGroup> mRowGroups;
+
+	/// False once a write failed. Guarded by mLock.
+	bool mWriteFailed = false;
+
+	std::mutex mLock;
+
+	/// The index of the next account a worker takes.
+	std::atomic<size_t> mNextAccount;
+
+	/// How many accounts that were asked for don't exist.
+	std::atomic<unsigned long long> mMissingAccounts;
+
+	void RunWorker(const std::vector<AccountId> * ids);
+	void WriteRowGroup(const SRows & rows, std::vector<unsigned char> & buffer);
+	bool WriteFooter();
+
+public:
+	CStatementExporter(std::shared_ptr<CAccountCache> accounts, size_t threadCount = 0);
+	CStatementExporter(const CStatementExporter &) = delete;
+	virtual ~CStatementExporter();
+
+	bool Export(const std::string & path, const std::vector<AccountId> & ids, SReport * report);
+	static bool Read(const std::string & path, SRows * rows);
+};
@@ -21,14 +21,59 @@ CTimeHelper::~CTimeHelper()
 
 
 /**
- * Identical to mktime in the <ctime> library. The only difference is that it 
- * subtracts the timezone offset to ensure GMT format. 
+ * Identical to mktime in the <ctime> library, except the time struct is read as GMT instead of local time.
+ * Fields outside their usual range are carried over the same way, and the struct is normalized on return.
+ * Computed directly rather than through mktime, which takes the process wide timezone lock and can reread
+ * the timezone on every call.
  * \param time The time struct containing the information to generate the unix epoch time
  * \returns The corresponding unix epoch time in GMT format.
  */
 time_t CTimeHelper::mktimeGMT(tm * const time)
 {
-	return mktime(time) - _timezone;
+	// Carry whole years out of the month, so the month is 0 to 11.
+	long long year = 1900LL + time->tm_year + time->tm_mon / 12;
+	int month = time->tm_mon % 12;
+	if (month < 0)
+	{
+		month += 12;
+		--year;
+	}
+
+	// Days from 1970-01-01 to the first of the month, counting years from March so leap days come last.
+	long long shiftedYear = (month < 2) ? year - 1 : year;
+	long long era = (shiftedYear >= 0 ? shiftedYear : shiftedYear - 399) / 400;
+	long long yearOfEra = shiftedYear - era * 400;
+	long long dayOfYear = (153 * ((month + 10) % 12) + 2) / 5;
+	long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	long long days = era * 146097 + dayOfEra - 719468;
+
+	long long seconds = (days + time->tm_mday - 1) * DAYS_TO_SECS +
+		time->tm_hour * 3600LL + time->tm_min * 60LL + time->tm_sec;
+	time_t result = (time_t)seconds;
+
+	struct tm normalized;
+	if (gmtimeSafe(&result, &normalized) != nullptr)
+	{
+		*time = normalized;
+	}
+	return result;
+}
+
+
+/**
+ * Identical to gmtime in the <ctime> library, except it fills in a struct the caller owns instead of
+ * one shared by every thread, so accounts can be read from several threads at once.
+ * \param time The unix epoch time to convert.
+ * \param result Where the broken down time is stored.
+ * \returns result, or nullptr if the time can't be converted.
+ */
+tm * CTimeHelper::gmtimeSafe(const time_t * time, tm * result)
+{
+#ifdef _WIN32
+	return (gmtime_s(result, time) == 0) ? result : nullptr;
+#else
+	return gmtime_r(time, result);
+#endif
 }
 
 
@@ -39,7 +84,8 @@ time_t CTimeHelper::mktimeGMT(tm * const time)
  */
 time_t CTimeHelper::GetEndOfDay(const time_t time)
 {
-	struct tm * t = gmtime(&time);
+	struct tm buffer;
+	struct tm * t = gmtimeSafe(&time, &buffer);
 	t->tm_hour = t->tm_min = t->tm_sec = 0;
 	t->tm_mday += 1;
 	t->tm_yday = 0;
@@ -53,7 +99,8 @@ time_t CTimeHelper::GetEndOfDay(const time_t time)
 */
 time_t CTimeHelper::GetStartOfDay(const time_t time)
 {
-	struct tm * t = gmtime(&time);
+	struct tm buffer;
+	struct tm * t = gmtimeSafe(&time, &buffer);
 	t->tm_hour = t->tm_min = t->tm_sec = 0;
 	return mktimeGMT(t);
 }
@@ -68,7 +115,8 @@ time_t CTimeHelper::GetStartOfDay(const time_t time)
  */
 time_t CTimeHelper::AddDays(const time_t * time, int days)
 {
-	struct tm * editedTime = gmtime(time);
+	struct tm buffer;
+	struct tm * editedTime = gmtimeSafe(time, &buffer);
 
 	editedTime->tm_mday += days;
 	editedTime->tm_yday = 0;
@@ -89,7 +137,7 @@ int CTimeHelper::DiffDays(const time_t time1, const time_t time2)
 {
 	double diffSec = difftime(GetStartOfDay(time1), GetStartOfDay(time2));
 
-	return ((int)diffSec) / DAYS_TO_SECS;
+	return (int)(diffSec / DAYS_TO_SECS);
 
 }
 
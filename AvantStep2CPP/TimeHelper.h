@@ -10,6 +10,7 @@ class CTimeHelper
 {
 public:
 	static time_t mktimeGMT(struct tm * const time);
+	static struct tm * gmtimeSafe(const time_t * time, struct tm * result);
 	static time_t GetEndOfDay(const time_t time);
 	static time_t GetStartOfDay(const time_t time);
 	static time_t AddDays(const time_t * time, int days);
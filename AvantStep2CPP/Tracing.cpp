@@ -0,0 +1,212 @@
+#include "Tracing.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+using std::atomic;
+using std::string;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+
+/**
+ * The spans recorded by one thread. Only that thread writes it. The fields are atomic so a dump can
+ * read them while they're written; a dump throws away any slot the writer may have lapped.
+ */
+struct SThreadTrace
+{
+	struct SRecord
+	{
+		atomic<const char *> mName;
+		atomic<unsigned long long> mStart;
+		atomic<unsigned long long> mEnd;
+	};
+
+	/// The thread number written in the trace.
+	int mThread;
+
+	/// How many spans the thread recorded since it started. The next one goes in mHead % BUFFER_CAPACITY.
+	atomic<unsigned long long> mHead;
+
+	/// Spans recorded before this number were cleared.
+	atomic<unsigned long long> mCleared;
+
+	std::unique_ptr<SRecord[]> mRecords;
+
+	SThreadTrace(int thread) : mThread(thread), mHead(0), mCleared(0), mRecords(new SRecord[CTracing::BUFFER_CAPACITY])
+	{
+	}
+};
+
+
+/**
+ * Every thread's spans. Buffers outlive their threads so a dump after the threads exit still shows them.
+ */
+struct STraceRegistry
+{
+	std::mutex mLock;
+	std::vector<std::unique_ptr<SThreadTrace>> mThreads;
+};
+
+/**
+ * \returns The registry.
+ */
+static STraceRegistry & GetRegistry()
+{
+	static STraceRegistry registry;
+	return registry;
+}
+
+/**
+ * \returns The calling thread's spans. Registered the first time the thread records one.
+ */
+static SThreadTrace & GetThreadTrace()
+{
+	thread_local SThreadTrace * trace = nullptr;
+	if (trace == nullptr)
+	{
+		STraceRegistry & registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mLock);
+		registry.mThreads.emplace_back(new SThreadTrace((int)registry.mThreads.size() + 1));
+		trace = registry.mThreads.back().get();
+	}
+	return *trace;
+}
+
+
+/**
+ * \returns The current time in nanoseconds, for the start and end of spans.
+ */
+unsigned long long CTracing::Now()
+{
+	return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * Record a span in the calling thread's ring buffer, overwriting the oldest one if it is full.
+ * \param name What the span is called. Must be a string literal, since only the pointer is kept.
+ * \param start When the span started, from Now.
+ * \param end When the span ended, from Now.
+ */
+void CTracing::Record(const char * name, unsigned long long start, unsigned long long end)
+{
+	SThreadTrace & trace = GetThreadTrace();
+	unsigned long long head = trace.mHead.load(memory_order_relaxed);
+	SThreadTrace::SRecord & record = trace.mRecords[head % BUFFER_CAPACITY];
+	record.mName.store(name, memory_order_relaxed);
+	record.mStart.store(start, memory_order_relaxed);
+	record.mEnd.store(end, memory_order_relaxed);
+	trace.mHead.store(head + 1, memory_order_release);
+}
+
+
+/**
+ * Write the spans every thread has kept as Chrome trace-event JSON. Threads can keep recording meanwhile.
+ * \param stream Where to write.
+ */
+void CTracing::WriteChromeTrace(std::ostream & stream)
+{
+	STraceRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+
+	stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char line[256];
+	for (std::unique_ptr<SThreadTrace> & trace : registry.mThreads)
+	{
+		unsigned long long head = trace->mHead.load(memory_order_acquire);
+		unsigned long long begin = trace->mCleared.load(memory_order_relaxed);
+		if (head - begin > BUFFER_CAPACITY)
+		{
+			begin = head - BUFFER_CAPACITY;
+		}
+
+		for (unsigned long long i = begin; i < head; ++i)
+		{
+			SThreadTrace::SRecord & record = trace->mRecords[i % BUFFER_CAPACITY];
+			const char * name = record.mName.load(memory_order_relaxed);
+			unsigned long long start = record.mStart.load(memory_order_relaxed);
+			unsigned long long end = record.mEnd.load(memory_order_relaxed);
+
+			// If the writer reached this slot again while it was read, the record may be torn.
+			if (trace->mHead.load(memory_order_acquire) - i >= BUFFER_CAPACITY)
+			{
+				continue;
+			}
+
+			snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"cat\":\"engine\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				first ? "" : ",", name, trace->mThread, (double)start / 1000.0, (double)(end - start) / 1000.0);
+			stream << line;
+			first = false;
+		}
+	}
+	stream << "\n]}\n";
+}
+
+
+/**
+ * Write the spans every thread has kept to a file, as Chrome trace-event JSON.
+ * \param path The file.
+ * \returns True if the file was written.
+ */
+bool CTracing::WriteChromeTrace(const string & path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+	WriteChromeTrace(file);
+	return (bool)file;
+}
+
+
+/**
+ * Forget every span recorded so far.
+ */
+void CTracing::Clear()
+{
+	STraceRegistry & registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mLock);
+	for (std::unique_ptr<SThreadTrace> & trace : registry.mThreads)
+	{
+		trace->mCleared.store(trace->mHead.load(memory_order_acquire), memory_order_relaxed);
+	}
+}
+
+
+/**
+ * Constructor. Starts the span.
+ * \param name What the span is called. Must be a string literal, since only the pointer is kept.
+ */
+CTracing::Span::Span(const char * name) : mName(name), mStart(CTracing::Now())
+{
+}
+
+
+/**
+ * Destructor. Records the span unless End already did.
+ */
+CTracing::Span::~Span()
+{
+	this->End();
+}
+
+
+/**
+ * Record the span now instead of when it is destroyed.
+ */
+void CTracing::Span::End()
+{
+	if (!this->mEnded)
+	{
+		CTracing::Record(this->mName, this->mStart, CTracing::Now());
+		this->mEnded = true;
+	}
+}
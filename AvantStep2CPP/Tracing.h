@@ -0,0 +1,70 @@
+#pragma once
+#include <ostream>
+#include <string>
+
+
+/**
+ * Records spans of time (one call, or one phase of a call) so individual slow calls can be looked at
+ * in chrome://tracing or Perfetto.
+ *
+ * Every thread records into its own ring buffer, without locks, so only the latest spans of each thread
+ * are kept. WriteChromeTrace dumps them as Chrome trace-event JSON.
+ *
+ * The engine records spans through the TRACE_SCOPE, TRACE_BEGIN and TRACE_END macros, which only do
+ * anything if AVANT_TRACING is defined. Without it they compile to nothing.
+ */
+class CTracing
+{
+public:
+	/// How many spans each thread keeps. Older ones are overwritten.
+	static const size_t BUFFER_CAPACITY = 1 << 16;
+
+	/**
+	 * A span that starts when it is constructed and is recorded when it is ended or destroyed.
+	 */
+	class Span
+	{
+	private:
+		/// What the span is called. Must be a string literal, since only the pointer is kept.
+		const char * mName;
+
+		/// When the span started, from CTracing::Now.
+		unsigned long long mStart;
+
+		/// True once the span was recorded.
+		bool mEnded = false;
+
+	public:
+		Span(const char * name);
+		Span(const Span &) = delete;
+		~Span();
+
+		void End();
+	};
+
+	static unsigned long long Now();
+	static void Record(const char * name, unsigned long long start, unsigned long long end);
+
+	static void WriteChromeTrace(std::ostream & stream);
+	static bool WriteChromeTrace(const std::string & path);
+	static void Clear();
+
+	CTracing() = delete;
+};
+
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef AVANT_TRACING
+/// Record a span from here to the end of the enclosing scope.
+#define TRACE_SCOPE(name) CTracing::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+/// Start a span called name that TRACE_END(span) ends.
+#define TRACE_BEGIN(span, name) CTracing::Span span(name)
+/// End a span started by TRACE_BEGIN.
+#define TRACE_END(span) span.End()
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(span, name) ((void)0)
+#define TRACE_END(span) ((void)0)
+#endif
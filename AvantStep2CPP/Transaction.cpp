@@ -2,25 +2,30 @@
 
 
 
-CTransaction::CTransaction(double value, time_t time, TransactionType type) : mValue(value), mTime(time), mType(type)
+CTransaction::CTransaction(double value, time_t time, TransactionType type) : mTime(time), mValue(CMoney::FromDollars(value)), mType(type), mReserved(0)
 {
 }
 
-CTransaction::~CTransaction()
+CTransaction::CTransaction(CMoney value, time_t time, TransactionType type) : mTime(time), mValue(value), mType(type), mReserved(0)
 {
 }
 
-time_t CTransaction::GetTime()
+time_t CTransaction::GetTime() const
 {
 	return this->mTime;
 }
 
-CTransaction::TransactionType CTransaction::GetType()
+CTransaction::TransactionType CTransaction::GetType() const
 {
 	return this->mType;
 }
 
-double CTransaction::GetValue()
+double CTransaction::GetValue() const
+{
+	return this->mValue.ToDollars();
+}
+
+CMoney CTransaction::GetAmount() const
 {
 	return this->mValue;
-}
\ No newline at end of file
+}
@@ -1,10 +1,15 @@
 #pragma once
+#include <cstdint>
 #include <ctime>
+#include "Money.h"
 
 
 /**
- * Class representing transactions made. They can either be charges to the card or payments. Either way, the value of the transaction 
+ * Class representing transactions made. They can either be charges to the card or payments. Either way, the value of the transaction
  * is positive. Leave it to the credit card to organize purchases and payments.
+ *
+ * Transactions are small fixed-width values so that a transaction store can keep them contiguously, in memory or in a
+ * memory-mapped file, without one allocation per transaction.
  */
 class CTransaction
 {
@@ -18,27 +23,33 @@ public:
 		PAYMENT
 	};
 
-private:		
-	/// How much money is in the transaction. Should always be positive. A transaction is a way to acknowledge money was exchanged. You cannot exchange negative money to someone. 
-	double mValue;
-	
+private:
+	/// The time the transaction took place, stored as seconds after unix epoch time.
+	time_t mTime;
+
+	/// How much money is in the transaction. Should always be positive. A transaction is a way to acknowledge money was exchanged. You cannot exchange negative money to someone.
+	CMoney mValue;
+
 	/// The type of transaction made. See TransactionType for more details.
 	TransactionType mType;
-	
-	/// The time the transaction took place, stored as seconds after unix epoch time. 
-	time_t mTime;
 
-public:	
-	
+	/// Always 0. Fills what would otherwise be padding after mType, so a transaction written to a file as it is laid
+	/// out in memory has every byte set.
+	uint32_t mReserved;
+
+public:
+
 
 	CTransaction() = delete;
-	CTransaction(const CTransaction &) = delete;
 	CTransaction(double value, time_t time, TransactionType type);
+	CTransaction(CMoney value, time_t time, TransactionType type);
 
-	time_t GetTime();
-	TransactionType GetType();
-	double GetValue();
-
-	virtual ~CTransaction();
+	time_t GetTime() const;
+	TransactionType GetType() const;
+	double GetValue() const;
+	CMoney GetAmount() const;
 };
 
+// The memory-mapped transaction store writes transactions to disk as they are laid out in memory, the value as a
+// whole number of millionths of a dollar.
+static_assert(sizeof(CTransaction) == 24, "CTransaction must stay a fixed-width record");
@@ -7,8 +7,6 @@
 #include "TransactionFactory.h"
 #include "TimeHelper.h"
 
-using std::shared_ptr;
-
 
 /**
  * Constructor. Doesn't do much.
@@ -32,14 +30,14 @@ CTransactionFactory::~CTransactionFactory()
  * \param value The value of the transaction.
  * \param time The time the transaction took place as a time struct.
  * \param type The type of transaction. Charges increase balance, payments decrease it.
- * \returns A shared pointer to the created CTransaction object.
+ * \returns The created CTransaction object.
  */
-shared_ptr<CTransaction> CTransactionFactory::CreateTransaction(double value, tm * time, CTransaction::TransactionType type)
+CTransaction CTransactionFactory::CreateTransaction(double value, tm * time, CTransaction::TransactionType type)
 {
 	// Convert to epoch time
 	time_t transactionTime = CTimeHelper::mktimeGMT(time);
 
-	return std::make_shared<CTransaction>(value, transactionTime, type);
+	return CTransaction(value, transactionTime, type);
 }
 
 
@@ -52,12 +50,13 @@ shared_ptr<CTransaction> CTransactionFactory::CreateTransaction(double value, tm
  * \param accountStart The day the credit card account was started.
  * \param days How many days after the account 
  * \param type The type of transaction. Charges increase balance, payments decrease it.
- * \returns A shared pointer to the created CTransaction object.
+ * \returns The created CTransaction object.
  */
-shared_ptr<CTransaction> CTransactionFactory::CreateTransaction(double value, const time_t * accountStart, int days, CTransaction::TransactionType type)
+CTransaction CTransactionFactory::CreateTransaction(double value, const time_t * accountStart, int days, CTransaction::TransactionType type)
 {
 	// Convert epoch time of the account start time to a tm struct. We can add days to this struct without fear of overlap.
-	struct tm *time = gmtime(accountStart);
+	struct tm buffer;
+	struct tm *time = CTimeHelper::gmtimeSafe(accountStart, &buffer);
 
 	// Our days start at index 0 so we have to add one.
 	time->tm_mday += days;
@@ -1,6 +1,5 @@
 #pragma once
 #include "Transaction.h"
-#include <memory>
 
 
 /**
@@ -14,8 +13,8 @@ public:
 	CTransactionFactory();
 	virtual ~CTransactionFactory();
 
-	std::shared_ptr<CTransaction> CreateTransaction(double value, struct tm * time, CTransaction::TransactionType type);
-	std::shared_ptr<CTransaction> CreateTransaction(double value, const time_t *accountStart, int days, CTransaction::TransactionType type);
+	CTransaction CreateTransaction(double value, struct tm * time, CTransaction::TransactionType type);
+	CTransaction CreateTransaction(double value, const time_t *accountStart, int days, CTransaction::TransactionType type);
 
 };
 
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include "TransactionStore.h"
+
+
+/**
+ * A read-only view of a run of consecutive transactions of a store, such as the ones of a day or a cycle.
+ * Nothing is copied: the view is two iterators into the store, and reading it reads the store's memory.
+ * Like any iterator into a store, a view is only good until the store changes.
+ *
+ * The members are named begin and end so a view works in a range-based for and with the standard
+ * algorithms, and with C++20 ranges it is a borrowed view with random access.
+ *
+ * A store keeps its transactions in at most two runs of memory, so a view is one contiguous array unless it
+ * spans both. GetSegments hands those arrays out directly, for code that wants plain pointers.
+ */
+class CTransactionRange
+{
+public:
+	typedef CTransactionStore::Iterator iterator;
+	typedef CTransactionStore::Iterator const_iterator;
+	typedef CTransaction value_type;
+	typedef const CTransaction & reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+private:
+	/// The first transaction of the view.
+	iterator mBegin;
+
+	/// DIRECTLY AFTER the last transaction of the view.
+	iterator mEnd;
+
+public:
+	/**
+	 * Constructor. An empty view.
+	 */
+	CTransactionRange() = default;
+
+	/**
+	 * Constructor.
+	 * \param begin Iterator to the first transaction of the view.
+	 * \param end Iterator DIRECTLY AFTER the last transaction of the view. Must be into the same store.
+	 */
+	CTransactionRange(iterator begin, iterator end) : mBegin(begin), mEnd(end)
+	{
+	}
+
+	iterator begin() const { return this->mBegin; }
+	iterator end() const { return this->mEnd; }
+	size_type size() const { return (size_type)(this->mEnd - this->mBegin); }
+	bool empty() const { return this->mBegin == this->mEnd; }
+	reference operator[](size_type index) const { return this->mBegin[(difference_type)index]; }
+	reference front() const { return *this->mBegin; }
+	reference back() const { return *(this->mEnd - 1); }
+
+	/**
+	 * \returns The transactions of the view as one array, or nullptr if they span both runs of the store
+	 *		or there are none. There are size() of them.
+	 */
+	const CTransaction * Data() const
+	{
+		const CTransaction * first;
+		const CTransaction * second;
+		size_t firstCount, secondCount;
+		this->GetSegments(&first, &firstCount, &second, &secondCount);
+		return (secondCount == 0 && firstCount > 0) ? first : nullptr;
+	}
+
+	/**
+	 * Get the transactions of the view as arrays of the store's memory, in time order.
+	 * \param first Receives the first array.
+	 * \param firstCount Receives how many transactions are in the first array. 0 if the view is empty.
+	 * \param second Receives the array that follows the first one.
+	 * \param secondCount Receives how many transactions are in the second array. 0 unless the view spans both
+	 *		runs of the store.
+	 */
+	void GetSegments(const CTransaction ** first, size_t * firstCount, const CTransaction ** second, size_t * secondCount) const
+	{
+		size_t headCount = this->mBegin.HeadCount();
+		size_t begin = this->mBegin.Index();
+		size_t end = this->mEnd.Index();
+		*first = nullptr;
+		*firstCount = 0;
+		*second = nullptr;
+		*secondCount = 0;
+		if (begin >= end)
+		{
+			return;
+		}
+		if (end <= headCount || begin >= headCount)
+		{
+			*first = &*this->mBegin;
+			*firstCount = end - begin;
+			return;
+		}
+		*first = &*this->mBegin;
+		*firstCount = headCount - begin;
+		*second = &*(this->mBegin + (difference_type)*firstCount);
+		*secondCount = end - headCount;
+	}
+};
+
+#if defined(__cpp_lib_ranges)
+#include <ranges>
+
+// A view only refers to the store, so iterators taken from a temporary view stay good.
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<CTransactionRange> = true;
+
+template <>
+inline constexpr bool std::ranges::enable_view<CTransactionRange> = true;
+#endif
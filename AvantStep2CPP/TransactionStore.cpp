@@ -0,0 +1,62 @@
+#include "TransactionStore.h"
+#include "InlineTransactionStore.h"
+
+
+/**
+ * Constructor. The store starts out empty.
+ */
+CTransactionStore::CTransactionStore()
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CTransactionStore::~CTransactionStore()
+{
+}
+
+
+/**
+ * Tell the store the given range is about to be read once from start to end. Stores that
+ * don't keep their transactions in memory can use this to read ahead. By default it does nothing.
+ * \param start Iterator to the first transaction that will be read.
+ * \param end Iterator DIRECTLY AFTER the last transaction that will be read.
+ */
+void CTransactionStore::AdviseSequential(Iterator start, Iterator end) const
+{
+}
+
+
+/**
+ * Make a copy of the store that can be changed without affecting this one. By default the copy keeps
+ * every transaction in memory, whatever kind of store this is.
+ * \returns The copy.
+ */
+std::unique_ptr<CTransactionStore> CTransactionStore::Clone() const
+{
+	std::unique_ptr<CTransactionStore> copy(new CInlineTransactionStore());
+	for (Iterator iter = this->Begin(); iter != this->End(); ++iter)
+	{
+		copy->Insert(copy->Size(), *iter);
+	}
+	return copy;
+}
+
+
+/**
+ * Derived stores call this every time their buffers move or change size, so the iterators
+ * handed out by Begin() and End() see the current contents.
+ * \param head Pointer to the first contiguous run of transactions.
+ * \param headCount How many transactions are in head.
+ * \param tail Pointer to the run of transactions that follows head.
+ * \param tailCount How many transactions are in tail.
+ */
+void CTransactionStore::SetSegments(const CTransaction * head, size_t headCount, const CTransaction * tail, size_t tailCount)
+{
+	this->mHead = head;
+	this->mHeadCount = headCount;
+	this->mTail = tail;
+	this->mTailCount = tailCount;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include "Transaction.h"
+
+
+/**
+ * Abstract storage for the transactions of a credit card account. Transactions are always kept in order by time.
+ *
+ * A store exposes its contents as at most two contiguous segments of fixed-width transactions: a head and a tail.
+ * Iterating a store never goes through a virtual call; only changing it does. Stores that keep everything in one
+ * buffer just leave the tail empty.
+ */
+class CTransactionStore
+{
+public:
+
+	/**
+	 * Random access iterator over the transactions of a store, in time order.
+	 * Any change to the store invalidates every iterator into it.
+	 */
+	class Iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef CTransaction value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const CTransaction * pointer;
+		typedef const CTransaction & reference;
+
+		Iterator() = default;
+		Iterator(const CTransaction * head, size_t headCount, const CTransaction * tail, size_t index) :
+			mHead(head), mHeadCount(headCount), mTail(tail), mIndex(index) {}
+
+		reference operator*() const { return (mIndex < mHeadCount) ? mHead[mIndex] : mTail[mIndex - mHeadCount]; }
+		pointer operator->() const { return &(**this); }
+		reference operator[](difference_type offset) const { return *(*this + offset); }
+
+		Iterator & operator++() { ++mIndex; return *this; }
+		Iterator operator++(int) { Iterator copy = *this; ++mIndex; return copy; }
+		Iterator & operator--() { --mIndex; return *this; }
+		Iterator operator--(int) { Iterator copy = *this; --mIndex; return copy; }
+		Iterator & operator+=(difference_type offset) { mIndex += offset; return *this; }
+		Iterator & operator-=(difference_type offset) { mIndex -= offset; return *this; }
+		Iterator operator+(difference_type offset) const { Iterator copy = *this; return copy += offset; }
+		Iterator operator-(difference_type offset) const { Iterator copy = *this; return copy -= offset; }
+		friend Iterator operator+(difference_type offset, const Iterator & iter) { return iter + offset; }
+		difference_type operator-(const Iterator & other) const { return (difference_type)mIndex - (difference_type)other.mIndex; }
+
+		bool operator==(const Iterator & other) const { return mIndex == other.mIndex; }
+		bool operator!=(const Iterator & other) const { return mIndex != other.mIndex; }
+		bool operator<(const Iterator & other) const { return mIndex < other.mIndex; }
+		bool operator>(const Iterator & other) const { return mIndex > other.mIndex; }
+		bool operator<=(const Iterator & other) const { return mIndex <= other.mIndex; }
+		bool operator>=(const Iterator & other) const { return mIndex >= other.mIndex; }
+
+		/// Position of this iterator from the beginning of the store.
+		size_t Index() const { return mIndex; }
+
+		/// How many transactions of the store are in its head. Positions from there on are in its tail.
+		size_t HeadCount() const { return mHeadCount; }
+
+	private:
+		const CTransaction * mHead = nullptr;
+		size_t mHeadCount = 0;
+		const CTransaction * mTail = nullptr;
+		size_t mIndex = 0;
+	};
+
+	CTransactionStore();
+	CTransactionStore(const CTransactionStore &) = delete;
+	virtual ~CTransactionStore();
+
+	Iterator Begin() const { return Iterator(mHead, mHeadCount, mTail, 0); }
+	Iterator End() const { return Iterator(mHead, mHeadCount, mTail, mHeadCount + mTailCount); }
+	size_t Size() const { return mHeadCount + mTailCount; }
+	bool Empty() const { return Size() == 0; }
+
+	/**
+	 * Insert a transaction so it ends up at the given position.
+	 * \param position Index the transaction will have after the insert. Must keep the store in time order.
+	 * \param transaction The transaction to insert.
+	 * \returns True if the transaction was stored. False if the store could not grow.
+	 */
+	virtual bool Insert(size_t position, const CTransaction & transaction) = 0;
+
+	/**
+	 * Remove the transaction at the given position.
+	 * \param position Index of the transaction to remove.
+	 * \returns True if the transaction was removed. False if the store could not shrink.
+	 */
+	virtual bool Erase(size_t position) = 0;
+
+	/**
+	 * Remove every transaction.
+	 */
+	virtual void Clear() = 0;
+
+	virtual void AdviseSequential(Iterator start, Iterator end) const;
+	virtual std::unique_ptr<CTransactionStore> Clone() const;
+
+	/**
+	 * \returns How many bytes of memory this store is holding on to, including itself.
+	 */
+	virtual size_t GetMemoryUsage() const = 0;
+
+protected:
+	void SetSegments(const CTransaction * head, size_t headCount, const CTransaction * tail, size_t tailCount);
+
+private:
+	/// The first contiguous run of transactions.
+	const CTransaction * mHead = nullptr;
+
+	/// How many transactions are in mHead.
+	size_t mHeadCount = 0;
+
+	/// The run of transactions that follows mHead. All of them are at or after the last one in mHead.
+	const CTransaction * mTail = nullptr;
+
+	/// How many transactions are in mTail.
+	size_t mTailCount = 0;
+};
@@ -0,0 +1,72 @@
+#include "VectorTransactionStore.h"
+
+
+/**
+ * Constructor. The store starts out empty.
+ */
+CVectorTransactionStore::CVectorTransactionStore()
+{
+}
+
+
+/**
+ * Destructor.
+ */
+CVectorTransactionStore::~CVectorTransactionStore()
+{
+}
+
+
+/**
+ * Point the base class iterators at the vector's buffer. The vector is the only segment.
+ */
+void CVectorTransactionStore::UpdateSegments()
+{
+	this->SetSegments(this->mTransactions.data(), this->mTransactions.size(), nullptr, 0);
+}
+
+
+/**
+ * Insert a transaction so it ends up at the given position.
+ * \param position Index the transaction will have after the insert.
+ * \param transaction The transaction to insert.
+ * \returns Always true.
+ */
+bool CVectorTransactionStore::Insert(size_t position, const CTransaction & transaction)
+{
+	this->mTransactions.insert(this->mTransactions.begin() + position, transaction);
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove the transaction at the given position.
+ * \param position Index of the transaction to remove.
+ * \returns Always true.
+ */
+bool CVectorTransactionStore::Erase(size_t position)
+{
+	this->mTransactions.erase(this->mTransactions.begin() + position);
+	this->UpdateSegments();
+	return true;
+}
+
+
+/**
+ * Remove every transaction.
+ */
+void CVectorTransactionStore::Clear()
+{
+	this->mTransactions.clear();
+	this->UpdateSegments();
+}
+
+
+/**
+ * \returns How many bytes of memory this store is holding on to, including itself.
+ */
+size_t CVectorTransactionStore::GetMemoryUsage() const
+{
+	return sizeof(*this) + this->mTransactions.capacity() * sizeof(CTransaction);
+}
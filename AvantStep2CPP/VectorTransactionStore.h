@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+#include "TransactionStore.h"
+
+
+/**
+ * A transaction store that keeps every transaction of the account in one contiguous in-memory buffer.
+ * CInlineTransactionStore, the default, does the same once an account outgrows its inline room.
+ */
+class CVectorTransactionStore : public CTransactionStore
+{
+private:
+	/// All the transactions of the account, in order by time.
+	std::vector<CTransaction> mTransactions;
+
+	void UpdateSegments();
+
+public:
+	CVectorTransactionStore();
+	virtual ~CVectorTransactionStore();
+
+	virtual bool Insert(size_t position, const CTransaction & transaction) override;
+	virtual bool Erase(size_t position) override;
+	virtual void Clear() override;
+	virtual size_t GetMemoryUsage() const override;
+};
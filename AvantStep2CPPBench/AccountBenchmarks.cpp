@@ -0,0 +1,683 @@
+/**
+ * \file AccountBenchmarks.cpp
+ *
+ * Benchmarks of the public operations of CCreditCardAccount.
+ */
+
+#include "AccountBenchmarks.h"
+#include "BenchmarkRunner.h"
+#include "../AvantStep2CPP/AccountCache.h"
+#include "../AvantStep2CPP/AccountSnapshot.h"
+#include "../AvantStep2CPP/BalanceAlerts.h"
+#include "../AvantStep2CPP/CreditCardAccount.h"
+#include "../AvantStep2CPP/MemoryAccountStore.h"
+#include "../AvantStep2CPP/PortfolioAggregates.h"
+#include "../AvantStep2CPP/SettlementImporter.h"
+#include "../AvantStep2CPP/StatementExporter.h"
+#include "../AvantStep2CPP/TransactionFactory.h"
+#include "../AvantStep2CPP/VectorTransactionStore.h"
+using std::string;
+using std::vector;
+using std::unique_ptr;
+
+/// Midnight on February 27, 2012 GMT, the same start date the tests use.
+const time_t BENCH_START_TIME = (time_t)1330300800;
+
+/// History accounts don't accrue interest. A history of millions of transactions spans tens of thousands
+/// of cycles, and any positive rate would overflow the balance. The interest is still calculated, just as zero.
+const double BENCH_HISTORY_APR = 0.0;
+
+/// High enough that no benchmark other than declined_charge ever hits it.
+const double BENCH_LIMIT = 1e12;
+
+/// The value of every charge and payment in a generated history.
+const double BENCH_VALUE = 10.0;
+
+/// History lengths the single-account benchmarks are measured at.
+static const vector<long long> HISTORY_LENGTHS = { 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+
+/**
+ * Build an account with a history of the given length without going through AddCharge and AddPayment,
+ * which would take longer than any benchmark for long histories. Every day has a charge and a payment
+ * of the same value, so the balance stays at openingBalance.
+ * \param length How many transactions the history has, not counting the opening charge.
+ * \param openingBalance If positive, a charge of this value is made on day 0 before the history.
+ * \param lastDay Where the day of the last transaction is stored.
+ * \returns The account.
+ */
+static unique_ptr<CCreditCardAccount> CreateHistory(long long length, double openingBalance, int * lastDay)
+{
+	CTransactionFactory factory;
+	unique_ptr<CTransactionStore> store(new CVectorTransactionStore());
+	if (openingBalance > 0.0)
+	{
+		store->Insert(store->Size(), factory.CreateTransaction(openingBalance, &BENCH_START_TIME, 0, CTransaction::CHARGE));
+	}
+
+	int day = 0;
+	for (long long i = 0; i < length; ++i)
+	{
+		day = (int)(i / 2);
+		CTransaction::TransactionType type = (i % 2 == 0) ? CTransaction::CHARGE : CTransaction::PAYMENT;
+		store->Insert(store->Size(), factory.CreateTransaction(BENCH_VALUE, &BENCH_START_TIME, day, type));
+	}
+
+	*lastDay = day;
+	return unique_ptr<CCreditCardAccount>(new CCreditCardAccount(BENCH_HISTORY_APR, BENCH_LIMIT, BENCH_START_TIME, std::move(store)));
+}
+
+
+/**
+ * Base of the benchmarks that do one operation on a single account with a long history.
+ */
+class CHistoryBenchmark : public CBenchmark
+{
+protected:
+	/// The account the operations are done on.
+	unique_ptr<CCreditCardAccount> mAccount;
+
+	/// The day of the last transaction in the history.
+	int mLastDay = 0;
+
+	/// Balance the history starts with. Payments need something to pay off.
+	virtual double GetOpeningBalance() { return 0.0; }
+
+public:
+	virtual vector<long long> GetParameters() override { return HISTORY_LENGTHS; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAccount = CreateHistory(parameter, this->GetOpeningBalance(), &this->mLastDay);
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAccount.reset();
+	}
+};
+
+
+/**
+ * A charge on the day of the last transaction. The path almost every real transaction takes.
+ */
+class CAppendChargeBenchmark : public CHistoryBenchmark
+{
+public:
+	virtual string GetName() override { return "append_charge"; }
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->AddCharge(0.01, this->mLastDay);
+		}
+	}
+};
+
+
+/**
+ * A payment on the day of the last transaction.
+ */
+class CAppendPaymentBenchmark : public CHistoryBenchmark
+{
+protected:
+	virtual double GetOpeningBalance() override { return 1e9; }
+
+public:
+	virtual string GetName() override { return "append_payment"; }
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->AddPayment(0.01, this->mLastDay);
+		}
+	}
+};
+
+
+/**
+ * A charge in the middle of the history. Every later balance moves, and each is checked against the credit limit.
+ */
+class CBackdatedInsertBenchmark : public CHistoryBenchmark
+{
+public:
+	virtual string GetName() override { return "backdated_insert"; }
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->AddCharge(0.01, this->mLastDay / 2);
+		}
+	}
+};
+
+
+/**
+ * A charge over the credit limit. It is inserted, the balance is calculated, and it is erased again.
+ */
+class CDeclinedChargeBenchmark : public CHistoryBenchmark
+{
+public:
+	virtual string GetName() override { return "declined_charge"; }
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->AddCharge(BENCH_LIMIT * 2, this->mLastDay);
+		}
+	}
+};
+
+
+/**
+ * The balance on the day of the last transaction, which applies the whole history.
+ */
+class CBalanceOnDayBenchmark : public CHistoryBenchmark
+{
+public:
+	/// Keeps the compiler from dropping the calls.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "balance_on_day"; }
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mSink += this->mAccount->GetBalanceOnDay(this->mLastDay);
+		}
+	}
+};
+
+
+/**
+ * A change of APR in the middle of the history, then the statement of every cycle. The statements before the
+ * change are kept, and the rest are worked out again in one walk.
+ */
+class CStatementsBenchmark : public CHistoryBenchmark
+{
+public:
+	/// Keeps the compiler from dropping the calls.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "statements"; }
+
+	virtual void Run(long long operations) override
+	{
+		CCreditCardAccount::SStatement statement;
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->ScheduleAPR((i % 2 == 0) ? 0.20 : 0.25, this->mLastDay / 2);
+			int cycles = this->mAccount->GetCycleCount();
+			for (int cycle = 0; cycle < cycles; ++cycle)
+			{
+				this->mAccount->GetStatement(cycle, &statement);
+				this->mSink += statement.mClosingBalance;
+			}
+		}
+	}
+};
+
+
+/**
+ * The end of a cycle across many accounts: every account has a cycle's worth of transactions, and each
+ * operation posts the first charge of the next cycle to one account and reads its balance. The parameter
+ * is the number of accounts, so this measures how the per-account cost holds up as the working set grows.
+ */
+class CCycleCloseBenchmark : public CBenchmark
+{
+private:
+	/// How many transactions each account has in its first cycle.
+	static const int TRANSACTIONS_PER_ACCOUNT = 20;
+
+	/// The accounts, each with one open cycle.
+	vector<unique_ptr<CCreditCardAccount>> mAccounts;
+
+public:
+	/// Keeps the compiler from dropping the calls.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "cycle_close"; }
+
+	virtual vector<long long> GetParameters() override { return { 10, 100, 1000, 10000, 100000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAccounts.clear();
+		this->mAccounts.reserve((size_t)parameter);
+		for (long long i = 0; i < parameter; ++i)
+		{
+			unique_ptr<CCreditCardAccount> account(new CCreditCardAccount(0.15, BENCH_LIMIT, BENCH_START_TIME));
+			for (int day = 0; day < TRANSACTIONS_PER_ACCOUNT; ++day)
+			{
+				account->AddCharge(BENCH_VALUE, day);
+			}
+			this->mAccounts.push_back(std::move(account));
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			CCreditCardAccount * account = this->mAccounts[(size_t)i].get();
+			account->AddCharge(BENCH_VALUE, 30);
+			this->mSink += account->GetBalanceOnDay(30);
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAccounts.clear();
+	}
+
+	/// Each account can close its cycle only once.
+	virtual long long GetFixedOperations(long long parameter) override { return parameter; }
+};
+
+
+/**
+ * The balance at the end of every cycle of a year-long history under many APRs at once. The parameter
+ * is the number of APRs, so this measures how little each extra APR costs.
+ */
+class CAprScenariosBenchmark : public CBenchmark
+{
+private:
+	/// How many transactions the history has. Two a day, so it spans a year.
+	static const long long HISTORY_LENGTH = 730;
+
+	unique_ptr<CCreditCardAccount> mAccount;
+	vector<double> mAPRs;
+	vector<int> mDays;
+	vector<double> mBalances;
+
+public:
+	/// Keeps the compiler from dropping the calls.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "apr_scenarios"; }
+
+	virtual vector<long long> GetParameters() override { return { 1, 4, 16, 64, 256 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		int lastDay = 0;
+		this->mAccount = CreateHistory(HISTORY_LENGTH, BENCH_VALUE * 100, &lastDay);
+		this->mAPRs.clear();
+		for (long long i = 0; i < parameter; ++i)
+		{
+			this->mAPRs.push_back(0.05 + 0.30 * i / parameter);
+		}
+		this->mDays.clear();
+		for (int day = 29; day <= lastDay; day += 30)
+		{
+			this->mDays.push_back(day);
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mAccount->GetBalancesOnDays(this->mAPRs, this->mDays, this->mBalances);
+			this->mSink += this->mBalances.back();
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAccount.reset();
+	}
+};
+
+
+/**
+ * Reading the current balance of every account of a portfolio of mostly idle ones, each with a few
+ * transactions added the normal way. Measures how much of the account a scan has to pull into cache.
+ */
+class CIdleScanBenchmark : public CBenchmark
+{
+private:
+	/// How many transactions each account has.
+	static const int TRANSACTIONS_PER_ACCOUNT = 4;
+
+	vector<unique_ptr<CCreditCardAccount>> mAccounts;
+
+public:
+	/// Keeps the compiler from dropping the calls.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "idle_scan"; }
+
+	virtual vector<long long> GetParameters() override { return { 1000, 10000, 100000, 1000000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAccounts.clear();
+		this->mAccounts.reserve((size_t)parameter);
+		for (long long i = 0; i < parameter; ++i)
+		{
+			unique_ptr<CCreditCardAccount> account(new CCreditCardAccount(0.15, BENCH_LIMIT, BENCH_START_TIME));
+			for (int day = 0; day < TRANSACTIONS_PER_ACCOUNT; ++day)
+			{
+				account->AddCharge(BENCH_VALUE, day);
+			}
+			this->mAccounts.push_back(std::move(account));
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		size_t count = this->mAccounts.size();
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mSink += this->mAccounts[(size_t)i % count]->GetCurrentBalance(nullptr);
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAccounts.clear();
+	}
+};
+
+
+/**
+ * Importing a settlement file that is already in memory, so the disk isn't measured. One operation is one row.
+ * The rows of each account are in day order, interleaved with those of the other accounts.
+ */
+class CSettlementImportBenchmark : public CBenchmark
+{
+private:
+	/// How many accounts the rows are spread over.
+	static const long long ACCOUNT_COUNT = 10000;
+
+	std::shared_ptr<CAccountCache> mAccounts;
+	string mFile;
+
+public:
+	virtual string GetName() override { return "settlement_import"; }
+
+	virtual vector<long long> GetParameters() override { return { 10000, 100000, 1000000, 10000000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAccounts = std::make_shared<CAccountCache>(std::make_shared<CMemoryAccountStore>(), (size_t)-1);
+		for (long long id = 0; id < ACCOUNT_COUNT; ++id)
+		{
+			this->mAccounts->CreateAccount((AccountId)id, BENCH_HISTORY_APR, BENCH_LIMIT, BENCH_START_TIME);
+		}
+		this->mFile.clear();
+		char row[64];
+		for (long long i = 0; i < parameter; ++i)
+		{
+			snprintf(row, sizeof(row), "%lld,%lld,%.2f,C\n", i % ACCOUNT_COUNT, i / ACCOUNT_COUNT, BENCH_VALUE);
+			this->mFile += row;
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		CSettlementImporter importer(this->mAccounts);
+		CSettlementImporter::SReport report;
+		importer.ImportBuffer(this->mFile.data(), this->mFile.size(), &report);
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAccounts.reset();
+		string().swap(this->mFile);
+	}
+
+	/// The file can only be imported once, since importing it again would add every row twice.
+	virtual long long GetFixedOperations(long long parameter) override { return parameter; }
+};
+
+
+/**
+ * Export the statements of many accounts, each with a charge every ten days over three cycles. One operation is
+ * one account, and every run exports all of them to the same file.
+ */
+class CStatementExportBenchmark : public CBenchmark
+{
+private:
+	/// Where the export is written, in the working directory.
+	static const char * const FILE_PATH;
+
+	std::shared_ptr<CAccountCache> mAccounts;
+	vector<AccountId> mIds;
+
+public:
+	virtual string GetName() override { return "statement_export"; }
+
+	virtual vector<long long> GetParameters() override { return { 10000, 100000, 1000000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAccounts = std::make_shared<CAccountCache>(std::make_shared<CMemoryAccountStore>(), (size_t)-1);
+		CCreditCardAccount::SPendingTransaction charges[9];
+		for (int i = 0; i < 9; ++i)
+		{
+			charges[i] = { BENCH_VALUE, i * 10, CTransaction::CHARGE };
+		}
+		bool added[9];
+		for (long long id = 0; id < parameter; ++id)
+		{
+			this->mAccounts->CreateAccount((AccountId)id, BENCH_HISTORY_APR, BENCH_LIMIT, BENCH_START_TIME);
+			this->mAccounts->AddTransactions((AccountId)id, charges, 9, added);
+			this->mIds.push_back((AccountId)id);
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		CStatementExporter exporter(this->mAccounts);
+		CStatementExporter::SReport report;
+		exporter.Export(FILE_PATH, this->mIds, &report);
+	}
+
+	virtual void Teardown() override
+	{
+		std::remove(FILE_PATH);
+		this->mAccounts.reset();
+		vector<AccountId>().swap(this->mIds);
+	}
+
+	/// An export always covers every account.
+	virtual long long GetFixedOperations(long long parameter) override { return parameter; }
+};
+
+const char * const CStatementExportBenchmark::FILE_PATH = "statement_export.bench";
+
+
+/**
+ * Keeping portfolio totals over many accounts. One operation is one account's balance changing, followed by
+ * asking for the ten most utilized accounts, the way a risk dashboard would after every transaction.
+ */
+class CPortfolioUpdateBenchmark : public CBenchmark
+{
+private:
+	unique_ptr<CPortfolioAggregates> mPortfolio;
+	long long mAccountCount = 0;
+
+	/// Walks the accounts in a scattered order, so updates don't always hit the same part of the heap.
+	unsigned long long mNext = 0;
+
+	vector<CPortfolioAggregates::SUtilization> mTop;
+
+public:
+	virtual string GetName() override { return "portfolio_update"; }
+
+	virtual vector<long long> GetParameters() override { return { 1000, 10000, 100000, 1000000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mPortfolio.reset(new CPortfolioAggregates());
+		this->mAccountCount = parameter;
+		for (long long id = 0; id < parameter; ++id)
+		{
+			this->mPortfolio->Update((AccountId)id, (double)(id % 997), 1000.0 * (1 + id % 30));
+		}
+	}
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mNext = this->mNext * 6364136223846793005ULL + 1442695040888963407ULL;
+			AccountId id = (AccountId)((this->mNext >> 33) % (unsigned long long)this->mAccountCount);
+			this->mPortfolio->Update(id, (double)((this->mNext >> 20) % 30000), 1000.0 * (1 + id % 30));
+			this->mPortfolio->GetTopUtilization(10, this->mTop);
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mPortfolio.reset();
+	}
+};
+
+
+/**
+ * Scanning a snapshot of many accounts for "balance over $1500, APR over 20% and the cycle closes within 3 days".
+ * One operation is one scan of every account. The values are spread so each predicate keeps a fair share of the
+ * rows, and the scan can't skip many words early.
+ */
+class CSnapshotScanBenchmark : public CBenchmark
+{
+private:
+	CAccountSnapshot mSnapshot;
+	vector<CAccountSnapshot::SPredicate> mPredicates;
+	CAccountSnapshot::SSelection mSelection;
+
+public:
+	/// Keeps the compiler from dropping the scans.
+	size_t mSink = 0;
+
+	virtual string GetName() override { return "snapshot_scan"; }
+
+	virtual vector<long long> GetParameters() override { return { 100000, 1000000, 10000000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mSnapshot.Clear(BENCH_START_TIME);
+		unsigned long long state = 49;
+		for (long long id = 0; id < parameter; ++id)
+		{
+			state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+			CCreditCardAccount::SSummary summary;
+			summary.mBalance = (double)((state >> 20) % 3000);
+			summary.mAPR = (double)((state >> 40) % 40) / 100.0;
+			summary.mCreditLimit = 1000.0 * (1 + id % 10);
+			summary.mDaysToCycleClose = 1 + (int)((id + (long long)(state >> 60)) % 30);
+			this->mSnapshot.Add((AccountId)id, summary);
+		}
+		this->mPredicates = {
+			{ CAccountSnapshot::BALANCE, CAccountSnapshot::GREATER, 1500.0 },
+			{ CAccountSnapshot::APR, CAccountSnapshot::GREATER, 0.20 },
+			{ CAccountSnapshot::DAYS_TO_CYCLE_CLOSE, CAccountSnapshot::LESS_OR_EQUAL, 3.0 }
+		};
+	}
+
+	virtual void Run(long long operations) override
+	{
+		for (long long i = 0; i < operations; ++i)
+		{
+			this->mSnapshot.Select(this->mPredicates, &this->mSelection);
+			this->mSink += this->mSelection.mWords.back();
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mSnapshot.Clear(BENCH_START_TIME);
+		vector<unsigned long long>().swap(this->mSelection.mWords);
+	}
+};
+
+
+/**
+ * Checking changes of balance against balance alerts: the 80% and 100% utilization thresholds of every account,
+ * plus a payoff alert on each of the parameter's accounts. One operation is one change of balance, and two
+ * changes in five cross a threshold. The events are drained as they come, the way a consumer would.
+ */
+class CAlertCheckBenchmark : public CBenchmark
+{
+private:
+	unique_ptr<CBalanceAlerts> mAlerts;
+	long long mAccountCount = 0;
+
+	/// The balance each account is at.
+	vector<double> mBalances;
+
+public:
+	/// Keeps the compiler from dropping the events.
+	double mSink = 0.0;
+
+	virtual string GetName() override { return "alert_check"; }
+
+	virtual vector<long long> GetParameters() override { return { 1000, 100000 }; }
+
+	virtual void Setup(long long parameter) override
+	{
+		this->mAlerts.reset(new CBalanceAlerts());
+		this->mAlerts->Subscribe({ CBalanceAlerts::UTILIZATION, 0.8, CBalanceAlerts::RISING });
+		this->mAlerts->Subscribe({ CBalanceAlerts::UTILIZATION, 1.0, CBalanceAlerts::RISING });
+		for (long long id = 0; id < parameter; ++id)
+		{
+			this->mAlerts->Subscribe((AccountId)id, { CBalanceAlerts::BALANCE, 0.0, CBalanceAlerts::FALLING });
+		}
+		this->mAccountCount = parameter;
+		this->mBalances.assign((size_t)parameter, 0.0);
+	}
+
+	virtual void Run(long long operations) override
+	{
+		CBalanceAlerts::SEvent event;
+		for (long long i = 0; i < operations; ++i)
+		{
+			size_t id = (size_t)(i % this->mAccountCount);
+			double previous = this->mBalances[id];
+			double balance = (previous >= BENCH_VALUE * 100) ? 0.0 : previous + BENCH_VALUE * 25;
+			this->mBalances[id] = balance;
+			this->mAlerts->Check((AccountId)id, previous, balance, BENCH_VALUE * 125);
+			while (this->mAlerts->TryPop(event))
+			{
+				this->mSink += event.mBalance;
+			}
+		}
+	}
+
+	virtual void Teardown() override
+	{
+		this->mAlerts.reset();
+		vector<double>().swap(this->mBalances);
+	}
+};
+
+
+/**
+ * Add every account benchmark to a runner.
+ * \param runner The runner.
+ */
+void AddAccountBenchmarks(CBenchmarkRunner & runner)
+{
+	runner.Add(unique_ptr<CBenchmark>(new CAppendChargeBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CAppendPaymentBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CBackdatedInsertBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CDeclinedChargeBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CBalanceOnDayBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CStatementsBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CCycleCloseBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CAprScenariosBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CIdleScanBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CSettlementImportBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CStatementExportBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CPortfolioUpdateBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CSnapshotScanBenchmark()));
+	runner.Add(unique_ptr<CBenchmark>(new CAlertCheckBenchmark()));
+}
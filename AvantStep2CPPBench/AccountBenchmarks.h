@@ -0,0 +1,5 @@
+#pragma once
+
+class CBenchmarkRunner;
+
+void AddAccountBenchmarks(CBenchmarkRunner & runner);
@@ -0,0 +1,66 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/// How many times operator new was called.
+static std::atomic<unsigned long long> allocationCount(0);
+
+/// How many bytes were asked for from operator new.
+static std::atomic<unsigned long long> allocatedBytes(0);
+
+
+/**
+ * \returns How many heap allocations were made since the process started.
+ */
+unsigned long long CAllocationCounter::GetAllocationCount()
+{
+	return allocationCount.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * \returns How many bytes were allocated on the heap since the process started.
+ */
+unsigned long long CAllocationCounter::GetAllocatedBytes()
+{
+	return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+
+void * operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	void * memory = std::malloc(size == 0 ? 1 : size);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void * operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void * memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
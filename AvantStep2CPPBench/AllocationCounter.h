@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+
+/**
+ * Counts every heap allocation the benchmark process makes. AllocationCounter.cpp replaces the
+ * global operator new to do the counting, so this only works in the benchmark executable.
+ */
+class CAllocationCounter
+{
+public:
+	static unsigned long long GetAllocationCount();
+	static unsigned long long GetAllocatedBytes();
+
+	CAllocationCounter() = delete;
+};
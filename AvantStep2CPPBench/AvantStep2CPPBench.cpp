@@ -0,0 +1,121 @@
+// AvantStep2CPPBench.cpp : Benchmarks of the account engine. See the Makefile for how to build and run it.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "BenchmarkRunner.h"
+#include "AccountBenchmarks.h"
+#include "../AvantStep2CPP/EngineMetrics.h"
+#include "../AvantStep2CPP/Tracing.h"
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+
+void print_usage()
+{
+	cout << "Usage: AvantStep2CPPBench [options]" << endl;
+	cout << "  --filter <text>       Only run benchmarks whose name contains text" << endl;
+	cout << "  --max-history <n>     Skip parameters bigger than n" << endl;
+	cout << "  --budget <seconds>    Skip bigger parameters once one takes a tenth of this (default 10)" << endl;
+	cout << "  --min-time <seconds>  How long to time each measurement (default 0.2)" << endl;
+	cout << "  --json <path>         Also write the results as JSON" << endl;
+	cout << "  --label <text>        Label stored in the JSON, a commit hash for example" << endl;
+	cout << "  --metrics <path>      Write the engine metrics to path when done" << endl;
+	cout << "  --trace <path>        Write the latest spans as Chrome trace JSON (build with TRACING=1)" << endl;
+}
+
+
+int main(int argc, char * argv[])
+{
+	CBenchmarkRunner runner;
+	string jsonPath;
+	string label = "unlabeled";
+	string metricsPath;
+	string tracePath;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		if (option == "--help" || option == "-h")
+		{
+			print_usage();
+			return 0;
+		}
+		if (i + 1 >= argc)
+		{
+			cerr << "Missing value for " << option << endl;
+			print_usage();
+			return 1;
+		}
+
+		const char * value = argv[++i];
+		if (option == "--filter")
+		{
+			runner.SetFilter(value);
+		}
+		else if (option == "--max-history")
+		{
+			runner.SetMaxParameter(atoll(value));
+		}
+		else if (option == "--budget")
+		{
+			runner.SetBudget(atof(value));
+		}
+		else if (option == "--min-time")
+		{
+			runner.SetMinimumTime(atof(value));
+		}
+		else if (option == "--json")
+		{
+			jsonPath = value;
+		}
+		else if (option == "--label")
+		{
+			label = value;
+		}
+		else if (option == "--metrics")
+		{
+			metricsPath = value;
+		}
+		else if (option == "--trace")
+		{
+			tracePath = value;
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			print_usage();
+			return 1;
+		}
+	}
+
+	AddAccountBenchmarks(runner);
+	runner.Run();
+
+	if (!jsonPath.empty() && !runner.WriteJson(jsonPath, label))
+	{
+		cerr << "Could not write " << jsonPath << endl;
+		return 1;
+	}
+	if (!metricsPath.empty() && !CEngineMetrics::WriteTextFile(metricsPath))
+	{
+		cerr << "Could not write " << metricsPath << endl;
+		return 1;
+	}
+	if (!tracePath.empty())
+	{
+#ifndef AVANT_TRACING
+		cerr << "Tracing isn't compiled in, so " << tracePath << " has no engine spans. Build with TRACING=1." << endl;
+#endif
+		if (!CTracing::WriteChromeTrace(tracePath))
+		{
+			cerr << "Could not write " << tracePath << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
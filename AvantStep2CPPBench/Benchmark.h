@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+
+
+/**
+ * One benchmark of the account engine. A benchmark is measured once per parameter (usually the
+ * length of the transaction history, or the number of accounts) so the runner can show how its
+ * cost scales.
+ *
+ * For every parameter the runner calls Setup once, untimed, then Run with the number of operations
+ * to time. Run may be called more than once per Setup while the runner calibrates.
+ */
+class CBenchmark
+{
+public:
+	CBenchmark() {}
+	CBenchmark(const CBenchmark &) = delete;
+	virtual ~CBenchmark() {}
+
+	/// \returns The name the benchmark is reported under.
+	virtual std::string GetName() = 0;
+
+	/// \returns The parameters to measure, smallest first.
+	virtual std::vector<long long> GetParameters() = 0;
+
+	/// Build whatever Run needs. Not timed.
+	virtual void Setup(long long parameter) = 0;
+
+	/// Do the given number of operations. Timed.
+	virtual void Run(long long operations) = 0;
+
+	/// Release whatever Setup built. Not timed.
+	virtual void Teardown() {}
+
+	/**
+	 * Benchmarks whose operations can't be repeated indefinitely after one Setup (closing a cycle
+	 * on every account, say) return how many they can do. The runner times exactly that many.
+	 * \returns The number of operations Run has to be called with, or 0 to let the runner pick.
+	 */
+	virtual long long GetFixedOperations(long long parameter) { return 0; }
+};
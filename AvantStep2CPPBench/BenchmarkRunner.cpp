@@ -0,0 +1,305 @@
+#include "BenchmarkRunner.h"
+#include "AllocationCounter.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+
+/**
+ * \param start When the interval started.
+ * \returns Seconds since start.
+ */
+static double SecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+/**
+ * Constructor. By default every benchmark runs at every parameter, but a parameter is skipped once a
+ * smaller one took more than a tenth of the 10 second budget.
+ */
+CBenchmarkRunner::CBenchmarkRunner() : mMaxParameter(-1), mBudgetSeconds(10.0), mMinimumSeconds(0.2)
+{
+}
+
+
+/**
+ * Add a benchmark to run.
+ * \param benchmark The benchmark.
+ */
+void CBenchmarkRunner::Add(std::unique_ptr<CBenchmark> benchmark)
+{
+	this->mBenchmarks.push_back(std::move(benchmark));
+}
+
+
+/**
+ * \param filter Only benchmarks whose name contains this are run. Empty runs all of them.
+ */
+void CBenchmarkRunner::SetFilter(const string & filter)
+{
+	this->mFilter = filter;
+}
+
+
+/**
+ * \param maxParameter Parameters bigger than this are skipped. Negative means no limit.
+ */
+void CBenchmarkRunner::SetMaxParameter(long long maxParameter)
+{
+	this->mMaxParameter = maxParameter;
+}
+
+
+/**
+ * \param seconds Roughly how long one benchmark may take at one parameter. Once a parameter takes more
+ *		than a tenth of this, bigger parameters are skipped, since they cost at least ten times as much.
+ */
+void CBenchmarkRunner::SetBudget(double seconds)
+{
+	this->mBudgetSeconds = seconds;
+}
+
+
+/**
+ * \param seconds How long the timed part of each measurement should last.
+ */
+void CBenchmarkRunner::SetMinimumTime(double seconds)
+{
+	this->mMinimumSeconds = seconds;
+}
+
+
+/**
+ * Set up a benchmark at one parameter, calibrate how many operations to time, and time them.
+ * \param benchmark The benchmark.
+ * \param parameter The parameter to measure it at.
+ * \returns The measurement.
+ */
+CBenchmarkRunner::SResult CBenchmarkRunner::Measure(CBenchmark & benchmark, long long parameter)
+{
+	SResult result;
+	result.mBenchmark = benchmark.GetName();
+	result.mParameter = parameter;
+
+	Clock::time_point setupStart = Clock::now();
+	benchmark.Setup(parameter);
+	result.mSetupSeconds = SecondsSince(setupStart);
+
+	Clock::time_point measureStart = Clock::now();
+	long long operations = benchmark.GetFixedOperations(parameter);
+	bool fixed = operations > 0;
+	if (!fixed)
+	{
+		operations = 1;
+	}
+
+	while (true)
+	{
+		unsigned long long allocations = CAllocationCounter::GetAllocationCount();
+		unsigned long long bytes = CAllocationCounter::GetAllocatedBytes();
+		Clock::time_point start = Clock::now();
+		this->mCounters.Start();
+		benchmark.Run(operations);
+		this->mCounters.Stop();
+		double elapsed = SecondsSince(start);
+		allocations = CAllocationCounter::GetAllocationCount() - allocations;
+		bytes = CAllocationCounter::GetAllocatedBytes() - bytes;
+
+		result.mOperations = operations;
+		result.mNanosecondsPerOperation = elapsed * 1e9 / (double)operations;
+		result.mAllocationsPerOperation = (double)allocations / (double)operations;
+		result.mBytesPerOperation = (double)bytes / (double)operations;
+		for (int i = 0; i < CPerfCounters::COUNTER_COUNT; ++i)
+		{
+			double value = this->mCounters.GetValue((CPerfCounters::Counter)i);
+			result.mCountersPerOperation[i] = (value < 0.0) ? -1.0 : value / (double)operations;
+		}
+
+		if (fixed || elapsed >= this->mMinimumSeconds || SecondsSince(measureStart) + elapsed * 2 > this->mBudgetSeconds)
+		{
+			break;
+		}
+
+		// Aim a bit past the minimum time, but don't grow too fast off a noisy first sample.
+		double scale = (elapsed > 0.0) ? 1.4 * this->mMinimumSeconds / elapsed : 100.0;
+		operations = (long long)((double)operations * std::min(100.0, std::max(2.0, scale)));
+	}
+
+	benchmark.Teardown();
+	return result;
+}
+
+
+/**
+ * Run every benchmark that matches the filter at each of its parameters and print the results.
+ */
+void CBenchmarkRunner::Run()
+{
+	if (!this->mCounters.IsAnyAvailable())
+	{
+		printf("Hardware counters are unavailable (check /proc/sys/kernel/perf_event_paranoid). Reporting time only.\n");
+	}
+
+	for (std::unique_ptr<CBenchmark> & benchmark : this->mBenchmarks)
+	{
+		string name = benchmark->GetName();
+		if (name.find(this->mFilter) == string::npos)
+		{
+			continue;
+		}
+
+		bool tooSlow = false;
+		for (long long parameter : benchmark->GetParameters())
+		{
+			if (tooSlow || (this->mMaxParameter >= 0 && parameter > this->mMaxParameter))
+			{
+				SResult skipped;
+				skipped.mBenchmark = name;
+				skipped.mParameter = parameter;
+				skipped.mSkipped = true;
+				this->mResults.push_back(skipped);
+				printf("%-24s n=%-10lld skipped\n", name.c_str(), parameter);
+				continue;
+			}
+
+			Clock::time_point start = Clock::now();
+			SResult result = this->Measure(*benchmark, parameter);
+			tooSlow = SecondsSince(start) > this->mBudgetSeconds / 10.0;
+			this->mResults.push_back(result);
+			printf("%-24s n=%-10lld %14.1f ns/op %10.2f allocs/op %12.1f B/op",
+				name.c_str(), parameter, result.mNanosecondsPerOperation, result.mAllocationsPerOperation,
+				result.mBytesPerOperation);
+			this->PrintCounters(result);
+			printf("  (%lld ops, setup %.2fs)\n", result.mOperations, result.mSetupSeconds);
+			fflush(stdout);
+		}
+		this->PrintScaling(name);
+	}
+}
+
+
+/**
+ * Print the hardware counts per operation of a measurement, and instructions per cycle. Prints nothing
+ * for counters that are unavailable.
+ * \param result The measurement.
+ */
+void CBenchmarkRunner::PrintCounters(const SResult & result)
+{
+	const double * counters = result.mCountersPerOperation;
+	if (counters[CPerfCounters::CYCLES] >= 0.0)
+	{
+		printf(" %12.0f cycles/op", counters[CPerfCounters::CYCLES]);
+	}
+	if (counters[CPerfCounters::INSTRUCTIONS] >= 0.0 && counters[CPerfCounters::CYCLES] > 0.0)
+	{
+		printf(" %5.2f IPC", counters[CPerfCounters::INSTRUCTIONS] / counters[CPerfCounters::CYCLES]);
+	}
+	if (counters[CPerfCounters::CACHE_MISSES] >= 0.0)
+	{
+		printf(" %10.1f cache-misses/op", counters[CPerfCounters::CACHE_MISSES]);
+	}
+	if (counters[CPerfCounters::BRANCH_MISSES] >= 0.0)
+	{
+		printf(" %10.1f branch-misses/op", counters[CPerfCounters::BRANCH_MISSES]);
+	}
+}
+
+
+/**
+ * Print how the cost per operation of a benchmark grows from one parameter to the next, as the
+ * exponent k in O(n^k). A benchmark whose operations don't depend on history length has k near 0.
+ * \param benchmark The name of the benchmark.
+ */
+void CBenchmarkRunner::PrintScaling(const string & benchmark)
+{
+	const SResult * previous = nullptr;
+	for (const SResult & result : this->mResults)
+	{
+		if (result.mBenchmark != benchmark || result.mSkipped)
+		{
+			continue;
+		}
+		if (previous != nullptr && previous->mNanosecondsPerOperation > 0.0 && result.mParameter > previous->mParameter)
+		{
+			double ratio = result.mNanosecondsPerOperation / previous->mNanosecondsPerOperation;
+			double exponent = std::log(ratio) / std::log((double)result.mParameter / (double)previous->mParameter);
+			printf("%-24s   %lld -> %lld: x%.2f per op, O(n^%.2f)\n", "", previous->mParameter, result.mParameter, ratio, exponent);
+		}
+		previous = &result;
+	}
+}
+
+
+/**
+ * Write every result as JSON, so results of different versions can be compared by a script.
+ * \param path The file to write.
+ * \param label Identifies the version that was measured, a commit hash for example.
+ * \returns True if the file was written.
+ */
+bool CBenchmarkRunner::WriteJson(const string & path, const string & label)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	char timestamp[32];
+	time_t now = time(nullptr);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	file << "{\n";
+	file << "  \"label\": \"" << label << "\",\n";
+	file << "  \"timestamp\": \"" << timestamp << "\",\n";
+	file << "  \"results\": [";
+	for (size_t i = 0; i < this->mResults.size(); ++i)
+	{
+		const SResult & result = this->mResults[i];
+		file << (i == 0 ? "\n" : ",\n");
+		file << "    {\"benchmark\": \"" << result.mBenchmark << "\", \"n\": " << result.mParameter;
+		if (result.mSkipped)
+		{
+			file << ", \"skipped\": true}";
+			continue;
+		}
+		file << ", \"skipped\": false";
+		file << ", \"operations\": " << result.mOperations;
+		file << ", \"ns_per_op\": " << result.mNanosecondsPerOperation;
+		file << ", \"allocs_per_op\": " << result.mAllocationsPerOperation;
+		file << ", \"bytes_per_op\": " << result.mBytesPerOperation;
+		file << ", \"setup_seconds\": " << result.mSetupSeconds;
+		for (int c = 0; c < CPerfCounters::COUNTER_COUNT; ++c)
+		{
+			file << ", \"" << CPerfCounters::GetName((CPerfCounters::Counter)c) << "_per_op\": ";
+			if (result.mCountersPerOperation[c] < 0.0)
+			{
+				file << "null";
+			}
+			else
+			{
+				file << result.mCountersPerOperation[c];
+			}
+		}
+		file << "}";
+	}
+	file << "\n  ]\n}\n";
+	return (bool)file;
+}
+
+
+/**
+ * \returns Every measurement so far.
+ */
+const vector<CBenchmarkRunner::SResult> & CBenchmarkRunner::GetResults()
+{
+	return this->mResults;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "PerfCounters.h"
+
+
+/**
+ * Runs benchmarks, prints their results with scaling curves, and writes them as JSON.
+ */
+class CBenchmarkRunner
+{
+public:
+	/**
+	 * The measurement of one benchmark at one parameter.
+	 */
+	struct SResult
+	{
+		std::string mBenchmark;
+		long long mParameter = 0;
+
+		/// How many operations were timed.
+		long long mOperations = 0;
+
+		double mNanosecondsPerOperation = 0.0;
+		double mAllocationsPerOperation = 0.0;
+		double mBytesPerOperation = 0.0;
+
+		/// Hardware counts per operation, indexed by CPerfCounters::Counter. Negative if unavailable.
+		double mCountersPerOperation[CPerfCounters::COUNTER_COUNT] = { -1.0, -1.0, -1.0, -1.0 };
+
+		/// How long Setup took, in seconds.
+		double mSetupSeconds = 0.0;
+
+		/// True if the parameter wasn't measured because smaller ones already took too long.
+		bool mSkipped = false;
+	};
+
+private:
+	/// The benchmarks to run, in the order they were added.
+	std::vector<std::unique_ptr<CBenchmark>> mBenchmarks;
+
+	/// Every measurement so far.
+	std::vector<SResult> mResults;
+
+	/// Only benchmarks whose name contains this are run.
+	std::string mFilter;
+
+	/// Parameters bigger than this are skipped.
+	long long mMaxParameter;
+
+	/// Roughly how long one benchmark may take at one parameter, in seconds.
+	double mBudgetSeconds;
+
+	/// How long the timed part of a measurement should last, in seconds.
+	double mMinimumSeconds;
+
+	/// Hardware counters read around every timed region.
+	CPerfCounters mCounters;
+
+	SResult Measure(CBenchmark & benchmark, long long parameter);
+	void PrintCounters(const SResult & result);
+	void PrintScaling(const std::string & benchmark);
+
+public:
+	CBenchmarkRunner();
+
+	void Add(std::unique_ptr<CBenchmark> benchmark);
+	void SetFilter(const std::string & filter);
+	void SetMaxParameter(long long maxParameter);
+	void SetBudget(double seconds);
+	void SetMinimumTime(double seconds);
+
+	void Run();
+	bool WriteJson(const std::string & path, const std::string & label);
+
+	const std::vector<SResult> & GetResults();
+};
@@ -0,0 +1,189 @@
+#include "PerfCounters.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+
+#ifdef __linux__
+/**
+ * Open one hardware counter for the calling thread, disabled until Start.
+ * \param config Which hardware event to count, one of PERF_COUNT_HW_*.
+ * \returns The file descriptor of the counter, or -1 if it can't be opened.
+ */
+static int OpenCounter(unsigned long long config)
+{
+	struct perf_event_attr attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.config = config;
+	attributes.disabled = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+
+	// With more counters than the PMU has, the kernel multiplexes them. Reading both times lets Stop scale
+	// a count up to the whole measured region.
+	attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+#endif
+
+
+/**
+ * Constructor. Opens every counter it can.
+ */
+CPerfCounters::CPerfCounters()
+{
+#ifdef __linux__
+	static const unsigned long long configs[COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+#endif
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+#ifdef __linux__
+		this->mDescriptors[i] = OpenCounter(configs[i]);
+#else
+		this->mDescriptors[i] = -1;
+#endif
+		this->mValues[i] = -1.0;
+	}
+}
+
+
+/**
+ * Destructor. Closes the counters.
+ */
+CPerfCounters::~CPerfCounters()
+{
+#ifdef __linux__
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+		if (this->mDescriptors[i] >= 0)
+		{
+			close(this->mDescriptors[i]);
+		}
+	}
+#endif
+}
+
+
+/**
+ * \param counter The counter.
+ * \returns True if the counter could be opened.
+ */
+bool CPerfCounters::IsAvailable(Counter counter)
+{
+	return this->mDescriptors[counter] >= 0;
+}
+
+
+/**
+ * \returns True if at least one counter could be opened.
+ */
+bool CPerfCounters::IsAnyAvailable()
+{
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+		if (this->mDescriptors[i] >= 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+ * Reset the counters and start counting.
+ */
+void CPerfCounters::Start()
+{
+#ifdef __linux__
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+		if (this->mDescriptors[i] >= 0)
+		{
+			ioctl(this->mDescriptors[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(this->mDescriptors[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+}
+
+
+/**
+ * Stop counting and read what was counted since Start. A counter that can't be read is marked as
+ * unavailable from then on.
+ */
+void CPerfCounters::Stop()
+{
+#ifdef __linux__
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+		if (this->mDescriptors[i] >= 0)
+		{
+			ioctl(this->mDescriptors[i], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+	{
+		this->mValues[i] = -1.0;
+		if (this->mDescriptors[i] < 0)
+		{
+			continue;
+		}
+
+		// The value, then how long the counter was enabled, then how long it was actually counting.
+		unsigned long long data[3];
+		if (read(this->mDescriptors[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0)
+		{
+			close(this->mDescriptors[i]);
+			this->mDescriptors[i] = -1;
+			continue;
+		}
+		this->mValues[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+	}
+#endif
+}
+
+
+/**
+ * \param counter The counter.
+ * \returns What the counter counted between the last Start and Stop, or -1 if it is unavailable.
+ */
+double CPerfCounters::GetValue(Counter counter)
+{
+	return this->mValues[counter];
+}
+
+
+/**
+ * \param counter The counter.
+ * \returns The name the counter is reported under.
+ */
+const char * CPerfCounters::GetName(Counter counter)
+{
+	switch (counter)
+	{
+	case CYCLES:
+		return "cycles";
+	case INSTRUCTIONS:
+		return "instructions";
+	case CACHE_MISSES:
+		return "cache_misses";
+	case BRANCH_MISSES:
+		return "branch_misses";
+	default:
+		return "unknown";
+	}
+}
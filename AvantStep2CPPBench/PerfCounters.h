@@ -0,0 +1,44 @@
+#pragma once
+
+
+/**
+ * Hardware performance counters of the calling thread, read through Linux perf_event_open.
+ *
+ * Counters that can't be opened (not Linux, no PMU in a virtual machine, perf_event_paranoid too
+ * strict) are reported as unavailable rather than failing, so the benchmarks still run with
+ * wall-clock numbers only.
+ */
+class CPerfCounters
+{
+public:
+	/// The counters that are read.
+	enum Counter
+	{
+		CYCLES,
+		INSTRUCTIONS,
+		CACHE_MISSES,
+		BRANCH_MISSES,
+		COUNTER_COUNT
+	};
+
+private:
+	/// File descriptor of each counter, or -1 if it couldn't be opened.
+	int mDescriptors[COUNTER_COUNT];
+
+	/// Counts read by the last Stop, or -1 for counters that are unavailable.
+	double mValues[COUNTER_COUNT];
+
+public:
+	CPerfCounters();
+	CPerfCounters(const CPerfCounters &) = delete;
+	~CPerfCounters();
+
+	bool IsAvailable(Counter counter);
+	bool IsAnyAvailable();
+
+	void Start();
+	void Stop();
+
+	double GetValue(Counter counter);
+	static const char * GetName(Counter counter);
+};
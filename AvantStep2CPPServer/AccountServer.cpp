@@ -0,0 +1,453 @@
+#include "AccountServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "RequestProtocol.h"
+using std::shared_ptr;
+using std::string;
+
+/// How many events the loop handles per epoll_wait.
+const int MAX_EVENTS = 64;
+
+/// How much is read from a connection at a time.
+const size_t READ_SIZE = 64 * 1024;
+
+/// Connections waiting to be accepted before the kernel refuses more.
+const int LISTEN_BACKLOG = 128;
+
+
+/**
+ * Make a socket's reads and writes return instead of waiting.
+ * \param socket The socket.
+ * \returns False if it couldn't be changed.
+ */
+static bool SetNonBlocking(int socket)
+{
+	int flags = fcntl(socket, F_GETFL, 0);
+	return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+
+/**
+ * Constructor.
+ * \param accounts Where requests are carried out.
+ * \param startDate The day every account opens on.
+ */
+CAccountServer::CAccountServer(shared_ptr<CAccountCache> accounts, time_t startDate) :
+	mAccounts(accounts), mStartDate(startDate)
+{
+	this->mEpoll = epoll_create1(EPOLL_CLOEXEC);
+	this->mWakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = this->mWakeup;
+	epoll_ctl(this->mEpoll, EPOLL_CTL_ADD, this->mWakeup, &event);
+}
+
+
+/**
+ * Destructor. Closes every socket. The loop must not be running.
+ */
+CAccountServer::~CAccountServer()
+{
+	while (!this->mConnections.empty())
+	{
+		this->Close(this->mConnections.begin()->first);
+	}
+	for (int listener : this->mListeners)
+	{
+		close(listener);
+	}
+	for (const string & path : this->mSocketPaths)
+	{
+		unlink(path.c_str());
+	}
+	close(this->mWakeup);
+	close(this->mEpoll);
+}
+
+
+/**
+ * Start accepting connections on a socket that is already listening.
+ * \param listener The socket.
+ * \returns False if it couldn't be added to the loop. The socket is closed.
+ */
+bool CAccountServer::AddListener(int listener)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = listener;
+	if (!SetNonBlocking(listener) || epoll_ctl(this->mEpoll, EPOLL_CTL_ADD, listener, &event) != 0)
+	{
+		close(listener);
+		return false;
+	}
+	this->mListeners.push_back(listener);
+	return true;
+}
+
+
+/**
+ * Listen on a Unix domain socket. Whatever is at the path already is replaced.
+ * \param path Where the socket goes.
+ * \returns False if the server couldn't listen there.
+ */
+bool CAccountServer::ListenUnix(const string & path)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		return false;
+	}
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0)
+	{
+		return false;
+	}
+	unlink(path.c_str());
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, LISTEN_BACKLOG) != 0)
+	{
+		close(listener);
+		return false;
+	}
+	this->mSocketPaths.push_back(path);
+	return this->AddListener(listener);
+}
+
+
+/**
+ * Listen on a TCP port of the loopback interface only.
+ * \param port The port.
+ * \returns False if the server couldn't listen there.
+ */
+bool CAccountServer::ListenTcp(unsigned short port)
+{
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0)
+	{
+		return false;
+	}
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, LISTEN_BACKLOG) != 0)
+	{
+		close(listener);
+		return false;
+	}
+	return this->AddListener(listener);
+}
+
+
+/**
+ * Handle connections until Stop is called.
+ */
+void CAccountServer::Run()
+{
+	epoll_event events[MAX_EVENTS];
+	while (true)
+	{
+		int count = epoll_wait(this->mEpoll, events, MAX_EVENTS, -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return;
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			int socket = events[i].data.fd;
+			if (socket == this->mWakeup)
+			{
+				return;
+			}
+			if (std::find(this->mListeners.begin(), this->mListeners.end(), socket) != this->mListeners.end())
+			{
+				this->Accept(socket);
+			}
+			else if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+			{
+				this->Close(socket);
+			}
+			else
+			{
+				if (events[i].events & EPOLLOUT)
+				{
+					this->Write(socket);
+				}
+				if ((events[i].events & EPOLLIN) && this->mConnections.count(socket) > 0)
+				{
+					this->Read(socket);
+				}
+			}
+		}
+	}
+}
+
+
+/**
+ * Make Run return. Safe to call from another thread or a signal handler.
+ */
+void CAccountServer::Stop()
+{
+	unsigned long long one = 1;
+	ssize_t written = write(this->mWakeup, &one, sizeof(one));
+	(void)written;
+}
+
+
+/**
+ * Accept every connection waiting on a listening socket.
+ * \param listener The socket.
+ */
+void CAccountServer::Accept(int listener)
+{
+	while (true)
+	{
+		int socket = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (socket < 0)
+		{
+			return;
+		}
+
+		// Responses are already batched, so don't hold small ones back as well.
+		int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = socket;
+		if (epoll_ctl(this->mEpoll, EPOLL_CTL_ADD, socket, &event) != 0)
+		{
+			close(socket);
+			continue;
+		}
+		this->mConnections[socket] = SConnection();
+	}
+}
+
+
+/**
+ * Read what a connection sent, carry out every complete request, and send the responses.
+ * \param socket The connection.
+ */
+void CAccountServer::Read(int socket)
+{
+	SConnection & connection = this->mConnections[socket];
+	char buffer[READ_SIZE];
+	ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+	{
+		this->Close(socket);
+		return;
+	}
+	if (received < 0)
+	{
+		return;
+	}
+
+	connection.mInput.append(buffer, received);
+	this->HandleRequests(connection);
+	if (connection.mInput.size() >= CRequestProtocol::MAX_LINE)
+	{
+		// Not a single request, however long we wait.
+		CRequestProtocol::AppendError(connection.mOutput, "request too long");
+		connection.mInput.clear();
+	}
+	this->Write(socket);
+}
+
+
+/**
+ * Send as much of a connection's pending responses as the socket takes, and watch for writability
+ * if some are left.
+ * \param socket The connection.
+ */
+void CAccountServer::Write(int socket)
+{
+	SConnection & connection = this->mConnections[socket];
+	while (connection.mOutputSent < connection.mOutput.size())
+	{
+		ssize_t sent = send(socket, connection.mOutput.data() + connection.mOutputSent,
+			connection.mOutput.size() - connection.mOutputSent, MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			{
+				break;
+			}
+			this->Close(socket);
+			return;
+		}
+		connection.mOutputSent += sent;
+	}
+
+	if (connection.mOutputSent == connection.mOutput.size())
+	{
+		connection.mOutput.clear();
+		connection.mOutputSent = 0;
+	}
+
+	// Keep reading while responses drain, unless so many are waiting that the client clearly isn't
+	// reading them. Then stop reading it until it catches up.
+	size_t waiting = connection.mOutput.size() - connection.mOutputSent;
+	unsigned int events = EPOLLIN;
+	if (waiting > MAX_PENDING_OUTPUT)
+	{
+		events = EPOLLOUT;
+	}
+	else if (waiting > 0)
+	{
+		events = EPOLLIN | EPOLLOUT;
+	}
+	if (events != connection.mEvents)
+	{
+		epoll_event event = {};
+		event.events = events;
+		event.data.fd = socket;
+		epoll_ctl(this->mEpoll, EPOLL_CTL_MOD, socket, &event);
+		connection.mEvents = events;
+	}
+}
+
+
+/**
+ * Close a connection and forget about it.
+ * \param socket The connection.
+ */
+void CAccountServer::Close(int socket)
+{
+	epoll_ctl(this->mEpoll, EPOLL_CTL_DEL, socket, nullptr);
+	close(socket);
+	this->mConnections.erase(socket);
+}
+
+
+/**
+ * Carry out every complete request a connection has sent, queuing their responses.
+ * \param connection The connection.
+ */
+void CAccountServer::HandleRequests(SConnection & connection)
+{
+	size_t start = 0;
+	while (true)
+	{
+		size_t end = connection.mInput.find('\n', start);
+		if (end == string::npos)
+		{
+			break;
+		}
+		this->HandleLine(connection.mInput.data() + start, end - start, connection.mOutput);
+		start = end + 1;
+	}
+	connection.mInput.erase(0, start);
+}
+
+
+/**
+ * Carry out one request.
+ * \param line The request, without its newline.
+ * \param length How long the request is.
+ * \param output Where its response goes.
+ */
+void CAccountServer::HandleLine(const char * line, size_t length, string & output)
+{
+	this->mRequests++;
+	CRequestProtocol::SRequest request;
+	string error;
+	if (!CRequestProtocol::ParseRequest(line, length, &request, &error))
+	{
+		CRequestProtocol::AppendError(output, error);
+		return;
+	}
+
+	switch (request.mType)
+	{
+	case CRequestProtocol::OPEN:
+		if (this->mAccounts->CreateAccount(request.mAccount, request.mAPR, request.mLimit, this->mStartDate))
+		{
+			CRequestProtocol::AppendOk(output);
+		}
+		else
+		{
+			CRequestProtocol::AppendError(output, "exists");
+		}
+		break;
+	case CRequestProtocol::CHARGE:
+	case CRequestProtocol::PAYMENT:
+	{
+		bool added = (request.mType == CRequestProtocol::CHARGE) ?
+			this->mAccounts->AddCharge(request.mAccount, request.mValue, request.mDay) :
+			this->mAccounts->AddPayment(request.mAccount, request.mValue, request.mDay);
+		if (added)
+		{
+			CRequestProtocol::AppendOk(output);
+		}
+		else
+		{
+			CRequestProtocol::AppendDeclined(output);
+		}
+		break;
+	}
+	case CRequestProtocol::BALANCE:
+	{
+		double balance = 0.0;
+		if (this->mAccounts->GetBalanceOnDay(request.mAccount, request.mDay, &balance))
+		{
+			CRequestProtocol::AppendBalance(output, balance);
+		}
+		else
+		{
+			CRequestProtocol::AppendError(output, "no account");
+		}
+		break;
+	}
+	case CRequestProtocol::RATE:
+		if (this->mAccounts->ScheduleAPR(request.mAccount, request.mAPR, request.mDay))
+		{
+			CRequestProtocol::AppendOk(output);
+		}
+		else
+		{
+			CRequestProtocol::AppendError(output, "rejected");
+		}
+		break;
+	}
+}
+
+
+/**
+ * \returns How many requests were carried out, malformed ones included.
+ */
+unsigned long long CAccountServer::GetRequestCount()
+{
+	return this->mRequests;
+}
+
+
+/**
+ * \returns How many clients are connected.
+ */
+size_t CAccountServer::GetConnectionCount()
+{
+	return this->mConnections.size();
+}
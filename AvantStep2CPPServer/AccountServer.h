@@ -0,0 +1,88 @@
+#pragma once
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../AvantStep2CPP/AccountCache.h"
+
+
+/**
+ * Serves account requests over Unix domain sockets or localhost TCP, using the line protocol in
+ * CRequestProtocol.
+ *
+ * One thread runs an epoll loop over the listening sockets and every connection. Each time a connection
+ * is readable, every complete request in what arrived is carried out, and all their responses are sent
+ * with one write. A client can therefore pipeline: send many requests, then read the responses, which
+ * come back in order. Whatever can't be written right away waits for the socket to become writable, and
+ * a connection whose responses pile up isn't read again until they have been sent.
+ */
+class CAccountServer
+{
+private:
+	/**
+	 * One client connection.
+	 */
+	struct SConnection
+	{
+		/// Received bytes that don't make up a whole request yet.
+		std::string mInput;
+
+		/// Responses that haven't been written yet.
+		std::string mOutput;
+
+		/// How much of mOutput has been written already.
+		size_t mOutputSent = 0;
+
+		/// The epoll events the connection is registered for. Starts as EPOLLIN.
+		unsigned int mEvents = 1;
+	};
+
+	/// Where requests are carried out.
+	std::shared_ptr<CAccountCache> mAccounts;
+
+	/// The day every account opened on. Request days count from it.
+	time_t mStartDate;
+
+	int mEpoll = -1;
+
+	/// Written to by Stop, to wake the loop.
+	int mWakeup = -1;
+
+	/// The sockets accepting connections.
+	std::vector<int> mListeners;
+
+	/// Every open connection, by socket.
+	std::unordered_map<int, SConnection> mConnections;
+
+	/// Unix socket paths to remove when the server is destroyed.
+	std::vector<std::string> mSocketPaths;
+
+	/// How many requests were carried out.
+	unsigned long long mRequests = 0;
+
+	bool AddListener(int listener);
+	void Accept(int listener);
+	void Read(int socket);
+	void Write(int socket);
+	void Close(int socket);
+	void HandleRequests(SConnection & connection);
+	void HandleLine(const char * line, size_t length, std::string & output);
+
+public:
+	/// Responses a connection may have waiting before it isn't read any more.
+	static const size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+	CAccountServer(std::shared_ptr<CAccountCache> accounts, time_t startDate);
+	CAccountServer(const CAccountServer &) = delete;
+	virtual ~CAccountServer();
+
+	bool ListenUnix(const std::string & path);
+	bool ListenTcp(unsigned short port);
+
+	void Run();
+	void Stop();
+
+	unsigned long long GetRequestCount();
+	size_t GetConnectionCount();
+};
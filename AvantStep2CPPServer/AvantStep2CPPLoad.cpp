@@ -0,0 +1,406 @@
+// AvantStep2CPPLoad.cpp : Load generator for AvantStep2CPPServer. See the Makefile for how to build and run it.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "RequestProtocol.h"
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+
+/**
+ * What to connect to and how hard to push.
+ */
+struct SLoadOptions
+{
+	string mUnixPath;
+	int mPort = -1;
+	int mConnections = 4;
+	long long mRequests = 100000;
+	int mPipeline = 16;
+	int mAccounts = 1000;
+	double mAPR = 0.35;
+	double mLimit = 1000000.0;
+};
+
+/**
+ * What one connection saw.
+ */
+struct SConnectionResult
+{
+	/// How long each request took from being sent to its response arriving, in nanoseconds.
+	vector<long long> mLatencies;
+
+	long long mOk = 0;
+	long long mDeclined = 0;
+	long long mBalances = 0;
+	long long mErrors = 0;
+	bool mFailed = false;
+};
+
+
+void print_usage()
+{
+	cout << "Usage: AvantStep2CPPLoad [options]" << endl;
+	cout << "  --unix <path>         Connect to a Unix domain socket" << endl;
+	cout << "  --port <port>         Connect to a TCP port of localhost" << endl;
+	cout << "  --connections <n>     Connections, each on its own thread (default 4)" << endl;
+	cout << "  --requests <n>        Requests in total, spread over the connections (default 100000)" << endl;
+	cout << "  --pipeline <n>        Requests each connection keeps in flight (default 16)" << endl;
+	cout << "  --accounts <n>        Accounts to open and spread the requests over (default 1000)" << endl;
+}
+
+
+/**
+ * Connect to the server.
+ * \param options Where the server is.
+ * \returns The socket, or -1 if the server couldn't be reached.
+ */
+int connect_to_server(const SLoadOptions & options)
+{
+	int socket = -1;
+	if (!options.mUnixPath.empty())
+	{
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, options.mUnixPath.c_str(), sizeof(address.sun_path) - 1);
+		socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket >= 0 && connect(socket, (sockaddr *)&address, sizeof(address)) != 0)
+		{
+			close(socket);
+			return -1;
+		}
+		return socket;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)options.mPort);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socket = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (socket >= 0 && connect(socket, (sockaddr *)&address, sizeof(address)) != 0)
+	{
+		close(socket);
+		return -1;
+	}
+	int noDelay = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	return socket;
+}
+
+
+/**
+ * Send a whole buffer.
+ * \returns False if the connection broke.
+ */
+bool send_all(int socket, const string & buffer)
+{
+	size_t sent = 0;
+	while (sent < buffer.size())
+	{
+		ssize_t written = send(socket, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+		if (written <= 0)
+		{
+			return false;
+		}
+		sent += written;
+	}
+	return true;
+}
+
+
+/**
+ * The request a connection sends at a position in its sequence. Six in ten are charges, one is a payment,
+ * and the rest are balance queries. A connection only uses its own accounts and moves days forward,
+ * so its transactions are appended rather than backdated.
+ * \param options The load settings.
+ * \param connection Which connection.
+ * \param index The position in the connection's sequence.
+ * \param total How many requests the connection sends.
+ */
+CRequestProtocol::SRequest make_request(const SLoadOptions & options, int connection, long long index, long long total)
+{
+	CRequestProtocol::SRequest request;
+	int ownAccounts = std::max(1, options.mAccounts / options.mConnections);
+	request.mAccount = (AccountId)(connection + (index % ownAccounts) * options.mConnections);
+	request.mDay = (int)(index * 365 / std::max(1LL, total));
+	int kind = (int)(index % 10);
+	if (kind < 6)
+	{
+		request.mType = CRequestProtocol::CHARGE;
+		request.mValue = 1.0 + (double)(index % 50);
+	}
+	else if (kind < 7)
+	{
+		request.mType = CRequestProtocol::PAYMENT;
+		request.mValue = 10.0;
+	}
+	else
+	{
+		request.mType = CRequestProtocol::BALANCE;
+	}
+	return request;
+}
+
+
+/**
+ * Send requests over one connection, keeping a window of them in flight, and time every response.
+ * \param options The load settings.
+ * \param connection Which connection this is.
+ * \param requests How many requests to send.
+ * \param result Receives what the connection saw.
+ */
+void run_connection(const SLoadOptions & options, int connection, long long requests, SConnectionResult * result)
+{
+	int socket = connect_to_server(options);
+	if (socket < 0)
+	{
+		result->mFailed = true;
+		return;
+	}
+	result->mLatencies.reserve((size_t)requests);
+
+	std::deque<Clock::time_point> inFlight;
+	string output;
+	string input;
+	char buffer[64 * 1024];
+	long long next = 0;
+	while (next < requests || !inFlight.empty())
+	{
+		// Top the window up with one write.
+		output.clear();
+		size_t added = 0;
+		while (next < requests && (int)(inFlight.size() + added) < options.mPipeline)
+		{
+			CRequestProtocol::AppendRequest(output, make_request(options, connection, next, requests));
+			++next;
+			++added;
+		}
+		if (added > 0)
+		{
+			inFlight.insert(inFlight.end(), added, Clock::now());
+			if (!send_all(socket, output))
+			{
+				result->mFailed = true;
+				break;
+			}
+		}
+
+		ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+		{
+			result->mFailed = true;
+			break;
+		}
+		Clock::time_point arrivedAt = Clock::now();
+		input.append(buffer, received);
+
+		size_t start = 0;
+		size_t end;
+		while ((end = input.find('\n', start)) != string::npos && !inFlight.empty())
+		{
+			if (input.compare(start, 2, "OK") == 0)
+			{
+				result->mOk++;
+			}
+			else if (input.compare(start, 8, "DECLINED") == 0)
+			{
+				result->mDeclined++;
+			}
+			else if (input.compare(start, 7, "BALANCE") == 0)
+			{
+				result->mBalances++;
+			}
+			else
+			{
+				result->mErrors++;
+			}
+			result->mLatencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(arrivedAt - inFlight.front()).count());
+			inFlight.pop_front();
+			start = end + 1;
+		}
+		input.erase(0, start);
+	}
+	close(socket);
+}
+
+
+/**
+ * Open the accounts the load runs against, pipelining the requests.
+ * \param options The load settings.
+ * \returns False if the server couldn't be reached.
+ */
+bool open_accounts(const SLoadOptions & options)
+{
+	int socket = connect_to_server(options);
+	if (socket < 0)
+	{
+		return false;
+	}
+	string output;
+	for (int id = 0; id < options.mAccounts; ++id)
+	{
+		CRequestProtocol::SRequest request;
+		request.mType = CRequestProtocol::OPEN;
+		request.mAccount = (AccountId)id;
+		request.mAPR = options.mAPR;
+		request.mLimit = options.mLimit;
+		CRequestProtocol::AppendRequest(output, request);
+	}
+	bool sent = send_all(socket, output);
+
+	// Every response is one line. Accounts that already exist answer with an error, which is fine.
+	int responses = 0;
+	char buffer[64 * 1024];
+	while (sent && responses < options.mAccounts)
+	{
+		ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+		{
+			sent = false;
+			break;
+		}
+		responses += (int)std::count(buffer, buffer + received, '\n');
+	}
+	close(socket);
+	return sent;
+}
+
+
+/**
+ * \param sorted Latencies in ascending order.
+ * \param fraction Which percentile, as a fraction.
+ * \returns The latency at that percentile, in microseconds.
+ */
+double percentile(const vector<long long> & sorted, double fraction)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+	size_t index = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+	return sorted[index] / 1000.0;
+}
+
+
+int main(int argc, char * argv[])
+{
+	SLoadOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		if (option == "--help" || option == "-h")
+		{
+			print_usage();
+			return 0;
+		}
+		if (i + 1 >= argc)
+		{
+			cerr << "Missing value for " << option << endl;
+			print_usage();
+			return 1;
+		}
+
+		const char * value = argv[++i];
+		if (option == "--unix")
+		{
+			options.mUnixPath = value;
+		}
+		else if (option == "--port")
+		{
+			options.mPort = atoi(value);
+		}
+		else if (option == "--connections")
+		{
+			options.mConnections = std::max(1, atoi(value));
+		}
+		else if (option == "--requests")
+		{
+			options.mRequests = std::max(1LL, atoll(value));
+		}
+		else if (option == "--pipeline")
+		{
+			options.mPipeline = std::max(1, atoi(value));
+		}
+		else if (option == "--accounts")
+		{
+			options.mAccounts = std::max(1, atoi(value));
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			print_usage();
+			return 1;
+		}
+	}
+	if (options.mUnixPath.empty() && options.mPort < 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	if (!open_accounts(options))
+	{
+		cerr << "Couldn't reach the server" << endl;
+		return 1;
+	}
+
+	vector<SConnectionResult> results(options.mConnections);
+	vector<std::thread> threads;
+	Clock::time_point start = Clock::now();
+	for (int c = 0; c < options.mConnections; ++c)
+	{
+		long long requests = options.mRequests / options.mConnections + (c < options.mRequests % options.mConnections ? 1 : 0);
+		threads.emplace_back(run_connection, std::cref(options), c, requests, &results[c]);
+	}
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	SConnectionResult total;
+	for (SConnectionResult & result : results)
+	{
+		total.mLatencies.insert(total.mLatencies.end(), result.mLatencies.begin(), result.mLatencies.end());
+		total.mOk += result.mOk;
+		total.mDeclined += result.mDeclined;
+		total.mBalances += result.mBalances;
+		total.mErrors += result.mErrors;
+		total.mFailed = total.mFailed || result.mFailed;
+	}
+	std::sort(total.mLatencies.begin(), total.mLatencies.end());
+
+	cout << std::fixed << std::setprecision(1);
+	cout << total.mLatencies.size() << " requests in " << seconds << " s over " << options.mConnections
+		<< " connections, pipeline " << options.mPipeline << ": " << (total.mLatencies.size() / seconds) << " requests/s" << endl;
+	cout << "  ok " << total.mOk << ", declined " << total.mDeclined << ", balances " << total.mBalances
+		<< ", errors " << total.mErrors << endl;
+	cout << "  latency us: p50 " << percentile(total.mLatencies, 0.50) << "  p90 " << percentile(total.mLatencies, 0.90)
+		<< "  p99 " << percentile(total.mLatencies, 0.99) << "  p99.9 " << percentile(total.mLatencies, 0.999)
+		<< "  max " << percentile(total.mLatencies, 1.0) << endl;
+	if (total.mFailed)
+	{
+		cerr << "A connection broke before all its responses arrived" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,186 @@
+// AvantStep2CPPServer.cpp : Serves accounts over a local socket. See the Makefile for how to build and run it.
+//
+
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "AccountServer.h"
+#include "../AvantStep2CPP/AccountCache.h"
+#include "../AvantStep2CPP/EngineMetrics.h"
+#include "../AvantStep2CPP/FileAccountStore.h"
+#include "../AvantStep2CPP/MemoryAccountStore.h"
+#include "../AvantStep2CPP/SettlementImporter.h"
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+/// Every account opens at midnight on February 27, 2012 GMT, like in the console application.
+const time_t DEFAULT_TIME = (time_t)1330300800;
+
+/// How much memory the accounts may use unless --budget says otherwise.
+const size_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+/// The running server, so the signal handler can stop it.
+static CAccountServer * gServer = nullptr;
+
+
+void print_usage()
+{
+	cout << "Usage: AvantStep2CPPServer [options]" << endl;
+	cout << "  --unix <path>         Listen on a Unix domain socket" << endl;
+	cout << "  --port <port>         Listen on a TCP port of localhost" << endl;
+	cout << "  --store <directory>   Keep accounts that don't fit in memory in files here (default: memory only)" << endl;
+	cout << "  --budget <bytes>      Memory the accounts may use before some are evicted (default 256 MiB)" << endl;
+	cout << "  --metrics <path>      Write the engine metrics to path on exit" << endl;
+	cout << "  --import <path>       Apply a settlement file to the accounts in the store before listening" << endl;
+	cout << "At least one of --unix and --port is required." << endl;
+}
+
+
+/**
+ * Apply a settlement file to the accounts and print what happened.
+ * \param accounts The accounts.
+ * \param path The settlement file.
+ * \returns False if the file couldn't be read.
+ */
+bool import_settlement(std::shared_ptr<CAccountCache> accounts, const string & path)
+{
+	CSettlementImporter importer(accounts);
+	CSettlementImporter::SReport report;
+	if (!importer.Import(path, &report))
+	{
+		cerr << "Couldn't read " << path << endl;
+		return false;
+	}
+	cout << "Imported " << report.mRows << " rows from " << path << " in " << report.mSeconds << " s ("
+		<< (unsigned long long)report.mRowsPerSecond << " rows/s, " << importer.GetThreadCount() << " threads)" << endl;
+	cout << "  " << report.mAccepted << " accepted, " << report.mDeclined << " declined, "
+		<< report.mUnknownAccount << " for unknown accounts, " << report.mRejected << " rejected" << endl;
+	for (const CSettlementImporter::SRejectedRow & rejection : report.mRejections)
+	{
+		cout << "  line " << rejection.mLine << ": " << rejection.mReason << ": " << rejection.mText << endl;
+	}
+	if (report.mRejected > report.mRejections.size())
+	{
+		cout << "  ... and " << (report.mRejected - report.mRejections.size()) << " more rejected rows" << endl;
+	}
+	return true;
+}
+
+
+void handle_signal(int)
+{
+	if (gServer != nullptr)
+	{
+		gServer->Stop();
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	string unixPath;
+	int port = -1;
+	string storeDirectory;
+	size_t budget = DEFAULT_MEMORY_BUDGET;
+	string metricsPath;
+	string importPath;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		if (option == "--help" || option == "-h")
+		{
+			print_usage();
+			return 0;
+		}
+		if (i + 1 >= argc)
+		{
+			cerr << "Missing value for " << option << endl;
+			print_usage();
+			return 1;
+		}
+
+		const char * value = argv[++i];
+		if (option == "--unix")
+		{
+			unixPath = value;
+		}
+		else if (option == "--port")
+		{
+			port = atoi(value);
+		}
+		else if (option == "--store")
+		{
+			storeDirectory = value;
+		}
+		else if (option == "--budget")
+		{
+			budget = (size_t)atoll(value);
+		}
+		else if (option == "--metrics")
+		{
+			metricsPath = value;
+		}
+		else if (option == "--import")
+		{
+			importPath = value;
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			print_usage();
+			return 1;
+		}
+	}
+	if (unixPath.empty() && port < 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::shared_ptr<CAccountStore> store;
+	if (storeDirectory.empty())
+	{
+		store = std::make_shared<CMemoryAccountStore>();
+	}
+	else
+	{
+		store = std::make_shared<CFileAccountStore>(storeDirectory);
+	}
+	std::shared_ptr<CAccountCache> accounts = std::make_shared<CAccountCache>(store, budget);
+	if (!importPath.empty() && !import_settlement(accounts, importPath))
+	{
+		return 1;
+	}
+
+	CAccountServer server(accounts, DEFAULT_TIME);
+	if (!unixPath.empty() && !server.ListenUnix(unixPath))
+	{
+		cerr << "Couldn't listen on " << unixPath << endl;
+		return 1;
+	}
+	if (port >= 0 && (port > 65535 || !server.ListenTcp((unsigned short)port)))
+	{
+		cerr << "Couldn't listen on port " << port << endl;
+		return 1;
+	}
+
+	gServer = &server;
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+	cout << "Listening. Stop with Ctrl-C." << endl;
+	server.Run();
+	gServer = nullptr;
+
+	cout << server.GetRequestCount() << " requests served." << endl;
+	if (!metricsPath.empty() && !CEngineMetrics::WriteTextFile(metricsPath))
+	{
+		cerr << "Couldn't write " << metricsPath << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,331 @@
+// AvantStep2CPPWorkload.cpp : Generates realistic account traffic, runs it against the engine, and writes it
+// as a command file that can be replayed. See the Makefile for how to build and run it.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "RequestProtocol.h"
+#include "WorkloadGenerator.h"
+#include "../AvantStep2CPP/AccountCache.h"
+#include "../AvantStep2CPP/EngineMetrics.h"
+#include "../AvantStep2CPP/MemoryAccountStore.h"
+#include "../AvantStep2CPP/ShadowVerifier.h"
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+typedef std::chrono::steady_clock Clock;
+
+/// Every account opens at midnight on February 27, 2012 GMT, like in the console application and the server.
+const time_t DEFAULT_TIME = (time_t)1330300800;
+
+/// Enough memory that the working set never has to be evicted.
+const size_t MEMORY_BUDGET = (size_t)4 << 30;
+
+/// Names of the request types, indexed by CRequestProtocol::RequestType.
+const char * const REQUEST_NAMES[] = { "open", "charge", "payment", "balance", "rate" };
+const int REQUEST_TYPE_COUNT = 5;
+
+
+/**
+ * What happened to each kind of request while running against the engine.
+ */
+struct SRunResult
+{
+	vector<long long> mLatencies[REQUEST_TYPE_COUNT];
+	long long mAccepted[REQUEST_TYPE_COUNT] = {};
+	long long mRejected[REQUEST_TYPE_COUNT] = {};
+};
+
+
+void print_usage()
+{
+	cout << "Usage: AvantStep2CPPWorkload [options]" << endl;
+	cout << "  --operations <n>        Requests to generate (default 1000000)" << endl;
+	cout << "  --accounts <n>          Accounts (default 10000)" << endl;
+	cout << "  --zipf <s>              Zipf exponent of account activity, 0 for uniform (default 1.0)" << endl;
+	cout << "  --per-cycle <n>         Transactions per account per 30 day cycle (default 20)" << endl;
+	cout << "  --charges <fraction>    Fraction of transactions that are charges (default 0.8)" << endl;
+	cout << "  --backdated <fraction>  Fraction of transactions dated before the account's latest (default 0.02)" << endl;
+	cout << "  --declines <fraction>   Fraction of charges sized over the credit limit (default 0.05)" << endl;
+	cout << "  --queries <ratio>       Balance queries per transaction (default 1.0)" << endl;
+	cout << "  --limit <amount>        Credit limit of every account (default 5000)" << endl;
+	cout << "  --apr <rate>            APR of every account, as a decimal (default 0.35)" << endl;
+	cout << "  --seed <n>              Random seed. The same seed gives the same requests (default 1)" << endl;
+	cout << "  --write <path>          Write the requests as a command file instead of running them" << endl;
+	cout << "  --replay <path>         Run the requests in a command file instead of generating them" << endl;
+	cout << "  --metrics <path>        Write the engine metrics to path when done" << endl;
+	cout << "  --shadow <fraction>     Check this fraction of balances against the reference calculation (default 0)" << endl;
+	cout << "  --shadow-dir <path>     Write a command file reproducing each shadow mismatch to this directory" << endl;
+	cout << "Command files use the server's line protocol, so they can also be sent to AvantStep2CPPServer." << endl;
+}
+
+
+/**
+ * Carry out one request against the engine and time it.
+ * \param accounts The engine.
+ * \param request The request.
+ * \param result Where the outcome is recorded.
+ */
+void run_request(CAccountCache & accounts, const CRequestProtocol::SRequest & request, SRunResult & result)
+{
+	Clock::time_point start = Clock::now();
+	bool accepted = false;
+	double balance = 0.0;
+	switch (request.mType)
+	{
+	case CRequestProtocol::OPEN:
+		accepted = accounts.CreateAccount(request.mAccount, request.mAPR, request.mLimit, DEFAULT_TIME);
+		break;
+	case CRequestProtocol::CHARGE:
+		accepted = accounts.AddCharge(request.mAccount, request.mValue, request.mDay);
+		break;
+	case CRequestProtocol::PAYMENT:
+		accepted = accounts.AddPayment(request.mAccount, request.mValue, request.mDay);
+		break;
+	case CRequestProtocol::BALANCE:
+		accepted = accounts.GetBalanceOnDay(request.mAccount, request.mDay, &balance);
+		break;
+	case CRequestProtocol::RATE:
+		accepted = accounts.ScheduleAPR(request.mAccount, request.mAPR, request.mDay);
+		break;
+	}
+	result.mLatencies[request.mType].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+	if (accepted)
+	{
+		result.mAccepted[request.mType]++;
+	}
+	else
+	{
+		result.mRejected[request.mType]++;
+	}
+}
+
+
+/**
+ * Print throughput, outcomes and latency percentiles of a run.
+ * \param result The run.
+ * \param seconds How long it took.
+ */
+void print_result(SRunResult & result, double seconds)
+{
+	long long total = 0;
+	for (int type = 0; type < REQUEST_TYPE_COUNT; ++type)
+	{
+		total += (long long)result.mLatencies[type].size();
+	}
+	cout << std::fixed << std::setprecision(1);
+	cout << total << " requests in " << seconds << " s: " << (total / seconds) << " requests/s" << endl;
+	cout << "  type       count   rejected    p50 us    p99 us    max us" << endl;
+	for (int type = 0; type < REQUEST_TYPE_COUNT; ++type)
+	{
+		vector<long long> & latencies = result.mLatencies[type];
+		if (latencies.empty())
+		{
+			continue;
+		}
+		std::sort(latencies.begin(), latencies.end());
+		size_t count = latencies.size();
+		cout << "  " << std::left << std::setw(8) << REQUEST_NAMES[type] << std::right
+			<< std::setw(8) << count << std::setw(11) << result.mRejected[type]
+			<< std::setw(10) << latencies[count / 2] / 1000.0
+			<< std::setw(10) << latencies[std::min(count - 1, count * 99 / 100)] / 1000.0
+			<< std::setw(10) << latencies[count - 1] / 1000.0 << endl;
+	}
+}
+
+
+int main(int argc, char * argv[])
+{
+	CWorkloadGenerator::SOptions options;
+	long long operations = 1000000;
+	string writePath;
+	string replayPath;
+	string metricsPath;
+	double shadowRate = 0.0;
+	string shadowDirectory;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		if (option == "--help" || option == "-h")
+		{
+			print_usage();
+			return 0;
+		}
+		if (i + 1 >= argc)
+		{
+			cerr << "Missing value for " << option << endl;
+			print_usage();
+			return 1;
+		}
+
+		const char * value = argv[++i];
+		if (option == "--operations")
+		{
+			operations = atoll(value);
+		}
+		else if (option == "--accounts")
+		{
+			options.mAccounts = atoi(value);
+		}
+		else if (option == "--zipf")
+		{
+			options.mZipfExponent = atof(value);
+		}
+		else if (option == "--per-cycle")
+		{
+			options.mTransactionsPerCycle = atof(value);
+		}
+		else if (option == "--charges")
+		{
+			options.mChargeFraction = atof(value);
+		}
+		else if (option == "--backdated")
+		{
+			options.mBackdatedFraction = atof(value);
+		}
+		else if (option == "--declines")
+		{
+			options.mDeclineFraction = atof(value);
+		}
+		else if (option == "--queries")
+		{
+			options.mQueriesPerWrite = atof(value);
+		}
+		else if (option == "--limit")
+		{
+			options.mLimit = atof(value);
+		}
+		else if (option == "--apr")
+		{
+			options.mAPR = atof(value);
+		}
+		else if (option == "--seed")
+		{
+			options.mSeed = (unsigned int)atoi(value);
+		}
+		else if (option == "--write")
+		{
+			writePath = value;
+		}
+		else if (option == "--replay")
+		{
+			replayPath = value;
+		}
+		else if (option == "--metrics")
+		{
+			metricsPath = value;
+		}
+		else if (option == "--shadow")
+		{
+			shadowRate = atof(value);
+		}
+		else if (option == "--shadow-dir")
+		{
+			shadowDirectory = value;
+		}
+		else
+		{
+			cerr << "Unknown option " << option << endl;
+			print_usage();
+			return 1;
+		}
+	}
+
+	CWorkloadGenerator generator(options);
+	CRequestProtocol::SRequest request;
+
+	if (!writePath.empty())
+	{
+		std::ofstream file(writePath, std::ios::binary);
+		string buffer;
+		for (long long i = 0; i < operations && file; ++i)
+		{
+			generator.Next(request);
+			CRequestProtocol::AppendRequest(buffer, request);
+			if (buffer.size() >= 1 << 16)
+			{
+				file.write(buffer.data(), buffer.size());
+				buffer.clear();
+			}
+		}
+		file.write(buffer.data(), buffer.size());
+		if (!file)
+		{
+			cerr << "Couldn't write " << writePath << endl;
+			return 1;
+		}
+		cout << operations << " requests written to " << writePath << endl;
+		return 0;
+	}
+
+	// Generate or read everything up front, so only the engine is timed.
+	vector<CRequestProtocol::SRequest> requests;
+	if (!replayPath.empty())
+	{
+		std::ifstream file(replayPath);
+		if (!file)
+		{
+			cerr << "Couldn't read " << replayPath << endl;
+			return 1;
+		}
+		string line;
+		string error;
+		long long lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			++lineNumber;
+			if (!CRequestProtocol::ParseRequest(line.c_str(), line.size(), &request, &error))
+			{
+				cerr << replayPath << ":" << lineNumber << ": " << error << endl;
+				return 1;
+			}
+			requests.push_back(request);
+		}
+	}
+	else
+	{
+		requests.reserve((size_t)std::max(0LL, operations));
+		for (long long i = 0; i < operations; ++i)
+		{
+			generator.Next(request);
+			requests.push_back(request);
+		}
+	}
+
+	CShadowVerifier::SetSampleRate(shadowRate);
+	CShadowVerifier::SetReproductionDirectory(shadowDirectory);
+	CAccountCache accounts(std::make_shared<CMemoryAccountStore>(), MEMORY_BUDGET);
+	SRunResult result;
+	Clock::time_point start = Clock::now();
+	for (const CRequestProtocol::SRequest & next : requests)
+	{
+		run_request(accounts, next, result);
+	}
+	print_result(result, std::chrono::duration<double>(Clock::now() - start).count());
+
+	if (shadowRate > 0.0)
+	{
+		CShadowVerifier::Flush();
+		cout << "shadow verification: " << CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_VERIFIED_SAMPLES) << " checked, "
+			<< CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_DROPPED_SAMPLES) << " dropped, "
+			<< CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_MISMATCHES) << " mismatches" << endl;
+	}
+
+	if (!metricsPath.empty() && !CEngineMetrics::WriteTextFile(metricsPath))
+	{
+		cerr << "Couldn't write " << metricsPath << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include "RequestProtocol.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using std::string;
+
+/// The most fields any request has.
+const int MAX_FIELDS = 4;
+
+
+/**
+ * Split a line into space-separated fields.
+ * \param line The line, without its newline.
+ * \param length How long the line is.
+ * \param fields Receives each field. Every field is copied, so they are null-terminated.
+ * \returns How many fields there were, or MAX_FIELDS + 1 if there were too many.
+ */
+static int SplitFields(const char * line, size_t length, string fields[MAX_FIELDS])
+{
+	int count = 0;
+	size_t i = 0;
+	while (i < length)
+	{
+		while (i < length && (line[i] == ' ' || line[i] == '\r'))
+		{
+			++i;
+		}
+		if (i == length)
+		{
+			break;
+		}
+		if (count == MAX_FIELDS)
+		{
+			return MAX_FIELDS + 1;
+		}
+		size_t start = i;
+		while (i < length && line[i] != ' ' && line[i] != '\r')
+		{
+			++i;
+		}
+		fields[count++].assign(line + start, i - start);
+	}
+	return count;
+}
+
+/**
+ * Read a whole field as a number.
+ * \param field The field.
+ * \param value Receives the number.
+ * \returns False if the field isn't entirely a number.
+ */
+static bool ParseDouble(const string & field, double * value)
+{
+	char * end = nullptr;
+	*value = strtod(field.c_str(), &end);
+	return end != field.c_str() && *end == '\0';
+}
+
+/**
+ * Read a whole field as an integer.
+ * \param field The field.
+ * \param value Receives the integer.
+ * \returns False if the field isn't entirely an integer.
+ */
+static bool ParseInteger(const string & field, long long * value)
+{
+	char * end = nullptr;
+	*value = strtoll(field.c_str(), &end, 10);
+	return end != field.c_str() && *end == '\0';
+}
+
+
+/**
+ * Parse one request line.
+ * \param line The line, without its newline.
+ * \param length How long the line is.
+ * \param request Receives the request.
+ * \param error Receives why the line isn't a request, if it isn't.
+ * \returns True if the line is a request.
+ */
+bool CRequestProtocol::ParseRequest(const char * line, size_t length, SRequest * request, string * error)
+{
+	string fields[MAX_FIELDS];
+	int count = SplitFields(line, length, fields);
+	if (count == 0)
+	{
+		*error = "empty request";
+		return false;
+	}
+
+	int expected = 0;
+	const string & command = fields[0];
+	if (command == "OPEN")
+	{
+		request->mType = OPEN;
+		expected = 4;
+	}
+	else if (command == "CHARGE")
+	{
+		request->mType = CHARGE;
+		expected = 4;
+	}
+	else if (command == "PAYMENT")
+	{
+		request->mType = PAYMENT;
+		expected = 4;
+	}
+	else if (command == "BALANCE")
+	{
+		request->mType = BALANCE;
+		expected = 3;
+	}
+	else if (command == "RATE")
+	{
+		request->mType = RATE;
+		expected = 4;
+	}
+	else
+	{
+		*error = "unknown request";
+		return false;
+	}
+	if (count != expected)
+	{
+		*error = "wrong number of fields";
+		return false;
+	}
+
+	long long account = 0;
+	if (!ParseInteger(fields[1], &account) || account < 0)
+	{
+		*error = "bad account";
+		return false;
+	}
+	request->mAccount = (AccountId)account;
+
+	long long day = 0;
+	bool valid = true;
+	switch (request->mType)
+	{
+	case OPEN:
+		valid = ParseDouble(fields[2], &request->mAPR) && ParseDouble(fields[3], &request->mLimit);
+		break;
+	case CHARGE:
+	case PAYMENT:
+		valid = ParseDouble(fields[2], &request->mValue) && ParseInteger(fields[3], &day);
+		break;
+	case BALANCE:
+		valid = ParseInteger(fields[2], &day);
+		break;
+	case RATE:
+		valid = ParseDouble(fields[2], &request->mAPR) && ParseInteger(fields[3], &day);
+		break;
+	}
+	if (!valid || day < 0 || day > 0x7fffffff)
+	{
+		*error = "bad number";
+		return false;
+	}
+	request->mDay = (int)day;
+	return true;
+}
+
+
+/**
+ * Append a request line, as a client sends it.
+ * \param buffer Where to append.
+ * \param request The request.
+ */
+void CRequestProtocol::AppendRequest(string & buffer, const SRequest & request)
+{
+	char line[MAX_LINE];
+	int length = 0;
+	unsigned long long account = request.mAccount;
+	switch (request.mType)
+	{
+	case OPEN:
+		length = snprintf(line, sizeof(line), "OPEN %llu %.15g %.15g\n", account, request.mAPR, request.mLimit);
+		break;
+	case CHARGE:
+		length = snprintf(line, sizeof(line), "CHARGE %llu %.15g %d\n", account, request.mValue, request.mDay);
+		break;
+	case PAYMENT:
+		length = snprintf(line, sizeof(line), "PAYMENT %llu %.15g %d\n", account, request.mValue, request.mDay);
+		break;
+	case BALANCE:
+		length = snprintf(line, sizeof(line), "BALANCE %llu %d\n", account, request.mDay);
+		break;
+	case RATE:
+		length = snprintf(line, sizeof(line), "RATE %llu %.15g %d\n", account, request.mAPR, request.mDay);
+		break;
+	}
+	buffer.append(line, length);
+}
+
+
+/**
+ * Append the response to a request that succeeded.
+ * \param buffer Where to append.
+ */
+void CRequestProtocol::AppendOk(string & buffer)
+{
+	buffer.append("OK\n");
+}
+
+
+/**
+ * Append the response to a charge or payment the account turned down.
+ * \param buffer Where to append.
+ */
+void CRequestProtocol::AppendDeclined(string & buffer)
+{
+	buffer.append("DECLINED\n");
+}
+
+
+/**
+ * Append the response to a balance request.
+ * \param buffer Where to append.
+ * \param balance The balance.
+ */
+void CRequestProtocol::AppendBalance(string & buffer, double balance)
+{
+	char line[MAX_LINE];
+	int length = snprintf(line, sizeof(line), "BALANCE %.2f\n", balance);
+	buffer.append(line, length);
+}
+
+
+/**
+ * Append the response to a request that couldn't be carried out.
+ * \param buffer Where to append.
+ * \param reason Why. Must not contain a newline.
+ */
+void CRequestProtocol::AppendError(string & buffer, const string & reason)
+{
+	buffer.append("ERR ");
+	buffer.append(reason);
+	buffer.append("\n");
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include "../AvantStep2CPP/AccountStore.h"
+
+
+/**
+ * The line protocol the account server speaks. Every request and every response is one line of
+ * space-separated fields ending in '\n'. Responses come back in the order the requests were sent, so a
+ * client may send many requests before reading any response.
+ *
+ *   OPEN <account> <apr> <limit>       ->  OK | ERR exists
+ *   CHARGE <account> <value> <day>     ->  OK | DECLINED
+ *   PAYMENT <account> <value> <day>    ->  OK | DECLINED
+ *   BALANCE <account> <day>            ->  BALANCE <value> | ERR no account
+ *   RATE <account> <apr> <day>         ->  OK | ERR rejected
+ *
+ * Anything else gets ERR followed by the reason.
+ */
+class CRequestProtocol
+{
+public:
+	/// The longest line either side accepts, newline included.
+	static const size_t MAX_LINE = 256;
+
+	/// What a request asks for.
+	enum RequestType
+	{
+		OPEN,
+		CHARGE,
+		PAYMENT,
+		BALANCE,
+		RATE
+	};
+
+	/**
+	 * One parsed request. Fields a request type doesn't use are left at zero.
+	 */
+	struct SRequest
+	{
+		RequestType mType = BALANCE;
+		AccountId mAccount = 0;
+
+		/// The APR for OPEN and RATE.
+		double mAPR = 0.0;
+
+		/// The credit limit for OPEN.
+		double mLimit = 0.0;
+
+		/// The amount for CHARGE and PAYMENT.
+		double mValue = 0.0;
+
+		/// The day for CHARGE, PAYMENT, BALANCE and RATE.
+		int mDay = 0;
+	};
+
+	static bool ParseRequest(const char * line, size_t length, SRequest * request, std::string * error);
+	static void AppendRequest(std::string & buffer, const SRequest & request);
+
+	static void AppendOk(std::string & buffer);
+	static void AppendDeclined(std::string & buffer);
+	static void AppendBalance(std::string & buffer, double balance);
+	static void AppendError(std::string & buffer, const std::string & reason);
+
+	CRequestProtocol() = delete;
+};
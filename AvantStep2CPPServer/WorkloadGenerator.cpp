@@ -0,0 +1,161 @@
+#include "WorkloadGenerator.h"
+#include <algorithm>
+#include <cmath>
+
+/// The amount of days in one cycle.
+const double DAYS_PER_CYCLE = 30.0;
+
+/// The typical charge, before it is capped by what is left of the credit limit.
+const double TYPICAL_CHARGE = 40.0;
+
+
+/**
+ * Round an amount down to whole cents, like every amount in a command file.
+ * \param value The amount.
+ * \returns The rounded amount, at least one cent.
+ */
+static double RoundToCents(double value)
+{
+	return std::max(0.01, floor(value * 100.0) / 100.0);
+}
+
+
+/**
+ * Constructor.
+ * \param options What the traffic looks like.
+ */
+CWorkloadGenerator::CWorkloadGenerator(const SOptions & options) :
+	mOptions(options), mRandom(options.mSeed)
+{
+	if (this->mOptions.mAccounts < 1)
+	{
+		this->mOptions.mAccounts = 1;
+	}
+	if (this->mOptions.mTransactionsPerCycle <= 0.0)
+	{
+		this->mOptions.mTransactionsPerCycle = 1.0;
+	}
+	this->mAccounts.resize(this->mOptions.mAccounts);
+
+	// The account of rank k is picked with a weight of 1 / k^s.
+	this->mZipfCumulative.resize(this->mOptions.mAccounts);
+	double total = 0.0;
+	for (int rank = 0; rank < this->mOptions.mAccounts; ++rank)
+	{
+		total += 1.0 / pow(rank + 1.0, this->mOptions.mZipfExponent);
+		this->mZipfCumulative[rank] = total;
+	}
+	for (double & cumulative : this->mZipfCumulative)
+	{
+		cumulative /= total;
+	}
+}
+
+
+/**
+ * \returns A random number in [0, 1).
+ */
+double CWorkloadGenerator::Uniform()
+{
+	return std::generate_canonical<double, 53>(this->mRandom);
+}
+
+
+/**
+ * \returns The account the next request is for. The busiest account is 0.
+ */
+int CWorkloadGenerator::PickAccount()
+{
+	double pick = this->Uniform();
+	std::vector<double>::iterator found = std::upper_bound(this->mZipfCumulative.begin(), this->mZipfCumulative.end(), pick);
+	if (found == this->mZipfCumulative.end())
+	{
+		return this->mOptions.mAccounts - 1;
+	}
+	return (int)(found - this->mZipfCumulative.begin());
+}
+
+
+/**
+ * Generate the next request.
+ * \param request Receives the request.
+ */
+void CWorkloadGenerator::Next(CRequestProtocol::SRequest & request)
+{
+	if (this->mHasDeferred)
+	{
+		request = this->mDeferred;
+		this->mHasDeferred = false;
+		return;
+	}
+
+	int id = this->PickAccount();
+	SAccountState & account = this->mAccounts[id];
+	request = CRequestProtocol::SRequest();
+	request.mAccount = (AccountId)id;
+
+	double queryChance = this->mOptions.mQueriesPerWrite / (1.0 + this->mOptions.mQueriesPerWrite);
+	if (this->Uniform() < queryChance)
+	{
+		// Anywhere from opening day to a cycle past the latest transaction.
+		request.mType = CRequestProtocol::BALANCE;
+		request.mDay = (int)(this->Uniform() * (std::max(account.mDay, (int)this->mDay) + DAYS_PER_CYCLE));
+	}
+	else
+	{
+		// Time moves on by a cycle once every account has made its share of transactions.
+		this->mDay += DAYS_PER_CYCLE / (this->mOptions.mTransactionsPerCycle * this->mOptions.mAccounts);
+		int today = std::max(account.mDay, (int)this->mDay);
+		if (account.mDay > 0 && this->Uniform() < this->mOptions.mBackdatedFraction)
+		{
+			// Somewhere in the cycle before the latest transaction.
+			int earliest = std::max(0, account.mDay - (int)DAYS_PER_CYCLE);
+			request.mDay = earliest + (int)(this->Uniform() * (account.mDay - earliest));
+		}
+		else
+		{
+			// Interest is added at the end of every cycle the account went through since its last transaction.
+			int cycles = today / (int)DAYS_PER_CYCLE - account.mDay / (int)DAYS_PER_CYCLE;
+			account.mBalance *= pow(1.0 + this->mOptions.mAPR * DAYS_PER_CYCLE / 365.0, cycles);
+			account.mDay = today;
+			request.mDay = today;
+		}
+
+		double headroom = std::max(0.0, this->mOptions.mLimit - account.mBalance);
+		if (account.mBalance <= 0.0 || this->Uniform() < this->mOptions.mChargeFraction)
+		{
+			request.mType = CRequestProtocol::CHARGE;
+			if (this->Uniform() < this->mOptions.mDeclineFraction)
+			{
+				// Just over what is left, so the engine has to decline it.
+				request.mValue = RoundToCents(headroom + 1.0 + TYPICAL_CHARGE * this->Uniform());
+			}
+			else
+			{
+				// Mostly small, now and then large, and never more than half of what is left.
+				double value = -TYPICAL_CHARGE * log(1.0 - this->Uniform());
+				request.mValue = RoundToCents(std::min(value, headroom / 2.0));
+				account.mBalance += request.mValue;
+			}
+		}
+		else
+		{
+			request.mType = CRequestProtocol::PAYMENT;
+			request.mValue = RoundToCents(account.mBalance * (0.2 + 0.6 * this->Uniform()));
+			account.mBalance -= request.mValue;
+		}
+	}
+
+	if (!account.mOpened)
+	{
+		account.mOpened = true;
+		this->mDeferred = request;
+		this->mHasDeferred = true;
+
+		request = CRequestProtocol::SRequest();
+		request.mType = CRequestProtocol::OPEN;
+		request.mAccount = (AccountId)id;
+		request.mAPR = this->mOptions.mAPR;
+		request.mLimit = this->mOptions.mLimit;
+	}
+}
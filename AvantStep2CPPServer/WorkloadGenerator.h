@@ -0,0 +1,92 @@
+#pragma once
+#include <random>
+#include <vector>
+#include "RequestProtocol.h"
+
+
+/**
+ * Generates account traffic that looks like production instead of a handful of hand-picked transactions.
+ *
+ * A few accounts get most of the traffic: how often an account is picked follows a Zipf distribution over
+ * its rank. Time moves forward so that the average account makes mTransactionsPerCycle transactions per
+ * cycle, which means busy accounts make many more. Some transactions are backdated into the cycle before
+ * the account's latest transaction, some charges are sized to go over the credit limit so they get
+ * declined, and balance queries are mixed in at a fixed ratio to writes.
+ *
+ * The generator keeps a rough balance per account, with interest added once a cycle, to size charges and
+ * payments so that the ones meant to go through mostly do. Every account is opened with an OPEN request
+ * the first time it is picked. The same options and seed always produce the same requests.
+ */
+class CWorkloadGenerator
+{
+public:
+	/**
+	 * What the traffic looks like.
+	 */
+	struct SOptions
+	{
+		/// How many accounts there are.
+		int mAccounts = 10000;
+
+		/// The Zipf exponent. 0 picks every account equally often, larger values concentrate traffic.
+		double mZipfExponent = 1.0;
+
+		/// How many transactions the average account makes per 30 day cycle.
+		double mTransactionsPerCycle = 20.0;
+
+		/// The fraction of transactions that are charges. The rest are payments.
+		double mChargeFraction = 0.8;
+
+		/// The fraction of transactions dated before the account's latest one.
+		double mBackdatedFraction = 0.02;
+
+		/// The fraction of charges sized to go over the credit limit.
+		double mDeclineFraction = 0.05;
+
+		/// Balance queries per transaction.
+		double mQueriesPerWrite = 1.0;
+
+		double mAPR = 0.35;
+		double mLimit = 5000.0;
+
+		unsigned int mSeed = 1;
+	};
+
+private:
+	/**
+	 * What the generator remembers about one account.
+	 */
+	struct SAccountState
+	{
+		bool mOpened = false;
+
+		/// The day of the account's latest transaction.
+		int mDay = 0;
+
+		/// Roughly the balance after the account's latest transaction.
+		double mBalance = 0.0;
+	};
+
+	SOptions mOptions;
+	std::mt19937_64 mRandom;
+
+	/// Entry i is the chance that one of the i + 1 busiest accounts is picked.
+	std::vector<double> mZipfCumulative;
+
+	std::vector<SAccountState> mAccounts;
+
+	/// The current day, with the fraction carried to the next transaction.
+	double mDay = 0.0;
+
+	/// A request picked before its account was opened, handed out after the OPEN.
+	CRequestProtocol::SRequest mDeferred;
+	bool mHasDeferred = false;
+
+	double Uniform();
+	int PickAccount();
+
+public:
+	CWorkloadGenerator(const SOptions & options);
+
+	void Next(CRequestProtocol::SRequest & request);
+};
@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountBook.h"
+#include <atomic>
+#include <ctime>
+#include <exception>
+#include <future>
+#include <vector>
+const time_t BOOK_DEFAULT_TIME = (time_t)1330300800;
+const double BOOK_DEFAULT_APR = 0.35;
+const double BOOK_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Coroutines need C++20. Without them there is no CAccountBook to test.
+#ifdef AVANT_HAS_COROUTINES
+
+namespace AvastStep2CPPTest
+{
+	/**
+	 * A coroutine nobody waits on. It starts right away and cleans up after itself.
+	 */
+	struct SDetached
+	{
+		struct promise_type
+		{
+			SDetached get_return_object() { return SDetached(); }
+			std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+			std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+	};
+
+	/**
+	 * What the coroutine in TestBookMatchesAccount saw.
+	 */
+	struct SBookResults
+	{
+		bool mOpened = false;
+		bool mOpenedTwice = true;
+		bool mAdded = false;
+		bool mOverLimit = true;
+		CAccountBook::SBalance mBalance = { false, 0.0 };
+		CAccountBook::SBalance mMissing = { true, 0.0 };
+	};
+
+	SDetached RunAccountHistory(CAccountBook & book, SBookResults * results, std::promise<void> * done)
+	{
+		results->mOpened = co_await book.Open(7, BOOK_DEFAULT_APR, BOOK_DEFAULT_CREDIT_LIMIT, BOOK_DEFAULT_TIME);
+		results->mOpenedTwice = co_await book.Open(7, BOOK_DEFAULT_APR, BOOK_DEFAULT_CREDIT_LIMIT, BOOK_DEFAULT_TIME);
+
+		// Identical to TEST_METHOD TestCCAccountAddItemsSkipCycle.
+		bool added = co_await book.Charge(7, 500.0, 0);
+		added = co_await book.Charge(7, 200, 8) && added;
+		added = co_await book.Payment(7, 200, 15) && added;
+		added = co_await book.Charge(7, 100, 25) && added;
+		added = co_await book.Charge(7, 300, 65) && added;
+		results->mAdded = added;
+		results->mOverLimit = co_await book.Charge(7, 5000, 66);
+
+		results->mBalance = co_await book.BalanceOnDay(7, 90);
+		results->mMissing = co_await book.BalanceOnDay(8, 90);
+		done->set_value();
+	}
+
+	SDetached ChargeRepeatedly(CAccountBook & book, AccountId id, int charges, std::atomic<int> * accepted, std::atomic<int> * finished)
+	{
+		for (int day = 0; day < charges; ++day)
+		{
+			if (co_await book.Charge(id, 1.0, day))
+			{
+				(*accepted)++;
+			}
+		}
+		(*finished)++;
+	}
+
+	TEST_CLASS(AccountBookTest)
+	{
+	public:
+
+		TEST_METHOD(TestBookMatchesAccount)
+		{
+			CAccountBook book(4);
+			SBookResults results;
+			std::promise<void> done;
+			std::future<void> finished = done.get_future();
+			RunAccountHistory(book, &results, &done);
+			finished.wait();
+
+			Assert::IsTrue(results.mOpened, L"The account wasn't opened");
+			Assert::IsFalse(results.mOpenedTwice, L"The account was opened twice");
+			Assert::IsTrue(results.mAdded, L"A valid transaction was declined");
+			Assert::IsFalse(results.mOverLimit, L"A charge over the limit was accepted");
+			Assert::IsTrue(results.mBalance.mFound, L"The account went missing");
+			Assert::AreEqual(results.mBalance.mBalance, 959.36, 0.005, L"Your balance calculation is wrong");
+			Assert::IsFalse(results.mMissing.mFound, L"An account that was never opened has a balance");
+		}
+
+		TEST_METHOD(TestBookManyCoroutines)
+		{
+			const int ACCOUNTS = 8;
+			const int COROUTINES_PER_ACCOUNT = 4;
+			const int CHARGES = 50;
+
+			std::atomic<int> accepted(0);
+			std::atomic<int> finished(0);
+			{
+				CAccountBook book(3);
+				std::promise<void> opened;
+				std::future<void> openedFuture = opened.get_future();
+				[](CAccountBook & book, std::promise<void> * opened) -> SDetached
+				{
+					for (AccountId id = 0; id < ACCOUNTS; ++id)
+					{
+						co_await book.Open(id, 0.0, 1000000.0, BOOK_DEFAULT_TIME);
+					}
+					opened->set_value();
+				}(book, &opened);
+				openedFuture.wait();
+
+				// Coroutines on the same account interleave. The limit is far away, so every charge fits and
+				// each one has to come back exactly once.
+				for (AccountId id = 0; id < ACCOUNTS; ++id)
+				{
+					for (int i = 0; i < COROUTINES_PER_ACCOUNT; ++i)
+					{
+						ChargeRepeatedly(book, id, CHARGES, &accepted, &finished);
+					}
+				}
+				while (finished < ACCOUNTS * COROUTINES_PER_ACCOUNT)
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			Assert::IsTrue(accepted == ACCOUNTS * COROUTINES_PER_ACCOUNT * CHARGES, L"Charges went missing");
+		}
+
+	};
+}
+
+#endif
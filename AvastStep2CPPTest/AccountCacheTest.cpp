@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "AccountCache.h"
+#include "MemoryAccountStore.h"
+#include <atomic>
+#include <memory>
+#include <ctime>
+#include <thread>
+#include <chrono>
+#include <vector>
+const time_t CACHE_DEFAULT_TIME = (time_t)1330300800;
+const double CACHE_DEFAULT_APR = 0.35;
+const double CACHE_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	/**
+	 * A store that takes a while to load, so concurrent misses overlap.
+	 */
+	class CSlowAccountStore : public CMemoryAccountStore
+	{
+	public:
+		int mLoads = 0;
+
+		virtual bool Load(AccountId id, std::vector<unsigned char> & buffer) override
+		{
+			mLoads++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			return CMemoryAccountStore::Load(id, buffer);
+		}
+	};
+
+	TEST_CLASS(AccountCacheTest)
+	{
+	public:
+
+		TEST_METHOD(TestAccountSerializeRoundTrip)
+		{
+			CCreditCardAccount cca(CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME);
+			cca.AddCharge(500.0, 0);
+			cca.AddCharge(200, 8);
+			cca.AddPayment(200, 15);
+			cca.AddCharge(100, 25);
+			cca.AddCharge(300, 65);
+
+			std::vector<unsigned char> buffer;
+			cca.Serialize(buffer);
+			std::shared_ptr<CCreditCardAccount> copy = CCreditCardAccount::Deserialize(buffer.data(), buffer.size());
+			Assert::IsTrue(copy != nullptr, L"The account couldn't be read back");
+
+			time_t balanceTime = -1;
+			time_t copyBalanceTime = -2;
+			Assert::IsTrue(copy->GetTransactionCount() == 5, L"Transactions went missing");
+			Assert::AreEqual(copy->GetCurrentBalance(&copyBalanceTime), cca.GetCurrentBalance(&balanceTime), 0.0, L"The current balance changed");
+			Assert::IsTrue(copyBalanceTime == balanceTime, L"The time of the current balance changed");
+			Assert::AreEqual(copy->GetBalanceOnDay(90), 959.36, 0.005, L"Your balance calculation is wrong");
+
+			Assert::IsTrue(CCreditCardAccount::Deserialize(buffer.data(), buffer.size() - 1) == nullptr, L"A truncated account should be rejected");
+		}
+
+		TEST_METHOD(TestAccountCacheEvictsAndRehydrates)
+		{
+			std::shared_ptr<CMemoryAccountStore> store = std::make_shared<CMemoryAccountStore>();
+
+			// Room for one account like the ones below, but not two.
+			CCreditCardAccount sample(CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME);
+			sample.AddCharge(500.0, 0);
+			sample.AddCharge(200, 8);
+			sample.AddPayment(200, 15);
+			sample.AddCharge(100, 25);
+			size_t budget = sample.GetMemoryUsage() * 3 / 2;
+			CAccountCache cache(store, budget);
+			Assert::IsTrue(cache.CreateAccount(1, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME), L"The account should be new");
+			Assert::IsTrue(cache.CreateAccount(2, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME), L"The account should be new");
+			Assert::IsFalse(cache.CreateAccount(1, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME), L"The account already exists");
+
+			for (AccountId id = 1; id <= 2; ++id)
+			{
+				cache.AddCharge(id, 500.0, 0);
+				cache.AddCharge(id, 200, 8);
+				cache.AddPayment(id, 200, 15);
+				cache.AddCharge(id, 100, 25);
+			}
+			Assert::IsTrue(cache.GetEvictionCount() > 0, L"Going over the budget should have evicted an account");
+			Assert::IsTrue(cache.GetMemoryUsage() <= budget, L"The cache is over its budget");
+
+			double balance = 0.0;
+			Assert::IsTrue(cache.GetBalanceOnDay(1, 30, &balance), L"The account should be loaded back from the store");
+			Assert::AreEqual(balance, 616.21, 0.005, L"Your balance calculation is wrong");
+			Assert::IsTrue(cache.GetBalanceOnDay(2, 30, &balance), L"The account should be loaded back from the store");
+			Assert::AreEqual(balance, 616.21, 0.005, L"Your balance calculation is wrong");
+			Assert::IsTrue(cache.GetMissCount() > 0, L"Loading an evicted account is a miss");
+			Assert::IsTrue(cache.GetHitCount() > 0, L"Using the same account twice in a row is a hit");
+
+			Assert::IsFalse(cache.GetBalanceOnDay(3, 30, &balance), L"That account doesn't exist");
+		}
+
+		TEST_METHOD(TestAccountCacheCoalescesMisses)
+		{
+			std::shared_ptr<CSlowAccountStore> store = std::make_shared<CSlowAccountStore>();
+			{
+				CAccountCache writer(store, 1 << 20);
+				writer.CreateAccount(7, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME);
+				writer.AddCharge(7, 500.0, 0);
+			}
+
+			store->mLoads = 0;
+			CAccountCache cache(store, 1 << 20);
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 4; ++i)
+			{
+				threads.push_back(std::thread([&cache]() {
+					double balance = 0.0;
+					cache.GetBalanceOnDay(7, 30, &balance);
+				}));
+			}
+			for (std::thread & thread : threads)
+			{
+				thread.join();
+			}
+
+			Assert::IsTrue(store->mLoads == 1, L"The account should have been loaded exactly once");
+			Assert::IsTrue(cache.GetMissCount() + cache.GetHitCount() == 4, L"Every call is either a hit or a miss");
+		}
+
+		TEST_METHOD(TestAccountCacheFlushesDuringEviction)
+		{
+			std::shared_ptr<CMemoryAccountStore> store = std::make_shared<CMemoryAccountStore>();
+			const AccountId accounts = 16;
+			const int charges = 200;
+			{
+				// Room for a few accounts, so the writers keep evicting each other's while the flusher runs.
+				CCreditCardAccount sample(CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME);
+				CAccountCache cache(store, sample.GetMemoryUsage() * 4);
+				for (AccountId id = 0; id < accounts; ++id)
+				{
+					cache.CreateAccount(id, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT, CACHE_DEFAULT_TIME);
+				}
+
+				std::atomic<bool> done(false);
+				std::thread flusher([&cache, &done]() {
+					while (!done)
+					{
+						cache.Flush();
+					}
+				});
+				std::vector<std::thread> writers;
+				for (AccountId first = 0; first < 4; ++first)
+				{
+					writers.push_back(std::thread([&cache, first, accounts, charges]() {
+						for (int charge = 0; charge < charges; ++charge)
+						{
+							for (AccountId id = first; id < accounts; id += 4)
+							{
+								cache.AddCharge(id, 1.0, 0);
+							}
+						}
+					}));
+				}
+				for (std::thread & writer : writers)
+				{
+					writer.join();
+				}
+				done = true;
+				flusher.join();
+				Assert::IsTrue(cache.GetEvictionCount() > 0, L"The accounts should have been evicted along the way");
+			}
+
+			// Every charge has to have reached the store, whichever of eviction and Flush wrote it last.
+			CAccountCache cache(store, 1 << 20);
+			for (AccountId id = 0; id < accounts; ++id)
+			{
+				double balance = 0.0;
+				Assert::IsTrue(cache.GetBalanceOnDay(id, 0, &balance), L"The account should be in the store");
+				Assert::AreEqual(balance, (double)charges, 0.0, L"An older copy of the account was written over a newer one");
+			}
+		}
+
+		TEST_METHOD(TestAccountCacheKeepsPortfolio)
+		{
+			std::shared_ptr<CMemoryAccountStore> store = std::make_shared<CMemoryAccountStore>();
+			{
+				// Small enough that most of the accounts are evicted along the way.
+				CAccountCache cache(store, 4096);
+				for (AccountId id = 0; id < 20; ++id)
+				{
+					cache.CreateAccount(id, CACHE_DEFAULT_APR, CACHE_DEFAULT_CREDIT_LIMIT * (1 + id % 3), CACHE_DEFAULT_TIME);
+					cache.AddCharge(id, 10.0 * id, 0);
+				}
+				cache.AddPayment(19, 90.0, 5);
+				Assert::IsFalse(cache.AddCharge(0, 5000.0, 1), L"The charge is over the limit");
+				Assert::IsTrue(cache.GetEvictionCount() > 0, L"The accounts should have been evicted");
+				Assert::AreEqual(cache.GetPortfolio().GetOutstandingBalance(), 1810.0, 0.0, L"Evicted accounts should still count");
+
+				// The charge of cycle 0 collects interest once the account has a transaction in cycle 1.
+				cache.AddCharge(19, 0.01, 31);
+				double balance = 0.0;
+				cache.GetBalanceOnDay(19, 31, &balance);
+				Assert::AreEqual(cache.GetPortfolio().GetOutstandingBalance(), 1710.0 + balance, 0.000001, L"The closed cycle's interest is missing");
+
+				std::vector<CPortfolioAggregates::SUtilization> top;
+				cache.GetPortfolio().GetTopUtilization(1, top);
+				Assert::IsTrue(top.size() == 1 && top[0].mAccount == 18, L"The most utilized account is wrong");
+			}
+
+			// Accounts that are only in the store count once they are loaded.
+			CAccountCache cache(store, 1 << 20);
+			Assert::IsTrue(cache.GetPortfolio().GetAccountCount() == 0, L"No account was loaded yet");
+			double balance = 0.0;
+			cache.GetBalanceOnDay(5, 0, &balance);
+			Assert::IsTrue(cache.GetPortfolio().GetAccountCount() == 1, L"The loaded account should count");
+			Assert::AreEqual(cache.GetPortfolio().GetOutstandingBalance(), 50.0, 0.0, L"The loaded account's balance is wrong");
+		}
+	};
+}
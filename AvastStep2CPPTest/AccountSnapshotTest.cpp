@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountCache.h"
+#include "AccountSnapshot.h"
+#include "MemoryAccountStore.h"
+#include <ctime>
+#include <memory>
+#include <random>
+#include <vector>
+const time_t SNAPSHOT_DEFAULT_TIME = (time_t)1330300800;
+const double SNAPSHOT_DEFAULT_APR = 0.35;
+const double SNAPSHOT_DEFAULT_CREDIT_LIMIT = 1000.0;
+const time_t SNAPSHOT_SECONDS_PER_DAY = 24 * 60 * 60;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(AccountSnapshotTest)
+	{
+	public:
+
+		TEST_METHOD(TestSnapshotRefreshesFromCache)
+		{
+			CAccountCache accounts(std::make_shared<CMemoryAccountStore>(), 1 << 24);
+			std::vector<AccountId> ids;
+			for (AccountId id = 0; id < 200; ++id)
+			{
+				// Each account opened a day later than the one before.
+				accounts.CreateAccount(id, SNAPSHOT_DEFAULT_APR, SNAPSHOT_DEFAULT_CREDIT_LIMIT * (1 + id % 4),
+					SNAPSHOT_DEFAULT_TIME + (time_t)id * SNAPSHOT_SECONDS_PER_DAY);
+				accounts.AddCharge(id, (double)(id % 50) * 10.0, 0);
+				ids.push_back(id);
+				if (id % 3 == 0)
+				{
+					ids.push_back(1000 + id);
+				}
+			}
+			accounts.ScheduleAPR(7, 0.10, 20);
+
+			// As of day 70 of account 0.
+			time_t asOf = SNAPSHOT_DEFAULT_TIME + 70 * SNAPSHOT_SECONDS_PER_DAY;
+			CAccountSnapshot snapshot;
+			Assert::IsTrue(snapshot.Refresh(accounts, ids, asOf, 3) == 200, L"The accounts that don't exist should be left out");
+			Assert::IsTrue(snapshot.Size() == 200 && snapshot.GetAsOf() == asOf, L"The snapshot is the wrong size");
+			for (size_t row = 0; row < snapshot.Size(); ++row)
+			{
+				Assert::IsTrue(snapshot.GetId(row) == row, L"The rows should be in the order of the accounts");
+			}
+			Assert::AreEqual(snapshot.GetValue(CAccountSnapshot::DAYS_TO_CYCLE_CLOSE, 0), 20.0, 0.0, L"Account 0 is on day 10 of its third cycle");
+			Assert::AreEqual(snapshot.GetValue(CAccountSnapshot::DAYS_TO_CYCLE_CLOSE, 10), 30.0, 0.0, L"Account 10 is on the first day of a cycle");
+			Assert::AreEqual(snapshot.GetValue(CAccountSnapshot::DAYS_TO_CYCLE_CLOSE, 80), 40.0, 0.0, L"Account 80 hasn't opened yet");
+			Assert::AreEqual(snapshot.GetValue(CAccountSnapshot::APR, 7), 0.10, 0.0, L"The APR should follow the schedule");
+			Assert::AreEqual(snapshot.GetValue(CAccountSnapshot::UTILIZATION, 9), 0.045, 0.0, L"The utilization is wrong");
+
+			// Accounts owing over $300 whose cycle closes within 3 days.
+			std::vector<CAccountSnapshot::SPredicate> predicates = {
+				{ CAccountSnapshot::BALANCE, CAccountSnapshot::GREATER, 300.0 },
+				{ CAccountSnapshot::DAYS_TO_CYCLE_CLOSE, CAccountSnapshot::LESS_OR_EQUAL, 3.0 }
+			};
+			CAccountSnapshot::SSelection selection;
+			snapshot.Select(predicates, &selection);
+			std::vector<AccountId> selected;
+			snapshot.GetSelectedIds(selection, selected);
+			std::vector<AccountId> expected = { 41, 42, 43 };
+			Assert::IsTrue(selected == expected, L"The wrong accounts were selected");
+			Assert::IsTrue(selection.Count() == 3 && selection.IsSelected(42) && !selection.IsSelected(12), L"The selection is wrong");
+		}
+
+		TEST_METHOD(TestSnapshotMatchesRowByRow)
+		{
+			std::mt19937 random(49);
+			CAccountSnapshot snapshot;
+			// Not a whole number of words, so the last one is partly padding.
+			for (int rows : { 0, 1, 63, 64, 1000 })
+			{
+				snapshot.Clear(SNAPSHOT_DEFAULT_TIME);
+				for (int row = 0; row < rows; ++row)
+				{
+					CCreditCardAccount::SSummary summary;
+					summary.mBalance = (double)((int)(random() % 2000) - 200);
+					summary.mAPR = (double)(random() % 40) / 100.0;
+					summary.mCreditLimit = (double)(random() % 5) * 500.0;
+					summary.mDaysToCycleClose = 1 + random() % 30;
+					snapshot.Add(10 * row, summary);
+				}
+
+				for (int query = 0; query < 50; ++query)
+				{
+					std::vector<CAccountSnapshot::SPredicate> predicates;
+					for (int p = random() % 4; p > 0; --p)
+					{
+						CAccountSnapshot::SPredicate predicate;
+						predicate.mColumn = (CAccountSnapshot::EColumn)(random() % CAccountSnapshot::COLUMN_COUNT);
+						predicate.mComparison = (CAccountSnapshot::EComparison)(random() % 4);
+						// Values from the same ranges as the columns, so equality comes up.
+						predicate.mValue = (predicate.mColumn == CAccountSnapshot::UTILIZATION || rows == 0) ? (double)(random() % 12) / 4.0
+							: snapshot.GetValue(predicate.mColumn, random() % rows);
+						predicates.push_back(predicate);
+					}
+					CAccountSnapshot::SSelection selection;
+					snapshot.Select(predicates, &selection);
+
+					size_t count = 0;
+					for (int row = 0; row < rows; ++row)
+					{
+						bool meets = true;
+						for (const CAccountSnapshot::SPredicate & predicate : predicates)
+						{
+							double value = snapshot.GetValue(predicate.mColumn, row);
+							switch (predicate.mComparison)
+							{
+							case CAccountSnapshot::LESS: meets &= value < predicate.mValue; break;
+							case CAccountSnapshot::LESS_OR_EQUAL: meets &= value <= predicate.mValue; break;
+							case CAccountSnapshot::GREATER: meets &= value > predicate.mValue; break;
+							default: meets &= value >= predicate.mValue; break;
+							}
+						}
+						Assert::IsTrue(selection.IsSelected(row) == meets, L"A row was selected wrongly");
+						count += meets ? 1 : 0;
+					}
+					Assert::IsTrue(selection.Count() == count, L"Padding rows were selected");
+					std::vector<AccountId> ids;
+					snapshot.GetSelectedIds(selection, ids);
+					Assert::IsTrue(ids.size() == count && (count == 0 || ids.back() % 10 == 0), L"The selected accounts are wrong");
+				}
+			}
+		}
+
+	};
+}
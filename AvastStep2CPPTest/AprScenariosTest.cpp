@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "AprScenarios.h"
+#include <ctime>
+#include <memory>
+#include <random>
+#include <vector>
+const time_t SCENARIO_DEFAULT_TIME = (time_t)1330300800;
+const double SCENARIO_DEFAULT_APR = 0.35;
+const double SCENARIO_DEFAULT_CREDIT_LIMIT = 1000000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(AprScenariosTest)
+	{
+	public:
+
+		TEST_METHOD(TestScenariosKnownBalance)
+		{
+			// Identical to TEST_METHOD TestCCAccountAddItemsSkipCycle.
+			CCreditCardAccount creditCard(0.0, SCENARIO_DEFAULT_CREDIT_LIMIT, SCENARIO_DEFAULT_TIME);
+			creditCard.AddCharge(500.0, 0);
+			creditCard.AddCharge(200, 8);
+			creditCard.AddPayment(200, 15);
+			creditCard.AddCharge(100, 25);
+			creditCard.AddCharge(300, 65);
+
+			std::vector<double> balances;
+			creditCard.GetBalancesOnDays({ 0.0, SCENARIO_DEFAULT_APR }, { 90, 7 }, balances);
+			Assert::IsTrue(balances.size() == 4, L"There should be a balance for every day and APR");
+			Assert::AreEqual(balances[0], 900.0, 0.005, L"Interest was charged at an APR of 0");
+			Assert::AreEqual(balances[1], 959.36, 0.005, L"Your balance calculation is wrong");
+			Assert::AreEqual(balances[2], 500.0, 0.005, L"A later transaction was counted");
+			Assert::AreEqual(balances[3], 500.0, 0.005, L"A later transaction was counted");
+		}
+
+		TEST_METHOD(TestScenariosMatchAccountPerApr)
+		{
+			// Not a multiple of any lane block, so the last block is partly empty.
+			std::vector<double> aprs;
+			for (int i = 0; i < 37; ++i)
+			{
+				aprs.push_back(0.01 * i);
+			}
+
+			std::mt19937 random(39);
+			std::vector<std::unique_ptr<CCreditCardAccount>> accounts;
+			for (double apr : aprs)
+			{
+				accounts.emplace_back(new CCreditCardAccount(apr, SCENARIO_DEFAULT_CREDIT_LIMIT, SCENARIO_DEFAULT_TIME));
+			}
+			int day = 3;
+			for (int i = 0; i < 200; ++i)
+			{
+				// Now and then skip whole cycles.
+				day += (i % 50 == 49) ? 95 : (int)(random() % 4);
+				double value = 1.0 + random() % 100;
+				bool charge = (random() % 3 != 0);
+				for (std::unique_ptr<CCreditCardAccount> & account : accounts)
+				{
+					if (charge)
+					{
+						account->AddCharge(value, day);
+					}
+					else
+					{
+						account->AddPayment(value, day);
+					}
+				}
+			}
+
+			// Out of order, before the first transaction, on cycle boundaries and past the last transaction.
+			std::vector<int> days = { day + 200, 0, 2, 29, 30, 31, day / 2, 59, 60, day, 1 };
+			std::vector<double> balances;
+			accounts[0]->GetBalancesOnDays(aprs, days, balances);
+			for (size_t d = 0; d < days.size(); ++d)
+			{
+				for (size_t a = 0; a < aprs.size(); ++a)
+				{
+					double expected = accounts[a]->GetBalanceOnDay(days[d]);
+					Assert::AreEqual(balances[d * aprs.size() + a], expected, 0.0, L"A scenario disagrees with an account that has its APR");
+				}
+			}
+		}
+
+	};
+}
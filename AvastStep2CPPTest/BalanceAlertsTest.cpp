@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountCache.h"
+#include "BalanceAlerts.h"
+#include "MemoryAccountStore.h"
+#include <ctime>
+#include <memory>
+#include <vector>
+const time_t ALERTS_DEFAULT_TIME = (time_t)1330300800;
+const double ALERTS_DEFAULT_APR = 0.35;
+const double ALERTS_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(BalanceAlertsTest)
+	{
+	public:
+
+		std::vector<CBalanceAlerts::SEvent> Drain(CBalanceAlerts & alerts)
+		{
+			std::vector<CBalanceAlerts::SEvent> events;
+			CBalanceAlerts::SEvent event;
+			while (alerts.TryPop(event))
+			{
+				events.push_back(event);
+			}
+			return events;
+		}
+
+		TEST_METHOD(TestAlertsCrossings)
+		{
+			CBalanceAlerts alerts(4);
+			alerts.Check(1, 0.0, 900.0, 1000.0);
+			Assert::IsTrue(this->Drain(alerts).empty(), L"Nothing was subscribed to");
+
+			unsigned long long high = alerts.Subscribe({ CBalanceAlerts::UTILIZATION, 0.8, CBalanceAlerts::RISING });
+			unsigned long long full = alerts.Subscribe({ CBalanceAlerts::UTILIZATION, 1.0, CBalanceAlerts::RISING });
+			unsigned long long paid = alerts.Subscribe(2, { CBalanceAlerts::BALANCE, 0.0, CBalanceAlerts::FALLING });
+
+			alerts.Check(1, 700.0, 1000.0, 1000.0);
+			alerts.Check(1, 1000.0, 850.0, 1000.0);
+			alerts.Check(1, 850.0, 900.0, 1000.0);
+			std::vector<CBalanceAlerts::SEvent> events = this->Drain(alerts);
+			Assert::IsTrue(events.size() == 2, L"Reaching the limit crosses both thresholds, and nothing after it does");
+			Assert::IsTrue(events[0].mSubscription == high && events[1].mSubscription == full, L"The events are for the wrong subscriptions");
+			Assert::IsTrue(events[1].mAccount == 1 && events[1].mPreviousBalance == 700.0 && events[1].mBalance == 1000.0, L"The event is wrong");
+
+			// The zero threshold is only for account 2.
+			alerts.Check(1, 50.0, 0.0, 1000.0);
+			alerts.Check(2, 50.0, 0.0, 1000.0);
+			alerts.Check(2, 0.0, -10.0, 1000.0);
+			events = this->Drain(alerts);
+			Assert::IsTrue(events.size() == 1 && events[0].mSubscription == paid && events[0].mAccount == 2, L"Only account 2 paying off should fire");
+
+			Assert::IsTrue(alerts.Unsubscribe(high) && alerts.Unsubscribe(paid), L"The subscriptions exist");
+			Assert::IsFalse(alerts.Unsubscribe(paid), L"The subscription is already gone");
+			alerts.Check(2, 50.0, 0.0, 1000.0);
+			for (int i = 0; i < 5; ++i)
+			{
+				alerts.Check(1, 0.0, 1000.0, 1000.0);
+			}
+			events = this->Drain(alerts);
+			Assert::IsTrue(events.size() == 4 && events[0].mSubscription == full, L"Only the remaining subscription should fire, up to the queue size");
+			Assert::IsTrue(alerts.GetDroppedCount() == 1, L"The event that didn't fit should have been counted");
+		}
+
+		TEST_METHOD(TestAlertsFromCache)
+		{
+			std::shared_ptr<CMemoryAccountStore> store = std::make_shared<CMemoryAccountStore>();
+			CAccountCache cache(store, 1 << 20);
+			cache.GetAlerts().Subscribe({ CBalanceAlerts::UTILIZATION, 0.8, CBalanceAlerts::RISING });
+			cache.GetAlerts().Subscribe(3, { CBalanceAlerts::BALANCE, 0.0, CBalanceAlerts::FALLING });
+			for (AccountId id = 1; id <= 3; ++id)
+			{
+				cache.CreateAccount(id, ALERTS_DEFAULT_APR, ALERTS_DEFAULT_CREDIT_LIMIT, ALERTS_DEFAULT_TIME);
+			}
+			cache.AddCharge(1, 500.0, 0);
+			cache.AddCharge(1, 300.0, 5);
+			Assert::IsFalse(cache.AddCharge(2, 1500.0, 0), L"The charge is over the limit");
+			cache.AddCharge(3, 200.0, 0);
+			cache.AddPayment(3, 200.0, 3);
+
+			std::vector<CBalanceAlerts::SEvent> events = this->Drain(cache.GetAlerts());
+			Assert::IsTrue(events.size() == 2, L"The charge to 80% and the payoff should each fire once");
+			Assert::IsTrue(events[0].mAccount == 1 && events[0].mBalance == 800.0 && events[0].mCreditLimit == 1000.0, L"The utilization event is wrong");
+			Assert::IsTrue(events[1].mAccount == 3 && events[1].mPreviousBalance == 200.0 && events[1].mBalance == 0.0, L"The payoff event is wrong");
+
+			// Interest closes the cycle at 35% APR, which takes a balance of $790 over $800 by the next transaction.
+			cache.AddCharge(2, 790.0, 0);
+			cache.AddCharge(2, 0.01, 31);
+			events = this->Drain(cache.GetAlerts());
+			Assert::IsTrue(events.size() == 1 && events[0].mAccount == 2 && events[0].mBalance > 800.0, L"The interest should have crossed the threshold");
+		}
+
+	};
+}
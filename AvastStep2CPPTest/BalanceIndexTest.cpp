@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "BalanceIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(BalanceIndexTest)
+	{
+	public:
+
+		TEST_METHOD(TestIndexQueries)
+		{
+			CBalanceIndex index;
+			for (int cycle = 0; cycle < 5; ++cycle)
+			{
+				index.Push(100.0 * cycle);
+			}
+			index.SetExtremes(1, 150.0, 120.0);
+			index.SetExtremes(3, 400.0, 10.0);
+			Assert::AreEqual(index.HighestFrom(0), 400.0, 0.0, L"The highest balance is wrong");
+			Assert::IsTrue(index.HighestFrom(4) == -std::numeric_limits<double>::infinity(), L"A cycle that wasn't walked shouldn't have a highest balance");
+
+			index.AddFrom(2, 25.0);
+			Assert::AreEqual(index.GetStart(1), 100.0, 0.0, L"A cycle before the addition moved");
+			Assert::AreEqual(index.GetStart(2), 225.0, 0.0, L"The addition is missing from the start balance");
+			Assert::AreEqual(index.HighestFrom(2), 425.0, 0.0, L"The addition is missing from the highest balance");
+			Assert::AreEqual(index.LowestFrom(0), 35.0, 0.0, L"The addition is missing from the lowest balance");
+
+			index.Truncate(4);
+			Assert::IsTrue(index.Size() == 4, L"The index wasn't truncated");
+			Assert::IsTrue(index.HighestFrom(2) == -std::numeric_limits<double>::infinity(), L"The last cycle kept should have lost its extremes");
+			Assert::AreEqual(index.GetStart(3), 325.0, 0.0, L"The last cycle kept should keep its start balance");
+		}
+
+		TEST_METHOD(TestIndexMatchesPlainArrays)
+		{
+			const double none = std::numeric_limits<double>::infinity();
+			std::mt19937 random(41);
+			CBalanceIndex index;
+			std::vector<double> starts, highs, lows;
+			for (int i = 0; i < 5000; ++i)
+			{
+				int operation = (int)(random() % 10);
+				if (operation < 4 || starts.empty())
+				{
+					// Enough pushes to make the tree grow several times.
+					double start = (double)(random() % 1000);
+					index.Push(start);
+					starts.push_back(start);
+					highs.push_back(-none);
+					lows.push_back(none);
+				}
+				else if (operation < 6)
+				{
+					size_t cycle = random() % starts.size();
+					double high = (double)(random() % 1000), low = high - (double)(random() % 100);
+					index.SetExtremes(cycle, high, low);
+					highs[cycle] = high;
+					lows[cycle] = low;
+				}
+				else if (operation < 9)
+				{
+					size_t cycle = random() % starts.size();
+					double amount = (double)(random() % 200) - 100.0;
+					index.AddFrom(cycle, amount);
+					for (size_t later = cycle; later < starts.size(); ++later)
+					{
+						starts[later] += amount;
+						highs[later] += amount;
+						lows[later] += amount;
+					}
+				}
+				else
+				{
+					size_t count = 1 + random() % starts.size();
+					index.Truncate(count);
+					starts.resize(count);
+					highs.resize(count);
+					lows.resize(count);
+					highs[count - 1] = -none;
+					lows[count - 1] = none;
+				}
+
+				size_t cycle = random() % starts.size();
+				Assert::AreEqual(index.GetStart(cycle), starts[cycle], 0.000001, L"The start balance is wrong");
+
+				// Cycles that weren't walked leave the extremes infinite, which only compare equal exactly.
+				double highest = *std::max_element(highs.begin() + cycle, highs.end());
+				double lowest = *std::min_element(lows.begin() + cycle, lows.end());
+				Assert::IsTrue(std::isinf(highest) ? index.HighestFrom(cycle) == highest : std::fabs(index.HighestFrom(cycle) - highest) <= 0.000001,
+					L"The highest balance is wrong");
+				Assert::IsTrue(std::isinf(lowest) ? index.LowestFrom(cycle) == lowest : std::fabs(index.LowestFrom(cycle) - lowest) <= 0.000001,
+					L"The lowest balance is wrong");
+			}
+		}
+
+	};
+}
@@ -0,0 +1,265 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "ConcurrentAccount.h"
+#include "EngineMetrics.h"
+#include "EpochManager.h"
+#include "SnapshotTransactionStore.h"
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+const time_t CONCURRENT_DEFAULT_TIME = (time_t)1330300800;
+const double CONCURRENT_DEFAULT_APR = 0.35;
+const double CONCURRENT_DEFAULT_CREDIT_LIMIT = 1000000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(ConcurrentAccountTest)
+	{
+	public:
+
+		TEST_METHOD(TestSnapshotStoreCopiesAreIndependent)
+		{
+			CSnapshotTransactionStore store(4);
+			for (int i = 0; i < 10; ++i)
+			{
+				store.Insert(store.Size(), CTransaction(1.0, CONCURRENT_DEFAULT_TIME + i, CTransaction::CHARGE));
+			}
+			std::unique_ptr<CTransactionStore> copy = store.Clone();
+			copy->Insert(copy->Size(), CTransaction(2.0, CONCURRENT_DEFAULT_TIME + 20, CTransaction::CHARGE));
+			copy->Insert(0, CTransaction(3.0, CONCURRENT_DEFAULT_TIME - 1, CTransaction::PAYMENT));
+
+			Assert::IsTrue(store.Size() == 10, L"Changing the copy changed the original");
+			Assert::IsTrue(copy->Size() == 12, L"The copy lost transactions");
+			Assert::AreEqual(3.0, copy->Begin()->GetValue(), 0.0, L"The backdated transaction isn't first");
+			Assert::AreEqual(1.0, store.Begin()->GetValue(), 0.0, L"The original's first transaction changed");
+			Assert::AreEqual(2.0, (copy->End() - 1)->GetValue(), 0.0, L"The appended transaction isn't last");
+		}
+
+		TEST_METHOD(TestConcurrentMatchesSequential)
+		{
+			CCreditCardAccount cca(0.35, 1000.0, CONCURRENT_DEFAULT_TIME);
+			CConcurrentAccount concurrent(0.35, 1000.0, CONCURRENT_DEFAULT_TIME);
+			cca.AddCharge(500.0, 0);
+			cca.AddCharge(200, 8);
+			cca.AddPayment(200, 15);
+			cca.AddCharge(100, 25);
+			cca.AddCharge(300, 65);
+
+			bool added = concurrent.AddCharge(500.0, 0);
+			added = concurrent.AddCharge(200, 8) && added;
+			added = concurrent.AddPayment(200, 15) && added;
+			added = concurrent.AddCharge(100, 25) && added;
+			added = concurrent.AddCharge(300, 65) && added;
+			Assert::IsTrue(added, L"A valid transaction was declined");
+			Assert::IsFalse(concurrent.AddCharge(5000, 66), L"A charge over the limit was accepted");
+
+			size_t count = 0;
+			Assert::AreEqual(concurrent.GetBalanceOnDay(90, &count), 959.36, 0.005, L"Your balance calculation is wrong");
+			Assert::IsTrue(count == 5, L"The declined charge was published");
+			for (int day = 0; day < 100; day += 7)
+			{
+				Assert::AreEqual(cca.GetBalanceOnDay(day), concurrent.GetBalanceOnDay(day), 0.0, L"The concurrent account disagrees with the plain one");
+			}
+		}
+
+		TEST_METHOD(TestConcurrentStress)
+		{
+			const int DAYS = 400;
+			const int READERS = 3;
+
+			// One transaction a day, so every version the readers can see holds days 0 to n - 1. The balance at
+			// the end of the history after each transaction is what a reader must see for a version of that size.
+			CCreditCardAccount reference(CONCURRENT_DEFAULT_APR, CONCURRENT_DEFAULT_CREDIT_LIMIT, CONCURRENT_DEFAULT_TIME);
+			std::vector<double> expected(1, reference.GetBalanceOnDay(DAYS - 1));
+			for (int day = 0; day < DAYS; ++day)
+			{
+				if (day % 3 == 2)
+				{
+					reference.AddPayment(5.0, day);
+				}
+				else
+				{
+					reference.AddCharge(10.0, day);
+				}
+				expected.push_back(reference.GetBalanceOnDay(DAYS - 1));
+			}
+
+			CConcurrentAccount account(CONCURRENT_DEFAULT_APR, CONCURRENT_DEFAULT_CREDIT_LIMIT, CONCURRENT_DEFAULT_TIME);
+			std::atomic<bool> done(false);
+			std::atomic<int> mismatches(0);
+			std::atomic<int> reads(0);
+
+			std::thread writer([&]()
+			{
+				for (int day = 0; day < DAYS; ++day)
+				{
+					if (day % 3 == 2)
+					{
+						account.AddPayment(5.0, day);
+					}
+					else
+					{
+						account.AddCharge(10.0, day);
+					}
+				}
+				done = true;
+			});
+
+			// Contends for the write lock with charges that are always declined and must never be seen.
+			std::thread decliner([&]()
+			{
+				while (!done)
+				{
+					account.AddCharge(CONCURRENT_DEFAULT_CREDIT_LIMIT * 2, DAYS + 100);
+				}
+			});
+
+			std::vector<std::thread> readers;
+			for (int i = 0; i < READERS; ++i)
+			{
+				readers.emplace_back([&]()
+				{
+					size_t lastCount = 0;
+					do
+					{
+						size_t available = account.GetTransactionCount();
+						size_t count = 0;
+						double balance = account.GetBalanceOnDay(DAYS - 1, &count);
+						if (count < available || count < lastCount || count > (size_t)DAYS || balance != expected[count])
+						{
+							mismatches++;
+						}
+						lastCount = count;
+						reads++;
+					} while (!done);
+				});
+			}
+
+			writer.join();
+			decliner.join();
+			for (std::thread & reader : readers)
+			{
+				reader.join();
+			}
+
+			Assert::IsTrue(mismatches == 0, L"A reader saw an inconsistent version");
+			Assert::IsTrue(reads > 0, L"The readers never ran");
+			Assert::IsTrue(account.GetTransactionCount() == (size_t)DAYS, L"Transactions went missing");
+			Assert::AreEqual(expected[DAYS], account.GetBalanceOnDay(DAYS - 1), 0.0, L"The final balance is wrong");
+
+			CEpochManager::Reclaim();
+			CEpochManager::Reclaim();
+			Assert::IsTrue(CEpochManager::GetPendingCount() == 0, L"Old versions weren't deleted");
+		}
+
+		TEST_METHOD(TestConcurrentReadersShareAVersion)
+		{
+			const int DAYS = 300;
+			const int READERS = 4;
+
+			// A history over ten cycles with backdated transactions in it, so the version that is published has its
+			// latest balance and cycle balances to work out. Readers asking for different days at once would each
+			// remember them in the shared version if it hadn't been prepared.
+			CCreditCardAccount reference(CONCURRENT_DEFAULT_APR, CONCURRENT_DEFAULT_CREDIT_LIMIT, CONCURRENT_DEFAULT_TIME);
+			CConcurrentAccount account(CONCURRENT_DEFAULT_APR, CONCURRENT_DEFAULT_CREDIT_LIMIT, CONCURRENT_DEFAULT_TIME);
+			for (int day = 0; day < DAYS; day += 4)
+			{
+				reference.AddCharge(20.0, day);
+				account.AddCharge(20.0, day);
+			}
+			for (int day = 2; day < DAYS; day += 40)
+			{
+				reference.AddPayment(15.0, day);
+				account.AddPayment(15.0, day);
+			}
+			std::vector<double> expected;
+			for (int day = 0; day < DAYS + 60; ++day)
+			{
+				expected.push_back(reference.GetBalanceOnDay(day));
+			}
+			double expectedCurrent = reference.GetCurrentBalance(nullptr);
+
+			// Charges over the limit keep the combiner copying the version the readers are on, and publish nothing.
+			std::atomic<bool> done(false);
+			std::thread decliner([&]()
+			{
+				while (!done)
+				{
+					account.AddCharge(CONCURRENT_DEFAULT_CREDIT_LIMIT * 2, 5);
+				}
+			});
+
+			std::atomic<int> mismatches(0);
+			std::vector<std::thread> readers;
+			for (int i = 0; i < READERS; ++i)
+			{
+				readers.emplace_back([&, i]()
+				{
+					for (int pass = 0; pass < 20; ++pass)
+					{
+						// Each reader walks the days in its own order, so they ask for different cycles at once.
+						for (int step = 0; step < (int)expected.size(); ++step)
+						{
+							int day = (i % 2 == 0) ? (step * (i + 7)) % (int)expected.size() : (int)expected.size() - 1 - step;
+							if (account.GetBalanceOnDay(day) != expected[day] || account.GetCurrentBalance() != expectedCurrent)
+							{
+								mismatches++;
+							}
+						}
+					}
+				});
+			}
+			for (std::thread & reader : readers)
+			{
+				reader.join();
+			}
+			done = true;
+			decliner.join();
+
+			Assert::IsTrue(mismatches == 0, L"Readers sharing a version got different balances");
+			Assert::IsTrue(account.GetTransactionCount() == reference.GetTransactionCount(), L"A declined charge was published");
+		}
+
+		TEST_METHOD(TestCombinedWritesKeepTheLimit)
+		{
+			const int WRITERS = 8;
+			const int CHARGES_PER_WRITER = 50;
+
+			// Without interest exactly 100 charges of 10 fit under the limit, whichever writers they come from.
+			CConcurrentAccount account(0.0, 1000.0, CONCURRENT_DEFAULT_TIME);
+			CEngineMetrics::SHistogramSnapshot before = CEngineMetrics::GetHistogram(CEngineMetrics::COMBINED_BATCH_SIZE);
+			std::atomic<int> accepted(0);
+
+			std::vector<std::thread> writers;
+			for (int i = 0; i < WRITERS; ++i)
+			{
+				writers.emplace_back([&]()
+				{
+					for (int charge = 0; charge < CHARGES_PER_WRITER; ++charge)
+					{
+						if (account.AddCharge(10.0, 0))
+						{
+							accepted++;
+						}
+					}
+				});
+			}
+			for (std::thread & writer : writers)
+			{
+				writer.join();
+			}
+
+			CEngineMetrics::SHistogramSnapshot after = CEngineMetrics::GetHistogram(CEngineMetrics::COMBINED_BATCH_SIZE);
+			Assert::IsTrue(accepted == 100, L"The writers weren't told which charges fit under the limit");
+			Assert::IsTrue(account.GetTransactionCount() == 100, L"The published version disagrees with the results");
+			Assert::AreEqual(1000.0, account.GetCurrentBalance(), 0.005, L"The balance is wrong");
+			Assert::IsTrue(after.mSum - before.mSum == WRITERS * CHARGES_PER_WRITER, L"A write was applied more or less than once");
+			Assert::IsTrue(after.mCount - before.mCount <= (unsigned long long)(WRITERS * CHARGES_PER_WRITER), L"More batches than writes");
+		}
+
+	};
+}
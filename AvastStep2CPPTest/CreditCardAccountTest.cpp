@@ -1,10 +1,16 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "CreditCardAccount.h"
+#include "InlineTransactionStore.h"
+#include "SnapshotTransactionStore.h"
 #include "TimeHelper.h"
+#include "VectorTransactionStore.h"
 #include <memory>
 #include <ctime>
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <vector>
 const time_t DEFAULT_TIME = (time_t)1330300800;
 const double DEFAULT_APR = 0.35;
 const double DEFAULT_CREDIT_LIMIT = 1000.0;
@@ -178,6 +184,22 @@ namespace AvastStep2CPPTest
 		}
 
 
+		TEST_METHOD(TestCCBeforeOpening)
+		{
+			CCA cca = this->EmptyCCA();
+			Assert::IsFalse(cca->AddCharge(100.0, -5), L"A charge before the account opened should be rejected");
+			Assert::IsTrue(cca->GetTransactionCount() == 0, L"The rejected charge should not have been kept");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 0.0, 0.005, L"A rejected charge changed the balance");
+			Assert::AreEqual(cca->GetBalanceOnDay(10), 0.0, 0.005, L"A rejected charge changed the balance on a day");
+
+			// The balance on a day and the current balance agree on everything that was added.
+			Assert::IsTrue(cca->AddCharge(100.0, 0), L"This transaction should have gone through");
+			Assert::IsFalse(cca->AddPayment(50.0, -1), L"A payment before the account opened should be rejected");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 100.0, 0.005, L"Your balance calculation after adding a transaction is wrong");
+			Assert::AreEqual(cca->GetBalanceOnDay(10), 100.0, 0.005, L"Your balance calculation on a day is wrong");
+		}
+
+
 		TEST_METHOD(TestCCTransactionOrder)
 		{
 			CCA cca = this->EmptyCCA();
@@ -192,5 +214,294 @@ namespace AvastStep2CPPTest
 			Assert::IsTrue(result, L"This transaction should have gone through");
 
 		}
+
+
+		TEST_METHOD(TestCCAprSchedule)
+		{
+			CCA cca = this->EmptyCCA();
+			cca->AddCharge(500.0, 0);
+
+			// Ask first, so the changes below have to throw away what was worked out.
+			Assert::AreEqual(cca->GetBalanceOnDay(60), 529.18, 0.005, L"Your balance calculation is wrong");
+
+			// A promotional rate of 0 from the second cycle on.
+			Assert::IsTrue(cca->ScheduleAPR(0.0, 30), L"The APR change should have been accepted");
+			Assert::AreEqual(cca->GetBalanceOnDay(30), 514.38, 0.005, L"The first cycle should keep its APR");
+			Assert::AreEqual(cca->GetBalanceOnDay(60), 514.38, 0.005, L"No interest should accrue at an APR of 0");
+
+			// A penalty rate halfway through the second cycle.
+			Assert::IsTrue(cca->ScheduleAPR(0.35, 45), L"The APR change should have been accepted");
+			Assert::AreEqual(cca->GetAPROnDay(44), 0.0, 0.0, L"The APR before a change is wrong");
+			Assert::AreEqual(cca->GetAPROnDay(45), 0.35, 0.0, L"The APR from a change on is wrong");
+			Assert::AreEqual(cca->GetBalanceOnDay(60), 521.78, 0.005, L"Only the days after the change should accrue interest");
+
+			// Appending after the changes sees them too.
+			Assert::IsTrue(cca->AddCharge(100.0, 61), L"This transaction should have gone through");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 621.78, 0.005, L"Your balance calculation after adding a transaction is wrong");
+
+			Assert::IsFalse(cca->ScheduleAPR(0.2, -1), L"An APR change before the account opened should be rejected");
+			Assert::IsFalse(cca->ScheduleAPR(-0.2, 10), L"A negative APR should be rejected");
+
+			std::vector<unsigned char> buffer;
+			cca->Serialize(buffer);
+			std::shared_ptr<CCreditCardAccount> copy = CCreditCardAccount::Deserialize(buffer.data(), buffer.size());
+			Assert::IsTrue(copy != nullptr, L"The account couldn't be read back");
+			Assert::AreEqual(copy->GetBalanceOnDay(90), cca->GetBalanceOnDay(90), 0.000001, L"The APR schedule was lost");
+		}
+
+
+		TEST_METHOD(TestCCAprScheduleBackdatedChange)
+		{
+			CCA cca = this->EmptyCCA();
+			for (int day = 0; day < 150; day += 10)
+			{
+				cca->AddCharge(20.0, day);
+			}
+			double before = cca->GetBalanceOnDay(150);
+
+			// A change in the last cycle leaves earlier balances alone.
+			cca->ScheduleAPR(0.10, 125);
+			Assert::AreEqual(cca->GetBalanceOnDay(119), CCreditCardAccount(*cca).GetBalanceOnDay(119), 0.000001, L"A copy should agree with its original");
+			Assert::IsTrue(cca->GetBalanceOnDay(150) < before, L"A lower APR should lower the balance");
+
+			// Replacing a change and moving the rate back gives the original balances back.
+			cca->ScheduleAPR(DEFAULT_APR, 125);
+			Assert::AreEqual(cca->GetBalanceOnDay(150), before, 0.000001, L"Replacing an APR change didn't recalculate");
+		}
+
+
+		TEST_METHOD(TestCCBackdatedOverLimit)
+		{
+			CCA cca = this->EmptyCCA();
+			cca->AddCharge(500.0, 0);
+			cca->AddCharge(400.0, 40);
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 914.38, 0.005, L"Your balance calculation after adding a transaction is wrong");
+
+			// $600 on day 10 is fine by itself, but with its interest it puts day 40 at 1016.30.
+			Assert::IsFalse(cca->AddCharge(100.0, 10), L"A backdated charge that puts a later balance over the limit should be rejected");
+			Assert::IsTrue(cca->GetTransactionCount() == 2, L"The rejected charge should have been taken back out");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 914.38, 0.005, L"A rejected charge changed the balance");
+
+			Assert::IsTrue(cca->AddCharge(50.0, 10), L"This transaction should have gone through");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 965.34, 0.005, L"Your balance calculation after a backdated charge is wrong");
+			Assert::AreEqual(cca->GetBalanceOnDay(30), 565.34, 0.005, L"Your balance calculation after a backdated charge is wrong");
+
+			// A day before the opening day has no cycle to check it in, so it is never added.
+			Assert::IsFalse(cca->AddCharge(10.0, -5), L"A backdated charge before the account opened should be rejected");
+			Assert::IsTrue(cca->GetTransactionCount() == 3, L"The rejected charge should not have been kept");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 965.34, 0.005, L"A rejected charge changed the balance");
+
+			// $100 off on day 10 leaves $400 then, but the payment on day 40 would take the balance to -87.53.
+			CCA paidOff = this->EmptyCCA();
+			paidOff->AddCharge(500.0, 0);
+			paidOff->AddPayment(500.0, 40);
+			Assert::IsFalse(paidOff->AddPayment(100.0, 10), L"A backdated payment that makes a later balance negative should be rejected");
+			Assert::IsTrue(paidOff->AddPayment(10.0, 10), L"This transaction should have gone through");
+			Assert::AreEqual(paidOff->GetCurrentBalance(nullptr), 4.19, 0.005, L"Your balance calculation after a backdated payment is wrong");
+		}
+
+
+		TEST_METHOD(TestCCBackdatedMatchesInOrder)
+		{
+			struct SAdded
+			{
+				double mValue;
+				int mDay;
+				bool mCharge;
+			};
+
+			std::mt19937 random(41);
+			CCA cca = this->EmptyCCA();
+			std::vector<SAdded> added;
+			int lastDay = 0;
+			for (int i = 0; i < 400; ++i)
+			{
+				// Mostly into the past, so each one moves many later balances.
+				bool backdated = lastDay > 0 && random() % 4 != 0;
+				int day = backdated ? (int)(random() % lastDay) : lastDay + (int)(random() % 5);
+				SAdded transaction = { 1.0 + random() % 200, day, random() % 3 != 0 };
+				bool accepted = transaction.mCharge ? cca->AddCharge(transaction.mValue, day) : cca->AddPayment(transaction.mValue, day);
+				if (accepted)
+				{
+					added.push_back(transaction);
+					lastDay = std::max(lastDay, day);
+				}
+			}
+			Assert::IsTrue(added.size() > 100 && added.size() < 400, L"The limits should accept some transactions and decline others");
+
+			// The same transactions made in order. Every balance they pass through stayed within the limits, so all of them go through.
+			std::stable_sort(added.begin(), added.end(), [](const SAdded & a, const SAdded & b) { return a.mDay < b.mDay; });
+			CCA inOrder = this->EmptyCCA();
+			for (const SAdded & transaction : added)
+			{
+				bool accepted = transaction.mCharge ? inOrder->AddCharge(transaction.mValue, transaction.mDay) : inOrder->AddPayment(transaction.mValue, transaction.mDay);
+				Assert::IsTrue(accepted, L"A backdated transaction took a balance past the limits");
+			}
+
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), inOrder->GetCurrentBalance(nullptr), 0.0, L"Your balance calculation after backdated transactions is wrong");
+			for (int day = 0; day <= lastDay + 30; day += 3)
+			{
+				Assert::AreEqual(cca->GetBalanceOnDay(day), inOrder->GetBalanceOnDay(day), 0.0, L"Your balance calculation after backdated transactions is wrong");
+			}
+		}
+
+
+		TEST_METHOD(TestCCExactAmounts)
+		{
+			// 0.1 + 0.2 isn't 0.3 in doubles. Amounts are kept in whole millionths, so this is exactly the limit.
+			CCA cca = this->EmptyCCA();
+			Assert::IsTrue(cca->AddCharge(999.7, 0), L"This transaction should have gone through");
+			Assert::IsTrue(cca->AddCharge(0.1, 1), L"This transaction should have gone through");
+			Assert::IsTrue(cca->AddCharge(0.2, 2), L"A charge that brings the balance exactly to the limit should go through");
+			Assert::IsFalse(cca->AddCharge(0.000001, 3), L"A charge of a millionth over the limit should be rejected");
+			Assert::IsTrue(cca->AddPayment(1000.0, 4), L"A payment of exactly the balance should go through");
+			Assert::AreEqual(cca->GetCurrentBalance(nullptr), 0.0, 0.0, L"The balance should be exactly zero");
+
+			// The same transactions in another order end up at exactly the same balance.
+			CCA reversed = this->EmptyCCA();
+			reversed->AddCharge(0.2, 2);
+			reversed->AddCharge(0.1, 1);
+			reversed->AddCharge(999.7, 0);
+			reversed->AddPayment(1000.0, 4);
+			for (int day = 0; day <= 120; day += 5)
+			{
+				Assert::AreEqual(reversed->GetBalanceOnDay(day), cca->GetBalanceOnDay(day), 0.0, L"The order transactions were added in changed a balance");
+			}
+		}
+
+
+		TEST_METHOD(TestCCStatements)
+		{
+			// Identical to TEST_METHOD TestCCAccountAddItemsSkipCycle.
+			CCA cca = this->EmptyCCA();
+			cca->AddCharge(500.0, 0);
+			cca->AddCharge(200, 8);
+			cca->AddPayment(200, 15);
+			cca->AddCharge(100, 25);
+			cca->AddCharge(300, 65);
+
+			CCreditCardAccount::SStatement statement;
+			Assert::IsFalse(cca->GetStatement(-1, &statement), L"There is no statement before the account opened");
+			Assert::IsTrue(cca->GetStatement(2, &statement), L"The statement should have been made");
+			Assert::AreEqual(statement.mClosingBalance, 959.36, 0.005, L"The closing balance is wrong");
+			Assert::AreEqual(statement.mCharges, 300.0, 0.0, L"The charges are wrong");
+
+			Assert::IsTrue(cca->GetStatement(0, &statement), L"The statement should have been made");
+			Assert::AreEqual(statement.mOpeningBalance, 0.0, 0.0, L"The opening balance is wrong");
+			Assert::AreEqual(statement.mCharges, 800.0, 0.0, L"The charges are wrong");
+			Assert::AreEqual(statement.mPayments, 200.0, 0.0, L"The payments are wrong");
+			Assert::AreEqual(statement.mInterest, 16.21, 0.005, L"The interest is wrong");
+			Assert::AreEqual(statement.mClosingBalance, cca->GetBalanceOnDay(30), 0.0, L"The closing balance is wrong");
+
+			// A charge in cycle 1 changes its statement and the ones after it, not the one before.
+			CCreditCardAccount::SStatement before;
+			cca->GetStatement(1, &before);
+			Assert::IsTrue(cca->AddCharge(50, 40), L"This transaction should have gone through");
+			Assert::IsTrue(cca->GetStatement(0, &statement) && statement.mClosingBalance == before.mOpeningBalance, L"An earlier statement changed");
+			Assert::IsTrue(cca->GetStatement(1, &statement), L"The statement should have been made");
+			Assert::AreEqual(statement.mCharges, 50.0, 0.0, L"The new charge is missing from its statement");
+			Assert::AreEqual(statement.mClosingBalance, cca->GetBalanceOnDay(60), 0.0, L"The closing balance is wrong");
+			for (int cycle = 0; cycle < 5; ++cycle)
+			{
+				CCreditCardAccount::SStatement next;
+				cca->GetStatement(cycle, &statement);
+				cca->GetStatement(cycle + 1, &next);
+				Assert::AreEqual(next.mOpeningBalance, statement.mClosingBalance, 0.0, L"A cycle doesn't open with the closing balance of the one before");
+				Assert::AreEqual(statement.mClosingBalance, statement.mOpeningBalance + statement.mCharges - statement.mPayments + statement.mInterest, 0.000001, L"A statement doesn't add up");
+			}
+
+			// Every statement at once matches the ones made a cycle at a time.
+			std::vector<CCreditCardAccount::SStatement> statements;
+			cca->GetStatements(statements);
+			Assert::IsTrue(statements.size() == (size_t)cca->GetCycleCount(), L"There should be a statement for each cycle");
+			for (size_t cycle = 0; cycle < statements.size(); ++cycle)
+			{
+				cca->GetStatement((int)cycle, &statement);
+				Assert::IsTrue(statements[cycle].mCycle == (int)cycle, L"The statements are out of order");
+				Assert::AreEqual(statements[cycle].mClosingBalance, statement.mClosingBalance, 0.0, L"The closing balance is wrong");
+				Assert::AreEqual(statements[cycle].mInterest, statement.mInterest, 0.0, L"The interest is wrong");
+			}
+		}
+
+
+		TEST_METHOD(TestCCTransactionViews)
+		{
+			// A snapshot store keeps appended transactions apart from the ones before a backdated insert, so a view
+			// can span two runs of memory.
+			CCreditCardAccount cca(DEFAULT_APR, 10 * DEFAULT_CREDIT_LIMIT, DEFAULT_TIME,
+				std::unique_ptr<CTransactionStore>(new CSnapshotTransactionStore(8)));
+			for (int day = 0; day < 90; day += 3)
+			{
+				cca.AddCharge(1.0 + day, day);
+			}
+			cca.AddPayment(1.0, 1);
+			cca.AddCharge(5.0, 91);
+
+			CTransactionRange cycle = cca.GetTransactionsInCycle(1);
+			Assert::IsTrue(cycle.size() == 10, L"The cycle has the wrong transactions");
+			Assert::AreEqual(cycle.front().GetValue(), 31.0, 0.0, L"The view doesn't start at the first transaction of the cycle");
+			Assert::AreEqual(cycle.back().GetValue(), 58.0, 0.0, L"The view doesn't end at the last transaction of the cycle");
+			Assert::IsTrue(cycle.Data() == &*cycle.begin(), L"The view should point into the store");
+
+			double charged = 0.0;
+			for (const CTransaction & transaction : cca.GetTransactionsBetweenDays(0, 3))
+			{
+				charged += (transaction.GetType() == CTransaction::CHARGE) ? transaction.GetValue() : -transaction.GetValue();
+			}
+			Assert::AreEqual(charged, 4.0, 0.0, L"The view of days 0 to 3 has the wrong transactions");
+			Assert::IsTrue(cca.GetTransactionsBetweenDays(4, 5).empty(), L"No transactions were made on days 4 and 5");
+			Assert::IsTrue(cca.GetTransactionsBetweenDays(10, 9).empty(), L"A view that ends before it starts should be empty");
+
+			CTransactionRange all = cca.GetTransactionsBetweenDays(0, 100);
+			const CTransaction * first;
+			const CTransaction * second;
+			size_t firstCount, secondCount;
+			all.GetSegments(&first, &firstCount, &second, &secondCount);
+			Assert::IsTrue(secondCount == 1 && firstCount + secondCount == all.size(), L"The appended transaction should be in the second run");
+			Assert::IsTrue(all.Data() == nullptr, L"A view over two runs isn't one array");
+			Assert::AreEqual(second->GetValue(), 5.0, 0.0, L"The second run has the wrong transaction");
+		}
+
+		TEST_METHOD(TestCCInlineStore)
+		{
+			// The same history in the inline store, which moves to the heap partway through, and in a vector.
+			std::unique_ptr<CInlineTransactionStore> store(new CInlineTransactionStore());
+			CInlineTransactionStore * rawStore = store.get();
+			CCreditCardAccount inlined(DEFAULT_APR, 10 * DEFAULT_CREDIT_LIMIT, DEFAULT_TIME, std::move(store));
+			CCreditCardAccount vector(DEFAULT_APR, 10 * DEFAULT_CREDIT_LIMIT, DEFAULT_TIME,
+				std::unique_ptr<CTransactionStore>(new CVectorTransactionStore()));
+			const int count = 2 * (int)CInlineTransactionStore::INLINE_CAPACITY;
+			for (int i = 0; i < count; ++i)
+			{
+				// Every third transaction lands before the ones already there.
+				int day = (i % 3 == 2) ? i : 4 * i;
+				for (CCreditCardAccount * cca : { &inlined, &vector })
+				{
+					Assert::IsTrue((i % 4 == 3) ? cca->AddPayment(5.0, day) : cca->AddCharge(20.0 + i, day), L"This transaction should have gone through");
+				}
+				Assert::IsTrue(rawStore->IsInline() == (i + 1 <= (int)CInlineTransactionStore::INLINE_CAPACITY), L"The store moved to the heap at the wrong time");
+
+				if (i == (int)CInlineTransactionStore::INLINE_CAPACITY - 1)
+				{
+					// A copy of an inline account is inline too, and doesn't change with the original.
+					CCreditCardAccount copy(inlined);
+					CTransactionRange copied = copy.GetTransactionsBetweenDays(0, 4 * count);
+					Assert::IsTrue(copied.size() == (size_t)i + 1 && copied.Data() != &*inlined.GetTransactionsBetweenDays(0, 4 * count).begin(), L"The copy should have its own transactions");
+					Assert::AreEqual(copy.GetBalanceOnDay(4 * count), inlined.GetBalanceOnDay(4 * count), 0.0, L"The copy has a different balance");
+				}
+			}
+
+			Assert::IsTrue(inlined.GetTransactionCount() == vector.GetTransactionCount(), L"The stores hold a different number of transactions");
+			for (int day = 0; day <= 4 * count + 30; day += 7)
+			{
+				Assert::AreEqual(inlined.GetBalanceOnDay(day), vector.GetBalanceOnDay(day), 0.0, L"The inline store gives a different balance");
+			}
+			CTransactionRange all = inlined.GetTransactionsBetweenDays(0, 4 * count);
+			Assert::IsTrue(std::is_sorted(all.begin(), all.end(), [](const CTransaction & a, const CTransaction & b) { return a.GetTime() < b.GetTime(); }),
+				L"The transactions are out of order");
+
+			rawStore->Clear();
+			Assert::IsTrue(rawStore->IsInline() && rawStore->Empty(), L"A cleared store should be inline and empty");
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "EngineMetrics.h"
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <thread>
+const time_t METRICS_DEFAULT_TIME = (time_t)1330300800;
+const double METRICS_DEFAULT_APR = 0.35;
+const double METRICS_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(EngineMetricsTest)
+	{
+	public:
+
+		// The metrics are global, so these tests compare before and after instead of expecting exact values.
+		TEST_METHOD(TestMetricsTransactionPaths)
+		{
+			unsigned long long appends = CEngineMetrics::GetCounter(CEngineMetrics::APPEND_TRANSACTIONS);
+			unsigned long long crossings = CEngineMetrics::GetCounter(CEngineMetrics::CYCLE_CROSSING_TRANSACTIONS);
+			unsigned long long backdated = CEngineMetrics::GetCounter(CEngineMetrics::BACKDATED_TRANSACTIONS);
+			unsigned long long declined = CEngineMetrics::GetCounter(CEngineMetrics::DECLINED_TRANSACTIONS);
+			unsigned long long queries = CEngineMetrics::GetCounter(CEngineMetrics::BALANCE_QUERIES);
+			CEngineMetrics::SHistogramSnapshot scanned = CEngineMetrics::GetHistogram(CEngineMetrics::SCANNED_TRANSACTIONS);
+			CEngineMetrics::SHistogramSnapshot latency = CEngineMetrics::GetHistogram(CEngineMetrics::ADD_TRANSACTION_NANOSECONDS);
+
+			CCreditCardAccount cca(METRICS_DEFAULT_APR, METRICS_DEFAULT_CREDIT_LIMIT, METRICS_DEFAULT_TIME);
+			cca.AddCharge(500.0, 0);
+			cca.AddCharge(100.0, 10);
+			cca.AddCharge(100.0, 40);
+			cca.AddPayment(50.0, 5);
+			cca.AddCharge(5000.0, 41);
+			cca.GetBalanceOnDay(60);
+
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::APPEND_TRANSACTIONS) - appends == 3, L"Appends weren't counted");
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::CYCLE_CROSSING_TRANSACTIONS) - crossings == 1, L"The cycle crossing wasn't counted");
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::BACKDATED_TRANSACTIONS) - backdated == 1, L"The backdated payment wasn't counted");
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::DECLINED_TRANSACTIONS) - declined == 1, L"The charge over the limit wasn't counted");
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::BALANCE_QUERIES) - queries == 1, L"The balance query wasn't counted");
+			Assert::IsTrue(CEngineMetrics::GetHistogram(CEngineMetrics::SCANNED_TRANSACTIONS).mCount > scanned.mCount, L"Scan lengths weren't recorded");
+			Assert::IsTrue(CEngineMetrics::GetHistogram(CEngineMetrics::ADD_TRANSACTION_NANOSECONDS).mCount - latency.mCount == 5, L"Every transaction should be timed");
+		}
+
+		TEST_METHOD(TestMetricsAccountBytes)
+		{
+			long long accounts = CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNTS);
+			long long bytes = CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNT_BYTES);
+			{
+				CCreditCardAccount cca(METRICS_DEFAULT_APR, METRICS_DEFAULT_CREDIT_LIMIT, METRICS_DEFAULT_TIME);
+				for (int day = 0; day < 20; ++day)
+				{
+					cca.AddCharge(10.0, day);
+				}
+				Assert::IsTrue(CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNTS) - accounts == 1, L"The account wasn't counted");
+				Assert::IsTrue(CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNT_BYTES) - bytes == (long long)cca.GetMemoryUsage(), L"The account's memory wasn't counted");
+			}
+			Assert::IsTrue(CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNTS) == accounts, L"The destroyed account is still counted");
+			Assert::IsTrue(CEngineMetrics::GetGauge(CEngineMetrics::ACCOUNT_BYTES) == bytes, L"The destroyed account's memory is still counted");
+		}
+
+		TEST_METHOD(TestMetricsAcrossThreads)
+		{
+			unsigned long long appends = CEngineMetrics::GetCounter(CEngineMetrics::APPEND_TRANSACTIONS);
+			std::thread worker([]()
+			{
+				CCreditCardAccount cca(METRICS_DEFAULT_APR, METRICS_DEFAULT_CREDIT_LIMIT, METRICS_DEFAULT_TIME);
+				for (int day = 0; day < 10; ++day)
+				{
+					cca.AddCharge(10.0, day);
+				}
+			});
+			worker.join();
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::APPEND_TRANSACTIONS) - appends == 10, L"What an exited thread counted was lost");
+
+			std::ostringstream text;
+			CEngineMetrics::WriteText(text);
+			Assert::IsTrue(text.str().find("avant_transactions_total{path=\"append\"}") != std::string::npos, L"The counters are missing from the text");
+			Assert::IsTrue(text.str().find("avant_scanned_transactions_bucket{le=\"+Inf\"}") != std::string::npos, L"The histograms are missing from the text");
+		}
+
+	};
+}
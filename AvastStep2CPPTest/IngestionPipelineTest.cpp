@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountCache.h"
+#include "EngineMetrics.h"
+#include "IngestionPipeline.h"
+#include "MemoryAccountStore.h"
+#include "RingBuffer.h"
+#include <memory>
+#include <ctime>
+#include <thread>
+#include <vector>
+const time_t INGESTION_DEFAULT_TIME = (time_t)1330300800;
+const double INGESTION_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(IngestionPipelineTest)
+	{
+	public:
+
+		TEST_METHOD(TestRingBufferWrapsInOrder)
+		{
+			CRingBuffer<int> queue(5);
+			Assert::IsTrue(queue.GetCapacity() == 8, L"The capacity wasn't rounded up to a power of two");
+
+			int value = -1;
+			Assert::IsFalse(queue.TryPop(value), L"An empty queue returned a value");
+			for (int lap = 0; lap < 3; ++lap)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					Assert::IsTrue(queue.TryPush(lap * 8 + i), L"A queue with room refused a value");
+				}
+				Assert::IsFalse(queue.TryPush(-1), L"A full queue accepted a value");
+				Assert::IsTrue(queue.GetDepth() == 8, L"The depth is wrong");
+				for (int i = 0; i < 8; ++i)
+				{
+					Assert::IsTrue(queue.TryPop(value), L"A value went missing");
+					Assert::AreEqual(lap * 8 + i, value, L"Values came out of order");
+				}
+			}
+			Assert::IsFalse(queue.TryPop(value), L"An empty queue returned a value");
+		}
+
+		TEST_METHOD(TestPipelineAppliesEveryRecord)
+		{
+			const int PRODUCERS = 4;
+			const int ACCOUNTS_PER_PRODUCER = 2;
+			const int CHARGES_PER_ACCOUNT = 100;
+
+			std::shared_ptr<CAccountCache> accounts(new CAccountCache(std::make_shared<CMemoryAccountStore>(), 1 << 20));
+			for (AccountId id = 0; id < PRODUCERS * ACCOUNTS_PER_PRODUCER; ++id)
+			{
+				accounts->CreateAccount(id, 0.0, INGESTION_DEFAULT_CREDIT_LIMIT, INGESTION_DEFAULT_TIME);
+			}
+			CEngineMetrics::SHistogramSnapshot before = CEngineMetrics::GetHistogram(CEngineMetrics::INGESTION_BATCH_SIZE);
+
+			// A tiny queue, so producers outrun the appliers and have to wait.
+			CIngestionPipeline pipeline(accounts, 3, 8, 4);
+			std::vector<std::thread> producers;
+			for (int p = 0; p < PRODUCERS; ++p)
+			{
+				producers.emplace_back([&, p]()
+				{
+					// Every producer owns its accounts, so each account's charges arrive in day order.
+					for (int charge = 0; charge < CHARGES_PER_ACCOUNT; ++charge)
+					{
+						for (int a = 0; a < ACCOUNTS_PER_PRODUCER; ++a)
+						{
+							CIngestionPipeline::SRecord record = { (AccountId)(p * ACCOUNTS_PER_PRODUCER + a), 1.0, charge / 10, CTransaction::CHARGE, 0 };
+							pipeline.Push(record);
+						}
+					}
+				});
+			}
+			for (std::thread & producer : producers)
+			{
+				producer.join();
+			}
+			CIngestionPipeline::SRecord overLimit = { 0, INGESTION_DEFAULT_CREDIT_LIMIT, 20, CTransaction::CHARGE, 0 };
+			pipeline.Push(overLimit);
+			pipeline.Stop();
+
+			const unsigned long long records = PRODUCERS * ACCOUNTS_PER_PRODUCER * CHARGES_PER_ACCOUNT;
+			CEngineMetrics::SHistogramSnapshot after = CEngineMetrics::GetHistogram(CEngineMetrics::INGESTION_BATCH_SIZE);
+			Assert::IsTrue(pipeline.GetAcceptedCount() == records, L"Records went missing");
+			Assert::IsTrue(pipeline.GetDeclinedCount() == 1, L"The charge over the limit wasn't declined");
+			Assert::IsTrue(pipeline.GetQueueDepth() == 0, L"Stop left records in the queues");
+			Assert::IsTrue(after.mSum - before.mSum == records + 1, L"The batches don't add up to the records");
+			for (AccountId id = 0; id < PRODUCERS * ACCOUNTS_PER_PRODUCER; ++id)
+			{
+				double balance = -1.0;
+				Assert::IsTrue(accounts->GetBalanceOnDay(id, 20, &balance), L"An account went missing");
+				Assert::AreEqual((double)CHARGES_PER_ACCOUNT, balance, 0.005, L"An account's balance is wrong");
+			}
+		}
+
+	};
+}
@@ -0,0 +1,149 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "MappedTransactionStore.h"
+#include <memory>
+#include <ctime>
+#include <cstdio>
+#include <vector>
+const time_t MAPPED_DEFAULT_TIME = (time_t)1330300800;
+const double MAPPED_DEFAULT_APR = 0.35;
+const double MAPPED_DEFAULT_CREDIT_LIMIT = 1000.0;
+const char * MAPPED_STORE_PATH = "MappedTransactionStoreTest.dat";
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(MappedTransactionStoreTest)
+	{
+	public:
+
+		std::unique_ptr<CMappedTransactionStore> EmptyStore(size_t mergeThreshold)
+		{
+			remove(MAPPED_STORE_PATH);
+			std::unique_ptr<CMappedTransactionStore> store(new CMappedTransactionStore(mergeThreshold));
+			Assert::IsTrue(store->Open(MAPPED_STORE_PATH), L"The store file could not be opened");
+			return store;
+		}
+
+		TEST_METHOD(TestMappedStoreMatchesVector)
+		{
+			// A merge threshold of 2 makes the scenario go through the tail, the file and merges between them.
+			CCreditCardAccount mapped(MAPPED_DEFAULT_APR, MAPPED_DEFAULT_CREDIT_LIMIT, MAPPED_DEFAULT_TIME, this->EmptyStore(2));
+			CCreditCardAccount memory(MAPPED_DEFAULT_APR, MAPPED_DEFAULT_CREDIT_LIMIT, MAPPED_DEFAULT_TIME);
+
+			for (CCreditCardAccount * cca : { &mapped, &memory })
+			{
+				cca->AddCharge(500.0, 0);
+				cca->AddCharge(200, 8);
+				cca->AddPayment(200, 15);
+				cca->AddCharge(100, 25);
+				Assert::IsFalse(cca->AddCharge(900, 26), L"This charge should have gone over the limit");
+				cca->AddCharge(300, 65);
+			}
+
+			Assert::IsTrue(mapped.GetTransactionCount() == memory.GetTransactionCount(), L"The stores hold a different number of transactions");
+			Assert::AreEqual(memory.GetBalanceOnDay(90), 959.36, 0.005, L"Your balance calculation is wrong");
+			Assert::AreEqual(mapped.GetBalanceOnDay(90), memory.GetBalanceOnDay(90), 0.000001, L"The mapped store gives a different balance");
+			Assert::AreEqual(mapped.GetBalanceOnDay(30), memory.GetBalanceOnDay(30), 0.000001, L"The mapped store gives a different balance");
+		}
+
+		TEST_METHOD(TestMappedStoreBackdatedInsert)
+		{
+			std::unique_ptr<CMappedTransactionStore> store = this->EmptyStore(1);
+			CMappedTransactionStore * rawStore = store.get();
+			CCreditCardAccount cca(MAPPED_DEFAULT_APR, MAPPED_DEFAULT_CREDIT_LIMIT, MAPPED_DEFAULT_TIME, std::move(store));
+
+			cca.AddCharge(500.0, 0);
+			cca.AddPayment(200, 15);
+			cca.AddCharge(100, 25);
+			Assert::IsTrue(rawStore->GetFileCount() > 0, L"The tail should have been merged into the file");
+
+			// Lands before the end of the file.
+			cca.AddCharge(200, 8);
+			Assert::IsTrue(cca.GetTransactionCount() == 4, L"The backdated charge is missing");
+			Assert::AreEqual(cca.GetBalanceOnDay(30), 616.21, 0.005, L"Your balance calculation is wrong");
+
+			// Declined after it was written into the file. Taking it back out has to leave the rest of the file.
+			Assert::IsFalse(cca.AddCharge(900, 9), L"This charge should have gone over the limit");
+			Assert::IsTrue(cca.GetTransactionCount() == 4 && rawStore->GetFileCount() == 4, L"The declined charge should be gone and nothing else");
+			Assert::AreEqual(cca.GetBalanceOnDay(30), 616.21, 0.005, L"The declined charge changed the history");
+		}
+
+		TEST_METHOD(TestMappedStoreKeepsRoom)
+		{
+			{
+				std::unique_ptr<CMappedTransactionStore> store = this->EmptyStore(1);
+				for (int i = 0; i < 3000; ++i)
+				{
+					Assert::IsTrue(store->Insert(store->Size(), CTransaction(1.0 + i, MAPPED_DEFAULT_TIME + 2 * i, CTransaction::CHARGE)), L"The store couldn't grow");
+				}
+				// Backdated, then taken out again.
+				Assert::IsTrue(store->Insert(10, CTransaction(0.5, MAPPED_DEFAULT_TIME + 19, CTransaction::PAYMENT)), L"The store couldn't grow");
+				Assert::IsTrue(store->Erase(10) && store->Erase(0), L"Erasing from the file can't fail");
+				Assert::IsTrue(store->Size() == 2999 && store->Begin()->GetValue() == 2.0, L"The wrong transaction was erased");
+			}
+
+			std::unique_ptr<CMappedTransactionStore> store(new CMappedTransactionStore());
+			Assert::IsTrue(store->Open(MAPPED_STORE_PATH), L"The store file could not be opened again");
+			Assert::IsTrue(store->Size() == 2999, L"The unused room should have been cut off the file when it closed");
+			Assert::IsTrue((store->End() - 1)->GetValue() == 3000.0 && store->Begin()[9].GetValue() == 11.0, L"The file holds the wrong transactions");
+		}
+
+		TEST_METHOD(TestMappedStoreRejectsOtherFiles)
+		{
+			{
+				std::unique_ptr<CMappedTransactionStore> store = this->EmptyStore(1);
+				store->Insert(0, CTransaction(500.0, MAPPED_DEFAULT_TIME, CTransaction::CHARGE));
+				store->Insert(1, CTransaction(200.0, MAPPED_DEFAULT_TIME + 1, CTransaction::PAYMENT));
+			}
+
+			// The header is followed by whole records, and every byte of them is written, padding included.
+			std::vector<unsigned char> contents(4096);
+			FILE * file = fopen(MAPPED_STORE_PATH, "r+b");
+			size_t size = fread(contents.data(), 1, contents.size(), file);
+			Assert::IsTrue(size == 32 + 2 * sizeof(CTransaction), L"The file should be cut down to the header and its records");
+			for (size_t record = 0; record < 2; ++record)
+			{
+				const unsigned char * padding = contents.data() + 32 + record * sizeof(CTransaction) + 20;
+				Assert::IsTrue(padding[0] == 0 && padding[1] == 0 && padding[2] == 0 && padding[3] == 0, L"The padding of a record wasn't zeroed");
+			}
+
+			// A later version.
+			contents[8]++;
+			fseek(file, 0, SEEK_SET);
+			fwrite(contents.data(), 1, size, file);
+			fclose(file);
+			CMappedTransactionStore store;
+			Assert::IsFalse(store.Open(MAPPED_STORE_PATH), L"A file of another version should be rejected");
+
+			// Records without the header in front of them.
+			file = fopen(MAPPED_STORE_PATH, "wb");
+			fwrite(contents.data(), 1, 3 * sizeof(CTransaction), file);
+			fclose(file);
+			Assert::IsFalse(store.Open(MAPPED_STORE_PATH), L"A file that isn't transactions should be rejected");
+			file = fopen(MAPPED_STORE_PATH, "rb");
+			Assert::IsTrue(fread(contents.data(), 1, contents.size(), file) == 3 * sizeof(CTransaction), L"A rejected file was changed");
+			fclose(file);
+		}
+
+		TEST_METHOD(TestMappedStoreReopen)
+		{
+			{
+				CCreditCardAccount cca(MAPPED_DEFAULT_APR, MAPPED_DEFAULT_CREDIT_LIMIT, MAPPED_DEFAULT_TIME, this->EmptyStore(16));
+				cca.AddCharge(500.0, 0);
+				cca.AddPayment(200, 15);
+				cca.AddCharge(100, 25);
+			}
+
+			std::unique_ptr<CMappedTransactionStore> store(new CMappedTransactionStore());
+			Assert::IsTrue(store->Open(MAPPED_STORE_PATH), L"The store file could not be opened again");
+			Assert::IsTrue(store->Size() == 3, L"The tail wasn't merged into the file when the store closed");
+
+			time_t balanceTime = -1;
+			CCreditCardAccount cca(MAPPED_DEFAULT_APR, MAPPED_DEFAULT_CREDIT_LIMIT, MAPPED_DEFAULT_TIME, std::move(store));
+			Assert::AreEqual(cca.GetCurrentBalance(&balanceTime), 400.0, 0.005, L"The balance wasn't recalculated from the file");
+			Assert::AreEqual(cca.GetBalanceOnDay(30), 411.99, 0.005, L"Your balance calculation is wrong");
+		}
+	};
+}
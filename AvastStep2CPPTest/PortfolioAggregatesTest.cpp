@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "PortfolioAggregates.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(PortfolioAggregatesTest)
+	{
+	public:
+
+		TEST_METHOD(TestPortfolioQueries)
+		{
+			CPortfolioAggregates portfolio({ 1000.0, 5000.0 });
+			portfolio.Update(1, 250.0, 500.0);
+			portfolio.Update(2, 900.0, 1000.0);
+			portfolio.Update(3, 1000.0, 10000.0);
+			portfolio.Update(4, 10.0, 0.0);
+			Assert::AreEqual(portfolio.GetOutstandingBalance(), 2160.0, 0.0, L"The outstanding balance is wrong");
+
+			std::vector<CPortfolioAggregates::SBand> bands = portfolio.GetBands();
+			Assert::IsTrue(bands.size() == 3, L"There should be a band from 0 and one from each limit given");
+			Assert::IsTrue(bands[0].mAccounts == 2 && bands[0].mBalance == 260.0, L"The first band is wrong");
+			Assert::IsTrue(bands[1].mAccounts == 1 && bands[1].mBalance == 900.0 && bands[1].mLimitEnd == 5000.0, L"A limit at the start of a band belongs to it");
+			Assert::IsTrue(bands[2].mLimitEnd == std::numeric_limits<double>::infinity(), L"The last band has no end");
+
+			std::vector<CPortfolioAggregates::SUtilization> top;
+			portfolio.GetTopUtilization(3, top);
+			Assert::IsTrue(top.size() == 3 && top[0].mAccount == 4 && top[1].mAccount == 2 && top[2].mAccount == 1, L"The most utilized accounts are wrong");
+			Assert::AreEqual(top[1].mUtilization, 0.9, 0.0, L"The utilization is wrong");
+
+			// A payment moves the account down, and a new limit moves it to another band.
+			portfolio.Update(2, 100.0, 6000.0);
+			Assert::AreEqual(portfolio.GetOutstandingBalance(), 1360.0, 0.0, L"The payment is missing from the outstanding balance");
+			bands = portfolio.GetBands();
+			Assert::IsTrue(bands[1].mAccounts == 0 && bands[1].mBalance == 0.0, L"The account should have left its band");
+			Assert::IsTrue(bands[2].mAccounts == 2 && bands[2].mBalance == 1100.0, L"The account should have joined its new band");
+			portfolio.GetTopUtilization(10, top);
+			Assert::IsTrue(top.size() == 4 && top[1].mAccount == 1 && top[3].mAccount == 2, L"The account didn't move down");
+
+			CPortfolioAggregates::SUtilization one;
+			Assert::IsTrue(portfolio.GetUtilization(3, &one) && one.mBalance == 1000.0 && one.mUtilization == 0.1, L"The account's utilization is wrong");
+			Assert::IsFalse(portfolio.GetUtilization(5, &one), L"That account was never updated");
+		}
+
+		TEST_METHOD(TestPortfolioMatchesRecount)
+		{
+			const AccountId ACCOUNTS = 500;
+			const double LIMITS[] = { 0.0, 500.0, 2500.0, 7500.0, 30000.0 };
+			std::mt19937 random(48);
+			CPortfolioAggregates portfolio;
+			std::vector<double> balances(ACCOUNTS, 0.0), limits(ACCOUNTS, 0.0);
+			std::vector<bool> seen(ACCOUNTS, false);
+			for (int i = 0; i < 20000; ++i)
+			{
+				AccountId id = random() % ACCOUNTS;
+				// Whole cents, and plenty of ties in utilization.
+				balances[id] = (double)((long long)(random() % 200000) - 20000) / 100.0;
+				if (!seen[id] || random() % 20 == 0)
+				{
+					limits[id] = LIMITS[random() % 5];
+				}
+				seen[id] = true;
+				portfolio.Update(id, balances[id], limits[id]);
+
+				if (i % 1000 != 999)
+				{
+					continue;
+				}
+				std::vector<CPortfolioAggregates::SUtilization> expected;
+				long long cents = 0;
+				for (AccountId account = 0; account < ACCOUNTS; ++account)
+				{
+					if (!seen[account])
+					{
+						continue;
+					}
+					cents += std::llround(balances[account] * 100.0);
+					double utilization = (limits[account] > 0.0) ? balances[account] / limits[account]
+						: (balances[account] > 0.0) ? std::numeric_limits<double>::infinity() : 0.0;
+					expected.push_back({ account, balances[account], limits[account], utilization });
+				}
+				std::stable_sort(expected.begin(), expected.end(),
+					[](const CPortfolioAggregates::SUtilization & first, const CPortfolioAggregates::SUtilization & second) {
+						return first.mUtilization > second.mUtilization;
+					});
+				Assert::AreEqual(portfolio.GetOutstandingBalance(), cents / 100.0, 0.0, L"The outstanding balance drifted");
+				Assert::IsTrue(portfolio.GetAccountCount() == expected.size(), L"The account count is wrong");
+
+				std::vector<CPortfolioAggregates::SUtilization> top;
+				portfolio.GetTopUtilization(50, top);
+				Assert::IsTrue(top.size() == 50, L"There are enough accounts for the whole top");
+				for (size_t rank = 0; rank < top.size(); ++rank)
+				{
+					Assert::IsTrue(top[rank].mAccount == expected[rank].mAccount, L"The top accounts are in the wrong order");
+					Assert::AreEqual(top[rank].mBalance, expected[rank].mBalance, 0.0, L"The balance of a top account is wrong");
+				}
+			}
+		}
+
+	};
+}
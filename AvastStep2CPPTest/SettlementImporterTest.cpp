@@ -0,0 +1,116 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountCache.h"
+#include "MemoryAccountStore.h"
+#include "SettlementImporter.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+const time_t SETTLEMENT_DEFAULT_TIME = (time_t)1330300800;
+const double SETTLEMENT_DEFAULT_CREDIT_LIMIT = 1000.0;
+const char * SETTLEMENT_FILE_PATH = "SettlementImporterTest.csv";
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(SettlementImporterTest)
+	{
+	public:
+
+		std::shared_ptr<CAccountCache> OpenAccounts(AccountId count)
+		{
+			std::shared_ptr<CAccountCache> accounts(new CAccountCache(std::make_shared<CMemoryAccountStore>(), 1 << 24));
+			for (AccountId id = 0; id < count; ++id)
+			{
+				accounts->CreateAccount(id, 0.0, SETTLEMENT_DEFAULT_CREDIT_LIMIT, SETTLEMENT_DEFAULT_TIME);
+			}
+			return accounts;
+		}
+
+		TEST_METHOD(TestImporterAppliesInDayOrder)
+		{
+			std::shared_ptr<CAccountCache> accounts = this->OpenAccounts(4);
+			const std::string file =
+				"account,day,amount,type\r\n"
+				"1,5,100,P\r\n"
+				"1,2,300.50,C\r\n"
+				"\r\n"
+				"2,0,2000,charge\n"
+				"1,2,abc,C\n"
+				"3,1,5\n"
+				"99,1,5,C\n"
+				" 3 , 1 , 25.25 , c \n"
+				"3,1,-5,C\n"
+				"3,1,5,X";
+
+			// More threads than lines, so some of them get nothing.
+			CSettlementImporter importer(accounts, 16);
+			CSettlementImporter::SReport report;
+			importer.ImportBuffer(file.data(), file.size(), &report);
+
+			Assert::IsTrue(report.mRows == 9, L"The header or the blank line was counted as a row");
+			Assert::IsTrue(report.mAccepted == 3, L"The payment should have been applied after the earlier charge");
+			Assert::IsTrue(report.mDeclined == 1, L"The charge over the limit should have been declined");
+			Assert::IsTrue(report.mUnknownAccount == 1, L"The row for a missing account should have been counted");
+			Assert::IsTrue(report.mRejected == 4 && report.mRejections.size() == 4, L"The wrong rows were rejected");
+			Assert::IsTrue(report.mRejections[0].mLine == 6 && std::string(report.mRejections[0].mReason) == "bad amount", L"The first rejection is wrong");
+			Assert::IsTrue(report.mRejections[1].mLine == 7 && std::string(report.mRejections[1].mReason) == "too few fields", L"The second rejection is wrong");
+			Assert::IsTrue(report.mRejections[2].mLine == 10 && report.mRejections[2].mText == "3,1,-5,C", L"The third rejection is wrong");
+			Assert::IsTrue(report.mRejections[3].mLine == 11 && std::string(report.mRejections[3].mReason) == "bad type", L"The fourth rejection is wrong");
+
+			double balance = 0.0;
+			Assert::IsTrue(accounts->GetBalanceOnDay(1, 10, &balance), L"The account should exist");
+			Assert::AreEqual(balance, 200.5, 0.0, L"Account 1 has the wrong balance");
+			Assert::IsTrue(accounts->GetBalanceOnDay(3, 10, &balance), L"The account should exist");
+			Assert::AreEqual(balance, 25.25, 0.0, L"Account 3 has the wrong balance");
+		}
+
+		TEST_METHOD(TestImporterReadsFile)
+		{
+			const AccountId ACCOUNTS = 8;
+			const int CHARGES_PER_ACCOUNT = 500;
+			std::shared_ptr<CAccountCache> accounts = this->OpenAccounts(ACCOUNTS);
+
+			// The rows of every account are shuffled, so most of them are applied in a different order from the file.
+			std::vector<std::pair<AccountId, int>> rows;
+			for (AccountId id = 0; id < ACCOUNTS; ++id)
+			{
+				for (int charge = 0; charge < CHARGES_PER_ACCOUNT; ++charge)
+				{
+					rows.push_back(std::make_pair(id, charge));
+				}
+			}
+			std::mt19937 random(46);
+			std::shuffle(rows.begin(), rows.end(), random);
+			{
+				std::ofstream file(SETTLEMENT_FILE_PATH, std::ios::binary | std::ios::trunc);
+				for (const std::pair<AccountId, int> & row : rows)
+				{
+					file << row.first << ',' << row.second << ",1.5,C\n";
+				}
+			}
+
+			CSettlementImporter importer(accounts, 4);
+			CSettlementImporter::SReport report;
+			Assert::IsTrue(importer.Import(SETTLEMENT_FILE_PATH, &report), L"The file could not be imported");
+			remove(SETTLEMENT_FILE_PATH);
+			Assert::IsTrue(report.mRows == rows.size() && report.mAccepted == rows.size(), L"Every row should have been applied");
+			Assert::IsTrue(report.mRejected == 0 && report.mRejections.empty(), L"No row should have been rejected");
+			Assert::IsTrue(report.mRowsPerSecond > 0.0, L"The import rate is missing");
+			for (AccountId id = 0; id < ACCOUNTS; ++id)
+			{
+				double balance = 0.0;
+				accounts->GetBalanceOnDay(id, CHARGES_PER_ACCOUNT, &balance);
+				Assert::AreEqual(balance, 1.5 * CHARGES_PER_ACCOUNT, 0.0, L"An account has the wrong balance");
+			}
+
+			Assert::IsFalse(importer.Import("SettlementImporterTest.missing", &report), L"A missing file can't be imported");
+		}
+
+	};
+}
@@ -0,0 +1,124 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CreditCardAccount.h"
+#include "EngineMetrics.h"
+#include "ShadowVerifier.h"
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+const time_t SHADOW_DEFAULT_TIME = (time_t)1330300800;
+const double SHADOW_DEFAULT_APR = 0.35;
+const double SHADOW_DEFAULT_CREDIT_LIMIT = 1000.0;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(ShadowVerifierTest)
+	{
+	public:
+
+		TEST_METHOD(TestReferenceMatchesKnownBalance)
+		{
+			// Identical to TEST_METHOD TestCCAccountAddItemsSkipCycle.
+			std::vector<CShadowVerifier::STransaction> transactions = {
+				{ 500.0, 0, CTransaction::CHARGE },
+				{ 200.0, 8, CTransaction::CHARGE },
+				{ 200.0, 15, CTransaction::PAYMENT },
+				{ 100.0, 25, CTransaction::CHARGE },
+				{ 300.0, 65, CTransaction::CHARGE }
+			};
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 90), 959.36, 0.005, L"The reference calculation is wrong");
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 29), 600.0, 0.005, L"Interest was added before the cycle closed");
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 7), 500.0, 0.005, L"A later transaction was counted");
+		}
+
+		TEST_METHOD(TestReferenceBeforeOpening)
+		{
+			// A transaction before the opening day counts on the opening day, and doesn't hold up the ones after it.
+			std::vector<CShadowVerifier::STransaction> transactions = {
+				{ 50.0, 3, CTransaction::CHARGE },
+				{ 100.0, -45, CTransaction::CHARGE }
+			};
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 0), 100.0, 0.005, L"The transaction before opening is missing");
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 10), 150.0, 0.005, L"A later transaction was held up");
+
+			// The same as charging it on the opening day, which is as early as CCreditCardAccount allows.
+			CCreditCardAccount creditCard(SHADOW_DEFAULT_APR, SHADOW_DEFAULT_CREDIT_LIMIT, SHADOW_DEFAULT_TIME);
+			Assert::IsFalse(creditCard.AddCharge(100.0, -45), L"A charge before the account opened should be rejected");
+			creditCard.AddCharge(100.0, 0);
+			creditCard.AddCharge(50.0, 3);
+			Assert::AreEqual(CShadowVerifier::ReferenceBalanceOnDay(SHADOW_DEFAULT_APR, transactions, 30), creditCard.GetBalanceOnDay(30), 0.000001, L"Interest accrued before opening");
+		}
+
+		TEST_METHOD(TestSampledBalancesMatchReference)
+		{
+			CShadowVerifier::ClearMismatches();
+			unsigned long long verifiedBefore = CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_VERIFIED_SAMPLES);
+			CShadowVerifier::SetSampleRate(1.0);
+
+			std::mt19937 random(38);
+			int queries = 0;
+			for (int account = 0; account < 20; ++account)
+			{
+				CCreditCardAccount creditCard(SHADOW_DEFAULT_APR, SHADOW_DEFAULT_CREDIT_LIMIT, SHADOW_DEFAULT_TIME);
+				int day = 0;
+				for (int i = 0; i < 40; ++i)
+				{
+					day += (int)(random() % 12);
+					if (random() % 3 == 0)
+					{
+						creditCard.AddPayment(10.0 + random() % 50, day);
+					}
+					else
+					{
+						creditCard.AddCharge(10.0 + random() % 50, day);
+					}
+				}
+
+				// Before, between and after the transactions, and on cycle boundaries. Every other account also
+				// changes its APR between queries, which throws away part of what the account worked out.
+				for (int query = 0; query <= day + 60; query += 7)
+				{
+					if (account % 2 == 1 && query % 5 == 0)
+					{
+						creditCard.ScheduleAPR(0.05 * (random() % 8), (int)(random() % (day + 1)));
+					}
+					creditCard.GetBalanceOnDay(query);
+					++queries;
+				}
+				CShadowVerifier::Flush();
+			}
+			CShadowVerifier::SetSampleRate(0.0);
+
+			unsigned long long checked = CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_VERIFIED_SAMPLES) - verifiedBefore;
+			unsigned long long dropped = CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_DROPPED_SAMPLES);
+			Assert::IsTrue(checked + dropped >= (unsigned long long)queries, L"Not every balance calculation was sampled");
+			Assert::IsTrue(checked > 0, L"Nothing was checked");
+			Assert::IsTrue(CShadowVerifier::GetMismatches().empty(), L"A balance calculation disagrees with the reference calculation");
+		}
+
+		TEST_METHOD(TestMismatchIsReproducible)
+		{
+			CShadowVerifier::ClearMismatches();
+			unsigned long long mismatchesBefore = CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_MISMATCHES);
+
+			CShadowVerifier::SSample sample;
+			sample.mAPR = SHADOW_DEFAULT_APR;
+			sample.mCreditLimit = SHADOW_DEFAULT_CREDIT_LIMIT;
+			sample.mTransactions = { { 500.0, 0, CTransaction::CHARGE }, { 125.5, 40, CTransaction::PAYMENT } };
+			sample.mDay = 45;
+			sample.mBalance = 374.5;
+			CShadowVerifier::Submit(std::move(sample));
+			CShadowVerifier::Flush();
+
+			std::vector<CShadowVerifier::SMismatch> mismatches = CShadowVerifier::GetMismatches();
+			Assert::IsTrue(mismatches.size() == 1, L"The mismatch wasn't recorded");
+			Assert::IsTrue(CEngineMetrics::GetCounter(CEngineMetrics::SHADOW_MISMATCHES) == mismatchesBefore + 1, L"The mismatch wasn't counted");
+			Assert::AreEqual(mismatches[0].mExpectedBalance, 374.5 + 500.0 * SHADOW_DEFAULT_APR / 365 * 30, 0.005, L"The expected balance is wrong");
+			Assert::IsTrue(mismatches[0].mReproduction == "OPEN 0 0.35 1000\nCHARGE 0 500 0\nPAYMENT 0 125.5 40\nBALANCE 0 45\n", L"The reproduction doesn't replay the account");
+			CShadowVerifier::ClearMismatches();
+		}
+
+	};
+}
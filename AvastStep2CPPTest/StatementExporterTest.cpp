@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AccountCache.h"
+#include "MemoryAccountStore.h"
+#include "StatementExporter.h"
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+const time_t EXPORT_DEFAULT_TIME = (time_t)1330300800;
+const double EXPORT_DEFAULT_APR = 0.35;
+const double EXPORT_DEFAULT_CREDIT_LIMIT = 1000.0;
+const char * EXPORT_FILE_PATH = "StatementExporterTest.dat";
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(StatementExporterTest)
+	{
+	public:
+
+		TEST_METHOD(TestExporterWritesEveryCycle)
+		{
+			// More accounts than a worker takes at a time, so every worker gets some.
+			const AccountId ACCOUNTS = 3 * CStatementExporter::ACCOUNT_BLOCK;
+			const AccountId MISSING = ACCOUNTS + 7;
+			std::shared_ptr<CAccountCache> accounts(new CAccountCache(std::make_shared<CMemoryAccountStore>(), 1 << 24));
+			std::vector<AccountId> ids;
+			for (AccountId id = 0; id < ACCOUNTS; ++id)
+			{
+				accounts->CreateAccount(id, EXPORT_DEFAULT_APR, EXPORT_DEFAULT_CREDIT_LIMIT, EXPORT_DEFAULT_TIME);
+				// Every tenth account has no transactions and so no statements.
+				for (int day = 0; id % 10 != 0 && day < (int)(id % 5 + 1) * 30; day += 7)
+				{
+					accounts->AddCharge(id, 1.0 + id % 13, day);
+				}
+				ids.push_back(id);
+			}
+			accounts->AddPayment(1, 3.0, 20);
+			ids.push_back(MISSING);
+
+			CStatementExporter exporter(accounts, 4);
+			CStatementExporter::SReport report;
+			Assert::IsTrue(exporter.Export(EXPORT_FILE_PATH, ids, &report), L"The export could not be written");
+			CStatementExporter::SRows rows;
+			bool read = CStatementExporter::Read(EXPORT_FILE_PATH, &rows);
+			remove(EXPORT_FILE_PATH);
+			Assert::IsTrue(read, L"The export could not be read back");
+			Assert::IsTrue(report.mAccounts == ACCOUNTS && report.mMissingAccounts == 1, L"The missing account was not counted");
+			Assert::IsTrue(report.mRows == rows.Size() && report.mBytes > 0, L"The report doesn't match the file");
+
+			// The rows of an account are together and in order by cycle, whatever order the accounts are in.
+			std::map<AccountId, size_t> firstRows;
+			for (size_t row = 0; row < rows.Size(); ++row)
+			{
+				if (row == 0 || rows.mAccount[row] != rows.mAccount[row - 1])
+				{
+					Assert::IsTrue(firstRows.insert(std::make_pair(rows.mAccount[row], row)).second, L"The rows of an account are split up");
+				}
+			}
+			for (AccountId id = 0; id < ACCOUNTS; ++id)
+			{
+				std::vector<CCreditCardAccount::SStatement> statements;
+				accounts->GetStatements(id, &statements);
+				auto first = firstRows.find(id);
+				Assert::IsTrue(statements.empty() == (first == firstRows.end()), L"An account is missing or shouldn't be there");
+				for (size_t cycle = 0; cycle < statements.size(); ++cycle)
+				{
+					size_t row = first->second + cycle;
+					Assert::IsTrue(row < rows.Size() && rows.mAccount[row] == id && rows.mCycle[row] == (int)cycle, L"A cycle is missing");
+					Assert::AreEqual(rows.mOpeningBalance[row], statements[cycle].mOpeningBalance, 0.0, L"The opening balance is wrong");
+					Assert::AreEqual(rows.mCharges[row], statements[cycle].mCharges, 0.0, L"The charges are wrong");
+					Assert::AreEqual(rows.mPayments[row], statements[cycle].mPayments, 0.0, L"The payments are wrong");
+					Assert::AreEqual(rows.mInterest[row], statements[cycle].mInterest, 0.0, L"The interest is wrong");
+					Assert::AreEqual(rows.mClosingBalance[row], statements[cycle].mClosingBalance, 0.0, L"The closing balance is wrong");
+				}
+			}
+			Assert::IsTrue(firstRows.find(MISSING) == firstRows.end(), L"The missing account has rows");
+			Assert::AreEqual(rows.mPayments[firstRows[1]], 3.0, 0.0, L"The payment is missing from its statement");
+
+			Assert::IsFalse(CStatementExporter::Read("StatementExporterTest.missing", &rows), L"A missing file can't be read");
+		}
+
+	};
+}
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "Tracing.h"
+#include <sstream>
+#include <string>
+#include <thread>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AvastStep2CPPTest
+{
+	TEST_CLASS(TracingTest)
+	{
+	public:
+
+		TEST_METHOD(TestTracingChromeTrace)
+		{
+			CTracing::Clear();
+			{
+				CTracing::Span outer("outer");
+				CTracing::Span inner("inner");
+				inner.End();
+			}
+			std::thread worker([]()
+			{
+				CTracing::Span span("worker");
+			});
+			worker.join();
+
+			std::ostringstream stream;
+			CTracing::WriteChromeTrace(stream);
+			std::string trace = stream.str();
+			Assert::IsTrue(trace.find("\"traceEvents\"") != std::string::npos, L"Not a Chrome trace");
+			Assert::IsTrue(trace.find("\"name\":\"outer\",\"cat\":\"engine\",\"ph\":\"X\"") != std::string::npos, L"The outer span is missing");
+			Assert::IsTrue(trace.find("\"name\":\"inner\"") != std::string::npos, L"The inner span is missing");
+			Assert::IsTrue(trace.find("\"name\":\"worker\"") != std::string::npos, L"A span of an exited thread is missing");
+
+			CTracing::Clear();
+			std::ostringstream cleared;
+			CTracing::WriteChromeTrace(cleared);
+			Assert::IsTrue(cleared.str().find("\"name\"") == std::string::npos, L"Clear didn't forget the spans");
+		}
+
+		TEST_METHOD(TestTracingRingOverwritesOldest)
+		{
+			CTracing::Clear();
+			CTracing::Record("first", 0, 1);
+			for (size_t i = 0; i < CTracing::BUFFER_CAPACITY; ++i)
+			{
+				CTracing::Record("later", 2, 3);
+			}
+
+			std::ostringstream stream;
+			CTracing::WriteChromeTrace(stream);
+			std::string trace = stream.str();
+			Assert::IsTrue(trace.find("\"name\":\"first\"") == std::string::npos, L"The oldest span should have been overwritten");
+			Assert::IsTrue(trace.find("\"name\":\"later\"") != std::string::npos, L"The newest spans are missing");
+			CTracing::Clear();
+		}
+
+	};
+}